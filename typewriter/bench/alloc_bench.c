@@ -0,0 +1,169 @@
+// Allocation count and peak RSS of the ways a sessions page can be turned into session_t values:
+//   dom    - whole body buffered, cJSON DOM, strdup per string (the pre-streaming path)
+//   strdup - streaming parser, strdup per string (api_parse_sessions_page)
+//   arena  - streaming parser into one session_batch_t holding the whole page
+//   arena64 - same, but the batch is cleared every 64 rows like the sync writer does
+// Each mode runs in its own child process so peak RSS is not shared between them.
+#include "../src/typewriter_api.h"
+#include <cjson/cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+static unsigned long long n_alloc;
+static unsigned long long n_free;
+
+void *malloc(size_t n) {
+    n_alloc++;
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t a, size_t b) {
+    n_alloc++;
+    return __libc_calloc(a, b);
+}
+
+void *realloc(void *p, size_t n) {
+    n_alloc++;
+    return __libc_realloc(p, n);
+}
+
+void free(void *p) {
+    if (p) n_free++;
+    __libc_free(p);
+}
+
+#define CHUNK 16384
+
+static char *make_page(int rows, size_t *out_len) {
+    static const char *words[] = {"der", "Mann", "ging", "über", "die", "Straße", "und", "größer",
+                                  "wurde", "das", "Haus", "ähnlich", "wie", "früher", "Mädchen"};
+    size_t cap = (size_t)rows * 8192 + 256;
+    char *buf = __libc_malloc(cap);
+    size_t len = (size_t)sprintf(buf, "{\"success\":true,\"data\":[");
+    unsigned int seed = 42;
+    for (int i = 0; i < rows; i++) {
+        len += (size_t)sprintf(buf + len, "%s{\"id\":%d,\"text\":\"", i ? "," : "", rows - i);
+        int nwords = 200 + (int)(rand_r(&seed) % 800);
+        for (int w = 0; w < nwords; w++) {
+            len += (size_t)sprintf(buf + len, "%s%s", w ? " " : "", words[rand_r(&seed) % 15]);
+        }
+        len += (size_t)sprintf(buf + len,
+                               "\",\"created_at\":\"2024-01-01T10:00:00Z\",\"word_count\":%d,"
+                               "\"char_count\":0,\"letter_count\":0}",
+                               nwords);
+    }
+    len += (size_t)sprintf(buf + len, "],\"pagination\":{\"limit\":%d,\"offset\":0,\"total\":%d}}", rows, rows);
+    *out_len = len;
+    return buf;
+}
+
+static size_t run_dom(const char *page, size_t len) {
+    http_buffer_t body = {0};
+    for (size_t off = 0; off < len; off += CHUNK) {
+        size_t n = len - off < CHUNK ? len - off : CHUNK;
+        body.data = realloc(body.data, body.len + n + 1);
+        memcpy(body.data + body.len, page + off, n);
+        body.len += n;
+        body.data[body.len] = '\0';
+    }
+    cJSON *root = cJSON_Parse(body.data);
+    cJSON *data = cJSON_GetObjectItem(root, "data");
+    size_t rows = (size_t)cJSON_GetArraySize(data);
+    session_t *arr = calloc(rows, sizeof(session_t));
+    for (size_t i = 0; i < rows; i++) {
+        cJSON *item = cJSON_GetArrayItem(data, (int)i);
+        arr[i].id = cJSON_GetObjectItem(item, "id")->valueint;
+        arr[i].text = strdup(cJSON_GetObjectItem(item, "text")->valuestring);
+        arr[i].created_at = strdup(cJSON_GetObjectItem(item, "created_at")->valuestring);
+    }
+    cJSON_Delete(root);
+    http_buffer_free(&body);
+    sessions_free(arr, rows);
+    return rows;
+}
+
+static size_t run_strdup(const char *page, size_t len) {
+    (void)len;
+    session_t *arr = NULL;
+    size_t rows = 0;
+    if (api_parse_sessions_page(page, &arr, &rows, NULL) != 0) return 0;
+    sessions_free(arr, rows);
+    return rows;
+}
+
+typedef struct {
+    session_batch_t batch;
+    size_t flush_at;
+    size_t rows;
+} arena_ctx_t;
+
+static int push_row(void *userdata, const session_t *s) {
+    arena_ctx_t *ctx = userdata;
+    if (session_batch_push(&ctx->batch, s) != 0) return -1;
+    ctx->rows++;
+    if (ctx->flush_at && ctx->batch.len >= ctx->flush_at) session_batch_clear(&ctx->batch);
+    return 0;
+}
+
+static size_t arena_page(const char *page, size_t len, size_t flush_at) {
+    arena_ctx_t ctx = {.flush_at = flush_at};
+    session_batch_init(&ctx.batch);
+    api_sessions_parser_t *p = api_sessions_parser_new(push_row, &ctx);
+    for (size_t off = 0; off < len; off += CHUNK) {
+        size_t n = len - off < CHUNK ? len - off : CHUNK;
+        api_sessions_parser_feed(p, page + off, n);
+    }
+    size_t rows = api_sessions_parser_finish(p, NULL) == 0 ? ctx.rows : 0;
+    api_sessions_parser_free(p);
+    session_batch_free(&ctx.batch);
+    return rows;
+}
+
+static size_t run_arena(const char *page, size_t len) {
+    return arena_page(page, len, 0);
+}
+
+static size_t run_arena64(const char *page, size_t len) {
+    return arena_page(page, len, 64);
+}
+
+int main(int argc, char **argv) {
+    int rows = argc > 1 ? atoi(argv[1]) : 1000;
+    int reps = argc > 2 ? atoi(argv[2]) : 5;
+    const char *names[] = {"dom", "strdup", "arena", "arena64"};
+    size_t (*runs[])(const char *, size_t) = {run_dom, run_strdup, run_arena, run_arena64};
+
+    size_t len = 0;
+    char *page = make_page(rows, &len);
+    printf("page: %d rows, %.1f MB, %d reps\n", rows, len / (1024.0 * 1024.0), reps);
+    printf("%-8s %14s %14s %12s\n", "mode", "allocs/page", "allocs/row", "peak RSS KB");
+    fflush(stdout);
+    for (int m = 0; m < 4; m++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            n_alloc = 0;
+            size_t got = 0;
+            for (int r = 0; r < reps; r++) got = runs[m](page, len);
+            struct rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+            double per_page = (double)n_alloc / reps;
+            printf("%-8s %14.0f %14.2f %12ld\n", names[m], per_page, got ? per_page / got : 0.0, ru.ru_maxrss);
+            fflush(stdout);
+            _exit(got == (size_t)rows ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) fprintf(stderr, "%s: parse failed\n", names[m]);
+    }
+    __libc_free(page);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""End-to-end benchmark for typewriter, run by `make bench`.
+
+Starts bench/mock_api.py, runs a full and an incremental sync against it, then times a fixed
+set of FTS queries through `typewriter serve`. Prints one JSON document so runs can be
+compared across commits.
+"""
+import argparse
+import json
+import math
+import os
+import re
+import signal
+import socket
+import sqlite3
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+QUERIES = [
+    "Haus",
+    "Mädchen",
+    "Straße AND früher",
+    '"das Haus"',
+    "Mäd*",
+    "Welt NOT Zeit",
+]
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    ordered = sorted(values)
+    # Nearest-rank percentile.
+    k = max(0, math.ceil(p / 100.0 * len(ordered)) - 1)
+    return ordered[k]
+
+
+def latency_summary(values_ms):
+    return {
+        "p50_ms": round(percentile(values_ms, 50), 3),
+        "p95_ms": round(percentile(values_ms, 95), 3),
+        "p99_ms": round(percentile(values_ms, 99), 3),
+        "mean_ms": round(sum(values_ms) / len(values_ms), 3),
+    }
+
+
+def mock_stats(base):
+    with urllib.request.urlopen(base + "/__bench/stats") as r:
+        return json.load(r)
+
+
+def run_sync(binary, db, base, args, extra):
+    before = mock_stats(base)
+    cmd = [binary, "sync", "--db", db, "--base-url", base, "--limit", str(args.limit),
+           "--concurrency", str(args.concurrency)] + extra
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    out = proc.stdout.read()
+    # wait4 instead of proc.wait() to get this child's own peak RSS.
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    seconds = time.monotonic() - start
+    after = mock_stats(base)
+    if proc.returncode != 0:
+        sys.stderr.write(out)
+        raise SystemExit("sync failed: %s" % " ".join(cmd))
+    m = re.search(r"Sync fertig: (\d+) Sessions", out)
+    rows = int(m.group(1)) if m else 0
+    body = after["bytes"] - before["bytes"]
+    return {
+        "rows": rows,
+        "seconds": round(seconds, 3),
+        "rows_per_s": round(rows / seconds, 1),
+        "mb_per_s": round(body / seconds / (1024 * 1024), 2),
+        "http_requests": after["requests"] - before["requests"],
+        "http_bytes": body,
+        "peak_rss_kb": usage.ru_maxrss,
+    }
+
+
+def query(sock, text, limit):
+    payload = bytes([ord("s")]) + struct.pack(">I", limit) + text.encode()
+    sock.sendall(struct.pack(">I", len(payload)) + payload)
+    n = struct.unpack(">I", recv_exact(sock, 4))[0]
+    body = recv_exact(sock, n)
+    if body[0] != 0:
+        raise SystemExit("query failed: %s" % text)
+    return body[1:]
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise SystemExit("serve closed the connection")
+        buf += chunk
+    return buf
+
+
+def run_queries(binary, db, args, workdir):
+    path = os.path.join(workdir, "bench.sock")
+    serve = subprocess.Popen([binary, "serve", "--db", db, "--socket", path, "--threads", "2"],
+                             stdout=subprocess.DEVNULL)
+    try:
+        for _ in range(100):
+            if os.path.exists(path):
+                break
+            time.sleep(0.05)
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(path)
+        for q in QUERIES:
+            query(sock, q, args.query_limit)  # warm-up
+        all_ms = []
+        per_query = {}
+        for q in QUERIES:
+            times = []
+            for _ in range(args.query_runs):
+                start = time.perf_counter()
+                query(sock, q, args.query_limit)
+                times.append((time.perf_counter() - start) * 1000.0)
+            per_query[q] = latency_summary(times)
+            all_ms.extend(times)
+        sock.close()
+    finally:
+        serve.send_signal(signal.SIGTERM)
+        serve.wait(timeout=10)
+    result = latency_summary(all_ms)
+    result.update({"runs_per_query": args.query_runs, "limit": args.query_limit, "per_query": per_query})
+    return result
+
+
+# Size of the full-text index's segments. The shadow table reads fine without the tokenizer.
+def fts_index_bytes(db):
+    con = sqlite3.connect("file:%s?mode=ro" % db, uri=True)
+    try:
+        return con.execute("SELECT sum(length(block)) FROM sessions_fts_data").fetchone()[0]
+    finally:
+        con.close()
+
+
+def git_commit():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "--short", "HEAD"], cwd=HERE, text=True,
+                                       stderr=subprocess.DEVNULL).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    p.add_argument("--binary", default=os.path.join(HERE, "..", "typewriter"))
+    p.add_argument("--sessions", type=int, default=20000)
+    p.add_argument("--words-mean", type=int, default=250)
+    p.add_argument("--words-sigma", type=float, default=0.8)
+    p.add_argument("--latency-ms", type=float, default=5.0)
+    p.add_argument("--error-rate", type=float, default=0.0)
+    p.add_argument("--inflect", type=float, default=0.0, help="share of words with a German ending")
+    p.add_argument("--grow", type=int, default=500, help="new sessions before the incremental sync")
+    p.add_argument("--limit", type=int, default=200)
+    p.add_argument("--concurrency", type=int, default=4)
+    p.add_argument("--query-runs", type=int, default=200)
+    p.add_argument("--query-limit", type=int, default=20)
+    p.add_argument("--out", help="also write the JSON here")
+    args = p.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    mock = subprocess.Popen([sys.executable, os.path.join(HERE, "mock_api.py"),
+                             "--sessions", str(args.sessions), "--words-mean", str(args.words_mean),
+                             "--words-sigma", str(args.words_sigma), "--latency-ms", str(args.latency_ms),
+                             "--error-rate", str(args.error_rate), "--inflect", str(args.inflect)],
+                            stdout=subprocess.PIPE, text=True)
+    try:
+        port = int(mock.stdout.readline().split()[-1])
+        base = "http://127.0.0.1:%d" % port
+        with tempfile.TemporaryDirectory(prefix="typewriter-bench-") as workdir:
+            db = os.path.join(workdir, "bench.db")
+            full = run_sync(binary, db, base, args, [])
+            req = urllib.request.Request(base + "/__bench/grow?n=%d" % args.grow, method="POST")
+            urllib.request.urlopen(req).read()
+            incremental = run_sync(binary, db, base, args, ["--incremental"])
+            search = run_queries(binary, db, args, workdir)
+            db_bytes = sum(os.path.getsize(os.path.join(workdir, f)) for f in os.listdir(workdir)
+                           if f.startswith("bench.db"))
+            fts_bytes = fts_index_bytes(db)
+    finally:
+        mock.terminate()
+        mock.wait(timeout=10)
+
+    result = {
+        "commit": git_commit(),
+        "config": {k: v for k, v in vars(args).items() if k not in ("binary", "out")},
+        "full_sync": full,
+        "incremental_sync": incremental,
+        "search": search,
+        "db_bytes": db_bytes,
+        "fts_bytes": fts_bytes,
+    }
+    text = json.dumps(result, indent=2, ensure_ascii=False)
+    print(text)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,109 @@
+// Checks the tw_german tokenizer (src/fts_german.c) on a small store of inflected German: a
+// prefix query must find every session its word finds, for the whole word ("lieben*" against
+// "lieben") and for each of its leading parts ("lie*", "lieb*", "liebe*"). The index holds stems,
+// so these only hold when prefix terms are stemmed like the text. Exits 1 on any miss.
+#include "../src/session_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *texts[] = {
+    "Wir lieben den Sommer",        "Die Liebe ist groß",          "Er liebte sie im Sommer",
+    "Morgen gehen wir",             "Guten Morgen, die Morgens sind kalt", "Das Mädchen lacht",
+    "Des Mädchens Hund",            "Zwei MAEDCHEN spielen",       "Die Häuser sind alt",
+    "Im Haus brennt Licht",         "Das Dach des Hauses",         "HAEUSER am See",
+    "Die Zeitungen liegen da",      "Eine Zeitung",                "Wir erinnern uns",
+    "Die Erinnerung bleibt",        "Die Straße und die Strassen", "Schöne Gärten",
+    "Im Garten",
+};
+
+static const char *words[] = {"lieben", "Liebe",    "Sommer",    "morgen",   "Mädchen", "Häuser", "Haus",
+                              "Hauses", "HAEUSER",  "Zeitungen", "erinnern", "Straße",  "Gärten"};
+
+// session_store_match_ids, with *ids and *len cleared first.
+static int match(session_store_t *store, const char *query, int **ids, size_t *len) {
+    *ids = NULL;
+    *len = 0;
+    return session_store_match_ids(store, query, ids, len);
+}
+
+// Whether every id in a (ascending) is also in b (ascending).
+static int subset(const int *a, size_t na, const int *b, size_t nb) {
+    size_t j = 0;
+    for (size_t i = 0; i < na; i++) {
+        while (j < nb && b[j] < a[i]) j++;
+        if (j == nb || b[j] != a[i]) return 0;
+    }
+    return 1;
+}
+
+int main(void) {
+    char tmp[] = "/tmp/fts_check_XXXXXX";
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    unlink(tmp);
+    char path[64];
+    snprintf(path, sizeof(path), "%s.db", tmp);
+
+    session_store_t store = {0};
+    if (session_store_open(&store, path) != 0 || session_store_init_schema(&store) != 0) return 1;
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]) && rc == 0; i++) {
+        session_t s = {.id = (int)i + 1, .text = (char *)texts[i], .created_at = (char *)"2024-05-01T10:00:00Z"};
+        if (session_store_upsert(&store, &s) < 0) rc = -1;
+    }
+
+    int checks = 0;
+    int failures = 0;
+    for (size_t w = 0; w < sizeof(words) / sizeof(words[0]) && rc == 0; w++) {
+        int *want = NULL;
+        size_t nwant = 0;
+        if (match(&store, words[w], &want, &nwant) != 0) {
+            rc = -1;
+            break;
+        }
+        if (nwant == 0) {
+            printf("FAIL %s: no session\n", words[w]);
+            failures++;
+        }
+        // Every leading part of two or more characters, cut on code point boundaries, up to the
+        // whole word.
+        size_t len = strlen(words[w]);
+        for (size_t k = 2; k <= len && rc == 0; k++) {
+            if (k < len && (words[w][k] & 0xC0) == 0x80) continue;
+            char query[80];
+            snprintf(query, sizeof(query), "%.*s*", (int)k, words[w]);
+            int *got = NULL;
+            size_t ngot = 0;
+            if (match(&store, query, &got, &ngot) != 0) {
+                rc = -1;
+                break;
+            }
+            checks++;
+            if (!subset(want, nwant, got, ngot)) {
+                printf("FAIL %s: %zu sessions, %s: %zu\n", words[w], nwant, query, ngot);
+                failures++;
+            }
+            free(got);
+        }
+        free(want);
+    }
+    session_store_close(&store);
+    unlink(path);
+    char side[80];
+    snprintf(side, sizeof(side), "%s-wal", path);
+    unlink(side);
+    snprintf(side, sizeof(side), "%s-shm", path);
+    unlink(side);
+    if (rc != 0) {
+        fprintf(stderr, "fts_check: store error\n");
+        return 1;
+    }
+    printf("%d prefix checks over %zu words, %d failed\n", checks, sizeof(words) / sizeof(words[0]), failures);
+    return failures ? 1 : 0;
+}
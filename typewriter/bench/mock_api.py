@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Typewriter API, used by `make bench`.
+
+Serves /api/v1/sessions (limit/offset, newest first by default), /api/v1/sessions/last and
+/api/v1/sessions/<id> from a deterministic synthetic corpus, /api/v1/documents/<id>/versions
+(oldest first) for sessions with an edit history (see --edited), plus /api/sse, which like the real
+route sends an `update` event (with the newest text) whenever something changed. Two extra
+endpoints drive the benchmark: GET /__bench/stats returns request and byte counters, POST
+/__bench/grow?n=N adds N new sessions (for incremental syncs and `watch`). --row-ms makes large
+pages slow and --capacity makes concurrent requests queue up and, past that, fail with a 503.
+"""
+import argparse
+import datetime
+import gzip
+import json
+import random
+import re
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+COMMON = ("der die das und ist nicht ein eine zu mit auf für von dem den sich es im auch "
+          "als wie aber noch nach bei aus wenn nur war Haus Mann Frau Straße Mädchen größer "
+          "früher ähnlich schnell heute morgen Abend Zeit Tag Jahr Welt Hand Auge Wort").split()
+# Endings that --inflect appends, so one stem shows up in several forms as in real German text.
+ENDINGS = ("e", "en", "er", "es", "s", "em", "ern", "est", "ung", "ungen", "lich", "heit", "isch")
+
+
+class Corpus:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.vocab = COMMON + [self._word() for _ in range(args.vocab)]
+        # Zipf-like weights so a few words are everywhere and most are rare.
+        self.weights = [1.0 / (rank + 1) for rank in range(len(self.vocab))]
+        self.lock = threading.Lock()
+        self.changed = threading.Condition(self.lock)
+        self.version = 0
+        self.sessions = []
+        self.start = datetime.datetime(2022, 1, 1)
+        self.grow(args.sessions)
+
+    def _word(self):
+        letters = "abcdefghijklmnoprstuwzäöüß"
+        return "".join(self.rng.choice(letters) for _ in range(self.rng.randint(3, 11)))
+
+    def _session(self, sid):
+        words = max(1, int(self.rng.lognormvariate(0, self.args.words_sigma) * self.args.words_mean))
+        chosen = self.rng.choices(self.vocab, self.weights, k=words)
+        if self.args.inflect:
+            chosen = [w + self.rng.choice(ENDINGS) if self.rng.random() < self.args.inflect else w for w in chosen]
+        text = " ".join(chosen)
+        if sid % 11 == 0:
+            text += ' "zitiert" \\ Zeile\nneu \U0001F600'
+        created = self.start + datetime.timedelta(minutes=37 * sid)
+        edits = 0
+        # Only drawn with --edited, so the default corpus stays the same as before.
+        if self.args.edited and self.rng.random() < self.args.edited:
+            edits = max(1, int(self.rng.expovariate(1.0 / self.args.versions)))
+        return {
+            "id": sid,
+            "text": text,
+            "created_at": created.strftime("%Y-%m-%dT%H:%M:%SZ"),
+            "word_count": len(text.split()),
+            "char_count": len(text),
+            "letter_count": sum(c.isalpha() for c in text),
+            "document_id": sid,
+            "parent_id": self._version_id(sid, edits - 1) if edits else None,
+            "_edits": edits,
+        }
+
+    @staticmethod
+    def _version_id(sid, k):
+        return 10_000_000 + sid * 1000 + k
+
+    def versions(self, sid):
+        """The versions a session was typed through, oldest first, ending with the session itself:
+        its text growing in steps, each earlier step with one word not yet corrected."""
+        with self.lock:
+            if not 1 <= sid <= len(self.sessions):
+                return None
+            final = self.sessions[sid - 1]
+        rng = random.Random(self.args.seed * 1_000_003 + sid)
+        words = final["text"].split(" ")
+        n = final["_edits"] + 1
+        created = datetime.datetime.strptime(final["created_at"], "%Y-%m-%dT%H:%M:%SZ")
+        out = []
+        for k in range(n - 1):
+            w = words[:max(1, len(words) * (k + 1) // n)]
+            w[rng.randrange(len(w))] = rng.choice(self.vocab)
+            text = " ".join(w)
+            out.append({
+                "id": self._version_id(sid, k),
+                "text": text,
+                "created_at": (created - datetime.timedelta(minutes=n - 1 - k)).strftime("%Y-%m-%dT%H:%M:%SZ"),
+                "word_count": len(text.split()),
+                "char_count": len(text),
+                "letter_count": sum(c.isalpha() for c in text),
+                "document_id": sid,
+                "parent_id": self._version_id(sid, k - 1) if k else None,
+            })
+        return out + [public(final)]
+
+    def grow(self, n):
+        with self.lock:
+            first = len(self.sessions) + 1
+            self.sessions.extend(self._session(i) for i in range(first, first + n))
+            self.version += 1
+            self.changed.notify_all()
+
+    def page(self, limit, offset):
+        with self.lock:
+            total = len(self.sessions)
+            if self.args.order == "newest":
+                hi = max(total - offset, 0)
+                rows = self.sessions[max(hi - limit, 0):hi][::-1]
+            else:
+                rows = self.sessions[offset:offset + limit]
+        return rows, total
+
+
+def public(session):
+    return {k: v for k, v in session.items() if not k.startswith("_")}
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    stats = {"requests": 0, "bytes": 0, "errors": 0}
+    stats_lock = threading.Lock()
+
+    def log_message(self, *args):
+        pass
+
+    def send_json(self, obj, code=200, count=True, retry_after=0):
+        body = json.dumps(obj).encode()
+        if count:
+            with self.stats_lock:
+                self.stats["requests"] += 1
+                self.stats["bytes"] += len(body)
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        if retry_after:
+            self.send_header("Retry-After", str(retry_after))
+        if self.server.args.gzip and "gzip" in self.headers.get("Accept-Encoding", ""):
+            body = gzip.compress(body, 5)
+            self.send_header("Content-Encoding", "gzip")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def send_events(self, corpus):
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Cache-Control", "no-cache, no-transform")
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.close_connection = True
+        with corpus.lock:
+            seen = corpus.version
+        while True:
+            with corpus.changed:
+                corpus.changed.wait_for(lambda: corpus.version != seen, timeout=15)
+                if corpus.version == seen:
+                    payload = ": keep-alive\n\n"
+                else:
+                    seen = corpus.version
+                    payload = "event: update\ndata: %s\n\n" % json.dumps({"text": corpus.sessions[-1]["text"]})
+            try:
+                self.wfile.write(payload.encode())
+                self.wfile.flush()
+            except OSError:
+                return
+
+    def do_GET(self):
+        args = self.server.args
+        corpus = self.server.corpus
+        url = urlparse(self.path)
+        if url.path == "/__bench/stats":
+            with self.stats_lock:
+                return self.send_json(dict(self.stats, total=len(corpus.sessions)), count=False)
+        if url.path == "/api/sse":
+            return self.send_events(corpus)
+        if not url.path.startswith(("/api/v1/sessions", "/api/v1/documents/")):
+            return self.send_json({"success": False, "error": "not found"}, 404)
+        if self.server.slots and not self.server.slots.acquire(blocking=False):
+            # Busy: wait for a slot behind the others, or turn the request away if too many wait.
+            with self.server.waiting_lock:
+                full = self.server.waiting >= args.capacity
+                if not full:
+                    self.server.waiting += 1
+            if full:
+                with self.stats_lock:
+                    self.stats["errors"] += 1
+                return self.send_json({"success": False, "error": "overloaded"}, 503, retry_after=1)
+            self.server.slots.acquire()
+            with self.server.waiting_lock:
+                self.server.waiting -= 1
+        try:
+            return self.serve_api(args, corpus, url)
+        finally:
+            if self.server.slots:
+                self.server.slots.release()
+
+    def serve_api(self, args, corpus, url):
+        if args.latency_ms:
+            time.sleep(args.latency_ms / 1000.0)
+        if args.error_rate and random.random() < args.error_rate:
+            with self.stats_lock:
+                self.stats["errors"] += 1
+            return self.send_json({"success": False, "error": "injected"}, 500)
+        if url.path == "/api/v1/sessions":
+            q = parse_qs(url.query)
+            limit = int(q.get("limit", ["20"])[0])
+            offset = int(q.get("offset", ["0"])[0])
+            rows, total = corpus.page(limit, offset)
+            if args.row_ms:
+                time.sleep(len(rows) * args.row_ms / 1000.0)
+            return self.send_json({"success": True, "data": [public(r) for r in rows],
+                                   "pagination": {"limit": limit, "offset": offset, "total": total}})
+        if url.path == "/api/v1/sessions/last":
+            with corpus.lock:
+                last = corpus.sessions[-1] if corpus.sessions else None
+            return self.send_json({"success": True, "data": public(last)} if last else {"success": False}, 200)
+        m = re.match(r"^/api/v1/sessions/(\d+)$", url.path)
+        if m and 1 <= int(m.group(1)) <= len(corpus.sessions):
+            return self.send_json({"success": True, "data": public(corpus.sessions[int(m.group(1)) - 1])})
+        m = re.match(r"^/api/v1/documents/(\d+)/versions$", url.path)
+        versions = corpus.versions(int(m.group(1))) if m else None
+        if versions is not None:
+            q = parse_qs(url.query)
+            limit = int(q.get("limit", ["20"])[0])
+            offset = int(q.get("offset", ["0"])[0])
+            return self.send_json({"success": True, "data": versions[offset:offset + limit],
+                                   "pagination": {"limit": limit, "offset": offset, "total": len(versions)}})
+        return self.send_json({"success": False, "error": "not found"}, 404)
+
+    def do_POST(self):
+        url = urlparse(self.path)
+        if url.path == "/__bench/grow":
+            n = int(parse_qs(url.query).get("n", ["0"])[0])
+            self.server.corpus.grow(n)
+            return self.send_json({"total": len(self.server.corpus.sessions)}, count=False)
+        return self.send_json({"success": False}, 404, count=False)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    p.add_argument("--port", type=int, default=0, help="0 picks a free port")
+    p.add_argument("--sessions", type=int, default=20000)
+    p.add_argument("--words-mean", type=int, default=250, help="median words per session")
+    p.add_argument("--words-sigma", type=float, default=0.8, help="lognormal spread of the length")
+    p.add_argument("--vocab", type=int, default=5000)
+    p.add_argument("--inflect", type=float, default=0.0, help="share of words that get a German ending")
+    p.add_argument("--latency-ms", type=float, default=5.0)
+    p.add_argument("--error-rate", type=float, default=0.0)
+    p.add_argument("--row-ms", type=float, default=0.0, help="extra latency per session on a page")
+    p.add_argument("--capacity", type=int, default=0,
+                   help="requests served at once; as many more wait, the rest get a 503 (0: no limit)")
+    p.add_argument("--order", choices=("newest", "oldest"), default="newest")
+    p.add_argument("--gzip", action="store_true", help="compress when the client accepts gzip")
+    p.add_argument("--edited", type=float, default=0.0, help="share of sessions with an edit history")
+    p.add_argument("--versions", type=int, default=20, help="mean number of edits of an edited session")
+    p.add_argument("--seed", type=int, default=1)
+    args = p.parse_args()
+
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.daemon_threads = True
+    server.args = args
+    server.corpus = Corpus(args)
+    server.slots = threading.BoundedSemaphore(args.capacity) if args.capacity else None
+    server.waiting = 0
+    server.waiting_lock = threading.Lock()
+    print("listening on %d" % server.server_address[1], flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
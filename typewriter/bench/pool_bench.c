@@ -0,0 +1,239 @@
+// Read throughput of store_pool (src/store_pool.h) by thread count: T threads each run random
+// gets (80 %) and FTS searches (20 %) against one store for --seconds, for T = 1, 2, 4, ... up
+// to --threads (default: the core count), while a writer thread rewrites random sessions through
+// store_pool_write. Every get is checked against the id it asked for. --shared runs the same
+// reads on a single connection behind a mutex instead, which is what embedding a
+// session_store_t from several threads comes down to without the pool.
+// Without --db a store of --sessions synthetic sessions is built first in a temporary file.
+#include "../src/store_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WRITE_BATCH 16
+#define WRITE_PAUSE_MS 5
+#define VOCAB 400
+
+typedef struct {
+    store_pool_t *pool;
+    session_store_t *shared; // --shared: every reader uses this one connection
+    pthread_mutex_t *shared_mu;
+    int sessions;
+    double deadline;
+    unsigned int seed;
+    long long reads;
+    long long errors;
+} reader_t;
+
+typedef struct {
+    store_pool_t *pool;
+    int sessions;
+    double deadline;
+    long long rows;
+    long long errors;
+} writer_t;
+
+static char vocab[VOCAB][12];
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void make_vocab(void) {
+    static const char *common[] = {"der", "die", "das", "und", "ist", "nicht", "Haus", "Zeit", "Welt", "heute"};
+    unsigned int seed = 3;
+    for (int i = 0; i < VOCAB; i++) {
+        if (i < 10) {
+            snprintf(vocab[i], sizeof(vocab[i]), "%s", common[i]);
+            continue;
+        }
+        int len = 4 + rand_r(&seed) % 7;
+        for (int c = 0; c < len; c++) vocab[i][c] = (char)('a' + rand_r(&seed) % 26);
+        vocab[i][len] = '\0';
+    }
+}
+
+// Zipf-like: low ranks are far more frequent.
+static const char *pick_word(unsigned int *seed) {
+    double x = (double)rand_r(seed) / RAND_MAX;
+    return vocab[(int)(x * x * x * (VOCAB - 1))];
+}
+
+// id's synthetic session into s; the text lives in buf.
+static void make_session(int id, unsigned int *seed, char *buf, size_t cap, session_t *s) {
+    size_t n = 0;
+    int words = 50 + rand_r(seed) % 400;
+    for (int w = 0; w < words && n + 16 < cap; w++) n += (size_t)sprintf(buf + n, w ? " %s" : "%s", pick_word(seed));
+    static const char *created = "2024-05-01T10:00:00Z";
+    *s = (session_t){.id = id, .text = buf, .created_at = (char *)created, .word_count = words,
+                     .char_count = (int)n, .letter_count = (int)n - words + 1};
+}
+
+static int fill_store(store_pool_t *pool, int sessions) {
+    static char bufs[64][8192];
+    session_t rows[64];
+    unsigned int seed = 11;
+    for (int id = 1; id <= sessions;) {
+        size_t n = 0;
+        while (n < 64 && id <= sessions) {
+            make_session(id++, &seed, bufs[n], sizeof(bufs[n]), &rows[n]);
+            n++;
+        }
+        if (store_pool_write(pool, rows, n) != 0) return -1;
+    }
+    return 0;
+}
+
+static int read_once(reader_t *r) {
+    session_store_t *store = r->shared ? r->shared : store_pool_reader(r->pool);
+    if (!store) return -1;
+    int rc = 0;
+    if (r->shared) pthread_mutex_lock(r->shared_mu);
+    if (rand_r(&r->seed) % 5 != 0) {
+        int id = 1 + rand_r(&r->seed) % r->sessions;
+        session_t s = {0};
+        rc = session_store_get(store, id, &s) == 0 && s.id == id ? 0 : -1;
+        session_free(&s);
+    } else {
+        search_hit_t *hits = NULL;
+        size_t len = 0;
+        // A uniformly picked word is mostly a rare one, as typical queries are.
+        rc = session_store_search_hits(store, vocab[rand_r(&r->seed) % VOCAB], 10, 1, &hits, &len);
+        session_store_free_hits(hits, len);
+    }
+    if (r->shared) pthread_mutex_unlock(r->shared_mu);
+    return rc;
+}
+
+static void *reader_main(void *arg) {
+    reader_t *r = arg;
+    while (now_sec() < r->deadline) {
+        if (read_once(r) != 0) r->errors++;
+        r->reads++;
+    }
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    writer_t *w = arg;
+    static char bufs[WRITE_BATCH][8192];
+    session_t rows[WRITE_BATCH];
+    unsigned int seed = 17;
+    while (now_sec() < w->deadline) {
+        for (int i = 0; i < WRITE_BATCH; i++) {
+            make_session(1 + rand_r(&seed) % w->sessions, &seed, bufs[i], sizeof(bufs[i]), &rows[i]);
+        }
+        if (store_pool_write(w->pool, rows, WRITE_BATCH) != 0) w->errors++;
+        else w->rows += WRITE_BATCH;
+        struct timespec ts = {0, WRITE_PAUSE_MS * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *db = NULL;
+    int sessions = 10000;
+    double seconds = 3;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cores > 0 ? (int)cores : 1;
+    int shared = 0;
+    int with_writer = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) db = argv[++i];
+        else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) sessions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) max_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shared") == 0) shared = 1;
+        else if (strcmp(argv[i], "--no-writer") == 0) with_writer = 0;
+        else {
+            fprintf(stderr, "usage: %s [--db PATH] [--sessions N] [--seconds S] [--threads N] [--shared] [--no-writer]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+    make_vocab();
+    char tmp[] = "/tmp/pool_bench_XXXXXX";
+    char path[64];
+    if (!db) {
+        int fd = mkstemp(tmp);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+        unlink(tmp);
+        snprintf(path, sizeof(path), "%s.db", tmp);
+        db = path;
+    }
+    store_pool_t *pool = store_pool_open(db, NULL);
+    if (!pool) return 1;
+    store_stats_t stats = {0};
+    if (store_pool_stats(pool, &stats) != 0) return 1;
+    if (stats.count == 0) {
+        double started = now_sec();
+        if (fill_store(pool, sessions) != 0) {
+            fprintf(stderr, "could not fill %s\n", db);
+            return 1;
+        }
+        printf("filled %s with %d sessions in %.1fs\n", db, sessions, now_sec() - started);
+    } else {
+        sessions = stats.count;
+    }
+    session_store_t shared_store = {0};
+    pthread_mutex_t shared_mu = PTHREAD_MUTEX_INITIALIZER;
+    if (shared && session_store_open_readonly(&shared_store, db) != 0) return 1;
+
+    printf("%d cores, %s, writer %s\n", (int)cores, shared ? "one shared connection" : "store_pool",
+           with_writer ? "on" : "off");
+    printf("threads   reads/s  speedup  writes/s  errors\n");
+    double base = 0;
+    for (int t = 1;; t = t * 2 > max_threads && t < max_threads ? max_threads : t * 2) {
+        reader_t *readers = calloc((size_t)t, sizeof(*readers));
+        pthread_t *tids = calloc((size_t)t, sizeof(*tids));
+        if (!readers || !tids) return 1;
+        double deadline = now_sec() + seconds;
+        writer_t w = {.pool = pool, .sessions = sessions, .deadline = deadline};
+        pthread_t wt;
+        if (with_writer) pthread_create(&wt, NULL, writer_main, &w);
+        for (int i = 0; i < t; i++) {
+            readers[i] = (reader_t){.pool = pool, .sessions = sessions, .deadline = deadline, .seed = 100u + (unsigned)i};
+            if (shared) {
+                readers[i].shared = &shared_store;
+                readers[i].shared_mu = &shared_mu;
+            }
+            pthread_create(&tids[i], NULL, reader_main, &readers[i]);
+        }
+        long long reads = 0, errors = 0;
+        for (int i = 0; i < t; i++) {
+            pthread_join(tids[i], NULL);
+            reads += readers[i].reads;
+            errors += readers[i].errors;
+        }
+        if (with_writer) pthread_join(wt, NULL);
+        double qps = reads / seconds;
+        if (t == 1) base = qps;
+        printf("%7d %9.0f %7.2fx %9.0f %7lld\n", t, qps, base > 0 ? qps / base : 0, w.rows / seconds,
+               errors + w.errors);
+        free(readers);
+        free(tids);
+        if (t >= max_threads) break;
+    }
+    if (shared) session_store_close(&shared_store);
+    store_pool_close(pool);
+    if (db == path) {
+        unlink(path);
+        char side[80];
+        snprintf(side, sizeof(side), "%s-wal", path);
+        unlink(side);
+        snprintf(side, sizeof(side), "%s-shm", path);
+        unlink(side);
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Throughput of the text statistics scanner (src/text_stats.c) in GB/s, per implementation,
+// against the naive one-code-point-at-a-time loop:
+//   counts - words, chars and letters only
+//   tokens - the same plus the token callback
+//   terms  - tokens counted into a text_terms_t, reset per 2 KB session like the sync does
+// Every implementation is first checked against the naive loop on random (also invalid) UTF-8.
+#include "../src/text_stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CORPUS_BYTES (64u << 20)
+#define SESSION_BYTES 2048
+#define RUNS 5
+
+static const char *impls[] = {"naive", "scalar", "sse4.2", "avx2"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void scan(const char *impl, const char *text, size_t len, text_stats_t *st, text_token_fn fn, void *ud) {
+    if (strcmp(impl, "naive") == 0) {
+        text_stats_scan_naive(text, len, st, fn, ud);
+    } else {
+        text_stats_scan(text, len, st, fn, ud);
+    }
+}
+
+static void hash_token(void *userdata, const char *token, size_t len) {
+    uint64_t *h = userdata;
+    *h = (*h ^ (uint64_t)(uintptr_t)token) * 1099511628211ULL;
+    *h = (*h ^ len) * 1099511628211ULL;
+}
+
+// German-like prose: Zipf-weighted vocabulary (function words dominate), umlauts and ß in
+// about one word in ten, some punctuation, quotes, digits and the odd emoji.
+static char *make_corpus(size_t len) {
+    static const char *words[] = {"der",    "die",     "und",     "in",     "den",    "von",     "zu",
+                                  "das",    "mit",     "sich",    "des",    "auf",    "für",     "ist",
+                                  "im",     "dem",     "nicht",   "ein",    "Die",    "eine",    "als",
+                                  "auch",   "es",      "an",      "werden", "aus",    "er",      "hat",
+                                  "dass",   "sie",     "nach",    "wird",   "bei",    "einer",   "Der",
+                                  "um",     "am",      "sind",    "noch",   "wie",    "Mann",    "über",
+                                  "Straße", "größer",  "Mädchen", "früher", "Haus",   "ähnlich", "Tür,",
+                                  "Öl.",    "„Zitat“", "–",       "2024",   "Zeit.",  "Welt,",   "😀"};
+    size_t nwords = sizeof(words) / sizeof(words[0]);
+    double *cum = malloc(nwords * sizeof(double));
+    double total = 0;
+    for (size_t i = 0; i < nwords; i++) cum[i] = total += 1.0 / (double)(i + 1);
+    char *buf = malloc(len + 64);
+    size_t n = 0;
+    unsigned int seed = 7;
+    while (n < len) {
+        double x = (double)rand_r(&seed) / RAND_MAX * total;
+        size_t i = 0;
+        while (i + 1 < nwords && cum[i] < x) i++;
+        size_t wl = strlen(words[i]);
+        memcpy(buf + n, words[i], wl);
+        n += wl;
+        buf[n++] = rand_r(&seed) % 12 == 0 ? '\n' : ' ';
+    }
+    buf[len] = '\0';
+    free(cum);
+    return buf;
+}
+
+static int verify(const char *impl) {
+    static const char *pieces[] = {"a", "Z", "7", " ", "\n", "\t", "ä", "Ö", "ß", "€", " ", " ", "😀",
+                                   "a\xcc\x88", ".", "\xc3", "\x80", "\xe2\x82", "\xf0\x9f", "\xc1\x81", "\xff"};
+    unsigned int seed = 1;
+    char buf[600];
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t len = 0;
+        int pieces_n = rand_r(&seed) % 120;
+        for (int p = 0; p < pieces_n; p++) {
+            const char *s = pieces[rand_r(&seed) % (sizeof(pieces) / sizeof(pieces[0]))];
+            size_t sl = strlen(s);
+            memcpy(buf + len, s, sl);
+            len += sl;
+        }
+        text_stats_t want, got;
+        uint64_t want_h = 0, got_h = 0;
+        text_stats_scan_naive(buf, len, &want, hash_token, &want_h);
+        text_stats_scan(buf, len, &got, hash_token, &got_h);
+        if (memcmp(&want, &got, sizeof(want)) != 0 || want_h != got_h) {
+            fprintf(stderr, "%s: mismatch at iteration %d (words %d/%d chars %d/%d letters %d/%d)\n", impl, iter,
+                    got.words, want.words, got.chars, want.chars, got.letters, want.letters);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static double best_gbps(const char *impl, const char *text, size_t len, int mode) {
+    double best = 0;
+    text_terms_t terms = {0};
+    for (int r = 0; r < RUNS; r++) {
+        text_stats_t st;
+        uint64_t h = 0;
+        double t0 = now_sec();
+        if (mode == 2) {
+            for (size_t off = 0; off < len; off += SESSION_BYTES) {
+                size_t n = len - off < SESSION_BYTES ? len - off : SESSION_BYTES;
+                text_terms_reset(&terms);
+                scan(impl, text + off, n, &st, text_terms_add, &terms);
+            }
+        } else {
+            scan(impl, text, len, &st, mode ? hash_token : NULL, &h);
+        }
+        double secs = now_sec() - t0;
+        double gbps = (double)len / secs / 1e9;
+        if (gbps > best) best = gbps;
+    }
+    text_terms_free(&terms);
+    return best;
+}
+
+int main(void) {
+    char *text = make_corpus(CORPUS_BYTES);
+    printf("corpus: %u MB, default implementation: %s\n", CORPUS_BYTES >> 20, text_stats_impl());
+    printf("%-8s %10s %10s %10s\n", "impl", "counts", "tokens", "terms");
+    double naive[3] = {0, 0, 0};
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        const char *impl = impls[i];
+        if (strcmp(impl, "naive") != 0) {
+            if (text_stats_set_impl(impl) != 0) {
+                printf("%-8s %10s\n", impl, "n/a");
+                continue;
+            }
+            if (verify(impl) != 0) return 1;
+        }
+        double g[3];
+        for (int mode = 0; mode < 3; mode++) g[mode] = best_gbps(impl, text, CORPUS_BYTES, mode);
+        if (i == 0) memcpy(naive, g, sizeof(naive));
+        printf("%-8s %7.2f GB/s %5.2f GB/s %5.2f GB/s  (%.1fx / %.1fx / %.1fx vs naive)\n", impl, g[0], g[1], g[2],
+               g[0] / naive[0], g[1] / naive[1], g[2] / naive[2]);
+    }
+    free(text);
+    return 0;
+}
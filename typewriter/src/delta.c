@@ -0,0 +1,173 @@
+#include "delta.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROLL_MUL 0x01000193u
+#define DELTA_MAX_TARGET (1u << 30)
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} delta_buf_t;
+
+static void buf_put(delta_buf_t *b, const void *data, size_t len) {
+    if (b->failed || len == 0) return;
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len) cap *= 2;
+        unsigned char *n = realloc(b->data, cap);
+        if (!n) {
+            b->failed = 1;
+            return;
+        }
+        b->data = n;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void buf_varint(delta_buf_t *b, uint64_t v) {
+    unsigned char tmp[10];
+    size_t n = 0;
+    do {
+        unsigned char c = v & 0x7f;
+        v >>= 7;
+        tmp[n++] = c | (v ? 0x80 : 0);
+    } while (v);
+    buf_put(b, tmp, n);
+}
+
+static void emit_insert(delta_buf_t *b, const char *data, size_t len) {
+    if (len == 0) return;
+    buf_varint(b, (uint64_t)len << 1);
+    buf_put(b, data, len);
+}
+
+static void emit_copy(delta_buf_t *b, size_t offset, size_t len) {
+    if (len == 0) return;
+    buf_varint(b, (uint64_t)len << 1 | 1);
+    buf_varint(b, offset);
+}
+
+// Polynomial hash of DELTA_BLOCK bytes that can be rolled one byte forward.
+static uint32_t block_hash(const unsigned char *p) {
+    uint32_t h = 0;
+    for (int i = 0; i < DELTA_BLOCK; i++) h = h * ROLL_MUL + p[i];
+    return h;
+}
+
+static uint32_t slot_of(uint32_t h, int bits) {
+    return (h * 0x9E3779B1u) >> (32 - bits);
+}
+
+int delta_encode(const char *base, size_t base_len, const char *target, size_t target_len, char **out,
+                 size_t *out_len) {
+    const unsigned char *b = (const unsigned char *)base;
+    const unsigned char *t = (const unsigned char *)target;
+    delta_buf_t buf = {0};
+    buf_varint(&buf, target_len);
+
+    size_t limit = base_len < target_len ? base_len : target_len;
+    size_t prefix = 0;
+    while (prefix < limit && b[prefix] == t[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < limit - prefix && b[base_len - 1 - suffix] == t[target_len - 1 - suffix]) suffix++;
+    emit_copy(&buf, 0, prefix);
+
+    // Aligned blocks of the base, by hash; a slot keeps the last block that landed in it.
+    size_t nblocks = base_len / DELTA_BLOCK;
+    int bits = 6;
+    while (bits < 30 && ((size_t)1 << bits) < nblocks * 2) bits++;
+    uint32_t *table = NULL;
+    size_t end = target_len - suffix;
+    if (nblocks > 0 && end - prefix >= DELTA_BLOCK) {
+        table = calloc((size_t)1 << bits, sizeof(*table));
+        if (!table) buf.failed = 1;
+    }
+    size_t lit = prefix;
+    if (table) {
+        for (size_t i = 0; i < nblocks; i++) table[slot_of(block_hash(b + i * DELTA_BLOCK), bits)] = (uint32_t)i + 1;
+        uint32_t top = 1; // ROLL_MUL^(DELTA_BLOCK-1), the weight of the byte leaving the window
+        for (int i = 1; i < DELTA_BLOCK; i++) top *= ROLL_MUL;
+        size_t i = prefix;
+        uint32_t h = block_hash(t + i);
+        while (i + DELTA_BLOCK <= end) {
+            uint32_t slot = table[slot_of(h, bits)];
+            size_t pos = slot ? (size_t)(slot - 1) * DELTA_BLOCK : 0;
+            if (slot && memcmp(b + pos, t + i, DELTA_BLOCK) == 0) {
+                size_t s = i, bs = pos;
+                while (s > lit && bs > 0 && t[s - 1] == b[bs - 1]) s--, bs--;
+                size_t e = i + DELTA_BLOCK, be = pos + DELTA_BLOCK;
+                while (e < end && be < base_len && t[e] == b[be]) e++, be++;
+                emit_insert(&buf, target + lit, s - lit);
+                emit_copy(&buf, bs, e - s);
+                i = lit = e;
+                if (i + DELTA_BLOCK <= end) h = block_hash(t + i);
+                continue;
+            }
+            if (i + DELTA_BLOCK == end) break;
+            h = (h - t[i] * top) * ROLL_MUL + t[i + DELTA_BLOCK];
+            i++;
+        }
+        free(table);
+    }
+    emit_insert(&buf, target + lit, end - lit);
+    emit_copy(&buf, base_len - suffix, suffix);
+    if (buf.failed) {
+        free(buf.data);
+        return -1;
+    }
+    *out = (char *)buf.data;
+    *out_len = buf.len;
+    return 0;
+}
+
+static int read_varint(const unsigned char **p, const unsigned char *end, uint64_t *out) {
+    uint64_t v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char c = *(*p)++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int delta_apply(const char *base, size_t base_len, const void *delta, size_t delta_len, char **out, size_t *out_len) {
+    const unsigned char *p = delta;
+    const unsigned char *end = p + delta_len;
+    uint64_t target_len;
+    if (read_varint(&p, end, &target_len) != 0 || target_len > DELTA_MAX_TARGET) return -1;
+    char *t = malloc((size_t)target_len + 1);
+    if (!t) return -1;
+    size_t pos = 0;
+    while (p < end) {
+        uint64_t op, off;
+        if (read_varint(&p, end, &op) != 0) break;
+        size_t len = (size_t)(op >> 1);
+        if (len > target_len - pos) break;
+        if (op & 1) {
+            if (read_varint(&p, end, &off) != 0 || off > base_len || len > base_len - off) break;
+            memcpy(t + pos, base + off, len);
+        } else {
+            if (len > (size_t)(end - p)) break;
+            memcpy(t + pos, p, len);
+            p += len;
+        }
+        pos += len;
+    }
+    if (p != end || pos != target_len) {
+        free(t);
+        return -1;
+    }
+    t[pos] = '\0';
+    *out = t;
+    *out_len = pos;
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+
+// Binary delta of a target against a base: a varint target length followed by ops, each a
+// varint (len << 1 | copy) and then either a varint base offset (copy) or len literal bytes
+// (insert). The encoder matches runs of at least DELTA_BLOCK bytes through a hash of the
+// base's aligned blocks, after trimming the common prefix and suffix, so edits in the middle
+// or appended text cost little more than the bytes that changed. Applying is a single pass.
+#define DELTA_BLOCK 16
+
+// *out is malloc'ed. Returns 0 or -1.
+int delta_encode(const char *base, size_t base_len, const char *target, size_t target_len, char **out,
+                 size_t *out_len);
+// *out is malloc'ed and NUL-terminated. Returns 0, or -1 for a delta that does not fit base.
+int delta_apply(const char *base, size_t base_len, const void *delta, size_t delta_len, char **out, size_t *out_len);
+
+#endif // DELTA_H
@@ -0,0 +1,144 @@
+#include "export.h"
+#include "shard.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define EXPORT_BUF_BYTES (1u << 20)
+
+typedef struct {
+    FILE *out;
+    export_format_t format;
+    char *buf;
+    size_t len;
+    int failed;
+    long long rows;
+    long long bytes;
+} export_ctx_t;
+
+static void flush_buf(export_ctx_t *x) {
+    if (x->len && fwrite(x->buf, 1, x->len, x->out) != x->len) x->failed = 1;
+    x->bytes += (long long)x->len;
+    x->len = 0;
+}
+
+// Appends to the output buffer; anything at least as large as the buffer goes straight out.
+static void put(export_ctx_t *x, const void *data, size_t n) {
+    if (n > EXPORT_BUF_BYTES - x->len) {
+        flush_buf(x);
+        if (n >= EXPORT_BUF_BYTES) {
+            if (fwrite(data, 1, n, x->out) != n) x->failed = 1;
+            x->bytes += (long long)n;
+            return;
+        }
+    }
+    memcpy(x->buf + x->len, data, n);
+    x->len += n;
+}
+
+// Writes s as a JSON string; runs without characters to escape are copied in one piece.
+static void put_json_string(export_ctx_t *x, const char *s, size_t n) {
+    put(x, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        put(x, s + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"':
+            put(x, "\\\"", 2);
+            break;
+        case '\\':
+            put(x, "\\\\", 2);
+            break;
+        case '\n':
+            put(x, "\\n", 2);
+            break;
+        case '\r':
+            put(x, "\\r", 2);
+            break;
+        case '\t':
+            put(x, "\\t", 2);
+            break;
+        default: {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            put(x, esc, 6);
+        }
+        }
+    }
+    put(x, s + start, n - start);
+    put(x, "\"", 1);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static int write_row(void *userdata, const store_row_t *row) {
+    export_ctx_t *x = userdata;
+    if (x->format == EXPORT_BINARY) {
+        unsigned char hdr[20];
+        put_u32(hdr, (uint32_t)row->id);
+        put_u32(hdr + 4, (uint32_t)row->word_count);
+        put_u32(hdr + 8, (uint32_t)row->char_count);
+        put_u32(hdr + 12, (uint32_t)row->letter_count);
+        put_u32(hdr + 16, (uint32_t)row->created_at_len);
+        put(x, hdr, sizeof(hdr));
+        put(x, row->created_at, row->created_at_len);
+        put_u32(hdr, (uint32_t)row->text_len);
+        put(x, hdr, 4);
+        put(x, row->text, row->text_len);
+    } else {
+        char head[128];
+        int n = snprintf(head, sizeof(head), "{\"id\":%d,\"created_at\":", row->id);
+        put(x, head, (size_t)n);
+        put_json_string(x, row->created_at, row->created_at_len);
+        n = snprintf(head, sizeof(head), ",\"word_count\":%d,\"char_count\":%d,\"letter_count\":%d,\"text\":",
+                     row->word_count, row->char_count, row->letter_count);
+        put(x, head, (size_t)n);
+        put_json_string(x, row->text, row->text_len);
+        put(x, "}\n", 2);
+    }
+    x->rows++;
+    return x->failed ? -1 : 0;
+}
+
+int export_run(const char *db_path, const export_config_t *cfg, FILE *out) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    export_ctx_t x = {.out = out, .format = cfg->format, .buf = malloc(EXPORT_BUF_BYTES)};
+    if (!x.buf) return -1;
+    session_store_t store = {0};
+    if (session_store_open_reader(&store, db_path) != 0) {
+        free(x.buf);
+        return -1;
+    }
+    shard_reader_t shards;
+    if (shard_reader_open(&shards, &store, db_path, 0) != 0) {
+        session_store_close(&store);
+        free(x.buf);
+        return -1;
+    }
+    if (cfg->format == EXPORT_BINARY) put(&x, "TWX1", 4);
+    int rc = shard_reader_scan(&shards, &cfg->range, write_row, &x);
+    flush_buf(&x);
+    if (fflush(out) != 0) x.failed = 1;
+    shard_reader_close(&shards);
+    session_store_close(&store);
+    free(x.buf);
+    if (x.failed) {
+        fprintf(stderr, "Export: Schreiben fehlgeschlagen\n");
+        rc = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "Export: %lld Sessions, %.1f MB in %.2fs (%.1f MB/s)\n", x.rows, x.bytes / (1024.0 * 1024.0),
+            secs, secs > 0 ? x.bytes / (1024.0 * 1024.0) / secs : 0.0);
+    return rc;
+}
@@ -0,0 +1,22 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "session_store.h"
+#include <stdio.h>
+
+typedef enum {
+    EXPORT_NDJSON, // one JSON object per line, same fields as the API
+    EXPORT_BINARY  // "TWX1", then per session: u32 id, word_count, char_count, letter_count,
+                   // u32 length + created_at, u32 length + text (integers big-endian)
+} export_format_t;
+
+typedef struct {
+    export_format_t format;
+    store_range_t range;
+} export_config_t;
+
+// Streams the sessions in cfg->range from the store at db_path and its sealed shards to out over
+// read-only connections, shard by shard from the oldest year on, each in id order. Returns 0 or -1.
+int export_run(const char *db_path, const export_config_t *cfg, FILE *out);
+
+#endif // EXPORT_H
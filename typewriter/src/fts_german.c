@@ -0,0 +1,101 @@
+#include "fts_german.h"
+#include "stem.h"
+#include <string.h>
+
+// A tokenizer instance: unicode61 underneath, which does the splitting and folding.
+typedef struct {
+    fts5_tokenizer base;
+    Fts5Tokenizer *base_tok;
+    stem_cache_t cache;
+} german_tokenizer_t;
+
+typedef struct {
+    german_tokenizer_t *tok;
+    void *ctx;
+    int (*emit)(void *ctx, int flags, const char *token, int len, int start, int end);
+} token_ctx_t;
+
+// Gets each token from unicode61, already lowercased and without diacritics; offsets stay
+// those of the original text, so snippets and highlights mark the word as written.
+static int on_token(void *arg, int flags, const char *token, int len, int start, int end) {
+    token_ctx_t *c = arg;
+    if (len > STEM_MAX_WORD) return c->emit(c->ctx, flags, token, len, start, end);
+    // ß (U+00DF) and ẞ (U+1E9E) become "ss", which is never longer.
+    char folded[STEM_MAX_WORD];
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        const unsigned char *b = (const unsigned char *)token + i;
+        if (b[0] == 0xC3 && i + 1 < len && b[1] == 0x9F) {
+            i += 1;
+        } else if (b[0] == 0xE1 && i + 2 < len && b[1] == 0xBA && b[2] == 0x9E) {
+            i += 2;
+        } else {
+            folded[n++] = (char)b[0];
+            continue;
+        }
+        folded[n++] = 's';
+        folded[n++] = 's';
+    }
+    // Prefix query terms are stemmed too: the index only holds stems, and a word's stem is never
+    // longer than the word, so "lieben*" looks for "lieb*" and still finds "lieben" and "liebe".
+    char stem[STEM_MAX_WORD];
+    size_t k = stem_cached(&c->tok->cache, folded, (size_t)n, stem);
+    if (k > 0) return c->emit(c->ctx, flags, stem, (int)k, start, end);
+    return c->emit(c->ctx, flags, folded, n, start, end);
+}
+
+static int german_create(void *userdata, const char **args, int nargs, Fts5Tokenizer **out) {
+    fts5_api *api = userdata;
+    german_tokenizer_t *t = sqlite3_malloc64(sizeof(*t));
+    const char **base_args = sqlite3_malloc64(sizeof(*base_args) * (size_t)(nargs + 2));
+    if (!t || !base_args) {
+        sqlite3_free(t);
+        sqlite3_free(base_args);
+        return SQLITE_NOMEM;
+    }
+    memset(t, 0, sizeof(*t));
+    base_args[0] = "remove_diacritics";
+    base_args[1] = "2";
+    for (int i = 0; i < nargs; i++) base_args[i + 2] = args[i];
+    void *base_userdata = NULL;
+    int rc = api->xFindTokenizer(api, "unicode61", &base_userdata, &t->base);
+    if (rc == SQLITE_OK) rc = t->base.xCreate(base_userdata, base_args, nargs + 2, &t->base_tok);
+    sqlite3_free(base_args);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(t);
+        return rc;
+    }
+    *out = (Fts5Tokenizer *)t;
+    return SQLITE_OK;
+}
+
+static void german_delete(Fts5Tokenizer *tok) {
+    german_tokenizer_t *t = (german_tokenizer_t *)tok;
+    if (!t) return;
+    t->base.xDelete(t->base_tok);
+    sqlite3_free(t);
+}
+
+static int german_tokenize(Fts5Tokenizer *tok, void *ctx, int flags, const char *text, int len,
+                           int (*emit)(void *ctx, int flags, const char *token, int len, int start, int end)) {
+    german_tokenizer_t *t = (german_tokenizer_t *)tok;
+    token_ctx_t c = {t, ctx, emit};
+    return t->base.xTokenize(t->base_tok, &c, flags, text, len, on_token);
+}
+
+static fts5_api *fts5_api_of(sqlite3 *db) {
+    fts5_api *api = NULL;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT fts5(?1);", -1, &stmt, NULL) != SQLITE_OK) return NULL;
+    sqlite3_bind_pointer(stmt, 1, &api, "fts5_api_ptr", NULL);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return api;
+}
+
+int fts_german_register(sqlite3 *db) {
+    fts5_api *api = fts5_api_of(db);
+    if (!api) return -1;
+    fts5_tokenizer t = {german_create, german_delete, german_tokenize};
+    return api->xCreateTokenizer(api, "tw_german", api, &t, NULL) == SQLITE_OK ? 0 : -1;
+}
@@ -0,0 +1,13 @@
+#ifndef FTS_GERMAN_H
+#define FTS_GERMAN_H
+
+#include <sqlite3.h>
+
+// Registers the FTS5 tokenizer "tw_german" on db. It splits text like unicode61 (extra arguments
+// are passed on to it) with case and diacritics folded, so "Häuser" and "HAUSER" read "hauser";
+// ß becomes "ss", and every word of ASCII letters is reduced to its stem (see stem_german), so
+// "Häuser", "Hauses" and "Haus" are one index entry. Prefix query terms are stemmed as well, so
+// "Häuser*" looks for "haus*". Each tokenizer instance keeps a stem cache (stem_cache_t).
+int fts_german_register(sqlite3 *db);
+
+#endif // FTS_GERMAN_H
@@ -0,0 +1,280 @@
+#include "history.h"
+#include "typewriter_api.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HISTORY_PAGE 100
+#define HISTORY_MAX_CONCURRENCY 32
+
+enum { DOC_WAITING, DOC_BUSY, DOC_DONE };
+
+typedef struct {
+    int document_id;
+    int have;    // versions stored
+    int head_id; // session of the newest stored version
+    int offset;  // of the page in flight
+    int attempt;
+    int state;
+    double due; // when a failed page may be requested again
+} history_doc_t;
+
+// Documents that need another page or a retry wait in `ready`; there are never more of them
+// than requests in flight.
+typedef struct {
+    session_store_t *store;
+    http_client_t *client;
+    int retries;
+    history_doc_t *ready[HISTORY_MAX_CONCURRENCY];
+    int nready;
+    int failed;   // documents given up on until the next sync
+    int db_error;
+    long long versions;
+    long long stored;
+    long long full;
+} history_ctx_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void doc_finish(history_ctx_t *ctx, history_doc_t *d) {
+    d->state = DOC_DONE;
+    if (session_store_document_synced(ctx->store, d->document_id) != 0) ctx->db_error = 1;
+}
+
+static void doc_wait(history_ctx_t *ctx, history_doc_t *d, double due) {
+    d->state = DOC_WAITING;
+    d->due = due;
+    ctx->ready[ctx->nready++] = d;
+}
+
+// A page of versions, oldest first. Every page after the first stored version starts with the
+// newest one already stored; if that no longer matches, the server's history was rewritten.
+static void on_versions(history_ctx_t *ctx, history_doc_t *d, const session_t *v, size_t n, int total) {
+    size_t skip = 0;
+    if (d->have > 0) {
+        if (n == 0 || v[0].id != d->head_id) {
+            if (session_store_drop_versions(ctx->store, d->document_id) != 0) {
+                ctx->db_error = 1;
+                return;
+            }
+            d->have = d->head_id = 0;
+            doc_wait(ctx, d, 0);
+            return;
+        }
+        skip = 1;
+    }
+    if (n > skip) {
+        if (session_store_add_versions(ctx->store, d->document_id, v + skip, n - skip, &ctx->stored) != 0) {
+            fprintf(stderr, "DB Fehler bei Dokument %d: %s\n", d->document_id, sqlite3_errmsg(ctx->store->db));
+            ctx->db_error = 1;
+            return;
+        }
+        for (size_t i = skip; i < n; i++) ctx->full += (long long)strlen(v[i].text);
+        ctx->versions += (long long)(n - skip);
+        d->have += (int)(n - skip);
+        d->head_id = v[n - 1].id;
+    }
+    d->attempt = 0;
+    if (n == skip || d->offset + (int)n >= total) doc_finish(ctx, d);
+    else doc_wait(ctx, d, 0);
+}
+
+static void on_page_done(void *arg, void *userdata, int rc, long status, http_buffer_t *body,
+                         const http_timing_t *timing) {
+    history_ctx_t *ctx = arg;
+    history_doc_t *d = userdata;
+    if (ctx->db_error) {
+        d->state = DOC_WAITING;
+        return;
+    }
+    session_t *v = NULL;
+    size_t n = 0;
+    pagination_t pg = {0};
+    if (rc == 0 && status == 200 && body->data && api_parse_sessions_page(body->data, &v, &n, &pg) == 0) {
+        on_versions(ctx, d, v, n, pg.total);
+        sessions_free(v, n);
+        return;
+    }
+    // The document is gone on the server: nothing left to mirror.
+    if (rc == 0 && status == 404) {
+        doc_finish(ctx, d);
+        return;
+    }
+    int retry = status == 200 || http_should_retry(rc, status);
+    if (retry && ++d->attempt < ctx->retries && !http_budget_exhausted(ctx->client)) {
+        long wait_ms = http_backoff_ms(ctx->client, d->attempt, timing->retry_after_ms);
+        doc_wait(ctx, d, now_sec() + wait_ms / 1000.0);
+        return;
+    }
+    fprintf(stderr, "API Fehler bei Dokument %d (HTTP %ld), Versionen übersprungen\n", d->document_id, status);
+    d->state = DOC_DONE;
+    ctx->failed++;
+}
+
+static int queue_page(http_multi_t *multi, history_doc_t *d) {
+    d->offset = d->have > 0 ? d->have - 1 : 0;
+    d->state = DOC_BUSY;
+    return api_queue_versions_page(multi, d->document_id, HISTORY_PAGE, d->offset, d);
+}
+
+int history_sync(http_client_t *client, session_store_t *store, int concurrency) {
+    doc_ref_t *refs = NULL;
+    size_t len = 0;
+    if (session_store_pending_documents(store, &refs, &len) != 0) {
+        fprintf(stderr, "DB Fehler: %s\n", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    if (len == 0) return 0;
+    if (concurrency < 1) concurrency = 1;
+    if (concurrency > HISTORY_MAX_CONCURRENCY) concurrency = HISTORY_MAX_CONCURRENCY;
+    history_doc_t *docs = calloc(len, sizeof(*docs));
+    http_multi_t *multi = docs ? http_multi_new(client) : NULL;
+    if (!multi) {
+        free(docs);
+        free(refs);
+        return -1;
+    }
+    history_ctx_t ctx = {.store = store, .client = client, .retries = client->retries > 0 ? client->retries : 1};
+    for (size_t i = 0; i < len; i++) {
+        docs[i].document_id = refs[i].document_id;
+        if (session_store_doc_head(store, docs[i].document_id, &docs[i].have, &docs[i].head_id) < 0) ctx.db_error = 1;
+    }
+    free(refs);
+    printf("Hole Versionen von %zu Dokumenten...\n", len);
+    double started = now_sec();
+
+    size_t next = 0;
+    int stop = 0; // request budget used up or a DB error: drain what is in flight
+    while (1) {
+        stop = stop || ctx.db_error;
+        double now = now_sec();
+        double wake = 0;
+        int i = 0;
+        while (!stop && i < ctx.nready) {
+            history_doc_t *d = ctx.ready[i];
+            if (d->due > now) {
+                if (wake == 0 || d->due < wake) wake = d->due;
+                i++;
+                continue;
+            }
+            ctx.ready[i] = ctx.ready[--ctx.nready];
+            if (queue_page(multi, d) != 0) {
+                d->state = DOC_WAITING;
+                stop = 1;
+            }
+        }
+        while (!stop && next < len && http_multi_inflight(multi) + ctx.nready < concurrency) {
+            if (queue_page(multi, &docs[next]) != 0) {
+                docs[next].state = DOC_WAITING;
+                stop = 1;
+            } else {
+                next++;
+            }
+        }
+        if (http_multi_inflight(multi) == 0 && (stop || (ctx.nready == 0 && next == len))) break;
+        int timeout_ms = 1000;
+        if (wake > 0 && wake - now < 1.0) timeout_ms = (int)((wake - now) * 1000) + 1;
+        if (http_multi_inflight(multi) > 0) {
+            if (http_multi_poll(multi, timeout_ms, on_page_done, &ctx) != 0) stop = 1;
+        } else {
+            struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+    }
+    http_multi_free(multi);
+    size_t left = 0;
+    for (size_t i = 0; i < len; i++) left += docs[i].state != DOC_DONE;
+    free(docs);
+
+    double elapsed = now_sec() - started;
+    printf("Versionen fertig: %lld neue Versionen in %.2fs, %.1f KB gespeichert (%.1f KB als Volltext)\n",
+           ctx.versions, elapsed, ctx.stored / 1024.0, ctx.full / 1024.0);
+    if (left > 0 && http_budget_exhausted(client)) {
+        fprintf(stderr, "Request-Budget von %ld Requests aufgebraucht.\n", client->max_requests);
+    }
+    if ((left > 0 || ctx.failed > 0) && !ctx.db_error) {
+        fprintf(stderr, "Versionen unvollständig: %zu Dokumente offen. Ein erneuter Aufruf von sync holt sie nach.\n",
+                left + (size_t)ctx.failed);
+    }
+    return ctx.db_error || left > 0 || ctx.failed > 0 ? -1 : 0;
+}
+
+typedef struct {
+    doc_version_t *items;
+    size_t len;
+    size_t cap;
+} version_list_t;
+
+static int collect_version(void *userdata, const doc_version_t *v) {
+    version_list_t *l = userdata;
+    if (l->len == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        doc_version_t *items = realloc(l->items, cap * sizeof(*items));
+        if (!items) return -1;
+        l->items = items;
+        l->cap = cap;
+    }
+    l->items[l->len] = *v;
+    l->items[l->len].created_at = strdup(v->created_at ? v->created_at : "");
+    if (!l->items[l->len].created_at) return -1;
+    l->len++;
+    return 0;
+}
+
+static void version_list_free(version_list_t *l) {
+    for (size_t i = 0; i < l->len; i++) free((char *)l->items[i].created_at);
+    free(l->items);
+}
+
+static int print_version(session_store_t *store, int document_id, const version_list_t *l, int at, FILE *out) {
+    const doc_version_t *v = &l->items[at - 1];
+    char *text = NULL;
+    size_t len = 0;
+    int rc = session_store_doc_text(store, document_id, at, &text, &len);
+    if (rc != 0) {
+        fprintf(stderr, "Version %d von Dokument %d nicht lesbar: %s\n", at, document_id, sqlite3_errmsg(store->db));
+        return -1;
+    }
+    fprintf(out, "Dokument #%d, Version %d/%zu: Session #%d (%s)\n%s\n", document_id, at, l->len, v->session_id,
+            v->created_at, text);
+    free(text);
+    return 0;
+}
+
+int history_run(session_store_t *store, int document_id, int at, FILE *out) {
+    version_list_t l = {0};
+    if (session_store_doc_versions(store, document_id, collect_version, &l) != 0) {
+        fprintf(stderr, "DB Fehler: %s\n", sqlite3_errmsg(store->db));
+        version_list_free(&l);
+        return -1;
+    }
+    int rc = 0;
+    if (l.len == 0) {
+        fprintf(stderr, "Dokument %d hat keine gespeicherten Versionen\n", document_id);
+        rc = 1;
+    } else if (at > 0 && (size_t)at > l.len) {
+        fprintf(stderr, "Version %d nicht gefunden, Dokument %d hat %zu\n", at, document_id, l.len);
+        rc = 1;
+    } else if (at > 0) {
+        rc = print_version(store, document_id, &l, at, out);
+    } else {
+        long long stored = 0, size = 0;
+        for (size_t i = 0; i < l.len; i++) {
+            stored += l.items[i].stored;
+            size += l.items[i].size;
+        }
+        fprintf(out, "Dokument #%d: %zu Versionen, %.1f KB gespeichert (%.1f KB als Volltext)\n", document_id, l.len,
+                stored / 1024.0, size / 1024.0);
+        for (size_t i = 0; i < l.len; i++) {
+            const doc_version_t *v = &l.items[i];
+            fprintf(out, "%5d  #%-8d %s %6d Wörter %8lld B  %s %lld B\n", v->version, v->session_id, v->created_at,
+                    v->word_count, v->size, v->keyframe == v->version ? "voll " : "Delta", v->stored);
+        }
+    }
+    version_list_free(&l);
+    return rc;
+}
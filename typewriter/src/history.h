@@ -0,0 +1,19 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "http_client.h"
+#include "session_store.h"
+#include <stdio.h>
+
+// Fetches the versions of every document sync queued (session_store_queue_documents), up to
+// concurrency documents at a time, and appends them to the store as deltas (see
+// session_store_add_versions). Versions already stored are not fetched again: each document
+// resumes one version before its newest, which must still match, or else is fetched from the
+// start. Documents that fail stay queued for the next run. Returns 0 or -1.
+int history_sync(http_client_t *client, session_store_t *store, int concurrency);
+
+// Lists the stored versions of a document, or with at > 0 prints version at. Returns 0, 1 when
+// the document or version is unknown, or -1.
+int history_run(session_store_t *store, int document_id, int at, FILE *out);
+
+#endif // HISTORY_H
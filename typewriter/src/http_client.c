@@ -1,11 +1,32 @@
 #include "http_client.h"
 #include <curl/curl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-static size_t write_cb(void *contents, size_t size, size_t nmemb, void *userp) {
+// A Retry-After beyond this is treated as a typo rather than waited out.
+#define HTTP_RETRY_AFTER_MAX_MS 300000L
+
+typedef struct {
+    http_write_fn fn;
+    void *userdata;
+    CURL *curl;
+} http_sink_t;
+
+// Only 2xx bodies reach the sink; error pages are dropped so the caller gets to see the status.
+static size_t stream_cb(char *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    http_sink_t *sink = userp;
+    long status = 0;
+    curl_easy_getinfo(sink->curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status < 200 || status >= 300) return realsize;
+    return sink->fn(sink->userdata, contents, realsize) == 0 ? realsize : 0;
+}
+
+static size_t write_cb(char *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
     http_buffer_t *mem = (http_buffer_t *)userp;
     char *ptr = realloc(mem->data, mem->len + realsize + 1);
@@ -17,74 +38,451 @@ static size_t write_cb(void *contents, size_t size, size_t nmemb, void *userp) {
     return realsize;
 }
 
+// Connection, DNS and TLS session caches outlive single requests: easy handles are
+// pooled (curl_easy_reset keeps their caches) and all of them share one CURLSH.
+struct http_shared {
+    CURLSH *share;
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+    pthread_mutex_t pool_mu;
+    CURL *pool[HTTP_POOL_SIZE];
+    int pool_len;
+    struct curl_slist *headers;
+};
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle;
+    (void)access;
+    http_shared_t *sh = userptr;
+    pthread_mutex_lock(&sh->locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    http_shared_t *sh = userptr;
+    pthread_mutex_unlock(&sh->locks[data]);
+}
+
+static struct curl_slist *build_headers(const http_client_t *client) {
+    struct curl_slist *headers = NULL;
+    if (client->api_key && strlen(client->api_key) > 0) {
+        char header[256];
+        snprintf(header, sizeof(header), "x-api-key: %s", client->api_key);
+        headers = curl_slist_append(headers, header);
+    }
+    return headers;
+}
+
+// curl_global_init and curl_global_cleanup are not thread-safe, so libcurl is set up once per
+// process on the first client and torn down only by http_global_cleanup.
+static pthread_once_t global_once = PTHREAD_ONCE_INIT;
+static int global_ok;
+
+static void global_init(void) {
+    global_ok = curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK;
+}
+
+void http_global_cleanup(void) {
+    if (!global_ok) return;
+    curl_global_cleanup();
+    global_ok = 0;
+}
+
 int http_client_init(http_client_t *client, const char *base_url, const char *api_key) {
     if (!client || !base_url) return -1;
     memset(client, 0, sizeof(*client));
+    pthread_once(&global_once, global_init);
+    if (!global_ok) return -1;
     client->base_url = strdup(base_url);
     client->api_key = api_key ? strdup(api_key) : NULL;
     client->timeout_ms = 15000;
-    client->retries = 3;
+    client->retries = 5;
+    client->backoff_base_ms = 200;
+    client->backoff_max_ms = 10000;
+    client->jitter_seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)client;
+
+    http_shared_t *sh = calloc(1, sizeof(*sh));
+    if (!sh || !client->base_url || (api_key && !client->api_key)) {
+        free(sh);
+        free(client->base_url);
+        free(client->api_key);
+        client->base_url = NULL;
+        client->api_key = NULL;
+        return -1;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_init(&sh->locks[i], NULL);
+    pthread_mutex_init(&sh->pool_mu, NULL);
+    sh->share = curl_share_init();
+    if (sh->share) {
+        curl_share_setopt(sh->share, CURLSHOPT_LOCKFUNC, share_lock);
+        curl_share_setopt(sh->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+        curl_share_setopt(sh->share, CURLSHOPT_USERDATA, sh);
+        curl_share_setopt(sh->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(sh->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(sh->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+    sh->headers = build_headers(client);
+    client->shared = sh;
     return 0;
 }
 
 void http_client_cleanup(http_client_t *client) {
     if (!client) return;
+    http_shared_t *sh = client->shared;
+    if (sh) {
+        for (int i = 0; i < sh->pool_len; i++) curl_easy_cleanup(sh->pool[i]);
+        if (sh->share) curl_share_cleanup(sh->share);
+        curl_slist_free_all(sh->headers);
+        for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_destroy(&sh->locks[i]);
+        pthread_mutex_destroy(&sh->pool_mu);
+        free(sh);
+        client->shared = NULL;
+    }
     free(client->base_url);
     free(client->api_key);
 }
 
-static void backoff_sleep(int attempt) {
-    int ms = 100 * (1 << attempt);
+static CURL *handle_acquire(http_client_t *client) {
+    http_shared_t *sh = client->shared;
+    CURL *curl = NULL;
+    pthread_mutex_lock(&sh->pool_mu);
+    if (sh->pool_len > 0) curl = sh->pool[--sh->pool_len];
+    pthread_mutex_unlock(&sh->pool_mu);
+    if (curl) {
+        curl_easy_reset(curl);
+        return curl;
+    }
+    return curl_easy_init();
+}
+
+static void handle_release(http_client_t *client, CURL *curl) {
+    http_shared_t *sh = client->shared;
+    pthread_mutex_lock(&sh->pool_mu);
+    if (sh->pool_len < HTTP_POOL_SIZE) {
+        sh->pool[sh->pool_len++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&sh->pool_mu);
+    if (curl) curl_easy_cleanup(curl);
+}
+
+static void read_timing(CURL *curl, http_timing_t *t) {
+    curl_off_t dns = 0, conn = 0, tls = 0, ttfb = 0, total = 0, retry_after = 0, bytes = 0;
+    long conns = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &conn);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &conns);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    t->dns_ms = dns / 1000.0;
+    t->connect_ms = conn / 1000.0;
+    t->tls_ms = tls / 1000.0;
+    t->ttfb_ms = ttfb / 1000.0;
+    t->total_ms = total / 1000.0;
+    t->bytes = (long long)bytes;
+    t->http_version = 0;
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &t->http_version);
+    t->reused = conns == 0;
+    curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+    t->retry_after_ms = retry_after > 0 ? (long)retry_after * 1000 : 0;
+}
+
+static void count_transfer(const http_client_t *client, CURL *curl, int ok, long status, const http_timing_t *t) {
+    metrics_t *m = client->metrics;
+    if (!m) return;
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    metrics_add(m, METRIC_HTTP_REQUESTS, 1);
+    metrics_add(m, METRIC_HTTP_BYTES, (unsigned long long)bytes);
+    if (!ok || status >= 400) metrics_add(m, METRIC_HTTP_ERRORS, 1);
+    if (!t->reused) metrics_add(m, METRIC_HTTP_CONNECTS, 1);
+    metrics_add_ns(m, METRIC_T_HTTP, (long long)(t->total_ms * 1e6));
+    metrics_add_ns(m, METRIC_T_TTFB, (long long)(t->ttfb_ms * 1e6));
+}
+
+int http_should_retry(int rc, long status) {
+    if (rc != 0) return 1;
+    return status == 408 || status == 429 || (status >= 500 && status != 501 && status != 505);
+}
+
+// Jitter keeps parallel transfers that failed together from retrying in lockstep.
+long http_backoff_ms(http_client_t *client, int attempt, long retry_after_ms) {
+    long cap = client->backoff_base_ms > 0 ? client->backoff_base_ms : 1;
+    for (int i = 1; i < attempt && cap < client->backoff_max_ms; i++) cap *= 2;
+    if (client->backoff_max_ms > 0 && cap > client->backoff_max_ms) cap = client->backoff_max_ms;
+    long ms = cap / 2 + (long)(rand_r(&client->jitter_seed) % (cap / 2 + 1));
+    if (retry_after_ms > HTTP_RETRY_AFTER_MAX_MS) retry_after_ms = HTTP_RETRY_AFTER_MAX_MS;
+    return ms > retry_after_ms ? ms : retry_after_ms;
+}
+
+void http_backoff_sleep(http_client_t *client, int attempt, long retry_after_ms) {
+    long ms = http_backoff_ms(client, attempt, retry_after_ms);
     struct timespec req = {ms / 1000, (ms % 1000) * 1000000};
     nanosleep(&req, NULL);
 }
 
-int http_get(http_client_t *client, const char *path, const char *query, http_buffer_t *out_body, long *status_code) {
-    if (!client || !path || !out_body) return -1;
-    CURL *curl = curl_easy_init();
-    if (!curl) return -1;
+int http_budget_take(http_client_t *client) {
+    long n = __atomic_add_fetch(&client->requests, 1, __ATOMIC_RELAXED);
+    if (client->max_requests > 0 && n > client->max_requests) {
+        __atomic_sub_fetch(&client->requests, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return 0;
+}
 
-    char url[2048];
+int http_budget_exhausted(const http_client_t *client) {
+    return client->max_requests > 0 && __atomic_load_n(&client->requests, __ATOMIC_RELAXED) >= client->max_requests;
+}
+
+static void build_url(const http_client_t *client, const char *path, const char *query, char *url, size_t len) {
     if (query && strlen(query) > 0)
-        snprintf(url, sizeof(url), "%s%s?%s", client->base_url, path, query);
+        snprintf(url, len, "%s%s?%s", client->base_url, path, query);
     else
-        snprintf(url, sizeof(url), "%s%s", client->base_url, path);
+        snprintf(url, len, "%s%s", client->base_url, path);
+}
 
-    struct curl_slist *headers = NULL;
-    if (client->api_key && strlen(client->api_key) > 0) {
-        char header[256];
-        snprintf(header, sizeof(header), "x-api-key: %s", client->api_key);
-        headers = curl_slist_append(headers, header);
-    }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+static void setup_easy(const http_client_t *client, CURL *curl, const char *url, curl_write_callback write_fn,
+                       void *write_data) {
+    if (client->shared->share) curl_easy_setopt(curl, CURLOPT_SHARE, client->shared->share);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->shared->headers);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, out_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_fn);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, write_data);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, client->timeout_ms);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, client->timeout_ms);
+}
+
+int http_get(http_client_t *client, const char *path, const char *query, http_buffer_t *out_body, long *status_code) {
+    if (!client || !client->shared || !path || !out_body) return -1;
+    CURL *curl = handle_acquire(client);
+    if (!curl) return -1;
+
+    char url[2048];
+    build_url(client, path, query, url, sizeof(url));
+    setup_easy(client, curl, url, write_cb, out_body);
 
+    // Retries transport errors and retryable statuses; the last response is returned as is.
     int attempt = 0;
-    CURLcode res;
-    do {
-        out_body->data = NULL;
-        out_body->len = 0;
+    CURLcode res = CURLE_OK;
+    long status = 0;
+    out_body->data = NULL;
+    out_body->len = 0;
+    for (;;) {
+        if (http_budget_take(client) != 0) {
+            handle_release(client, curl);
+            return -1;
+        }
         res = curl_easy_perform(curl);
-        if (res == CURLE_OK) break;
-        attempt++;
-        if (attempt < client->retries) backoff_sleep(attempt);
-    } while (attempt < client->retries);
+        read_timing(curl, &client->last_timing);
+        status = 0;
+        if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        count_transfer(client, curl, res == CURLE_OK, status, &client->last_timing);
+        if (!http_should_retry(res == CURLE_OK ? 0 : -1, status) || ++attempt >= client->retries) break;
+        metrics_add(client->metrics, METRIC_HTTP_RETRIES, 1);
+        http_buffer_free(out_body);
+        http_backoff_sleep(client, attempt, client->last_timing.retry_after_ms);
+    }
 
+    handle_release(client, curl);
     if (res != CURLE_OK) {
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+        http_buffer_free(out_body);
         return -1;
     }
+    if (status_code) *status_code = status;
+    return 0;
+}
 
-    if (status_code) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, status_code);
+// Single attempt without retries: whatever the sink consumed cannot be replayed.
+int http_get_stream(http_client_t *client, const char *path, const char *query, http_write_fn fn, void *userdata,
+                    long *status_code) {
+    if (!client || !client->shared || !path || !fn) return -1;
+    if (http_budget_take(client) != 0) return -1;
+    CURL *curl = handle_acquire(client);
+    if (!curl) return -1;
+
+    char url[2048];
+    build_url(client, path, query, url, sizeof(url));
+    http_sink_t sink = {fn, userdata, curl};
+    setup_easy(client, curl, url, stream_cb, &sink);
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status_code) *status_code = status;
+    read_timing(curl, &client->last_timing);
+    count_transfer(client, curl, res == CURLE_OK, status, &client->last_timing);
+    handle_release(client, curl);
+    return res == CURLE_OK ? 0 : -1;
+}
 
+static int events_progress(void *userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    const volatile sig_atomic_t *stop = userp;
+    return stop && *stop ? 1 : 0;
+}
+
+int http_get_events(http_client_t *client, const char *path, http_write_fn fn, void *userdata,
+                    const volatile sig_atomic_t *stop, long *status_code) {
+    if (!client || !client->shared || !path || !fn) return -1;
+    if (http_budget_take(client) != 0) return -1;
+    CURL *curl = handle_acquire(client);
+    if (!curl) return -1;
+
+    char url[2048];
+    build_url(client, path, NULL, url, sizeof(url));
+    http_sink_t sink = {fn, userdata, curl};
+    setup_easy(client, curl, url, stream_cb, &sink);
+    struct curl_slist *headers = build_headers(client);
+    headers = curl_slist_append(headers, "Accept: text/event-stream");
+    headers = curl_slist_append(headers, "Cache-Control: no-cache");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    // Events are small and must not wait in a decompressor's buffer.
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, NULL);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, events_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void *)stop);
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status_code) *status_code = status;
+    read_timing(curl, &client->last_timing);
+    count_transfer(client, curl, res == CURLE_OK, status, &client->last_timing);
+    handle_release(client, curl);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    return res == CURLE_OK ? 0 : -1;
+}
+
+typedef struct http_transfer {
+    CURL *curl;
+    http_buffer_t body;
+    http_sink_t sink;
+    void *userdata;
+    struct http_transfer *prev, *next;
+} http_transfer_t;
+
+struct http_multi {
+    http_client_t *client;
+    CURLM *multi;
+    http_transfer_t *active;
+    int inflight;
+};
+
+http_multi_t *http_multi_new(http_client_t *client) {
+    if (!client || !client->shared) return NULL;
+    http_multi_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->multi = curl_multi_init();
+    if (!m->multi) {
+        free(m);
+        return NULL;
+    }
+    curl_multi_setopt(m->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    m->client = client;
+    return m;
+}
+
+static void transfer_unlink(http_multi_t *m, http_transfer_t *t) {
+    if (t->prev) t->prev->next = t->next;
+    else m->active = t->next;
+    if (t->next) t->next->prev = t->prev;
+    curl_multi_remove_handle(m->multi, t->curl);
+    m->inflight--;
+}
+
+static void transfer_free(http_multi_t *m, http_transfer_t *t) {
+    handle_release(m->client, t->curl);
+    http_buffer_free(&t->body);
+    free(t);
+}
+
+void http_multi_free(http_multi_t *multi) {
+    if (!multi) return;
+    while (multi->active) {
+        http_transfer_t *t = multi->active;
+        transfer_unlink(multi, t);
+        transfer_free(multi, t);
+    }
+    curl_multi_cleanup(multi->multi);
+    free(multi);
+}
+
+int http_multi_add(http_multi_t *multi, const char *path, const char *query, void *userdata) {
+    return http_multi_add_stream(multi, path, query, NULL, NULL, userdata);
+}
+
+// With a sink, the body is handed to fn chunk by chunk instead of being buffered.
+int http_multi_add_stream(http_multi_t *multi, const char *path, const char *query, http_write_fn fn,
+                          void *fn_userdata, void *userdata) {
+    if (!multi || !path) return -1;
+    if (http_budget_take(multi->client) != 0) return -1;
+    http_transfer_t *t = calloc(1, sizeof(*t));
+    if (!t) return -1;
+    t->curl = handle_acquire(multi->client);
+    if (!t->curl) {
+        free(t);
+        return -1;
+    }
+    t->userdata = userdata;
+
+    char url[2048];
+    build_url(multi->client, path, query, url, sizeof(url));
+    if (fn) {
+        t->sink.fn = fn;
+        t->sink.userdata = fn_userdata;
+        t->sink.curl = t->curl;
+        setup_easy(multi->client, t->curl, url, stream_cb, &t->sink);
+    } else {
+        setup_easy(multi->client, t->curl, url, write_cb, &t->body);
+    }
+    curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+    if (curl_multi_add_handle(multi->multi, t->curl) != CURLM_OK) {
+        transfer_free(multi, t);
+        return -1;
+    }
+    t->next = multi->active;
+    if (multi->active) multi->active->prev = t;
+    multi->active = t;
+    multi->inflight++;
+    return 0;
+}
+
+int http_multi_inflight(const http_multi_t *multi) {
+    return multi ? multi->inflight : 0;
+}
+
+int http_multi_poll(http_multi_t *multi, int timeout_ms, http_done_cb cb, void *ctx) {
+    if (!multi) return -1;
+    int running = 0;
+    if (curl_multi_perform(multi->multi, &running) != CURLM_OK) return -1;
+    if (running > 0 && curl_multi_poll(multi->multi, NULL, 0, timeout_ms, NULL) != CURLM_OK) return -1;
+    if (curl_multi_perform(multi->multi, &running) != CURLM_OK) return -1;
+
+    CURLMsg *msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(multi->multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        CURL *curl = msg->easy_handle;
+        CURLcode res = msg->data.result;
+        http_transfer_t *t = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&t);
+        long status = 0;
+        if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        http_timing_t timing;
+        read_timing(curl, &timing);
+        count_transfer(multi->client, curl, res == CURLE_OK, status, &timing);
+        transfer_unlink(multi, t);
+        if (cb) cb(ctx, t->userdata, res == CURLE_OK ? 0 : -1, status, &t->body, &timing);
+        transfer_free(multi, t);
+    }
     return 0;
 }
 
@@ -1,13 +1,40 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
+#include "metrics.h"
+#include <signal.h>
 #include <stddef.h>
 
+#define HTTP_POOL_SIZE 8
+
+typedef struct http_shared http_shared_t;
+
+// Per-request timings in milliseconds, measured from the start of the request.
+typedef struct {
+    double dns_ms;
+    double connect_ms;
+    double tls_ms;
+    double ttfb_ms;
+    double total_ms;
+    long http_version;
+    int reused;
+    long retry_after_ms; // the response's Retry-After, 0 if it had none
+    long long bytes;     // body bytes received
+} http_timing_t;
+
 typedef struct {
     char *base_url;
     char *api_key;
     long timeout_ms;
-    int retries;
+    int retries;          // attempts per request, including the first
+    long backoff_base_ms; // the first retry waits about this long, doubling with each attempt
+    long backoff_max_ms;  // cap for one wait, unless the server's Retry-After asks for more
+    long max_requests;    // request budget over the client's lifetime, 0 for none
+    long requests;        // requests started so far
+    unsigned int jitter_seed;
+    http_shared_t *shared;
+    http_timing_t last_timing;
+    metrics_t *metrics;
 } http_client_t;
 
 typedef struct {
@@ -15,10 +42,48 @@ typedef struct {
     size_t len;
 } http_buffer_t;
 
+// Receives response body chunks as they arrive; return non-zero to abort the transfer.
+typedef int (*http_write_fn)(void *userdata, const char *data, size_t len);
+
 int http_client_init(http_client_t *client, const char *base_url, const char *api_key);
 void http_client_cleanup(http_client_t *client);
+// Releases libcurl's global state, which the first http_client_init sets up. Call it once at
+// exit, after every client on every thread is cleaned up; no client may be created afterwards.
+void http_global_cleanup(void);
 
 int http_get(http_client_t *client, const char *path, const char *query, http_buffer_t *out_body, long *status_code);
+int http_get_stream(http_client_t *client, const char *path, const char *query, http_write_fn fn, void *userdata,
+                    long *status_code);
 void http_buffer_free(http_buffer_t *buf);
+// Long-lived GET for a text/event-stream, without the overall timeout. Returns when the server
+// ends the stream, on a transport error, or about a second after *stop becomes non-zero.
+int http_get_events(http_client_t *client, const char *path, http_write_fn fn, void *userdata,
+                    const volatile sig_atomic_t *stop, long *status_code);
+
+// Whether a failed request is worth repeating: transport errors (rc != 0), 408, 429 and 5xx
+// other than 501/505. Other statuses will not change on a retry.
+int http_should_retry(int rc, long status);
+// Wait before retry number attempt (1-based): between half and all of base * 2^(attempt-1),
+// capped at backoff_max_ms, and never shorter than retry_after_ms.
+long http_backoff_ms(http_client_t *client, int attempt, long retry_after_ms);
+void http_backoff_sleep(http_client_t *client, int attempt, long retry_after_ms);
+// Counts one request against max_requests; -1 (and nothing is counted) once it is used up.
+int http_budget_take(http_client_t *client);
+int http_budget_exhausted(const http_client_t *client);
+
+typedef struct http_multi http_multi_t;
+
+// Called once per finished transfer. The callback may take ownership of body->data
+// (set it to NULL); otherwise the buffer is freed after the callback returns.
+typedef void (*http_done_cb)(void *ctx, void *userdata, int rc, long status, http_buffer_t *body,
+                             const http_timing_t *timing);
+
+http_multi_t *http_multi_new(http_client_t *client);
+void http_multi_free(http_multi_t *multi);
+int http_multi_add(http_multi_t *multi, const char *path, const char *query, void *userdata);
+int http_multi_add_stream(http_multi_t *multi, const char *path, const char *query, http_write_fn fn,
+                          void *fn_userdata, void *userdata);
+int http_multi_inflight(const http_multi_t *multi);
+int http_multi_poll(http_multi_t *multi, int timeout_ms, http_done_cb cb, void *ctx);
 
 #endif // HTTP_CLIENT_H
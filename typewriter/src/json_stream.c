@@ -0,0 +1,246 @@
+#include "json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum { ST_VALUE, ST_STRING, ST_ESCAPE, ST_UNICODE, ST_NUMBER, ST_LITERAL };
+
+void json_stream_init(json_stream_t *js, json_event_cb cb, void *userdata) {
+    memset(js, 0, sizeof(*js));
+    js->cb = cb;
+    js->userdata = userdata;
+}
+
+// Forget all parse state but keep the token buffer for reuse.
+void json_stream_reset(json_stream_t *js) {
+    char *buf = js->buf;
+    size_t cap = js->cap;
+    json_event_cb cb = js->cb;
+    void *userdata = js->userdata;
+    memset(js, 0, sizeof(*js));
+    js->buf = buf;
+    js->cap = cap;
+    js->cb = cb;
+    js->userdata = userdata;
+}
+
+void json_stream_free(json_stream_t *js) {
+    free(js->buf);
+    js->buf = NULL;
+    js->cap = 0;
+    js->len = 0;
+}
+
+static int buf_put(json_stream_t *js, const char *data, size_t n) {
+    if (js->len + n + 1 > js->cap) {
+        size_t cap = js->cap ? js->cap : 256;
+        while (js->len + n + 1 > cap) cap *= 2;
+        char *p = realloc(js->buf, cap);
+        if (!p) return -1;
+        js->buf = p;
+        js->cap = cap;
+    }
+    memcpy(js->buf + js->len, data, n);
+    js->len += n;
+    js->buf[js->len] = '\0';
+    return 0;
+}
+
+static int put_utf8(json_stream_t *js, unsigned int cp) {
+    char out[4];
+    size_t n;
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return buf_put(js, out, n);
+}
+
+static int emit(json_stream_t *js, json_event_t ev, int depth) {
+    if (js->cb && js->cb(js->userdata, ev, js->buf ? js->buf : "", js->len, depth) != 0) {
+        js->error = 1;
+        return -1;
+    }
+    js->len = 0;
+    if (js->buf) js->buf[0] = '\0';
+    return 0;
+}
+
+static int value_done(json_stream_t *js) {
+    if (js->depth == 0) js->done = 1;
+    return 0;
+}
+
+static int end_number(json_stream_t *js) {
+    js->state = ST_VALUE;
+    if (emit(js, JSON_NUMBER, js->depth) != 0) return -1;
+    return value_done(js);
+}
+
+static int handle_value_char(json_stream_t *js, char c) {
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case ':':
+        return 0;
+    case ',':
+        if (js->depth > 0 && js->stack[js->depth - 1] == '{') js->expect_key = 1;
+        return 0;
+    case '{':
+    case '[':
+        if (js->depth >= JSON_MAX_DEPTH) return -1;
+        js->stack[js->depth++] = c;
+        js->expect_key = c == '{';
+        return emit(js, c == '{' ? JSON_OBJECT_START : JSON_ARRAY_START, js->depth);
+    case '}':
+    case ']': {
+        if (js->depth == 0 || js->stack[js->depth - 1] != (c == '}' ? '{' : '[')) return -1;
+        int depth = js->depth--;
+        js->expect_key = 0;
+        if (emit(js, c == '}' ? JSON_OBJECT_END : JSON_ARRAY_END, depth) != 0) return -1;
+        return value_done(js);
+    }
+    case '"':
+        js->string_is_key = js->depth > 0 && js->stack[js->depth - 1] == '{' && js->expect_key;
+        js->expect_key = 0;
+        js->state = ST_STRING;
+        return 0;
+    case 't':
+        js->literal = "true";
+        break;
+    case 'f':
+        js->literal = "false";
+        break;
+    case 'n':
+        js->literal = "null";
+        break;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            js->state = ST_NUMBER;
+            return buf_put(js, &c, 1);
+        }
+        return -1;
+    }
+    js->state = ST_LITERAL;
+    js->literal_pos = 1;
+    return 0;
+}
+
+int json_stream_feed(json_stream_t *js, const char *data, size_t len) {
+    if (js->error) return -1;
+    size_t i = 0;
+    while (i < len) {
+        char c = data[i];
+        switch (js->state) {
+        case ST_VALUE:
+            if (js->done && c != ' ' && c != '\t' && c != '\r' && c != '\n') goto fail;
+            if (handle_value_char(js, c) != 0) goto fail;
+            i++;
+            break;
+        case ST_STRING: {
+            // Copy runs of plain bytes in one go; only quotes and escapes need attention.
+            size_t start = i;
+            while (i < len && data[i] != '"' && data[i] != '\\') i++;
+            if (i > start && buf_put(js, data + start, i - start) != 0) goto fail;
+            if (i == len) break;
+            if (data[i] == '\\') {
+                js->state = ST_ESCAPE;
+            } else {
+                js->state = ST_VALUE;
+                if (emit(js, js->string_is_key ? JSON_KEY : JSON_STRING, js->depth) != 0) goto fail;
+                if (!js->string_is_key) value_done(js);
+            }
+            i++;
+            break;
+        }
+        case ST_ESCAPE: {
+            char out = c;
+            switch (c) {
+            case 'n': out = '\n'; break;
+            case 't': out = '\t'; break;
+            case 'r': out = '\r'; break;
+            case 'b': out = '\b'; break;
+            case 'f': out = '\f'; break;
+            case 'u':
+                js->state = ST_UNICODE;
+                js->ucs = 0;
+                js->uhex = 0;
+                i++;
+                continue;
+            default: break;
+            }
+            if (buf_put(js, &out, 1) != 0) goto fail;
+            js->state = ST_STRING;
+            i++;
+            break;
+        }
+        case ST_UNICODE: {
+            int v;
+            if (c >= '0' && c <= '9') v = c - '0';
+            else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+            else goto fail;
+            js->ucs = (js->ucs << 4) | (unsigned int)v;
+            i++;
+            if (++js->uhex < 4) break;
+            js->state = ST_STRING;
+            if (js->ucs >= 0xD800 && js->ucs < 0xDC00) {
+                js->high_surrogate = js->ucs;
+                break;
+            }
+            unsigned int cp = js->ucs;
+            if (cp >= 0xDC00 && cp < 0xE000 && js->high_surrogate) {
+                cp = 0x10000 + ((js->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+            }
+            js->high_surrogate = 0;
+            if (put_utf8(js, cp) != 0) goto fail;
+            break;
+        }
+        case ST_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                if (buf_put(js, &c, 1) != 0) goto fail;
+                i++;
+            } else if (end_number(js) != 0) {
+                goto fail;
+            }
+            break;
+        case ST_LITERAL:
+            if (c != js->literal[js->literal_pos]) goto fail;
+            i++;
+            if (js->literal[++js->literal_pos] == '\0') {
+                json_event_t ev = js->literal[0] == 't' ? JSON_TRUE : js->literal[0] == 'f' ? JSON_FALSE : JSON_NULL;
+                js->state = ST_VALUE;
+                if (emit(js, ev, js->depth) != 0) goto fail;
+                value_done(js);
+            }
+            break;
+        }
+    }
+    return 0;
+fail:
+    js->error = 1;
+    return -1;
+}
+
+// Flushes a trailing top-level number and checks that exactly one complete value was read.
+int json_stream_finish(json_stream_t *js) {
+    if (js->error) return -1;
+    if (js->state == ST_NUMBER && end_number(js) != 0) return -1;
+    return js->done && js->state == ST_VALUE ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stddef.h>
+
+#define JSON_MAX_DEPTH 64
+
+typedef enum {
+    JSON_OBJECT_START,
+    JSON_OBJECT_END,
+    JSON_ARRAY_START,
+    JSON_ARRAY_END,
+    JSON_KEY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+} json_event_t;
+
+// depth is the nesting level of the container the event belongs to (the root container is 1).
+// str/len carry the decoded, NUL-terminated text of keys, strings and numbers; they are only
+// valid during the call. Returning non-zero aborts parsing.
+typedef int (*json_event_cb)(void *userdata, json_event_t ev, const char *str, size_t len, int depth);
+
+// Incremental (SAX-style) JSON lexer: input can be fed in arbitrary chunks, and only the
+// token currently being read is buffered.
+typedef struct {
+    json_event_cb cb;
+    void *userdata;
+    int state;
+    int error;
+    int done;
+    int depth;
+    char stack[JSON_MAX_DEPTH];
+    int expect_key;
+    int string_is_key;
+    char *buf;
+    size_t len;
+    size_t cap;
+    unsigned int ucs;
+    int uhex;
+    unsigned int high_surrogate;
+    const char *literal;
+    int literal_pos;
+} json_stream_t;
+
+void json_stream_init(json_stream_t *js, json_event_cb cb, void *userdata);
+void json_stream_reset(json_stream_t *js);
+int json_stream_feed(json_stream_t *js, const char *data, size_t len);
+int json_stream_finish(json_stream_t *js);
+void json_stream_free(json_stream_t *js);
+
+#endif // JSON_STREAM_H
@@ -0,0 +1,382 @@
+#include "kwic.h"
+#include "session_store.h"
+#include "shard.h"
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define KWIC_CHUNK 32      // sessions per job
+#define KWIC_MAX_WORDS 16  // words in a phrase
+#define KWIC_MAX_WINDOW 50 // words of context per side
+
+typedef struct {
+    size_t start;
+    size_t end;
+} kwic_token_t;
+
+typedef struct {
+    const char *term;
+    kwic_token_t words[KWIC_MAX_WORDS];
+    int nwords;
+    int prefix;
+    int window;
+    int width; // columns reserved for the left context
+    pthread_mutex_t mu;
+    pthread_cond_t done_cond;
+} kwic_ctx_t;
+
+typedef struct {
+    kwic_ctx_t *ctx;
+    int shard;               // see shard_reader_store
+    const char *skip_before; // rows created earlier are left out (see shard_reader_scan), or NULL
+    const int *ids;
+    size_t len;
+    char *text;
+    size_t text_len;
+    size_t hits;
+    int failed;
+    int done;
+} kwic_job_t;
+
+typedef struct {
+    session_store_t store;
+    shard_reader_t shards;
+    kwic_token_t *toks;
+    size_t toks_cap;
+    char *scratch;
+    size_t scratch_cap;
+} kwic_worker_t;
+
+typedef struct {
+    kwic_worker_t *w;
+    kwic_job_t *job;
+    FILE *out;
+} kwic_scan_t;
+
+// Decodes one UTF-8 code point; invalid bytes come back as themselves.
+static uint32_t next_cp(const unsigned char *s, size_t len, size_t *i) {
+    uint32_t c = s[*i];
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    if (extra == 0 || *i + (size_t)extra >= len) {
+        (*i)++;
+        return c;
+    }
+    uint32_t cp = c & (0x3F >> extra);
+    for (int k = 1; k <= extra; k++) {
+        if ((s[*i + k] & 0xC0) != 0x80) {
+            (*i)++;
+            return c;
+        }
+        cp = (cp << 6) | (s[*i + k] & 0x3F);
+    }
+    *i += (size_t)extra + 1;
+    return cp;
+}
+
+// Roughly what FTS5's unicode61 tokenizer treats as word characters: letters and digits,
+// but not the punctuation, symbol and emoji blocks that German text commonly contains.
+static int is_word_cp(uint32_t cp) {
+    if (cp < 0x80) return (cp >= '0' && cp <= '9') || ((cp | 0x20) >= 'a' && (cp | 0x20) <= 'z');
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return 0;
+    if ((cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F)) return 0;
+    if ((cp >= 0xFE00 && cp <= 0xFE0F) || cp >= 0x1F000) return 0;
+    return 1;
+}
+
+static uint32_t fold_cp(uint32_t cp) {
+    if ((cp >= 'A' && cp <= 'Z') || (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)) return cp + 0x20;
+    return cp;
+}
+
+// Splits s into words. Returns the number of tokens, or -1 if *toks could not grow.
+static long tokenize(const char *s, size_t len, kwic_token_t **toks, size_t *cap) {
+    const unsigned char *u = (const unsigned char *)s;
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t start = i;
+        if (!is_word_cp(next_cp(u, len, &i))) continue;
+        size_t end = i;
+        while (end < len) {
+            size_t j = end;
+            if (!is_word_cp(next_cp(u, len, &j))) break;
+            end = j;
+        }
+        if (n == *cap) {
+            size_t ncap = *cap ? *cap * 2 : 1024;
+            kwic_token_t *tmp = realloc(*toks, ncap * sizeof(kwic_token_t));
+            if (!tmp) return -1;
+            *toks = tmp;
+            *cap = ncap;
+        }
+        (*toks)[n].start = start;
+        (*toks)[n].end = end;
+        n++;
+        i = end;
+    }
+    return (long)n;
+}
+
+// Case-insensitive comparison of a text word with a term word (or its prefix).
+static int word_matches(const char *text, kwic_token_t t, const char *term, kwic_token_t w, int prefix) {
+    const unsigned char *a = (const unsigned char *)text;
+    const unsigned char *b = (const unsigned char *)term;
+    size_t i = t.start;
+    size_t j = w.start;
+    while (i < t.end && j < w.end) {
+        if (fold_cp(next_cp(a, t.end, &i)) != fold_cp(next_cp(b, w.end, &j))) return 0;
+    }
+    return j == w.end && (prefix || i == t.end);
+}
+
+// Copies s[0, len) into the worker's scratch buffer with whitespace runs collapsed to one
+// space and trimmed. Returns the copy's length in code points, or -1.
+static long normalize(kwic_worker_t *w, const char *s, size_t len) {
+    if (len + 1 > w->scratch_cap) {
+        char *tmp = realloc(w->scratch, len + 1);
+        if (!tmp) return -1;
+        w->scratch = tmp;
+        w->scratch_cap = len + 1;
+    }
+    size_t n = 0;
+    long cps = 0;
+    int space = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            space = n > 0;
+            continue;
+        }
+        if (space) {
+            w->scratch[n++] = ' ';
+            cps++;
+            space = 0;
+        }
+        w->scratch[n++] = c;
+        if (((unsigned char)c & 0xC0) != 0x80) cps++;
+    }
+    w->scratch[n] = '\0';
+    return cps;
+}
+
+static void print_normalized(kwic_worker_t *w, FILE *out, const char *s, size_t len) {
+    if (normalize(w, s, len) >= 0) fputs(w->scratch, out);
+}
+
+static int scan_session(void *userdata, const session_t *s) {
+    kwic_scan_t *scan = userdata;
+    kwic_worker_t *w = scan->w;
+    const kwic_ctx_t *ctx = scan->job->ctx;
+    if (scan->job->skip_before && s->created_at && strcmp(s->created_at, scan->job->skip_before) < 0) return 0;
+    size_t len = strlen(s->text);
+    long ntoks = tokenize(s->text, len, &w->toks, &w->toks_cap);
+    if (ntoks < 0) return -1;
+    const kwic_token_t *t = w->toks;
+    for (long i = 0; i + ctx->nwords <= ntoks; i++) {
+        int hit = 1;
+        for (int k = 0; k < ctx->nwords && hit; k++) {
+            hit = word_matches(s->text, t[i + k], ctx->term, ctx->words[k], ctx->prefix && k == ctx->nwords - 1);
+        }
+        if (!hit) continue;
+        long last = i + ctx->nwords - 1;
+        long from = i - ctx->window > 0 ? i - ctx->window : 0;
+        long to = last + ctx->window < ntoks ? last + ctx->window : ntoks - 1;
+
+        // Left context is right-aligned so the matches line up; cut it at the front if too long.
+        fprintf(scan->out, "#%-6d %.10s  ", s->id, s->created_at ? s->created_at : "");
+        long cps = ctx->window > 0 ? normalize(w, s->text + t[from].start, t[i].start - t[from].start) : 0;
+        if (cps < 0) return -1;
+        if (cps > ctx->width) {
+            const char *p = w->scratch;
+            for (long skip = cps - ctx->width + 1; skip > 0; p++) {
+                if (((unsigned char)p[1] & 0xC0) != 0x80) skip--;
+            }
+            fprintf(scan->out, "…%s", p);
+        } else {
+            fprintf(scan->out, "%*s%s", (int)(ctx->width - cps), "", ctx->window > 0 ? w->scratch : "");
+        }
+        fputs(" [", scan->out);
+        print_normalized(w, scan->out, s->text + t[i].start, t[last].end - t[i].start);
+        fputc(']', scan->out);
+        if (to > last) {
+            fputc(' ', scan->out);
+            print_normalized(w, scan->out, s->text + t[last].end, t[to].end - t[last].end);
+        }
+        fputc('\n', scan->out);
+        scan->job->hits++;
+    }
+    return 0;
+}
+
+static void run_job(void *worker_ctx, void *arg) {
+    kwic_worker_t *w = worker_ctx;
+    kwic_job_t *job = arg;
+    kwic_scan_t scan = {.w = w, .job = job, .out = open_memstream(&job->text, &job->text_len)};
+    session_store_t *store = shard_reader_store(&w->shards, job->shard);
+    int rc = scan.out ? session_store_each(store, job->ids, job->len, scan_session, &scan) : -1;
+    if (scan.out) fclose(scan.out);
+    pthread_mutex_lock(&job->ctx->mu);
+    job->failed = rc != 0;
+    job->done = 1;
+    pthread_cond_broadcast(&job->ctx->done_cond);
+    pthread_mutex_unlock(&job->ctx->mu);
+}
+
+// FTS5 phrase for the candidate lookup: "w1 w2 ..." with * after it for a prefix.
+static int build_query(const kwic_ctx_t *ctx, char *buf, size_t len) {
+    size_t n = 0;
+    buf[n++] = '"';
+    for (int k = 0; k < ctx->nwords; k++) {
+        size_t wlen = ctx->words[k].end - ctx->words[k].start;
+        if (n + wlen + 4 > len) return -1;
+        if (k) buf[n++] = ' ';
+        memcpy(buf + n, ctx->term + ctx->words[k].start, wlen);
+        n += wlen;
+    }
+    buf[n++] = '"';
+    if (ctx->prefix) buf[n++] = '*';
+    buf[n] = '\0';
+    return 0;
+}
+
+int kwic_run(const char *db_path, const char *term, const kwic_config_t *cfg, FILE *out) {
+    kwic_ctx_t ctx = {.term = term};
+    ctx.window = cfg->window < 0 ? 0 : cfg->window > KWIC_MAX_WINDOW ? KWIC_MAX_WINDOW : cfg->window;
+    ctx.width = ctx.window * 7;
+    size_t term_len = strlen(term);
+    while (term_len > 0 && (term[term_len - 1] == ' ' || term[term_len - 1] == '*')) {
+        if (term[term_len - 1] == '*') ctx.prefix = 1;
+        term_len--;
+    }
+    kwic_token_t *words = NULL;
+    size_t words_cap = 0;
+    long nwords = tokenize(term, term_len, &words, &words_cap);
+    if (nwords <= 0 || nwords > KWIC_MAX_WORDS) {
+        fprintf(stderr, nwords > 0 ? "Zu viele Wörter im Suchbegriff (max. %d)\n" : "Kein Suchbegriff\n",
+                KWIC_MAX_WORDS);
+        free(words);
+        return -1;
+    }
+    memcpy(ctx.words, words, (size_t)nwords * sizeof(kwic_token_t));
+    ctx.nwords = (int)nwords;
+    free(words);
+    char query[1024];
+    if (build_query(&ctx, query, sizeof(query)) != 0) {
+        fprintf(stderr, "Suchbegriff zu lang\n");
+        return -1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    session_store_t main_store = {0};
+    if (session_store_open_reader(&main_store, db_path) != 0) return -1;
+    shard_reader_t main_shards;
+    if (shard_reader_open(&main_shards, &main_store, db_path, 0) != 0) {
+        session_store_close(&main_store);
+        return -1;
+    }
+    // Sealed shards first, oldest year first, then the current store: ids keep their order.
+    size_t nparts = main_shards.count + 1;
+    int **part_ids = calloc(nparts, sizeof(int *));
+    size_t *part_len = calloc(nparts, sizeof(size_t));
+    char skip_before[sizeof(main_shards.current_from)];
+    snprintf(skip_before, sizeof(skip_before), "%s", main_shards.current_from);
+    size_t nids = 0;
+    size_t njobs = 0;
+    int rc = part_ids && part_len ? 0 : -1;
+    for (size_t p = 0; rc == 0 && p < nparts; p++) {
+        session_store_t *store = shard_reader_store(&main_shards, p + 1 < nparts ? (int)p + 1 : 0);
+        rc = session_store_match_ids(store, query, &part_ids[p], &part_len[p]);
+        nids += part_len[p];
+        njobs += (part_len[p] + KWIC_CHUNK - 1) / KWIC_CHUNK;
+    }
+    shard_reader_close(&main_shards);
+    session_store_close(&main_store);
+
+    int threads = cfg->threads < 1 ? 1 : cfg->threads;
+    if ((size_t)threads > njobs) threads = njobs > 0 ? (int)njobs : 1;
+    kwic_worker_t *workers = rc == 0 ? calloc((size_t)threads, sizeof(kwic_worker_t)) : NULL;
+    void **worker_ctx = rc == 0 ? calloc((size_t)threads, sizeof(void *)) : NULL;
+    kwic_job_t *jobs = rc == 0 ? calloc(njobs ? njobs : 1, sizeof(kwic_job_t)) : NULL;
+    int opened = 0;
+    size_t hits = 0;
+    rc = -1;
+    if (!workers || !worker_ctx || !jobs) goto done;
+    for (size_t p = 0, j = 0; p < nparts; p++) {
+        for (size_t at = 0; at < part_len[p]; at += KWIC_CHUNK, j++) {
+            jobs[j].ctx = &ctx;
+            jobs[j].shard = p + 1 < nparts ? (int)p + 1 : 0;
+            jobs[j].skip_before = jobs[j].shard == 0 && skip_before[0] ? skip_before : NULL;
+            jobs[j].ids = part_ids[p] + at;
+            jobs[j].len = part_len[p] - at < KWIC_CHUNK ? part_len[p] - at : KWIC_CHUNK;
+        }
+    }
+    for (; opened < threads; opened++) {
+        kwic_worker_t *w = &workers[opened];
+        if (session_store_open_readonly(&w->store, db_path) != 0) goto done;
+        if (shard_reader_open(&w->shards, &w->store, db_path, 0) != 0) {
+            session_store_close(&w->store);
+            goto done;
+        }
+        worker_ctx[opened] = w;
+    }
+    pthread_mutex_init(&ctx.mu, NULL);
+    pthread_cond_init(&ctx.done_cond, NULL);
+    thread_pool_t pool;
+    size_t ahead = (size_t)threads * 4;
+    if (thread_pool_init(&pool, threads, ahead, run_job, worker_ctx) != 0) {
+        pthread_cond_destroy(&ctx.done_cond);
+        pthread_mutex_destroy(&ctx.mu);
+        goto done;
+    }
+
+    // Jobs finish in any order; output is written in id order as soon as the next chunk is
+    // ready, with at most `ahead` chunks buffered.
+    rc = 0;
+    size_t submitted = 0;
+    for (size_t next = 0; next < njobs; next++) {
+        while (submitted < njobs && submitted < next + ahead) {
+            if (thread_pool_submit(&pool, &jobs[submitted]) != 0) break;
+            submitted++;
+        }
+        if (next >= submitted) {
+            rc = -1;
+            break;
+        }
+        pthread_mutex_lock(&ctx.mu);
+        while (!jobs[next].done) pthread_cond_wait(&ctx.done_cond, &ctx.mu);
+        pthread_mutex_unlock(&ctx.mu);
+        if (jobs[next].failed) rc = -1;
+        if (jobs[next].text) fwrite(jobs[next].text, 1, jobs[next].text_len, out);
+        free(jobs[next].text);
+        jobs[next].text = NULL;
+        hits += jobs[next].hits;
+    }
+    thread_pool_destroy(&pool);
+    for (size_t j = 0; j < submitted; j++) free(jobs[j].text);
+    pthread_cond_destroy(&ctx.done_cond);
+    pthread_mutex_destroy(&ctx.mu);
+    if (rc != 0) fprintf(stderr, "KWIC fehlgeschlagen\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%zu Treffer in %zu Sessions (%.3fs, %d Threads)\n", hits, nids, secs, threads);
+
+done:
+    for (int i = 0; i < opened; i++) {
+        shard_reader_close(&workers[i].shards);
+        session_store_close(&workers[i].store);
+        free(workers[i].toks);
+        free(workers[i].scratch);
+    }
+    free(workers);
+    free(worker_ctx);
+    free(jobs);
+    for (size_t p = 0; part_ids && p < nparts; p++) free(part_ids[p]);
+    free(part_ids);
+    free(part_len);
+    return rc;
+}
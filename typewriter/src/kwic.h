@@ -0,0 +1,17 @@
+#ifndef KWIC_H
+#define KWIC_H
+
+#include <stdio.h>
+
+typedef struct {
+    int window;  // words of context on each side
+    int threads; // worker threads, each with its own read-only connection
+} kwic_config_t;
+
+// Prints every occurrence of term in the store at db_path and its sealed shards as one
+// concordance line, shard by shard from the oldest year on, in session id order. term is a
+// word or a phrase, matched case-insensitively on word boundaries; a trailing * makes its last
+// word a prefix. Returns 0 or -1.
+int kwic_run(const char *db_path, const char *term, const kwic_config_t *cfg, FILE *out);
+
+#endif // KWIC_H
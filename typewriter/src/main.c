@@ -1,10 +1,19 @@
+#include "export.h"
+#include "history.h"
 #include "http_client.h"
+#include "kwic.h"
+#include "serve.h"
 #include "session_store.h"
+#include "shard.h"
+#include "similar.h"
+#include "snapshot.h"
 #include "sync.h"
 #include "typewriter_api.h"
+#include "watch.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static const char *env_or_default(const char *env, const char *def) {
     const char *v = getenv(env);
@@ -14,10 +23,27 @@ static const char *env_or_default(const char *env, const char *def) {
 static void usage(void) {
     printf("typewriter CLI\n");
     printf("Commands:\n");
-    printf("  sync   --db PATH [--base-url URL] [--api-key KEY] [--limit N]\n");
-    printf("  search --db PATH \"query\" [--limit N]\n");
+    printf("  sync   --db PATH [--base-url URL] [--api-key KEY] [--limit N] [--concurrency N] [--incremental] [--bulk]\n");
+    printf("         [--retries N] [--max-requests N] [--page-min N] [--page-max N] [--max-concurrency N] [--fixed]\n");
+    printf("         [--history] [--metrics json] [--metrics-interval SEC] [--metrics-file PATH]\n");
+    printf("  watch  --db PATH [--base-url URL] [--api-key KEY] [--events PATH] [--commit-ms N] [--interval SEC]\n");
+    printf("  search --db PATH \"query\" [--limit N] [--threads N]\n");
     printf("  get    --db PATH <id>\n");
     printf("  stats  --db PATH\n");
+    printf("  report --db PATH [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--granularity day|week|month]\n");
+    printf("  terms  --db PATH [--limit N] [<id>]\n");
+    printf("  kwic   --db PATH \"term\" [--window N] [--threads N]\n");
+    printf("  export --db PATH [--format ndjson|binary] [--from-id N] [--to-id N] [--from DAY] [--to DAY] [--out FILE]\n");
+    printf("  optimize --db PATH [--merge PAGES]\n");
+    printf("  compact --db PATH [--level N] [--retrain] [--plain]\n");
+    printf("  serve  --db PATH [--socket PATH] [--threads N]\n");
+    printf("  shard  --db PATH [--before YEAR]\n");
+    printf("  similar --db PATH <id> [--threshold J] [--limit N]\n");
+    printf("  dedupe --db PATH [--threshold J]\n");
+    printf("  history --db PATH <document-id> [--at VERSION]\n");
+    printf("  snapshot create --db PATH [--out FILE] [--level N]\n");
+    printf("  snapshot restore --db PATH <FILE|URL|-> [--force] [--no-sync] [sync options]\n");
+    printf("search/get/stats/report/terms use a running serve daemon (default socket: <db>.sock) when there is one.\n");
 }
 
 static int parse_int(const char *s, int *out) {
@@ -28,18 +54,62 @@ static int parse_int(const char *s, int *out) {
     return 0;
 }
 
+static int parse_double(const char *s, double *out) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (!end || *end != '\0') return -1;
+    *out = v;
+    return 0;
+}
+
 int main(int argc, char **argv) {
+    atexit(http_global_cleanup);
     if (argc < 2) {
         usage();
         return 1;
     }
     const char *cmd = argv[1];
+    // snapshot create|restore: the second word belongs to the command.
+    const char *subcmd = strcmp(cmd, "snapshot") == 0 && argc > 2 ? argv[2] : NULL;
     const char *db_path = "./sessions.db";
     const char *base_url = env_or_default("TYPEWRITER_BASE_URL", "http://localhost:3001");
     const char *api_key = getenv("TYPEWRITER_API_KEY");
     int limit = 20;
+    int concurrency = 4;
+    int page_min = 0;
+    int page_max = 0;
+    int max_concurrency = 0;
+    int fixed = 0;
+    int retries = 0;
+    const char *events_path = NULL;
+    int commit_ms = -1;
+    int interval = 0;
+    int max_requests = 0;
+    int incremental = 0;
+    int bulk = 0;
+    int history = 0;
+    int merge = 0;
+    int threads = 4;
+    int window = 5;
+    int before = 0;
+    int at = 0;
+    int force = 0;
+    int no_sync = 0;
+    double threshold = -1; // similar 0.5, dedupe 0.8
+    store_compact_opts_t compact = {0};
+    store_range_t range = {0};
+    const char *format = "ndjson";
+    const char *out_path = NULL;
+    const char *metrics = NULL;
+    int metrics_interval = 0;
+    const char *metrics_file = NULL;
+    const char *socket_path = NULL;
+    const char *from = NULL;
+    const char *to = NULL;
+    const char *granularity = "day";
+    const char *positional = NULL;
 
-    for (int i = 2; i < argc; i++) {
+    for (int i = subcmd ? 3 : 2; i < argc; i++) {
         if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
             db_path = argv[++i];
         } else if (strcmp(argv[i], "--base-url") == 0 && i + 1 < argc) {
@@ -48,7 +118,223 @@ int main(int argc, char **argv) {
             api_key = argv[++i];
         } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
             parse_int(argv[++i], &limit);
+        } else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &concurrency);
+        } else if (strcmp(argv[i], "--page-min") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &page_min);
+        } else if (strcmp(argv[i], "--page-max") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &page_max);
+        } else if (strcmp(argv[i], "--max-concurrency") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &max_concurrency);
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            fixed = 1;
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &retries);
+        } else if (strcmp(argv[i], "--max-requests") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &max_requests);
+        } else if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            events_path = argv[++i];
+        } else if (strcmp(argv[i], "--commit-ms") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &commit_ms);
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &interval);
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            incremental = 1;
+        } else if (strcmp(argv[i], "--bulk") == 0) {
+            bulk = 1;
+        } else if (strcmp(argv[i], "--history") == 0) {
+            history = 1;
+        } else if (strcmp(argv[i], "--merge") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &merge);
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &metrics_interval);
+        } else if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &threads);
+        } else if (strcmp(argv[i], "--before") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &before);
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            parse_double(argv[++i], &threshold);
+        } else if (strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &at);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &window);
+        } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &compact.level);
+        } else if (strcmp(argv[i], "--retrain") == 0) {
+            compact.retrain = 1;
+        } else if (strcmp(argv[i], "--plain") == 0) {
+            compact.plain = 1;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = 1;
+        } else if (strcmp(argv[i], "--no-sync") == 0) {
+            no_sync = 1;
+        } else if (strcmp(argv[i], "--from-id") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &range.from_id);
+        } else if (strcmp(argv[i], "--to-id") == 0 && i + 1 < argc) {
+            parse_int(argv[++i], &range.to_id);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = argv[++i];
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = argv[++i];
+        } else if (strcmp(argv[i], "--granularity") == 0 && i + 1 < argc) {
+            granularity = argv[++i];
+        } else if (!positional) {
+            positional = argv[i];
+        }
+    }
+
+    char socket_buf[108];
+    if (!socket_path && serve_socket_path(db_path, socket_buf, sizeof(socket_buf)) == 0) socket_path = socket_buf;
+
+    if (strcmp(cmd, "serve") == 0) {
+        if (!socket_path) {
+            fprintf(stderr, "Socket-Pfad zu lang, bitte --socket angeben\n");
+            return 1;
+        }
+        return serve_run(db_path, socket_path, threads) == 0 ? 0 : 1;
+    }
+    if (strcmp(cmd, "kwic") == 0) {
+        if (!positional) {
+            usage();
+            return 1;
+        }
+        kwic_config_t cfg = {.window = window, .threads = threads};
+        return kwic_run(db_path, positional, &cfg, stdout) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(cmd, "export") == 0) {
+        export_config_t cfg = {.format = EXPORT_NDJSON, .range = range};
+        cfg.range.from = from;
+        cfg.range.to = to;
+        if (strcmp(format, "binary") == 0) {
+            cfg.format = EXPORT_BINARY;
+        } else if (strcmp(format, "ndjson") != 0) {
+            fprintf(stderr, "Unbekanntes Format: %s (ndjson, binary)\n", format);
+            return 1;
+        }
+        FILE *out = out_path ? fopen(out_path, "wb") : stdout;
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+        int rc = export_run(db_path, &cfg, out);
+        if (out != stdout && fclose(out) != 0) rc = -1;
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (subcmd && strcmp(subcmd, "create") == 0) {
+        snapshot_config_t cfg = {.level = compact.level};
+        FILE *out = out_path ? fopen(out_path, "wb") : stdout;
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+        int rc = snapshot_create(db_path, &cfg, out);
+        if (out != stdout && fclose(out) != 0) rc = -1;
+        if (rc != 0 && out_path) remove(out_path);
+        return rc == 0 ? 0 : 1;
+    }
+    if (subcmd && strcmp(subcmd, "restore") == 0) {
+        if (!positional) {
+            usage();
+            return 1;
+        }
+        if (snapshot_restore(positional, db_path, force) != 0) return 1;
+        if (no_sync) return 0;
+        // Whatever is newer than the snapshot comes from the API.
+        cmd = "sync";
+        incremental = 1;
+    }
+
+    serve_request_t req = {0};
+    char report_query[64];
+    if (strcmp(cmd, "search") == 0) {
+        req.op = SERVE_OP_SEARCH;
+        req.arg = limit;
+        req.query = positional;
+    } else if (strcmp(cmd, "get") == 0) {
+        req.op = SERVE_OP_GET;
+        if (positional) parse_int(positional, &req.arg);
+    } else if (strcmp(cmd, "stats") == 0) {
+        req.op = SERVE_OP_STATS;
+    } else if (strcmp(cmd, "report") == 0) {
+        req.op = SERVE_OP_REPORT;
+        snprintf(report_query, sizeof(report_query), "%.15s %.15s %.15s", granularity, from ? from : "-",
+                 to ? to : "-");
+        req.query = report_query;
+    } else if (strcmp(cmd, "terms") == 0) {
+        req.op = SERVE_OP_TERMS;
+        req.arg = limit;
+        req.query = positional;
+    }
+    if (req.op) {
+        if ((req.op == SERVE_OP_SEARCH || req.op == SERVE_OP_GET) && !positional) {
+            usage();
+            return 1;
+        }
+        // Ask a running daemon first; only open the database here when there is none.
+        int rc = socket_path ? serve_client_request(socket_path, &req, stdout) : -1;
+        if (rc >= 0) return rc;
+        session_store_t store = {0};
+        if (session_store_open_reader(&store, db_path) != 0) return 1;
+        shard_reader_t shards;
+        if (shard_reader_open(&shards, &store, db_path, threads) != 0) {
+            session_store_close(&store);
+            return 1;
         }
+        rc = serve_execute(&store, &shards, &req, stdout);
+        shard_reader_close(&shards);
+        session_store_close(&store);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (strcmp(cmd, "similar") == 0 || strcmp(cmd, "dedupe") == 0) {
+        int dedupe = strcmp(cmd, "dedupe") == 0;
+        similar_config_t cfg = {.threshold = threshold >= 0 ? threshold : dedupe ? 0.8 : 0.5, .limit = limit};
+        int id = 0;
+        if (!dedupe && (!positional || parse_int(positional, &id) != 0)) {
+            usage();
+            return 1;
+        }
+        session_store_t store = {0};
+        if (session_store_open_reader(&store, db_path) != 0) return 1;
+        shard_reader_t shards;
+        if (shard_reader_open(&shards, &store, db_path, 0) != 0) {
+            session_store_close(&store);
+            return 1;
+        }
+        int rc = dedupe ? similar_dedupe(&shards, &cfg, stdout) : similar_run(&shards, id, &cfg, stdout);
+        shard_reader_close(&shards);
+        session_store_close(&store);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (strcmp(cmd, "history") == 0) {
+        int document_id = 0;
+        if (!positional || parse_int(positional, &document_id) != 0) {
+            usage();
+            return 1;
+        }
+        session_store_t store = {0};
+        if (session_store_open_reader(&store, db_path) != 0) return 1;
+        int rc = history_run(&store, document_id, at, stdout);
+        session_store_close(&store);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (metrics && strcmp(metrics, "json") != 0) {
+        fprintf(stderr, "Unbekanntes Metrics-Format: %s (unterstützt: json)\n", metrics);
+        return 1;
     }
 
     session_store_t store = {0};
@@ -58,44 +344,42 @@ int main(int argc, char **argv) {
     if (strcmp(cmd, "sync") == 0) {
         http_client_t client;
         http_client_init(&client, base_url, api_key ? api_key : "");
-        sync_config_t cfg = {.page_limit = limit};
+        if (retries > 0) client.retries = retries;
+        client.max_requests = max_requests;
+        sync_config_t cfg = {.page_limit = limit, .concurrency = concurrency, .fixed = fixed, .page_min = page_min,
+                             .page_max = page_max, .max_concurrency = max_concurrency, .incremental = incremental,
+                             .bulk = bulk, .history = history, .metrics_json = metrics != NULL,
+                             .metrics_interval = metrics_interval, .metrics_file = metrics_file};
         int rc = perform_sync(&client, &store, &cfg);
         http_client_cleanup(&client);
         session_store_close(&store);
         return rc == 0 ? 0 : 1;
-    } else if (strcmp(cmd, "search") == 0) {
-        if (argc < 3) {
-            usage();
-            return 1;
-        }
-        const char *query = argv[argc - 1];
-        session_store_search(&store, query, limit);
+    } else if (strcmp(cmd, "watch") == 0) {
+        http_client_t client;
+        http_client_init(&client, base_url, api_key ? api_key : "");
+        watch_config_t cfg = {.events_path = events_path, .commit_ms = commit_ms, .interval_sec = interval};
+        int rc = watch_run(&client, &store, &cfg);
+        http_client_cleanup(&client);
         session_store_close(&store);
-        return 0;
-    } else if (strcmp(cmd, "get") == 0) {
-        if (argc < 3) {
-            usage();
-            return 1;
-        }
-        int id = 0;
-        parse_int(argv[argc - 1], &id);
-        session_t s = {0};
-        if (session_store_get(&store, id, &s) == 0) {
-            printf("Session #%d (%s)\n%s\n", s.id, s.created_at, s.text);
-            session_free(&s);
-        } else {
-            printf("Session not found in DB\n");
-        }
+        return rc == 0 ? 0 : 1;
+    } else if (strcmp(cmd, "optimize") == 0) {
+        int rc = session_store_optimize(&store, merge);
         session_store_close(&store);
-        return 0;
-    } else if (strcmp(cmd, "stats") == 0) {
-        store_stats_t stats = {0};
-        if (session_store_stats(&store, &stats) == 0) {
-            printf("Sessions: %d\nLast created_at: %s\nDB size: %lld bytes\n", stats.count,
-                   stats.last_created_at, stats.db_size_bytes);
+        return rc == 0 ? 0 : 1;
+    } else if (strcmp(cmd, "compact") == 0) {
+        int rc = session_store_compact(&store, &compact, stdout);
+        session_store_close(&store);
+        return rc == 0 ? 0 : 1;
+    } else if (strcmp(cmd, "shard") == 0) {
+        if (before <= 0) {
+            time_t now = time(NULL);
+            struct tm tm;
+            localtime_r(&now, &tm);
+            before = tm.tm_year + 1900;
         }
+        int rc = shard_split(&store, db_path, before, stdout);
         session_store_close(&store);
-        return 0;
+        return rc == 0 ? 0 : 1;
     }
 
     usage();
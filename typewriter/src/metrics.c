@@ -0,0 +1,110 @@
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *counter_names[METRIC_COUNTER_COUNT] = {
+    "http_requests", "http_retries", "http_errors", "http_bytes", "http_connects", "parse_bytes",
+    "rows_inserted", "rows_updated", "rows_skipped", "pages",       "batches",      "count_mismatches",
+    "pages_resumed", "pages_failed", "reindex_skipped", "page_limit", "concurrency", "tuner_backoffs",
+    "rows_sealed",
+};
+
+static const char *timer_names[METRIC_TIMER_COUNT] = {
+    "http_ms", "ttfb_ms", "parse_ms", "db_write_ms", "commit_ms", "fts_ms", "queue_wait_ms", "terms_ms",
+    "backoff_ms",
+};
+
+void metrics_init(metrics_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->started_ns = metrics_now_ns();
+}
+
+unsigned long long metrics_get(const metrics_t *m, metric_counter_t c) {
+    return __atomic_load_n(&m->counters[c], __ATOMIC_RELAXED);
+}
+
+double metrics_ms(const metrics_t *m, metric_timer_t t) {
+    return __atomic_load_n(&m->timers_ns[t], __ATOMIC_RELAXED) / 1e6;
+}
+
+// One flat JSON object on a single line.
+int metrics_write_json(const metrics_t *m, FILE *out) {
+    fprintf(out, "{\"elapsed_s\":%.3f", (metrics_now_ns() - m->started_ns) / 1e9);
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        fprintf(out, ",\"%s\":%llu", counter_names[i], metrics_get(m, (metric_counter_t)i));
+    }
+    for (int i = 0; i < METRIC_TIMER_COUNT; i++) {
+        fprintf(out, ",\"%s\":%.3f", timer_names[i], metrics_ms(m, (metric_timer_t)i));
+    }
+    fprintf(out, "}\n");
+    return fflush(out) == 0 ? 0 : -1;
+}
+
+// Writes to PATH.tmp and renames it over PATH, so readers never see a partial file.
+int metrics_write_file(const metrics_t *m, const char *path) {
+    size_t len = strlen(path) + 5;
+    char *tmp = malloc(len);
+    if (!tmp) return -1;
+    snprintf(tmp, len, "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    int rc = -1;
+    if (f) {
+        rc = metrics_write_json(m, f);
+        if (fclose(f) != 0) rc = -1;
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Metrics konnten nicht geschrieben werden: %s\n", path);
+        remove(tmp);
+    }
+    free(tmp);
+    return rc;
+}
+
+static void *reporter_main(void *arg) {
+    metrics_reporter_t *r = arg;
+    pthread_mutex_lock(&r->mu);
+    while (!r->stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += r->interval_sec;
+        int rc = 0;
+        while (!r->stop && rc == 0) rc = pthread_cond_timedwait(&r->cond, &r->mu, &until);
+        if (r->stop) break;
+        if (r->path)
+            metrics_write_file(r->metrics, r->path);
+        else
+            metrics_write_json(r->metrics, stderr);
+    }
+    pthread_mutex_unlock(&r->mu);
+    return NULL;
+}
+
+int metrics_reporter_start(metrics_reporter_t *r, metrics_t *m, int interval_sec, const char *path) {
+    memset(r, 0, sizeof(*r));
+    if (interval_sec <= 0) return 0;
+    r->metrics = m;
+    r->interval_sec = interval_sec;
+    r->path = path;
+    pthread_mutex_init(&r->mu, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, reporter_main, r) != 0) {
+        pthread_mutex_destroy(&r->mu);
+        pthread_cond_destroy(&r->cond);
+        r->interval_sec = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_reporter_stop(metrics_reporter_t *r) {
+    if (r->interval_sec <= 0) return;
+    pthread_mutex_lock(&r->mu);
+    r->stop = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mu);
+    pthread_join(r->thread, NULL);
+    pthread_mutex_destroy(&r->mu);
+    pthread_cond_destroy(&r->cond);
+    r->interval_sec = 0;
+}
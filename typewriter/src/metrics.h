@@ -0,0 +1,96 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum {
+    METRIC_HTTP_REQUESTS,
+    METRIC_HTTP_RETRIES,
+    METRIC_HTTP_ERRORS,
+    METRIC_HTTP_BYTES,
+    METRIC_HTTP_CONNECTS,
+    METRIC_PARSE_BYTES,
+    METRIC_ROWS_INSERTED,
+    METRIC_ROWS_UPDATED,
+    METRIC_ROWS_SKIPPED,
+    METRIC_PAGES,
+    METRIC_BATCHES,
+    METRIC_COUNT_MISMATCHES,
+    METRIC_PAGES_RESUMED,
+    METRIC_PAGES_FAILED,
+    METRIC_REINDEX_SKIPPED,
+    METRIC_PAGE_LIMIT,  // gauge: the sync's current page size
+    METRIC_CONCURRENCY, // gauge: the sync's current requests in flight
+    METRIC_TUNER_BACKOFFS,
+    METRIC_ROWS_SEALED,
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+// Timers accumulate time spent per phase. Transfers overlap, so http/ttfb can exceed wall time.
+typedef enum {
+    METRIC_T_HTTP,
+    METRIC_T_TTFB,
+    METRIC_T_PARSE,
+    METRIC_T_DB_WRITE,
+    METRIC_T_COMMIT,
+    METRIC_T_FTS,
+    METRIC_T_QUEUE_WAIT,
+    METRIC_T_TERMS,
+    METRIC_T_BACKOFF,
+    METRIC_TIMER_COUNT
+} metric_timer_t;
+
+// Counters are updated with relaxed atomic adds, so any thread may record without locking.
+typedef struct {
+    unsigned long long counters[METRIC_COUNTER_COUNT];
+    unsigned long long timers_ns[METRIC_TIMER_COUNT];
+    long long started_ns;
+} metrics_t;
+
+static inline long long metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// All recording functions accept a NULL metrics pointer and do nothing then.
+static inline void metrics_add(metrics_t *m, metric_counter_t c, unsigned long long n) {
+    if (m) __atomic_fetch_add(&m->counters[c], n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_set(metrics_t *m, metric_counter_t c, unsigned long long v) {
+    if (m) __atomic_store_n(&m->counters[c], v, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_add_ns(metrics_t *m, metric_timer_t t, long long ns) {
+    if (m && ns > 0) __atomic_fetch_add(&m->timers_ns[t], (unsigned long long)ns, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_time_since(metrics_t *m, metric_timer_t t, long long start_ns) {
+    if (m) metrics_add_ns(m, t, metrics_now_ns() - start_ns);
+}
+
+void metrics_init(metrics_t *m);
+unsigned long long metrics_get(const metrics_t *m, metric_counter_t c);
+double metrics_ms(const metrics_t *m, metric_timer_t t);
+int metrics_write_json(const metrics_t *m, FILE *out);
+
+// Writes a snapshot every interval_sec seconds: to path (replaced atomically, for scrapers)
+// or, without a path, as one JSON line per snapshot on stderr.
+typedef struct {
+    metrics_t *metrics;
+    int interval_sec;
+    const char *path;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+} metrics_reporter_t;
+
+int metrics_reporter_start(metrics_reporter_t *r, metrics_t *m, int interval_sec, const char *path);
+void metrics_reporter_stop(metrics_reporter_t *r);
+int metrics_write_file(const metrics_t *m, const char *path);
+
+#endif // METRICS_H
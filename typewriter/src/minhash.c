@@ -0,0 +1,178 @@
+#include "minhash.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+void minhash_init(minhash_t *m, int keep) {
+    memset(m, 0, sizeof(*m));
+    m->keep = keep;
+    minhash_reset(m);
+}
+
+void minhash_reset(minhash_t *m) {
+    memset(m->mins, 0xff, sizeof(m->mins));
+    m->tokens = 0;
+    m->set_len = 0;
+    m->failed = 0;
+}
+
+void minhash_free(minhash_t *m) {
+    free(m->set);
+    m->set = NULL;
+    m->set_len = m->set_cap = 0;
+}
+
+// One permutation for all positions: the top bits of the shingle hash pick the position, the
+// low bits compete for its minimum. That is one update per shingle instead of MINHASH_PERMS.
+static void add_shingle(minhash_t *m, uint64_t h) {
+    int bin = (int)(h >> (64 - MINHASH_PERM_BITS));
+    uint32_t v = (uint32_t)h;
+    if (v < m->mins[bin]) m->mins[bin] = v;
+    if (!m->keep || m->failed) return;
+    if (m->set_len == m->set_cap) {
+        size_t cap = m->set_cap ? m->set_cap * 2 : 256;
+        uint64_t *set = realloc(m->set, cap * sizeof(uint64_t));
+        if (!set) {
+            m->failed = 1;
+            return;
+        }
+        m->set = set;
+        m->set_cap = cap;
+    }
+    m->set[m->set_len++] = h;
+}
+
+// Rotating each position differently keeps "a b c" and "c b a" apart.
+static uint64_t shingle_hash(const minhash_t *m, size_t n) {
+    uint64_t h = 0;
+    for (size_t i = 0; i < n; i++) h ^= rotl(m->window[i], (int)(i * 21 + 1));
+    return mix64(h);
+}
+
+void minhash_add(void *userdata, const char *token, size_t len) {
+    minhash_t *m = userdata;
+    const unsigned char *src = (const unsigned char *)token;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = src[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 0x20;
+        } else if (i > 0 && src[i - 1] == 0xC3 && c >= 0x80 && c <= 0x9E && c != 0x97) {
+            c += 0x20; // À-Þ -> à-þ
+        }
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    memmove(m->window, m->window + 1, (MINHASH_SHINGLE - 1) * sizeof(uint64_t));
+    m->window[MINHASH_SHINGLE - 1] = h;
+    if (++m->tokens >= MINHASH_SHINGLE) add_shingle(m, shingle_hash(m, MINHASH_SHINGLE));
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Positions no shingle fell into borrow from the next filled one, rehashed with the distance,
+// so two texts still agree on a borrowed position about as often as their sets overlap.
+static void densify(minhash_t *m) {
+    int filled = 0;
+    for (int i = 0; i < MINHASH_PERMS; i++) filled += m->mins[i] != UINT32_MAX;
+    if (filled == 0 || filled == MINHASH_PERMS) return;
+    uint32_t raw[MINHASH_PERMS];
+    memcpy(raw, m->mins, sizeof(raw));
+    for (int i = 0; i < MINHASH_PERMS; i++) {
+        if (raw[i] != UINT32_MAX) continue;
+        int k = 1;
+        while (raw[(i + k) % MINHASH_PERMS] == UINT32_MAX) k++;
+        m->mins[i] = (uint32_t)mix64(raw[(i + k) % MINHASH_PERMS] ^ ((uint64_t)k << 32));
+    }
+}
+
+void minhash_finish(minhash_t *m) {
+    if (m->tokens > 0 && m->tokens < MINHASH_SHINGLE) {
+        // The window holds the tokens at its end.
+        memmove(m->window, m->window + (MINHASH_SHINGLE - m->tokens), m->tokens * sizeof(uint64_t));
+        add_shingle(m, shingle_hash(m, m->tokens));
+    }
+    densify(m);
+    if (!m->keep || m->set_len == 0) return;
+    qsort(m->set, m->set_len, sizeof(uint64_t), cmp_u64);
+    size_t n = 1;
+    for (size_t i = 1; i < m->set_len; i++) {
+        if (m->set[i] != m->set[n - 1]) m->set[n++] = m->set[i];
+    }
+    m->set_len = n;
+}
+
+int minhash_empty(const minhash_t *m) {
+    return m->tokens == 0;
+}
+
+void minhash_bands(const uint32_t mins[MINHASH_PERMS], int64_t keys[MINHASH_BANDS]) {
+    for (int b = 0; b < MINHASH_BANDS; b++) {
+        uint64_t h = (uint64_t)b;
+        for (int r = 0; r < MINHASH_ROWS; r++) h = mix64(h ^ mins[b * MINHASH_ROWS + r]);
+        keys[b] = (int32_t)(uint32_t)h; // four bytes a row in session_lsh
+    }
+}
+
+// Big-endian, like the export format, so stores move between machines.
+void minhash_encode(const uint32_t mins[MINHASH_PERMS], unsigned char out[MINHASH_SIG_BYTES]) {
+    for (int i = 0; i < MINHASH_PERMS; i++) {
+        out[i * 4] = (unsigned char)(mins[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(mins[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(mins[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)mins[i];
+    }
+}
+
+int minhash_decode(const void *blob, size_t len, uint32_t mins[MINHASH_PERMS]) {
+    const unsigned char *p = blob;
+    if (!p || len != MINHASH_SIG_BYTES) return -1;
+    for (int i = 0; i < MINHASH_PERMS; i++) {
+        mins[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) | ((uint32_t)p[i * 4 + 2] << 8) |
+                  (uint32_t)p[i * 4 + 3];
+    }
+    return 0;
+}
+
+double minhash_estimate(const uint32_t a[MINHASH_PERMS], const uint32_t b[MINHASH_PERMS]) {
+    int same = 0;
+    for (int i = 0; i < MINHASH_PERMS; i++) same += a[i] == b[i];
+    return (double)same / MINHASH_PERMS;
+}
+
+double minhash_set_jaccard(const uint64_t *a, size_t alen, const uint64_t *b, size_t blen) {
+    size_t i = 0;
+    size_t j = 0;
+    size_t both = 0;
+    while (i < alen && j < blen) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            both++;
+            i++;
+            j++;
+        }
+    }
+    size_t any = alen + blen - both;
+    return any ? (double)both / (double)any : 1.0;
+}
+
+double minhash_jaccard(const minhash_t *a, const minhash_t *b) {
+    return minhash_set_jaccard(a->set, a->set_len, b->set, b->set_len);
+}
@@ -0,0 +1,52 @@
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MinHash over word shingles: a text is the set of its runs of MINHASH_SHINGLE consecutive
+// tokens (lowercased like text_terms_add), and two texts' signatures agree in a position with
+// probability equal to the Jaccard similarity of their sets. The signature comes from a single
+// hash per shingle (one-permutation hashing with densification), not one per position. LSH splits the signature into
+// MINHASH_BANDS bands of MINHASH_ROWS; texts sharing any band key are candidates, which for
+// 16 x 4 catches a pair at Jaccard 0.8 with probability 0.9998, at 0.5 with 0.64 and at 0.3
+// with 0.12.
+#define MINHASH_PERM_BITS 6
+#define MINHASH_PERMS (1 << MINHASH_PERM_BITS)
+#define MINHASH_BANDS 16
+#define MINHASH_ROWS (MINHASH_PERMS / MINHASH_BANDS)
+#define MINHASH_SHINGLE 3
+#define MINHASH_SIG_BYTES (MINHASH_PERMS * 4)
+
+typedef struct {
+    uint32_t mins[MINHASH_PERMS];
+    uint64_t window[MINHASH_SHINGLE]; // hashes of the last tokens
+    size_t tokens;
+    int keep;      // also collect the shingle set (for minhash_jaccard)
+    uint64_t *set; // shingle hashes, sorted and unique after minhash_finish
+    size_t set_len;
+    size_t set_cap;
+    int failed; // an allocation failed; the set is incomplete
+} minhash_t;
+
+void minhash_init(minhash_t *m, int keep);
+void minhash_reset(minhash_t *m);
+void minhash_free(minhash_t *m);
+// text_token_fn that feeds the minhash_t passed as userdata.
+void minhash_add(void *userdata, const char *token, size_t len);
+// Texts shorter than a shingle become one shingle of all their tokens.
+void minhash_finish(minhash_t *m);
+// Whether the text had any tokens; empty texts get no band keys.
+int minhash_empty(const minhash_t *m);
+
+void minhash_bands(const uint32_t mins[MINHASH_PERMS], int64_t keys[MINHASH_BANDS]);
+void minhash_encode(const uint32_t mins[MINHASH_PERMS], unsigned char out[MINHASH_SIG_BYTES]);
+int minhash_decode(const void *blob, size_t len, uint32_t mins[MINHASH_PERMS]);
+// Share of positions where two signatures agree: an estimate of the Jaccard similarity.
+double minhash_estimate(const uint32_t a[MINHASH_PERMS], const uint32_t b[MINHASH_PERMS]);
+// Exact Jaccard similarity of two sets from minhash_finish with keep set.
+double minhash_jaccard(const minhash_t *a, const minhash_t *b);
+// The same for sorted, unique shingle sets kept elsewhere.
+double minhash_set_jaccard(const uint64_t *a, size_t alen, const uint64_t *b, size_t blen);
+
+#endif // MINHASH_H
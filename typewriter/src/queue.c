@@ -0,0 +1,76 @@
+#include "queue.h"
+#include <stdlib.h>
+
+int queue_init(queue_t *q, size_t cap) {
+    if (!q || cap == 0) return -1;
+    q->items = calloc(cap, sizeof(void *));
+    if (!q->items) return -1;
+    q->cap = cap;
+    q->head = 0;
+    q->len = 0;
+    q->closed = 0;
+    pthread_mutex_init(&q->mu, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+void queue_destroy(queue_t *q) {
+    if (!q || !q->items) return;
+    pthread_mutex_destroy(&q->mu);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+    q->items = NULL;
+}
+
+// Blocks while the queue is full. Returns -1 once the queue has been closed.
+int queue_push(queue_t *q, void *item) {
+    pthread_mutex_lock(&q->mu);
+    while (q->len == q->cap && !q->closed) pthread_cond_wait(&q->not_full, &q->mu);
+    if (q->closed) {
+        pthread_mutex_unlock(&q->mu);
+        return -1;
+    }
+    q->items[(q->head + q->len) % q->cap] = item;
+    q->len++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mu);
+    return 0;
+}
+
+// Blocks while the queue is empty. Returns NULL once it is closed and drained.
+void *queue_pop(queue_t *q) {
+    pthread_mutex_lock(&q->mu);
+    while (q->len == 0 && !q->closed) pthread_cond_wait(&q->not_empty, &q->mu);
+    void *item = NULL;
+    if (q->len > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->len--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->mu);
+    return item;
+}
+
+void *queue_try_pop(queue_t *q) {
+    pthread_mutex_lock(&q->mu);
+    void *item = NULL;
+    if (q->len > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->len--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->mu);
+    return item;
+}
+
+void queue_close(queue_t *q) {
+    pthread_mutex_lock(&q->mu);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mu);
+}
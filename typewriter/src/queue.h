@@ -0,0 +1,27 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Bounded blocking FIFO of pointers, safe for multiple producers and consumers.
+typedef struct {
+    void **items;
+    size_t cap;
+    size_t head;
+    size_t len;
+    int closed;
+    pthread_mutex_t mu;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue_t;
+
+int queue_init(queue_t *q, size_t cap);
+void queue_destroy(queue_t *q);
+int queue_push(queue_t *q, void *item);
+void *queue_pop(queue_t *q);
+// Like queue_pop, but returns NULL at once when the queue is empty.
+void *queue_try_pop(queue_t *q);
+void queue_close(queue_t *q);
+
+#endif // QUEUE_H
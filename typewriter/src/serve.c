@@ -0,0 +1,435 @@
+#include "serve.h"
+#include "thread_pool.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_CLIENT_TIMEOUT_SEC 10
+// How long a worker waits for the rest of a request (or for a client to take its answer) once
+// the connection has become readable.
+#define SERVE_REQUEST_TIMEOUT_SEC 2
+
+static volatile sig_atomic_t serve_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+int serve_execute(session_store_t *store, shard_reader_t *shards, const serve_request_t *req, FILE *out) {
+    switch (req->op) {
+    case SERVE_OP_SEARCH:
+        if (shards) return shard_reader_search(shards, req->query ? req->query : "", req->arg, out);
+        return session_store_search(store, req->query ? req->query : "", req->arg, out);
+    case SERVE_OP_GET: {
+        session_t s = {0};
+        int rc = shards ? shard_reader_get(shards, req->arg, &s) : session_store_get(store, req->arg, &s);
+        if (rc < 0) return -1;
+        if (rc == 1) {
+            fprintf(out, "Session not found in DB\n");
+            return 0;
+        }
+        fprintf(out, "Session #%d (%s)\n%s\n", s.id, s.created_at, s.text);
+        session_free(&s);
+        return 0;
+    }
+    case SERVE_OP_STATS: {
+        store_stats_t stats = {0};
+        if (session_store_stats(store, &stats) != 0) return -1;
+        // The counts already include the sealed years (see session_store_seal_range), their files and
+        // newest session (when the current store is empty) not.
+        for (size_t i = 0; shards && i < shards->count; i++) {
+            store_stats_t sealed = {0};
+            if (session_store_stats(&shards->sealed[i], &sealed) != 0) return -1;
+            stats.db_size_bytes += sealed.db_size_bytes;
+            if (strcmp(sealed.last_created_at, stats.last_created_at) > 0) {
+                memcpy(stats.last_created_at, sealed.last_created_at, sizeof(stats.last_created_at));
+            }
+        }
+        fprintf(out, "Sessions: %d\nWords: %lld\nLast created_at: %s\nDB size: %lld bytes\n", stats.count,
+                stats.words, stats.last_created_at, stats.db_size_bytes);
+        return 0;
+    }
+    case SERVE_OP_REPORT: {
+        char period[16];
+        char from[16];
+        char to[16];
+        if (!req->query || sscanf(req->query, "%15s %15s %15s", period, from, to) != 3) return -1;
+        return session_store_report(store, period, strcmp(from, "-") ? from : NULL, strcmp(to, "-") ? to : NULL,
+                                    out);
+    }
+    case SERVE_OP_TERMS: {
+        int id = req->query ? atoi(req->query) : 0;
+        session_store_t *holder = id > 0 && shards ? shard_reader_find(shards, id) : NULL;
+        return session_store_top_terms(holder ? holder : store, id, req->arg, out);
+    }
+    }
+    return -1;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int connect_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_socket_path(const char *db_path, char *buf, size_t len) {
+    struct sockaddr_un addr;
+    int n = snprintf(buf, len, "%s.sock", db_path);
+    return n < 0 || (size_t)n >= len || (size_t)n >= sizeof(addr.sun_path) ? -1 : 0;
+}
+
+// Which file a path names right now: a restored store or a rewritten manifest is a new file
+// (both are renamed into place), so a change of inode means the worker must reopen.
+typedef struct {
+    int exists;
+    dev_t dev;
+    ino_t ino;
+} file_id_t;
+
+static file_id_t file_id(const char *path) {
+    struct stat st;
+    file_id_t id = {0};
+    if (path && stat(path, &st) == 0) {
+        id.exists = 1;
+        id.dev = st.st_dev;
+        id.ino = st.st_ino;
+    }
+    return id;
+}
+
+static int same_file(file_id_t a, file_id_t b) {
+    return a.exists == b.exists && (!a.exists || (a.dev == b.dev && a.ino == b.ino));
+}
+
+typedef struct {
+    const char *db_path;
+    char *manifest;
+    file_id_t db_id;
+    file_id_t manifest_id;
+    int open;
+    session_store_t store;
+    shard_reader_t shards;
+    unsigned char *buf; // one request, SERVE_MAX_REQUEST + 1 bytes
+    int back;           // write end of the pipe that hands connections back to the accept loop
+} serve_worker_t;
+
+static void worker_close(serve_worker_t *w) {
+    if (!w->open) return;
+    shard_reader_close(&w->shards);
+    session_store_close(&w->store);
+    memset(&w->store, 0, sizeof(w->store));
+    memset(&w->shards, 0, sizeof(w->shards));
+    w->open = 0;
+}
+
+// (Re)opens the worker's connections if the store or the manifest was replaced since.
+static int worker_refresh(serve_worker_t *w) {
+    file_id_t db = file_id(w->db_path);
+    file_id_t manifest = file_id(w->manifest);
+    if (w->open && same_file(db, w->db_id) && same_file(manifest, w->manifest_id)) return 0;
+    worker_close(w);
+    if (session_store_open_readonly(&w->store, w->db_path) != 0) return -1;
+    if (shard_reader_open(&w->shards, &w->store, w->db_path, 0) != 0) {
+        session_store_close(&w->store);
+        memset(&w->store, 0, sizeof(w->store));
+        return -1;
+    }
+    w->db_id = db;
+    w->manifest_id = manifest;
+    w->open = 1;
+    return 0;
+}
+
+// One job per request: the accept loop hands out a connection once it is readable, the worker
+// answers one request and gives the connection back, so idle clients hold no worker.
+static void handle_request(void *worker_ctx, void *job) {
+    serve_worker_t *w = worker_ctx;
+    int fd = *(int *)job;
+    free(job);
+    unsigned char *buf = w->buf;
+    if (read_full(fd, buf, 4) != 0) {
+        close(fd);
+        return;
+    }
+    uint32_t len = get_u32(buf);
+    if (len < 5 || len > SERVE_MAX_REQUEST || read_full(fd, buf, len) != 0) {
+        close(fd);
+        return;
+    }
+    buf[len] = '\0';
+    serve_request_t req = {.op = (char)buf[0], .arg = (int)(int32_t)get_u32(buf + 1), .query = (char *)buf + 5};
+
+    char *text = NULL;
+    size_t text_len = 0;
+    FILE *out = open_memstream(&text, &text_len);
+    int rc = -1;
+    if (out && worker_refresh(w) != 0) fprintf(out, "Datenbank konnte nicht neu geöffnet werden\n");
+    else if (out) rc = serve_execute(&w->store, &w->shards, &req, out);
+    if (out) fclose(out);
+    unsigned char hdr[5];
+    put_u32(hdr, (uint32_t)(text_len + 1));
+    hdr[4] = rc == 0 ? 0 : 1;
+    int sent = write_full(fd, hdr, sizeof(hdr)) == 0 && write_full(fd, text, text_len) == 0;
+    free(text);
+    if (!sent || write_full(w->back, &fd, sizeof(fd)) != 0) close(fd);
+}
+
+static int listen_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket-Pfad zu lang: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int probe = connect_socket(path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "Daemon läuft bereits auf %s\n", path);
+        return -1;
+    }
+    // Nobody answers, so whatever is left there is a stale socket from an unclean shutdown.
+    unlink(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc != 0 || listen(fd, 64) != 0) {
+        perror("serve");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The connections waiting for their next request, polled together with the listening socket and
+// the pipe the workers hand connections back through.
+typedef struct {
+    struct pollfd *fds;
+    size_t count;
+    size_t cap;
+} poll_set_t;
+
+static int poll_set_add(poll_set_t *set, int fd) {
+    if (set->count == set->cap) {
+        size_t cap = set->cap ? set->cap * 2 : 16;
+        struct pollfd *fds = realloc(set->fds, cap * sizeof(*fds));
+        if (!fds) return -1;
+        set->fds = fds;
+        set->cap = cap;
+    }
+    set->fds[set->count++] = (struct pollfd){.fd = fd, .events = POLLIN};
+    return 0;
+}
+
+static void add_client(poll_set_t *set, int fd) {
+    if (poll_set_add(set, fd) != 0) close(fd);
+}
+
+int serve_run(const char *db_path, const char *socket_path, int threads) {
+    if (threads < 1) threads = 1;
+    // Migrations need a writable connection; the workers only ever read.
+    session_store_t rw = {0};
+    if (session_store_open(&rw, db_path) != 0) return -1;
+    int rc = session_store_init_schema(&rw);
+    session_store_close(&rw);
+    if (rc != 0) return -1;
+
+    // Each worker keeps its own connections to the sealed shards too; requests already run in
+    // parallel, so a worker searches its shards one after another. A worker reopens them before
+    // a request once the store was restored or the shards were rewritten.
+    serve_worker_t *workers = calloc((size_t)threads, sizeof(serve_worker_t));
+    void **ctx = calloc((size_t)threads, sizeof(void *));
+    char *manifest = shard_manifest_path(db_path);
+    int back[2] = {-1, -1};
+    poll_set_t set = {0};
+    int opened = 0;
+    int fd = -1;
+    rc = -1;
+    if (!workers || !ctx || !manifest || pipe(back) != 0) goto done;
+    for (; opened < threads; opened++) {
+        serve_worker_t *w = &workers[opened];
+        w->db_path = db_path;
+        w->manifest = manifest;
+        w->back = back[1];
+        if (!(w->buf = malloc(SERVE_MAX_REQUEST + 1)) || worker_refresh(w) != 0) {
+            free(w->buf);
+            goto done;
+        }
+        ctx[opened] = w;
+    }
+    if ((fd = listen_socket(socket_path)) < 0) goto done;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    thread_pool_t pool;
+    if (thread_pool_init(&pool, threads, (size_t)threads * 4, handle_request, ctx) != 0) goto done;
+    printf("Serving %s on %s (%d Threads)\n", db_path, socket_path, threads);
+    fflush(stdout);
+    rc = 0;
+    if (poll_set_add(&set, fd) != 0 || poll_set_add(&set, back[0]) != 0) rc = -1;
+    // Wakes up regularly so a shutdown is noticed even while every client sits idle.
+    while (rc == 0 && !serve_stop) {
+        int n = poll(set.fds, (nfds_t)set.count, 500);
+        if (n < 0 && errno != EINTR) {
+            perror("poll");
+            rc = -1;
+        }
+        if (n <= 0) continue;
+        // Clients first: those added below are polled from the next round on.
+        for (size_t i = 2; i < set.count;) {
+            struct pollfd p = set.fds[i];
+            if (!p.revents) {
+                i++;
+                continue;
+            }
+            set.fds[i] = set.fds[--set.count];
+            // A readable connection carries a request or its end; the worker tells them apart.
+            int *job = (p.revents & POLLIN) ? malloc(sizeof(int)) : NULL;
+            if (job) *job = p.fd;
+            if (!job || thread_pool_submit(&pool, job) != 0) {
+                free(job);
+                close(p.fd);
+            }
+        }
+        if (set.fds[1].revents) {
+            int returned;
+            if (read_full(back[0], &returned, sizeof(returned)) == 0) add_client(&set, returned);
+        }
+        if (set.fds[0].revents) {
+            int client = accept(fd, NULL, NULL);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                perror("accept");
+                rc = -1;
+                break;
+            }
+            struct timeval tv = {.tv_sec = SERVE_REQUEST_TIMEOUT_SEC};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            add_client(&set, client);
+        }
+    }
+    serve_stop = 1;
+    thread_pool_destroy(&pool);
+    // The workers are gone; whatever they handed back is in the pipe.
+    close(back[1]);
+    back[1] = -1;
+    int returned;
+    while (read_full(back[0], &returned, sizeof(returned)) == 0) close(returned);
+    for (size_t i = 2; i < set.count; i++) close(set.fds[i].fd);
+
+done:
+    if (fd >= 0) {
+        close(fd);
+        unlink(socket_path);
+    }
+    for (int i = 0; i < opened; i++) {
+        worker_close(&workers[i]);
+        free(workers[i].buf);
+    }
+    if (back[0] >= 0) close(back[0]);
+    if (back[1] >= 0) close(back[1]);
+    free(set.fds);
+    free(manifest);
+    free(workers);
+    free(ctx);
+    return rc;
+}
+
+int serve_client_request(const char *socket_path, const serve_request_t *req, FILE *out) {
+    size_t qlen = req->query ? strlen(req->query) : 0;
+    if (qlen + 5 > SERVE_MAX_REQUEST) return -1;
+    int fd = connect_socket(socket_path);
+    if (fd < 0) return -1;
+    struct timeval tv = {.tv_sec = SERVE_CLIENT_TIMEOUT_SEC};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    unsigned char hdr[9];
+    put_u32(hdr, (uint32_t)(qlen + 5));
+    hdr[4] = (unsigned char)req->op;
+    put_u32(hdr + 5, (uint32_t)req->arg);
+    unsigned char resp[5];
+    if (write_full(fd, hdr, sizeof(hdr)) != 0 || write_full(fd, req->query, qlen) != 0 ||
+        read_full(fd, resp, sizeof(resp)) != 0 || get_u32(resp) == 0) {
+        // Nothing has been printed yet, so the caller can still answer locally.
+        close(fd);
+        return -1;
+    }
+    size_t left = get_u32(resp) - 1;
+    int status = resp[4] == 0 ? 0 : 1;
+    char chunk[16384];
+    while (left > 0) {
+        size_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+        if (read_full(fd, chunk, n) != 0) {
+            fprintf(stderr, "Verbindung zum Daemon abgebrochen\n");
+            status = 1;
+            break;
+        }
+        fwrite(chunk, 1, n, out);
+        left -= n;
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "session_store.h"
+#include "shard.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// Wire format over the Unix socket, all integers big-endian:
+//   request:  u32 length | u8 op | u32 arg | query bytes (search only)
+//   response: u32 length | u8 status (0 ok, 1 error) | output text
+// arg is the result limit for search and terms and the session id for get. report sends
+// "GRANULARITY FROM TO" as its query, with "-" for an open bound; terms sends the session id
+// (empty for all sessions).
+#define SERVE_OP_SEARCH 's'
+#define SERVE_OP_GET 'g'
+#define SERVE_OP_STATS 't'
+#define SERVE_OP_REPORT 'r'
+#define SERVE_OP_TERMS 'w'
+#define SERVE_MAX_REQUEST 65536
+
+typedef struct {
+    char op;
+    int arg;
+    const char *query;
+} serve_request_t;
+
+// Runs one request against store and writes what the CLI would print to out. search, get,
+// terms for one session and the size in stats also cover the sealed shards in shards, which
+// may be NULL; the other counts come from totals the store keeps for them.
+int serve_execute(session_store_t *store, shard_reader_t *shards, const serve_request_t *req, FILE *out);
+
+int serve_socket_path(const char *db_path, char *buf, size_t len);
+int serve_run(const char *db_path, const char *socket_path, int threads);
+
+// Returns -1 when no daemon answers on socket_path (callers fall back to opening the DB),
+// otherwise 0 or 1 for the request's own status after printing its output to out.
+int serve_client_request(const char *socket_path, const serve_request_t *req, FILE *out);
+
+#endif // SERVE_H
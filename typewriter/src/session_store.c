@@ -1,26 +1,562 @@
 #include "session_store.h"
+#include "delta.h"
+#include "fts_german.h"
 #include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+enum {
+    STMT_UPSERT,
+    STMT_UPSERT_BULK,
+    STMT_GET,
+    STMT_SEARCH,
+    STMT_META_GET,
+    STMT_META_SET,
+    STMT_STATS,
+    STMT_REPORT,
+    STMT_STREAKS,
+    STMT_MATCH_IDS,
+    STMT_EACH,
+    STMT_TERMS_SET,
+    STMT_TOP_TERMS,
+    STMT_TOP_TERMS_ALL,
+    STMT_SCAN,
+    STMT_MARK_PAGE,
+    STMT_SEARCH_RANKED,
+    STMT_SNIPPET,
+    STMT_SIG_GET,
+    STMT_SIG_SET,
+    STMT_LSH_ADD,
+    STMT_LSH_DEL,
+    STMT_LSH_ADD_ALL,
+    STMT_DOC_HEAD,
+    STMT_DOC_CHAIN,
+    STMT_DOC_ADD,
+    STMT_CONTAINS,
+    STMT_LAST // must stay <= STORE_STMT_COUNT
+};
+
+// Statements are prepared on first use and kept until session_store_close.
+static sqlite3_stmt *cached_stmt(session_store_t *store, int slot, const char *sql) {
+    sqlite3_stmt *stmt = store->stmts[slot];
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return stmt;
+    }
+    if (sqlite3_prepare_v3(store->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) return NULL;
+    store->stmts[slot] = stmt;
+    return stmt;
+}
+
+static int register_functions(session_store_t *store);
+
 int session_store_open(session_store_t *store, const char *path) {
     if (sqlite3_open(path, &store->db) != SQLITE_OK) {
         fprintf(stderr, "Could not open database: %s\n", sqlite3_errmsg(store->db));
         return -1;
     }
     sqlite3_exec(store->db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
-    return 0;
+    return register_functions(store);
+}
+
+// Query-only connection for readers such as the serve daemon: no schema DDL, no WAL switch.
+int session_store_open_readonly(session_store_t *store, const char *path) {
+    if (sqlite3_open_v2(path, &store->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Could not open database: %s\n", sqlite3_errmsg(store->db));
+        sqlite3_close(store->db);
+        store->db = NULL;
+        return -1;
+    }
+    return register_functions(store);
+}
+
+// Opens a sealed shard, which nothing writes any more: immutable=1 skips locking and change
+// detection, and the whole file stays memory-mapped for as long as the connection is open.
+int session_store_open_immutable(session_store_t *store, const char *path) {
+    char uri[4200] = "file:";
+    size_t n = 5;
+    for (const char *p = path; *p; p++) {
+        if (n + 4 + sizeof("?immutable=1") > sizeof(uri)) {
+            fprintf(stderr, "Pfad zu lang: %s\n", path);
+            return -1;
+        }
+        // The URI parser would take these for the query, fragment or an escape.
+        if (*p == '%' || *p == '?' || *p == '#') n += (size_t)sprintf(uri + n, "%%%02X", (unsigned char)*p);
+        else uri[n++] = *p;
+    }
+    strcpy(uri + n, "?immutable=1");
+    if (sqlite3_open_v2(uri, &store->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Could not open database: %s\n", sqlite3_errmsg(store->db));
+        sqlite3_close(store->db);
+        store->db = NULL;
+        return -1;
+    }
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA mmap_size=%lld;", STORE_SCAN_MMAP_BYTES);
+    sqlite3_exec(store->db, sql, NULL, NULL, NULL);
+    return register_functions(store);
 }
 
 void session_store_close(session_store_t *store) {
     if (!store || !store->db) return;
+    if (store->bulk) session_store_bulk_end(store);
+    for (int i = 0; i < STORE_STMT_COUNT; i++) {
+        sqlite3_finalize(store->stmts[i]);
+        store->stmts[i] = NULL;
+    }
+    text_terms_free(&store->terms);
+    free(store->minhash);
+    store->minhash = NULL;
+    free(store->scratch);
+    store->scratch = NULL;
+    store->scratch_cap = 0;
+    text_codec_free(store->codec);
+    store->codec = NULL;
     sqlite3_close(store->db);
     store->db = NULL;
 }
 
-int session_store_init_schema(session_store_t *store) {
+// sessions_fts is an external-content index over the plain texts (the sessions_plain view,
+// since sessions.text may be compressed); these triggers keep it in step. Updates that leave
+// the text alone (e.g. only counts changed) do not touch the index.
+#define FTS_TRIGGERS                                                                                               \
+    "CREATE TRIGGER IF NOT EXISTS sessions_fts_ai AFTER INSERT ON sessions BEGIN "                                 \
+    "INSERT INTO sessions_fts(rowid, text) VALUES (new.id, tw_text(new.text)); END;"                               \
+    "CREATE TRIGGER IF NOT EXISTS sessions_fts_ad AFTER DELETE ON sessions BEGIN "                                 \
+    "INSERT INTO sessions_fts(sessions_fts, rowid, text) VALUES ('delete', old.id, tw_text(old.text)); END;"       \
+    "CREATE TRIGGER IF NOT EXISTS sessions_fts_au AFTER UPDATE OF text ON sessions "                               \
+    "WHEN old.text IS NOT new.text BEGIN "                                                                         \
+    "INSERT INTO sessions_fts(sessions_fts, rowid, text) VALUES ('delete', old.id, tw_text(old.text));"            \
+    "INSERT INTO sessions_fts(rowid, text) VALUES (new.id, tw_text(new.text)); END;"
+
+#define FTS_DROP_TRIGGERS                                                                                          \
+    "DROP TRIGGER IF EXISTS sessions_fts_ai;"                                                                      \
+    "DROP TRIGGER IF EXISTS sessions_fts_ad;"                                                                      \
+    "DROP TRIGGER IF EXISTS sessions_fts_au;"
+
+// session_totals holds per-day, per-week (starting Monday) and per-month sums plus one 'all'
+// row, kept up to date by triggers so report and stats never scan sessions.
+#define TOTALS_WEEK(row) "COALESCE(date(substr(" row ".created_at, 1, 10), '-6 days', 'weekday 1'), '')"
+#define TOTALS_ADD(row, sign)                                                                                      \
+    "INSERT INTO session_totals (period, bucket, sessions, words, chars) VALUES "                                 \
+    "('day', substr(" row ".created_at, 1, 10), " sign "1, " sign row ".word_count, " sign row ".char_count),"     \
+    "('week', " TOTALS_WEEK(row) ", " sign "1, " sign row ".word_count, " sign row ".char_count),"                 \
+    "('month', substr(" row ".created_at, 1, 7), " sign "1, " sign row ".word_count, " sign row ".char_count),"    \
+    "('all', '', " sign "1, " sign row ".word_count, " sign row ".char_count) "                                    \
+    "ON CONFLICT(period, bucket) DO UPDATE SET sessions = sessions + excluded.sessions,"                          \
+    "words = words + excluded.words, chars = chars + excluded.chars;"
+
+#define TOTALS_TRIGGERS                                                                                            \
+    "CREATE TRIGGER IF NOT EXISTS sessions_totals_ai AFTER INSERT ON sessions BEGIN " TOTALS_ADD("new", "")       \
+    " END;"                                                                                                        \
+    "CREATE TRIGGER IF NOT EXISTS sessions_totals_ad AFTER DELETE ON sessions BEGIN " TOTALS_ADD("old", "-")      \
+    " END;"                                                                                                        \
+    "CREATE TRIGGER IF NOT EXISTS sessions_totals_au AFTER UPDATE OF created_at, word_count, char_count "          \
+    "ON sessions WHEN old.created_at IS NOT new.created_at OR old.word_count IS NOT new.word_count "               \
+    "OR old.char_count IS NOT new.char_count BEGIN " TOTALS_ADD("old", "-") TOTALS_ADD("new", "") " END;"
+
+#define TOTALS_REBUILD                                                                                             \
+    "DELETE FROM session_totals;"                                                                                  \
+    "INSERT INTO session_totals SELECT 'day', substr(created_at, 1, 10), COUNT(*), SUM(word_count), "             \
+    "SUM(char_count) FROM sessions GROUP BY 2;"                                                                    \
+    "INSERT INTO session_totals SELECT 'week', " TOTALS_WEEK("sessions") ", COUNT(*), SUM(word_count), "          \
+    "SUM(char_count) FROM sessions GROUP BY 2;"                                                                    \
+    "INSERT INTO session_totals SELECT 'month', substr(created_at, 1, 7), COUNT(*), SUM(word_count), "            \
+    "SUM(char_count) FROM sessions GROUP BY 2;"                                                                    \
+    "INSERT INTO session_totals SELECT 'all', '', COUNT(*), COALESCE(SUM(word_count), 0), "                       \
+    "COALESCE(SUM(char_count), 0) FROM sessions;"
+
+// Sealing a range deletes its rows, and with them their share of session_totals. These put it
+// back first (?1 and ?2 bound to the range), so report and stats keep counting the sealed
+// years without opening their shards; sealed_terms keeps their term counts for terms.
+#define TOTALS_KEEP_RANGE                                                                                          \
+    "INSERT INTO session_totals (period, bucket, sessions, words, chars) SELECT * FROM ("                         \
+    "SELECT 'day', substr(created_at, 1, 10), COUNT(*), SUM(word_count), SUM(char_count) FROM sessions "          \
+    "WHERE created_at >= ?1 AND created_at < ?2 GROUP BY 2 UNION ALL "                                            \
+    "SELECT 'week', " TOTALS_WEEK("sessions") ", COUNT(*), SUM(word_count), SUM(char_count) FROM sessions "       \
+    "WHERE created_at >= ?1 AND created_at < ?2 GROUP BY 2 UNION ALL "                                            \
+    "SELECT 'month', substr(created_at, 1, 7), COUNT(*), SUM(word_count), SUM(char_count) FROM sessions "         \
+    "WHERE created_at >= ?1 AND created_at < ?2 GROUP BY 2 UNION ALL "                                            \
+    "SELECT 'all', '', COUNT(*), COALESCE(SUM(word_count), 0), COALESCE(SUM(char_count), 0) FROM sessions "       \
+    "WHERE created_at >= ?1 AND created_at < ?2) WHERE true "                                                     \
+    "ON CONFLICT(period, bucket) DO UPDATE SET sessions = sessions + excluded.sessions,"                          \
+    "words = words + excluded.words, chars = chars + excluded.chars;"
+#define TERMS_KEEP_RANGE                                                                                           \
+    "INSERT INTO sealed_terms (term, n) SELECT j.key, SUM(j.value) FROM sessions s "                              \
+    "JOIN session_terms t ON t.session_id = s.id, json_each(t.terms) j "                                          \
+    "WHERE s.created_at >= ?1 AND s.created_at < ?2 GROUP BY j.key "                                              \
+    "ON CONFLICT(term) DO UPDATE SET n = n + excluded.n;"
+
+static int exec_sql(session_store_t *store, const char *sql, const char *what) {
+    char *errmsg = NULL;
+    if (sqlite3_exec(store->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", what, errmsg);
+        sqlite3_free(errmsg);
+        return -1;
+    }
+    return 0;
+}
+
+static int schema_has(session_store_t *store, const char *type, const char *name, const char *needle) {
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = "SELECT sql FROM sqlite_master WHERE type = ? AND name = ?";
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return 0;
+    sqlite3_bind_text(stmt, 1, type, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+    int found = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *v = (const char *)sqlite3_column_text(stmt, 0);
+        found = !needle || (v && strstr(v, needle));
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static void count_row_fn(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    session_store_t *store = sqlite3_user_data(ctx);
+    (void)argc;
+    metrics_add(store->metrics, sqlite3_value_int(argv[0]) ? METRIC_ROWS_UPDATED : METRIC_ROWS_INSERTED, 1);
+}
+
+// Changing PRAGMA temp_store deletes temporary triggers, so bulk_begin/_end call this again.
+static int install_count_triggers(session_store_t *store) {
+    if (!store->metrics) return 0;
+    return exec_sql(store,
+                    "CREATE TEMP TRIGGER IF NOT EXISTS metrics_sessions_ai AFTER INSERT ON main.sessions "
+                    "BEGIN SELECT tw_count_row(0); END;"
+                    "CREATE TEMP TRIGGER IF NOT EXISTS metrics_sessions_au AFTER UPDATE ON main.sessions "
+                    "BEGIN SELECT tw_count_row(1); END;",
+                    "DB error");
+}
+
+// Attaches phase timers and, through temporary triggers on this connection only, counts
+// inserted vs. updated rows (an upsert cannot tell them apart otherwise). NULL detaches.
+int session_store_set_metrics(session_store_t *store, metrics_t *m) {
+    store->metrics = m;
+    if (!m) {
+        return exec_sql(store, "DROP TRIGGER IF EXISTS temp.metrics_sessions_ai;"
+                               "DROP TRIGGER IF EXISTS temp.metrics_sessions_au;",
+                        "DB error");
+    }
+    if (sqlite3_create_function(store->db, "tw_count_row", 1, SQLITE_UTF8, store, count_row_fn, NULL, NULL) !=
+        SQLITE_OK) {
+        return -1;
+    }
+    return install_count_triggers(store);
+}
+
+static text_codec_t *store_codec(session_store_t *store) {
+    if (!store->codec) store->codec = text_codec_new();
+    return store->codec;
+}
+
+// Loads the dictionary with zstd id from text_dicts, or with id 0 the newest one, which then
+// also compresses new texts at its level.
+static int load_dict(session_store_t *store, unsigned id) {
+    const char *sql = id ? "SELECT dict, 0 FROM text_dicts WHERE zstd_id = ?"
+                         : "SELECT dict, level FROM text_dicts ORDER BY id DESC LIMIT 1";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (id) sqlite3_bind_int64(stmt, 1, id);
+    int rc = -1;
+    text_codec_t *codec = store_codec(store);
+    if (codec && sqlite3_step(stmt) == SQLITE_ROW) {
+        rc = text_codec_add_dict(codec, sqlite3_column_blob(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0),
+                                 sqlite3_column_int(stmt, 1));
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Loads the dictionary a compressed text needs and returns the text's size, or -1 with *err set.
+static long long frame_text_size(session_store_t *store, const void *frame, size_t len, const char **err) {
+    if (!text_codec_enabled()) {
+        *err = "Text ist zstd-komprimiert, typewriter mit make ZSTD=1 bauen";
+        return -1;
+    }
+    unsigned id = text_codec_frame_dict_id(frame, len);
+    text_codec_t *codec = store_codec(store);
+    if (!codec || (!text_codec_has_dict(codec, id) && load_dict(store, id) != 0)) {
+        *err = "Wörterbuch für komprimierten Text fehlt";
+        return -1;
+    }
+    long long n = text_codec_text_size(frame, len);
+    if (n < 0) *err = "Komprimierter Text ist beschädigt";
+    return n;
+}
+
+// tw_text(x): the plain text of a sessions.text value, which is either TEXT or a zstd frame
+// (BLOB) compressed with one of the dictionaries in text_dicts.
+static void text_fn(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+        sqlite3_result_value(ctx, argv[0]);
+        return;
+    }
+    session_store_t *store = sqlite3_user_data(ctx);
+    const void *frame = sqlite3_value_blob(argv[0]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+    const char *err = "Komprimierter Text ist beschädigt";
+    long long n = frame_text_size(store, frame, len, &err);
+    char *text = n >= 0 ? sqlite3_malloc64((sqlite3_uint64)n + 1) : NULL;
+    if (!text || text_codec_decompress(store->codec, text, (size_t)n + 1, frame, len) != 0) {
+        sqlite3_free(text);
+        sqlite3_result_error(ctx, err, -1);
+        return;
+    }
+    text[n] = '\0';
+    sqlite3_result_text64(ctx, text, (sqlite3_uint64)n, sqlite3_free, SQLITE_UTF8);
+}
+
+// tw_pack(x): x as a zstd frame with the current dictionary when the store has one and the
+// frame is smaller, otherwise x unchanged.
+static void pack_fn(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    session_store_t *store = sqlite3_user_data(ctx);
+    if (sqlite3_value_type(argv[0]) != SQLITE_TEXT || !store->codec || !text_codec_can_compress(store->codec)) {
+        sqlite3_result_value(ctx, argv[0]);
+        return;
+    }
+    const char *text = (const char *)sqlite3_value_text(argv[0]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+    size_t cap = text_codec_bound(len);
+    void *frame = sqlite3_malloc64(cap);
+    size_t n = frame ? text_codec_compress(store->codec, frame, cap, text, len) : 0;
+    if (n == 0 || n >= len) {
+        sqlite3_free(frame);
+        sqlite3_result_value(ctx, argv[0]);
+        return;
+    }
+    sqlite3_result_blob64(ctx, frame, n, sqlite3_free);
+}
+
+// The schema (view, triggers) calls tw_text and sessions_fts uses tw_german, so every connection
+// needs them, readers included.
+static int register_functions(session_store_t *store) {
+    int flags = SQLITE_UTF8 | SQLITE_INNOCUOUS;
+    if (sqlite3_create_function(store->db, "tw_text", 1, flags | SQLITE_DETERMINISTIC, store, text_fn, NULL,
+                                NULL) != SQLITE_OK ||
+        sqlite3_create_function(store->db, "tw_pack", 1, flags, store, pack_fn, NULL, NULL) != SQLITE_OK ||
+        fts_german_register(store->db) != 0) {
+        fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    text_terms_t *terms;
+    minhash_t *minhash;
+} index_tokens_t;
+
+static void index_token(void *userdata, const char *token, size_t len) {
+    index_tokens_t *t = userdata;
+    text_terms_add(t->terms, token, len);
+    minhash_add(t->minhash, token, len);
+}
+
+static int64_t text_fingerprint(const char *text, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)text[i]) * 1099511628211ULL;
+    return (int64_t)h;
+}
+
+static void check_counts(session_store_t *store, const session_t *s, const text_stats_t *st) {
+    if (st->words != s->word_count || st->chars != s->char_count || st->letters != s->letter_count) {
+        store->count_mismatches++;
+        metrics_add(store->metrics, METRIC_COUNT_MISMATCHES, 1);
+    }
+}
+
+// Moves the session's LSH buckets from its old signature (NULL for none) to the new one. Bands
+// that did not change, as after a small edit, are left alone.
+static int update_buckets(session_store_t *store, int id, const uint32_t *old, const uint32_t *mins) {
+    int64_t old_keys[MINHASH_BANDS];
+    int64_t keys[MINHASH_BANDS];
+    if (old) minhash_bands(old, old_keys);
+    if (mins) minhash_bands(mins, keys);
+    if (!old && mins) {
+        // A new row takes all its bands in one statement.
+        char sql[80 + MINHASH_BANDS * 12];
+        if (!store->stmts[STMT_LSH_ADD_ALL]) {
+            char *w = sql + sprintf(sql, "INSERT OR IGNORE INTO session_lsh (bucket, session_id) VALUES ");
+            for (int b = 0; b < MINHASH_BANDS; b++) {
+                w += sprintf(w, b ? ",(?%d,?%d)" : "(?%d,?%d)", b + 1, MINHASH_BANDS + 1);
+            }
+            strcpy(w, ";");
+        }
+        sqlite3_stmt *stmt = cached_stmt(store, STMT_LSH_ADD_ALL, sql);
+        if (!stmt) return -1;
+        for (int b = 0; b < MINHASH_BANDS; b++) sqlite3_bind_int64(stmt, b + 1, keys[b]);
+        sqlite3_bind_int(stmt, MINHASH_BANDS + 1, id);
+        int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+        sqlite3_reset(stmt);
+        return rc;
+    }
+    for (int b = 0; b < MINHASH_BANDS; b++) {
+        if (old && mins && old_keys[b] == keys[b]) continue;
+        sqlite3_stmt *stmt = NULL;
+        if (old) {
+            stmt = cached_stmt(store, STMT_LSH_DEL, "DELETE FROM session_lsh WHERE bucket = ? AND session_id = ?;");
+            if (!stmt) return -1;
+            sqlite3_bind_int64(stmt, 1, old_keys[b]);
+            sqlite3_bind_int(stmt, 2, id);
+            int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+            sqlite3_reset(stmt);
+            if (rc != 0) return -1;
+        }
+        if (mins) {
+            stmt = cached_stmt(store, STMT_LSH_ADD,
+                               "INSERT OR IGNORE INTO session_lsh (bucket, session_id) VALUES (?, ?);");
+            if (!stmt) return -1;
+            sqlite3_bind_int64(stmt, 1, keys[b]);
+            sqlite3_bind_int(stmt, 2, id);
+            int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+            sqlite3_reset(stmt);
+            if (rc != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// An empty text has no shingles and stays out of the buckets.
+static int sig_empty(const uint32_t mins[MINHASH_PERMS]) {
+    for (int i = 0; i < MINHASH_PERMS; i++) {
+        if (mins[i] != UINT32_MAX) return 0;
+    }
+    return 1;
+}
+
+// Everything derived from the text alone: the MinHash signature with its LSH buckets, the
+// local counts and a fingerprint of the text, so a row whose text did not change (only its
+// counts or created_at did) skips the rescan.
+static int write_signature(session_store_t *store, const session_t *s, int64_t fp, const text_stats_t *st,
+                           const uint32_t *old) {
+    const minhash_t *m = store->minhash;
+    if (update_buckets(store, s->id, old && !sig_empty(old) ? old : NULL, minhash_empty(m) ? NULL : m->mins) != 0) {
+        return -1;
+    }
+    unsigned char sig[MINHASH_SIG_BYTES];
+    minhash_encode(m->mins, sig);
+    const char *sql = "INSERT INTO session_sigs (session_id, text_fp, words, chars, letters, sig) "
+                      "VALUES (?, ?, ?, ?, ?, ?) ON CONFLICT(session_id) DO UPDATE SET text_fp=excluded.text_fp, "
+                      "words=excluded.words, chars=excluded.chars, letters=excluded.letters, sig=excluded.sig;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_SIG_SET, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, s->id);
+    sqlite3_bind_int64(stmt, 2, fp);
+    sqlite3_bind_int(stmt, 3, st->words);
+    sqlite3_bind_int(stmt, 4, st->chars);
+    sqlite3_bind_int(stmt, 5, st->letters);
+    sqlite3_bind_blob(stmt, 6, sig, sizeof(sig), SQLITE_STATIC);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+#define SIG_GET_SQL "SELECT text_fp, words, chars, letters, sig FROM session_sigs WHERE session_id = ?"
+
+// Recounts words, chars and letters locally, flagging rows where the server's counts differ,
+// and stores the row's term frequencies and signature, all from a single scan of the text.
+// The terms are one JSON object per session ({"haus":3,...}); tokens are letters and digits
+// only, so they never need escaping, and SQL can still unpack them with json_each.
+static int index_terms(session_store_t *store, const session_t *s) {
+    long long started = metrics_now_ns();
+    size_t text_len = strlen(s->text);
+    int64_t fp = text_fingerprint(s->text, text_len);
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_SIG_GET, SIG_GET_SQL);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, s->id);
+    uint32_t old[MINHASH_PERMS];
+    int have = 0;
+    int same = 0;
+    text_stats_t st;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        have = minhash_decode(sqlite3_column_blob(stmt, 4), (size_t)sqlite3_column_bytes(stmt, 4), old) == 0;
+        same = have && sqlite3_column_int64(stmt, 0) == fp;
+        st = (text_stats_t){sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3)};
+    }
+    sqlite3_reset(stmt);
+    if (same) {
+        check_counts(store, s, &st);
+        metrics_add(store->metrics, METRIC_REINDEX_SKIPPED, 1);
+        metrics_time_since(store->metrics, METRIC_T_TERMS, started);
+        return 0;
+    }
+
+    if (!store->minhash) {
+        store->minhash = malloc(sizeof(minhash_t));
+        if (!store->minhash) return -1;
+        minhash_init(store->minhash, 0);
+    }
+    minhash_reset(store->minhash);
+    text_terms_t *t = &store->terms;
+    text_terms_reset(t);
+    index_tokens_t tokens = {t, store->minhash};
+    text_stats_scan(s->text, text_len, &st, index_token, &tokens);
+    minhash_finish(store->minhash);
+    if (t->failed) return -1;
+    check_counts(store, s, &st);
+    size_t need = t->arena_len + t->len * 16 + 3;
+    if (need > store->scratch_cap) {
+        char *buf = realloc(store->scratch, need);
+        if (!buf) return -1;
+        store->scratch = buf;
+        store->scratch_cap = need;
+    }
+    char *w = store->scratch;
+    *w++ = '{';
+    for (size_t i = 0; i < t->cap; i++) {
+        const text_term_t *e = &t->slots[i];
+        if (e->count == 0) continue;
+        if (w > store->scratch + 1) *w++ = ',';
+        *w++ = '"';
+        memcpy(w, t->arena + e->offset, e->len);
+        w += e->len;
+        w += sprintf(w, "\":%d", e->count);
+    }
+    *w++ = '}';
+    const char *sql = "INSERT INTO session_terms (session_id, terms) VALUES (?, ?) "
+                      "ON CONFLICT(session_id) DO UPDATE SET terms=excluded.terms;";
+    stmt = cached_stmt(store, STMT_TERMS_SET, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, s->id);
+    sqlite3_bind_text(stmt, 2, store->scratch, (int)(w - store->scratch), SQLITE_STATIC);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_reset(stmt);
+    if (rc == 0) rc = write_signature(store, s, fp, &st, have ? old : NULL);
+    metrics_time_since(store->metrics, METRIC_T_TERMS, started);
+    return rc;
+}
+
+static int backfill_terms(session_store_t *store) {
+    const char *sql = "SELECT id, created_at, word_count, char_count, letter_count, tw_text(text) FROM sessions";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    int rc = 0;
+    int step = SQLITE_DONE;
+    while (rc == 0 && (step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        session_t s = {
+            .id = sqlite3_column_int(stmt, 0),
+            .created_at = (char *)sqlite3_column_text(stmt, 1),
+            .word_count = sqlite3_column_int(stmt, 2),
+            .char_count = sqlite3_column_int(stmt, 3),
+            .letter_count = sqlite3_column_int(stmt, 4),
+            .text = (char *)sqlite3_column_text(stmt, 5),
+        };
+        rc = index_terms(store, &s);
+    }
+    if (rc == 0 && step != SQLITE_DONE) rc = -1;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Stores from before versioning (user_version 0) run every step, so the early ones check
+// what is already there.
+static int migrate_tables(session_store_t *store) {
     const char *sql =
         "CREATE TABLE IF NOT EXISTS sessions ("
         "id INTEGER PRIMARY KEY,"
@@ -33,31 +569,216 @@ int session_store_init_schema(session_store_t *store) {
         "synced_at TEXT NOT NULL"
         ");"
         "CREATE INDEX IF NOT EXISTS idx_sessions_created_at ON sessions(created_at DESC);"
-        "CREATE VIRTUAL TABLE IF NOT EXISTS sessions_fts USING fts5(text, content='');";
-    char *errmsg = NULL;
-    if (sqlite3_exec(store->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
-        fprintf(stderr, "DB schema error: %s\n", errmsg);
-        sqlite3_free(errmsg);
+        "CREATE TABLE IF NOT EXISTS sync_meta (key TEXT PRIMARY KEY, value TEXT NOT NULL);"
+        "CREATE TABLE IF NOT EXISTS sync_pages ("
+        "page_offset INTEGER NOT NULL,"
+        "page_limit INTEGER NOT NULL,"
+        "total INTEGER NOT NULL,"
+        "PRIMARY KEY (page_offset, page_limit, total)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS session_totals ("
+        "period TEXT NOT NULL,"
+        "bucket TEXT NOT NULL,"
+        "sessions INTEGER NOT NULL,"
+        "words INTEGER NOT NULL,"
+        "chars INTEGER NOT NULL,"
+        "PRIMARY KEY (period, bucket)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS text_dicts ("
+        "id INTEGER PRIMARY KEY,"
+        "zstd_id INTEGER NOT NULL UNIQUE,"
+        "level INTEGER NOT NULL,"
+        "dict BLOB NOT NULL,"
+        "created_at TEXT NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS session_sigs ("
+        "session_id INTEGER PRIMARY KEY,"
+        "text_fp INTEGER NOT NULL,"
+        "words INTEGER NOT NULL,"
+        "chars INTEGER NOT NULL,"
+        "letters INTEGER NOT NULL,"
+        "sig BLOB NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS session_lsh ("
+        "bucket INTEGER NOT NULL,"
+        "session_id INTEGER NOT NULL,"
+        "PRIMARY KEY (bucket, session_id)"
+        ") WITHOUT ROWID;"
+        "CREATE INDEX IF NOT EXISTS idx_session_lsh_session ON session_lsh(session_id);"
+        "CREATE VIEW IF NOT EXISTS sessions_plain AS SELECT id, tw_text(text) AS text FROM sessions;";
+    return exec_sql(store, sql, "DB schema error");
+}
+
+static int migrate_text_hash(session_store_t *store) {
+    if (schema_has(store, "table", "sessions", "text_hash")) return 0;
+    return exec_sql(store, "ALTER TABLE sessions ADD COLUMN text_hash TEXT;", "DB schema error");
+}
+
+// Stores from before session_totals (or with a trigger missing) get their sums computed once.
+static int migrate_totals(session_store_t *store) {
+    if (schema_has(store, "trigger", "sessions_totals_au", NULL)) return 0;
+    if (exec_sql(store, "BEGIN;" TOTALS_TRIGGERS TOTALS_REBUILD "COMMIT;", "DB schema error") != 0) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
         return -1;
     }
     return 0;
 }
 
-static int update_fts(sqlite3 *db, int id, const char *text) {
-    const char *del_sql = "DELETE FROM sessions_fts WHERE rowid = ?";
-    const char *ins_sql = "INSERT INTO sessions_fts(rowid, text) VALUES(?, ?)";
+// Term frequencies and signatures are written by the store itself (see index_terms); stores
+// from before session_terms get both computed once here, stores from before session_sigs
+// in migrate_sigs.
+#define SIGS_TRIGGER_SQL                                                                                               \
+    "CREATE TRIGGER IF NOT EXISTS sessions_sigs_ad AFTER DELETE ON sessions BEGIN "                                    \
+    "DELETE FROM session_sigs WHERE session_id = old.id;"                                                              \
+    "DELETE FROM session_lsh WHERE session_id = old.id; END;"
+
+static int migrate_terms(session_store_t *store) {
+    if (schema_has(store, "trigger", "sessions_terms_ad", NULL)) return 0;
+    const char *terms_sql =
+        "BEGIN;"
+        "CREATE TABLE IF NOT EXISTS session_terms (session_id INTEGER PRIMARY KEY, terms TEXT NOT NULL);"
+        "CREATE TRIGGER IF NOT EXISTS sessions_terms_ad AFTER DELETE ON sessions BEGIN "
+        "DELETE FROM session_terms WHERE session_id = old.id; END;" SIGS_TRIGGER_SQL;
+    if (exec_sql(store, terms_sql, "DB schema error") != 0 || backfill_terms(store) != 0 ||
+        exec_sql(store, "COMMIT;", "DB schema error") != 0) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+static int migrate_sigs(session_store_t *store) {
+    if (schema_has(store, "trigger", "sessions_sigs_ad", NULL)) return 0;
+    if (exec_sql(store, "BEGIN;" SIGS_TRIGGER_SQL, "DB schema error") != 0 || backfill_terms(store) != 0 ||
+        exec_sql(store, "COMMIT;", "DB schema error") != 0) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+// Document versions are mirrored by sync after the sessions (see history.h); doc_pending lists
+// the documents it saw a new version of and still has to fetch.
+static int migrate_history(session_store_t *store) {
+    const char *sql =
+        "CREATE TABLE doc_versions ("
+        "document_id INTEGER NOT NULL,"
+        "version INTEGER NOT NULL,"
+        "session_id INTEGER NOT NULL,"
+        "parent_id INTEGER,"
+        "created_at TEXT NOT NULL,"
+        "word_count INTEGER NOT NULL,"
+        "size INTEGER NOT NULL,"
+        "keyframe INTEGER NOT NULL,"
+        "chain INTEGER NOT NULL,"
+        "text TEXT,"
+        "delta BLOB,"
+        "PRIMARY KEY (document_id, version)"
+        ");"
+        "CREATE TABLE doc_pending (document_id INTEGER PRIMARY KEY, head_id INTEGER NOT NULL);";
+    return exec_sql(store, sql, "DB schema error");
+}
+
+// Term counts of the sessions moved to sealed shards (see TERMS_KEEP_RANGE).
+static int migrate_sealed_terms(session_store_t *store) {
+    return exec_sql(store, "CREATE TABLE sealed_terms (term TEXT PRIMARY KEY, n INTEGER NOT NULL) WITHOUT ROWID;",
+                    "DB schema error");
+}
+
+// Older stores index sessions directly (content='sessions', or contentless before that, which
+// can neither delete rows nor produce snippets) or with the plain unicode61 tokenizer: the index
+// is replaced once and refilled.
+// Missing triggers also mean the index may be behind (a bulk sync that never finished), so
+// every read-write open runs this check, not only the migration.
+static int migrate_fts(session_store_t *store) {
+    int migrate = schema_has(store, "table", "sessions_fts", NULL) &&
+                  (!schema_has(store, "table", "sessions_fts", "content='sessions_plain'") ||
+                   !schema_has(store, "table", "sessions_fts", "tokenize='tw_german'"));
+    int rebuild = migrate || !schema_has(store, "trigger", "sessions_fts_au", NULL);
+    if (!rebuild) return 0;
+    if (exec_sql(store, "BEGIN;", "DB schema error") != 0) return -1;
+    int rc = 0;
+    if (migrate) rc = exec_sql(store, "DROP TABLE sessions_fts;" FTS_DROP_TRIGGERS, "FTS migration error");
+    if (rc == 0) {
+        rc = exec_sql(store,
+                      "CREATE VIRTUAL TABLE IF NOT EXISTS sessions_fts USING fts5("
+                      "text, content='sessions_plain', content_rowid='id', prefix='2 3', tokenize='tw_german');"
+                      FTS_TRIGGERS
+                      "INSERT INTO sessions_fts(sessions_fts) VALUES('rebuild');",
+                      "FTS migration error");
+    }
+    if (rc != 0) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return exec_sql(store, "COMMIT;", "DB schema error");
+}
+
+// In order; the store's PRAGMA user_version is the last one applied. New steps go at the end
+// with the next version and need not check for what is already there.
+static const struct {
+    int version;
+    int (*fn)(session_store_t *store);
+} migrations[] = {
+    {1, migrate_tables}, {2, migrate_text_hash}, {3, migrate_totals},
+    {4, migrate_terms},  {5, migrate_sigs},      {6, migrate_fts},
+    {7, migrate_history}, {8, migrate_fts}, {9, migrate_sealed_terms},
+};
+
+static int schema_version(session_store_t *store) {
     sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(db, del_sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
-    sqlite3_bind_int(stmt, 1, id);
-    sqlite3_step(stmt);
+    int v = -1;
+    if (sqlite3_prepare_v2(store->db, "PRAGMA user_version;", -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) v = sqlite3_column_int(stmt, 0);
     sqlite3_finalize(stmt);
+    return v;
+}
 
-    if (sqlite3_prepare_v2(db, ins_sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
-    sqlite3_bind_int(stmt, 1, id);
-    sqlite3_bind_text(stmt, 2, text, -1, SQLITE_STATIC);
-    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
-    sqlite3_finalize(stmt);
-    return rc;
+int session_store_init_schema(session_store_t *store) {
+    int version = schema_version(store);
+    if (version < 0) {
+        fprintf(stderr, "DB schema error: %s\n", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    if (version > STORE_SCHEMA_VERSION) {
+        fprintf(stderr, "Datenbank hat Schema-Version %d, unterstützt wird bis %d\n", version, STORE_SCHEMA_VERSION);
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(migrations) / sizeof(migrations[0]); i++) {
+        if (migrations[i].version <= version) continue;
+        char sql[48];
+        snprintf(sql, sizeof(sql), "PRAGMA user_version=%d;", migrations[i].version);
+        if (migrations[i].fn(store) != 0 || exec_sql(store, sql, "DB schema error") != 0) return -1;
+    }
+    if (migrate_fts(store) != 0) return -1;
+
+    // Compressed texts are written with the newest dictionary (see compact).
+    if (text_codec_enabled() && load_dict(store, 0) != 0) {
+        text_codec_free(store->codec);
+        store->codec = NULL;
+    }
+    session_store_meta_get(store, "sealed_before", store->sealed_before, sizeof(store->sealed_before));
+    return 0;
+}
+
+// Opens path for queries: read-only, no WAL switch and no DDL, so it takes no write lock and
+// never waits for a running sync. Only a store whose schema is behind (or that does not exist
+// yet) is opened read-write once first to migrate it.
+int session_store_open_reader(session_store_t *store, const char *path) {
+    int version = -1;
+    if (sqlite3_open_v2(path, &store->db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK) version = schema_version(store);
+    if (version == STORE_SCHEMA_VERSION) return register_functions(store);
+    sqlite3_close(store->db);
+    store->db = NULL;
+    if (version > STORE_SCHEMA_VERSION) {
+        fprintf(stderr, "Datenbank hat Schema-Version %d, unterstützt wird bis %d\n", version, STORE_SCHEMA_VERSION);
+        return -1;
+    }
+    if (session_store_open(store, path) != 0) return -1;
+    int rc = session_store_init_schema(store);
+    session_store_close(store);
+    memset(store, 0, sizeof(*store));
+    return rc == 0 ? session_store_open_readonly(store, path) : -1;
 }
 
 static void now_iso(char *buf, size_t len) {
@@ -67,91 +788,1467 @@ static void now_iso(char *buf, size_t len) {
     strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
 }
 
+// synced_at has one-second resolution; only reformat it when the second changes.
+static const char *store_now(session_store_t *store) {
+    time_t t = time(NULL);
+    if ((long long)t != store->synced_at_sec) {
+        store->synced_at_sec = (long long)t;
+        now_iso(store->synced_at, sizeof(store->synced_at));
+    }
+    return store->synced_at;
+}
+
+// FNV-1a over every synced column, so a row only counts as unchanged if nothing differs.
+static void content_hash(const session_t *s, char out[17]) {
+    unsigned long long h = 1469598103934665603ULL;
+    const char *parts[2] = {s->text, s->created_at};
+    for (int p = 0; p < 2; p++) {
+        for (const unsigned char *c = (const unsigned char *)parts[p]; c && *c; c++) {
+            h ^= *c;
+            h *= 1099511628211ULL;
+        }
+        h ^= 0xff;
+        h *= 1099511628211ULL;
+    }
+    int counts[3] = {s->word_count, s->char_count, s->letter_count};
+    for (int i = 0; i < 3; i++) {
+        h ^= (unsigned int)counts[i];
+        h *= 1099511628211ULL;
+    }
+    snprintf(out, 17, "%016llx", h);
+}
+
+// One statement inserts a row or, if its content hash differs, updates it.
+#define UPSERT_COLUMNS "INSERT INTO sessions (id, created_at, word_count, char_count, letter_count, text, text_hash, synced_at) VALUES "
+#define UPSERT_ROW "(?, ?, ?, ?, ?, tw_pack(?), ?, ?)"
+#define UPSERT_CONFLICT                                                                                            \
+    " ON CONFLICT(id) DO UPDATE SET "                                                                              \
+    "created_at=excluded.created_at,"                                                                              \
+    "word_count=excluded.word_count,"                                                                              \
+    "char_count=excluded.char_count,"                                                                              \
+    "letter_count=excluded.letter_count,"                                                                          \
+    "text=excluded.text,"                                                                                          \
+    "text_hash=excluded.text_hash,"                                                                                \
+    "synced_at=excluded.synced_at "                                                                                \
+    "WHERE sessions.text_hash IS NOT excluded.text_hash"
+
+static void bind_row(sqlite3_stmt *stmt, int base, const session_t *s, const char *hash, const char *synced_at) {
+    sqlite3_bind_int(stmt, base + 1, s->id);
+    sqlite3_bind_text(stmt, base + 2, s->created_at, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, base + 3, s->word_count);
+    sqlite3_bind_int(stmt, base + 4, s->char_count);
+    sqlite3_bind_int(stmt, base + 5, s->letter_count);
+    sqlite3_bind_text(stmt, base + 6, s->text, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, base + 7, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, base + 8, synced_at, -1, SQLITE_STATIC);
+}
+
+// Sessions from before sealed_before live in a sealed shard; the current one never takes them.
+// Sealed shards are opened immutable, so nothing writes them either: such rows are skipped and
+// counted in sealed_skipped, which sync and watch report.
+static int is_sealed(const session_store_t *store, const session_t *s) {
+    return store->sealed_before[0] && s->created_at && strcmp(s->created_at, store->sealed_before) < 0;
+}
+
+static void skip_sealed(session_store_t *store, size_t n) {
+    store->sealed_skipped += (long long)n;
+    metrics_add(store->metrics, METRIC_ROWS_SEALED, n);
+}
+
+// Returns 0 when the row was inserted or changed, 1 when the stored row already had the
+// same content hash (no UPDATE, so the FTS triggers do not fire either), 2 when it belongs
+// to a sealed shard and was skipped, -1 on error.
 int session_store_upsert(session_store_t *store, const session_t *s) {
-    const char *sql =
-        "INSERT INTO sessions (id, created_at, word_count, char_count, letter_count, text, synced_at) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?) "
-        "ON CONFLICT(id) DO UPDATE SET "
-        "created_at=excluded.created_at,"
-        "word_count=excluded.word_count,"
-        "char_count=excluded.char_count,"
-        "letter_count=excluded.letter_count,"
-        "text=excluded.text,"
-        "synced_at=excluded.synced_at;";
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
-    char synced_at[32];
-    now_iso(synced_at, sizeof(synced_at));
-    sqlite3_bind_int(stmt, 1, s->id);
-    sqlite3_bind_text(stmt, 2, s->created_at, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 3, s->word_count);
-    sqlite3_bind_int(stmt, 4, s->char_count);
-    sqlite3_bind_int(stmt, 5, s->letter_count);
-    sqlite3_bind_text(stmt, 6, s->text, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, synced_at, -1, SQLITE_STATIC);
+    if (is_sealed(store, s)) {
+        skip_sealed(store, 1);
+        return 2;
+    }
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_UPSERT, UPSERT_COLUMNS UPSERT_ROW UPSERT_CONFLICT ";");
+    if (!stmt) return -1;
+    char hash[17];
+    content_hash(s, hash);
+    bind_row(stmt, 0, s, hash, store_now(store));
     int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     if (rc != 0) return rc;
-    return update_fts(store->db, s->id, s->text);
+    if (sqlite3_changes(store->db) == 0) return 1;
+    return index_terms(store, s);
 }
 
+static int pragma_int(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    int v = 0;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) return 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) v = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+// Ingest-time settings for large imports; session_store_bulk_end restores the previous ones.
+int session_store_bulk_begin(session_store_t *store, const store_bulk_opts_t *opts) {
+    if (store->bulk) return 0;
+    store->saved_synchronous = pragma_int(store->db, "PRAGMA synchronous;");
+    store->saved_cache_size = pragma_int(store->db, "PRAGMA cache_size;");
+    store->saved_temp_store = pragma_int(store->db, "PRAGMA temp_store;");
+    const char *sql = opts && opts->synchronous_off
+                          ? "PRAGMA synchronous=OFF; PRAGMA cache_size=-262144; PRAGMA temp_store=MEMORY;"
+                          : "PRAGMA synchronous=NORMAL; PRAGMA cache_size=-262144; PRAGMA temp_store=MEMORY;";
+    if (sqlite3_exec(store->db, sql, NULL, NULL, NULL) != SQLITE_OK) return -1;
+    if (install_count_triggers(store) != 0) return -1;
+    // Without the triggers rows are written unindexed; bulk_end rebuilds the index in one pass.
+    if (opts && opts->defer_fts && exec_sql(store, FTS_DROP_TRIGGERS, "FTS error") != 0) return -1;
+    store->bulk = 1;
+    store->bulk_defer_fts = opts && opts->defer_fts;
+    return 0;
+}
+
+static int upsert_rows(session_store_t *store, const session_t *rows, size_t len, size_t *unchanged) {
+    char bulk_sql[sizeof(UPSERT_COLUMNS) + STORE_BULK_ROWS * (sizeof(UPSERT_ROW) + 1) + sizeof(UPSERT_CONFLICT) + 16];
+    size_t same = 0;
+    size_t i = 0;
+    const char *synced_at = store_now(store);
+    char hashes[STORE_BULK_ROWS][17];
+    while (len - i >= STORE_BULK_ROWS) {
+        if (!store->stmts[STMT_UPSERT_BULK]) {
+            char *w = bulk_sql;
+            w += sprintf(w, "%s", UPSERT_COLUMNS);
+            for (int r = 0; r < STORE_BULK_ROWS; r++) w += sprintf(w, "%s%s", r ? "," : "", UPSERT_ROW);
+            sprintf(w, "%s RETURNING id;", UPSERT_CONFLICT);
+        }
+        sqlite3_stmt *stmt = cached_stmt(store, STMT_UPSERT_BULK, bulk_sql);
+        if (!stmt) return -1;
+        for (int r = 0; r < STORE_BULK_ROWS; r++) {
+            content_hash(&rows[i + r], hashes[r]);
+            bind_row(stmt, r * 8, &rows[i + r], hashes[r], synced_at);
+        }
+        // RETURNING yields only rows that were inserted or actually updated.
+        int changed[STORE_BULK_ROWS];
+        size_t written = 0;
+        int step;
+        while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (written < STORE_BULK_ROWS) changed[written++] = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_reset(stmt);
+        if (step != SQLITE_DONE) return -1;
+        for (size_t c = 0; c < written; c++) {
+            // Last row wins if a page repeats an id, as in the upsert itself.
+            int r = STORE_BULK_ROWS - 1;
+            while (r >= 0 && rows[i + (size_t)r].id != changed[c]) r--;
+            if (r >= 0 && index_terms(store, &rows[i + (size_t)r]) != 0) return -1;
+        }
+        same += STORE_BULK_ROWS - written;
+        i += STORE_BULK_ROWS;
+    }
+    for (; i < len; i++) {
+        int rc = session_store_upsert(store, &rows[i]);
+        if (rc < 0) return -1;
+        if (rc == 1) same++;
+    }
+    *unchanged = same;
+    return 0;
+}
+
+// Upserts rows in multi-row statements of STORE_BULK_ROWS; the tail goes through the
+// single-row statement. Rows for sealed shards are skipped (see is_sealed) and not counted
+// as unchanged. Does not open a transaction of its own.
+int session_store_bulk_insert(session_store_t *store, const session_t *rows, size_t len, size_t *unchanged) {
+    long long started = metrics_now_ns();
+    session_t *kept = NULL;
+    size_t sealed = 0;
+    for (size_t i = 0; i < len; i++) sealed += (size_t)is_sealed(store, &rows[i]);
+    if (sealed > 0) {
+        skip_sealed(store, sealed);
+        kept = malloc((len - sealed + 1) * sizeof(session_t));
+        if (!kept) return -1;
+        size_t n = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (!is_sealed(store, &rows[i])) kept[n++] = rows[i];
+        }
+        rows = kept;
+        len = n;
+    }
+    size_t same = 0;
+    int rc = upsert_rows(store, rows, len, &same);
+    free(kept);
+    if (rc != 0) return -1;
+    if (unchanged) *unchanged = same;
+    metrics_add(store->metrics, METRIC_ROWS_SKIPPED, same);
+    metrics_time_since(store->metrics, METRIC_T_DB_WRITE, started);
+    return 0;
+}
+
+int session_store_bulk_end(session_store_t *store) {
+    if (!store->bulk) return 0;
+    int rc = 0;
+    if (store->bulk_defer_fts) {
+        const char *sql = "BEGIN;" FTS_TRIGGERS "INSERT INTO sessions_fts(sessions_fts) VALUES('rebuild');"
+                          "COMMIT;";
+        long long started = metrics_now_ns();
+        if (exec_sql(store, sql, "FTS rebuild error") != 0) {
+            sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+            rc = -1;
+        }
+        metrics_time_since(store->metrics, METRIC_T_FTS, started);
+    }
+    char sql[160];
+    snprintf(sql, sizeof(sql), "PRAGMA synchronous=%d; PRAGMA cache_size=%d; PRAGMA temp_store=%d;",
+             store->saved_synchronous, store->saved_cache_size, store->saved_temp_store);
+    if (sqlite3_exec(store->db, sql, NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+    if (install_count_triggers(store) != 0) rc = -1;
+    store->bulk = 0;
+    store->bulk_defer_fts = 0;
+    return rc;
+}
+
+// 1 when session id is in this store, 0 when not, -1 on error.
+int session_store_contains(session_store_t *store, int id) {
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_CONTAINS, "SELECT 1 FROM sessions WHERE id = ?");
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, id);
+    int step = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return step == SQLITE_ROW ? 1 : step == SQLITE_DONE ? 0 : -1;
+}
+
+// 0 with *out filled in (free it with session_free), 1 when there is no session id, -1 on error.
 int session_store_get(session_store_t *store, int id, session_t *out) {
     const char *sql =
-        "SELECT id, text, created_at, word_count, char_count, letter_count FROM sessions WHERE id = ?";
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+        "SELECT id, tw_text(text), created_at, word_count, char_count, letter_count FROM sessions WHERE id = ?";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_GET, sql);
+    if (!stmt) return -1;
     sqlite3_bind_int(stmt, 1, id);
     int rc = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+    int step = sqlite3_step(stmt);
+    if (step == SQLITE_ROW) {
+        // NULL for an SQL NULL, but also when SQLite runs out of memory converting the value.
+        const char *text = (const char *)sqlite3_column_text(stmt, 1);
+        const char *created_at = (const char *)sqlite3_column_text(stmt, 2);
         out->id = sqlite3_column_int(stmt, 0);
-        out->text = strdup((const char *)sqlite3_column_text(stmt, 1));
-        out->created_at = strdup((const char *)sqlite3_column_text(stmt, 2));
+        out->text = text ? strdup(text) : NULL;
+        out->created_at = created_at ? strdup(created_at) : NULL;
         out->word_count = sqlite3_column_int(stmt, 3);
         out->char_count = sqlite3_column_int(stmt, 4);
         out->letter_count = sqlite3_column_int(stmt, 5);
-        rc = 0;
+        if (out->text && out->created_at) {
+            rc = 0;
+        } else {
+            fprintf(stderr, "Session %d konnte nicht gelesen werden\n", id);
+            session_free(out);
+        }
+    } else if (step == SQLITE_DONE) {
+        rc = 1;
+    } else {
+        fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+// The best limit matches by bm25, best first. Without snippets, hit.snippet stays NULL until
+// session_store_snippets fills it in, which pays off when only some hits are kept (merging
+// shards). *out is malloc'd (NULL when empty).
+int session_store_search_hits(session_store_t *store, const char *query, int limit, int snippets, search_hit_t **out,
+                              size_t *len) {
+    const char *sql =
+        snippets ? "SELECT s.id, s.created_at, s.word_count, rank, snippet(sessions_fts, 0, '[', ']', '…', 10) "
+                   "FROM sessions_fts JOIN sessions s ON s.id = sessions_fts.rowid "
+                   "WHERE sessions_fts MATCH ? ORDER BY rank LIMIT ?;"
+                 : "SELECT s.id, s.created_at, s.word_count, rank "
+                   "FROM sessions_fts JOIN sessions s ON s.id = sessions_fts.rowid "
+                   "WHERE sessions_fts MATCH ? ORDER BY rank LIMIT ?;";
+    *out = NULL;
+    *len = 0;
+    sqlite3_stmt *stmt = cached_stmt(store, snippets ? STMT_SEARCH : STMT_SEARCH_RANKED, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
+    size_t cap = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 16;
+            search_hit_t *tmp = realloc(*out, cap * sizeof(search_hit_t));
+            if (!tmp) break;
+            *out = tmp;
+        }
+        const unsigned char *created_at = sqlite3_column_text(stmt, 1);
+        const unsigned char *snip = snippets ? sqlite3_column_text(stmt, 4) : NULL;
+        search_hit_t *h = &(*out)[(*len)++];
+        memset(h, 0, sizeof(*h));
+        h->id = sqlite3_column_int(stmt, 0);
+        h->created_at = strdup(created_at ? (const char *)created_at : "");
+        h->word_count = sqlite3_column_int(stmt, 2);
+        h->rank = sqlite3_column_double(stmt, 3);
+        if (snippets) h->snippet = strdup(snip ? (const char *)snip : "");
+    }
+    if (step != SQLITE_DONE) fprintf(stderr, "Suche fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+    sqlite3_reset(stmt);
+    if (step != SQLITE_DONE) {
+        session_store_free_hits(*out, *len);
+        *out = NULL;
+        *len = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Fills in the snippet of each hit that has none; the hits must come from this store.
+int session_store_snippets(session_store_t *store, const char *query, search_hit_t *hits, size_t len) {
+    const char *sql = "SELECT snippet(sessions_fts, 0, '[', ']', '…', 10) FROM sessions_fts "
+                      "WHERE sessions_fts MATCH ? AND rowid = ?;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_SNIPPET, sql);
+    if (!stmt) return -1;
+    int rc = 0;
+    for (size_t i = 0; i < len && rc == 0; i++) {
+        if (hits[i].snippet) continue;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, hits[i].id);
+        int step = sqlite3_step(stmt);
+        const unsigned char *snip = step == SQLITE_ROW ? sqlite3_column_text(stmt, 0) : NULL;
+        if (step != SQLITE_ROW && step != SQLITE_DONE) {
+            fprintf(stderr, "Suche fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+            rc = -1;
+        }
+        hits[i].snippet = strdup(snip ? (const char *)snip : "");
+    }
+    sqlite3_reset(stmt);
     return rc;
 }
 
-int session_store_search(session_store_t *store, const char *query, int limit) {
+void session_store_print_hits(const search_hit_t *hits, size_t len, FILE *out) {
+    fprintf(out, "FTS Ergebnisse:\n");
+    for (size_t i = 0; i < len; i++) {
+        const search_hit_t *h = &hits[i];
+        fprintf(out, "- #%d (%s) [%d Wörter]\n  %s\n", h->id, h->created_at ? h->created_at : "", h->word_count,
+                h->snippet ? h->snippet : "");
+    }
+}
+
+void session_store_free_hits(search_hit_t *hits, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        free(hits[i].created_at);
+        free(hits[i].snippet);
+    }
+    free(hits);
+}
+
+int session_store_search(session_store_t *store, const char *query, int limit, FILE *out) {
+    search_hit_t *hits = NULL;
+    size_t len = 0;
+    if (session_store_search_hits(store, query, limit, 1, &hits, &len) != 0) return -1;
+    session_store_print_hits(hits, len, out);
+    session_store_free_hits(hits, len);
+    return 0;
+}
+
+// Ids of all sessions matching an FTS query, ascending. *ids is malloc'd (NULL when empty).
+int session_store_match_ids(session_store_t *store, const char *query, int **ids, size_t *len) {
+    sqlite3_stmt *stmt =
+        cached_stmt(store, STMT_MATCH_IDS, "SELECT rowid FROM sessions_fts WHERE sessions_fts MATCH ? ORDER BY rowid;");
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+    int *buf = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 256;
+            int *tmp = realloc(buf, ncap * sizeof(int));
+            if (!tmp) break;
+            buf = tmp;
+            cap = ncap;
+        }
+        buf[n++] = sqlite3_column_int(stmt, 0);
+    }
+    if (step != SQLITE_DONE) fprintf(stderr, "Suche fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+    sqlite3_reset(stmt);
+    if (step != SQLITE_DONE) {
+        free(buf);
+        return -1;
+    }
+    *ids = buf;
+    *len = n;
+    return 0;
+}
+
+// Calls fn for each of ids that exists, in the given order. Strings are borrowed from SQLite
+// and only valid during the call, as with the parser callbacks.
+int session_store_each(session_store_t *store, const int *ids, size_t len, session_cb fn, void *userdata) {
     const char *sql =
-        "SELECT s.id, snippet(sessions_fts, 0, '[', ']', '…', 10) AS snip, s.created_at, s.word_count "
-        "FROM sessions_fts JOIN sessions s ON s.id = sessions_fts.rowid "
-        "WHERE sessions_fts MATCH ? "
-        "ORDER BY rank "
-        "LIMIT ?;";
+        "SELECT id, created_at, word_count, char_count, letter_count, tw_text(text) FROM sessions WHERE id = ?";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_EACH, sql);
+    if (!stmt) return -1;
+    int rc = 0;
+    for (size_t i = 0; i < len && rc == 0; i++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, ids[i]);
+        int step = sqlite3_step(stmt);
+        if (step == SQLITE_DONE) continue;
+        if (step != SQLITE_ROW) {
+            fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
+            rc = -1;
+            break;
+        }
+        session_t s = {
+            .id = sqlite3_column_int(stmt, 0),
+            .created_at = (char *)sqlite3_column_text(stmt, 1),
+            .word_count = sqlite3_column_int(stmt, 2),
+            .char_count = sqlite3_column_int(stmt, 3),
+            .letter_count = sqlite3_column_int(stmt, 4),
+            .text = (char *)sqlite3_column_text(stmt, 5),
+        };
+        if (fn(userdata, &s) != 0) rc = -1;
+    }
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+static int valid_day(const char *s) {
+    if (!s || strlen(s) != 10 || s[4] != '-' || s[7] != '-') return 0;
+    for (int i = 0; i < 10; i++) {
+        if (i != 4 && i != 7 && (s[i] < '0' || s[i] > '9')) return 0;
+    }
+    return 1;
+}
+
+// Calls fn for every session in range, in id order. The row points straight into SQLite's
+// buffers (memory-mapped pages where possible) or, for compressed texts, into a buffer the
+// store reuses, so a scan allocates nothing per row. Pointers are only valid during the call.
+int session_store_scan(session_store_t *store, const store_range_t *range, store_row_fn fn, void *userdata) {
+    if ((range->from && !valid_day(range->from)) || (range->to && !valid_day(range->to))) {
+        fprintf(stderr, "Ungültiges Datum, erwartet YYYY-MM-DD\n");
+        return -1;
+    }
+    if (!store->stmts[STMT_SCAN]) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA mmap_size=%lld;", STORE_SCAN_MMAP_BYTES);
+        sqlite3_exec(store->db, sql, NULL, NULL, NULL);
+    }
+    const char *sql = "SELECT id, created_at, word_count, char_count, letter_count, text FROM sessions "
+                      "WHERE id BETWEEN ?1 AND ?2 AND (?3 IS NULL OR created_at >= ?3) "
+                      "AND (?4 IS NULL OR created_at < date(?4, '+1 day')) ORDER BY id;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_SCAN, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, range->from_id);
+    sqlite3_bind_int(stmt, 2, range->to_id > 0 ? range->to_id : 0x7fffffff);
+    if (range->from) sqlite3_bind_text(stmt, 3, range->from, -1, SQLITE_STATIC);
+    if (range->to) sqlite3_bind_text(stmt, 4, range->to, -1, SQLITE_STATIC);
+    int rc = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        store_row_t row = {
+            .id = sqlite3_column_int(stmt, 0),
+            .created_at = (const char *)sqlite3_column_text(stmt, 1),
+            .created_at_len = (size_t)sqlite3_column_bytes(stmt, 1),
+            .word_count = sqlite3_column_int(stmt, 2),
+            .char_count = sqlite3_column_int(stmt, 3),
+            .letter_count = sqlite3_column_int(stmt, 4),
+        };
+        if (sqlite3_column_type(stmt, 5) == SQLITE_BLOB) {
+            const void *frame = sqlite3_column_blob(stmt, 5);
+            size_t len = (size_t)sqlite3_column_bytes(stmt, 5);
+            const char *err = "Komprimierter Text ist beschädigt";
+            long long n = frame_text_size(store, frame, len, &err);
+            if (n >= 0 && (size_t)n + 1 > store->scratch_cap) {
+                char *buf = realloc(store->scratch, (size_t)n + 1);
+                if (buf) {
+                    store->scratch = buf;
+                    store->scratch_cap = (size_t)n + 1;
+                }
+            }
+            if (n < 0 || (size_t)n + 1 > store->scratch_cap ||
+                text_codec_decompress(store->codec, store->scratch, store->scratch_cap, frame, len) != 0) {
+                fprintf(stderr, "Session #%d: %s\n", row.id, err);
+                rc = -1;
+                break;
+            }
+            store->scratch[n] = '\0';
+            row.text = store->scratch;
+            row.text_len = (size_t)n;
+        } else {
+            row.text = (const char *)sqlite3_column_text(stmt, 5);
+            row.text_len = (size_t)sqlite3_column_bytes(stmt, 5);
+        }
+        if (fn(userdata, &row) != 0) {
+            rc = -1;
+            break;
+        }
+    }
+    if (rc == 0 && step != SQLITE_DONE) {
+        fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
+        rc = -1;
+    }
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+// Most frequent terms of one session, or of all sessions when id is 0; those include the
+// sessions moved to sealed shards.
+int session_store_top_terms(session_store_t *store, int id, int limit, FILE *out) {
+    sqlite3_stmt *stmt =
+        id > 0 ? cached_stmt(store, STMT_TOP_TERMS,
+                             "SELECT j.key, j.value FROM session_terms, json_each(terms) j "
+                             "WHERE session_id = ?1 ORDER BY j.value DESC, j.key LIMIT ?2;")
+               : cached_stmt(store, STMT_TOP_TERMS_ALL,
+                             "SELECT key, SUM(n) AS total FROM (SELECT j.key AS key, j.value AS n "
+                             "FROM session_terms, json_each(terms) j UNION ALL SELECT term, n FROM sealed_terms) "
+                             "GROUP BY key ORDER BY total DESC, key LIMIT ?2;");
+    if (!stmt) return -1;
+    if (id > 0) sqlite3_bind_int(stmt, 1, id);
+    sqlite3_bind_int(stmt, 2, limit);
+    fprintf(out, "Häufigste Wörter:\n");
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        fprintf(out, "%10lld  %s\n", sqlite3_column_int64(stmt, 1), (const char *)sqlite3_column_text(stmt, 0));
+    }
+    if (step != SQLITE_DONE) fprintf(stderr, "Abfrage fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+    sqlite3_reset(stmt);
+    return step == SQLITE_DONE ? 0 : -1;
+}
+
+// Compacts the FTS index. merge_pages == 0 merges everything into one segment ('optimize');
+// otherwise runs an incremental 'merge' that writes at most about that many pages.
+int session_store_optimize(session_store_t *store, int merge_pages) {
     sqlite3_stmt *stmt = NULL;
+    const char *sql = merge_pages > 0 ? "INSERT INTO sessions_fts(sessions_fts, rank) VALUES('merge', ?);"
+                                      : "INSERT INTO sessions_fts(sessions_fts) VALUES('optimize');";
     if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, limit);
-    printf("FTS Ergebnisse:\n");
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int id = sqlite3_column_int(stmt, 0);
-        const unsigned char *snip = sqlite3_column_text(stmt, 1);
-        const unsigned char *created_at = sqlite3_column_text(stmt, 2);
-        int wc = sqlite3_column_int(stmt, 3);
-        printf("- #%d (%s) [%d Wörter]\n  %s\n", id, created_at, wc, snip ? (const char *)snip : "");
+    if (merge_pages > 0) sqlite3_bind_int(stmt, 1, merge_pages);
+    long long started = metrics_now_ns();
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    metrics_time_since(store->metrics, METRIC_T_FTS, started);
+    if (rc != 0) fprintf(stderr, "FTS optimize error: %s\n", sqlite3_errmsg(store->db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Gives the pages of deleted or shrunk rows back to the file system.
+int session_store_vacuum(session_store_t *store) {
+    return exec_sql(store, "VACUUM; PRAGMA wal_checkpoint(TRUNCATE);", "VACUUM error");
+}
+
+// Writes a copy of the store to path, which must not exist or be empty: the FTS index in one
+// segment, no WAL and no free pages. VACUUM INTO reads in one transaction, so a read-only
+// connection will do and a running sync is not held up.
+int session_store_copy_to(session_store_t *store, const char *path) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(store->db, "VACUUM INTO ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
     }
+    if (rc != 0) fprintf(stderr, "VACUUM error: %s\n", sqlite3_errmsg(store->db));
     sqlite3_finalize(stmt);
+    if (rc != 0) return -1;
+    session_store_t copy = {0};
+    if (session_store_open(&copy, path) != 0) return -1;
+    // Also rebuilds the index if the store was copied in the middle of a bulk sync.
+    rc = session_store_init_schema(&copy);
+    if (rc == 0) rc = session_store_optimize(&copy, 0);
+    if (rc == 0) rc = exec_sql(&copy, "PRAGMA journal_mode=DELETE; VACUUM;", "VACUUM error");
+    session_store_close(&copy);
+    return rc;
+}
+
+#define DICT_MAX_BYTES (112 * 1024)
+#define TRAIN_MAX_BYTES (16u << 20)
+#define TRAIN_SAMPLE_MAX_BYTES (128 * 1024)
+
+// Trains a dictionary on up to 16 MB of randomly chosen texts and stores it in text_dicts as
+// the newest, i.e. the one new texts are compressed with.
+static int train_dict(session_store_t *store, int level, FILE *out) {
+    const char *sql = "SELECT tw_text(s.text) FROM (SELECT id FROM sessions ORDER BY random() LIMIT "
+                      "COALESCE((SELECT ?1 / MAX(1, chars / MAX(sessions, 1)) + 1 FROM session_totals "
+                      "WHERE period = 'all' AND bucket = ''), 0)) r JOIN sessions s ON s.id = r.id;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    sqlite3_bind_int64(stmt, 1, TRAIN_MAX_BYTES);
+    char *samples = malloc(TRAIN_MAX_BYTES);
+    size_t *sizes = NULL;
+    size_t sizes_cap = 0;
+    unsigned n = 0;
+    size_t total = 0;
+    int rc = samples ? 0 : -1;
+    int step;
+    while (rc == 0 && (step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        size_t len = (size_t)sqlite3_column_bytes(stmt, 0);
+        if (len > TRAIN_SAMPLE_MAX_BYTES) len = TRAIN_SAMPLE_MAX_BYTES;
+        if (len == 0) continue;
+        if (total + len > TRAIN_MAX_BYTES) break;
+        if (n == sizes_cap) {
+            size_t ncap = sizes_cap ? sizes_cap * 2 : 1024;
+            size_t *tmp = realloc(sizes, ncap * sizeof(size_t));
+            if (!tmp) {
+                rc = -1;
+                break;
+            }
+            sizes = tmp;
+            sizes_cap = ncap;
+        }
+        memcpy(samples + total, sqlite3_column_blob(stmt, 0), len);
+        sizes[n++] = len;
+        total += len;
+    }
+    if (rc == 0 && step != SQLITE_ROW && step != SQLITE_DONE) {
+        fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
+        rc = -1;
+    }
+    sqlite3_finalize(stmt);
+
+    // zstd wants roughly ten times the dictionary size in samples.
+    size_t cap = total / 10 < DICT_MAX_BYTES ? total / 10 : DICT_MAX_BYTES;
+    char dict[DICT_MAX_BYTES];
+    size_t dict_len = 0;
+    if (rc == 0 && (n < 8 || cap < 1024)) {
+        fprintf(stderr, "Zu wenig Text für ein Wörterbuch (%u Sessions, %zu Bytes)\n", n, total);
+        rc = -1;
+    }
+    if (rc == 0 && (dict_len = text_codec_train(dict, cap, samples, sizes, n)) == 0) rc = -1;
+    free(samples);
+    free(sizes);
+    if (rc != 0) return -1;
+
+    sql = "INSERT OR REPLACE INTO text_dicts (zstd_id, level, dict, created_at) VALUES (?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    char created_at[32];
+    now_iso(created_at, sizeof(created_at));
+    sqlite3_bind_int64(stmt, 1, text_codec_dict_id(dict, dict_len));
+    sqlite3_bind_int(stmt, 2, level);
+    sqlite3_bind_blob(stmt, 3, dict, (int)dict_len, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, created_at, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_finalize(stmt);
+    if (rc != 0 || load_dict(store, 0) != 0) return -1;
+    fprintf(out, "Wörterbuch trainiert: %zu KB aus %u Sessions (%.1f MB), Level %d\n", dict_len / 1024, n,
+            total / (1024.0 * 1024.0), level);
     return 0;
 }
 
-int session_store_stats(session_store_t *store, store_stats_t *out) {
-    const char *sql = "SELECT COUNT(*), COALESCE(MAX(created_at), ''), "
-                      "(SELECT total_bytes FROM pragma_page_count() JOIN pragma_page_size());";
+// Stored text bytes (compressed or not) and the database file size.
+static int text_bytes(session_store_t *store, long long out[2]) {
+    const char *sql = "SELECT COALESCE(SUM(length(CAST(text AS BLOB))), 0), "
+                      "(SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()) FROM sessions;";
     sqlite3_stmt *stmt = NULL;
     if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
     int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out[0] = sqlite3_column_int64(stmt, 0);
+        out[1] = sqlite3_column_int64(stmt, 1);
+        rc = 0;
+    } else {
+        fprintf(stderr, "DB error: %s\n", sqlite3_errmsg(store->db));
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Rewrites every text as a zstd frame with the store's dictionary, training one first when
+// there is none (or opts->retrain is set), or back to plain text with opts->plain; then
+// VACUUMs so the file actually shrinks. The plain texts do not change, so the FTS triggers
+// are dropped for the rewrite instead of reindexing every row.
+int session_store_compact(session_store_t *store, const store_compact_opts_t *opts, FILE *out) {
+    if (!opts->plain && !text_codec_enabled()) {
+        fprintf(stderr, "typewriter wurde ohne zstd gebaut, Kompression mit make ZSTD=1\n");
+        return -1;
+    }
+    // Without --level a new dictionary keeps the current one's level.
+    int level = opts->level > 0 ? opts->level : 3;
+    if (opts->level <= 0) {
+        sqlite3_stmt *stmt = NULL;
+        const char *sql = "SELECT level FROM text_dicts ORDER BY id DESC LIMIT 1;";
+        if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            level = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    long long before[2];
+    long long after[2];
+    if (text_bytes(store, before) != 0) return -1;
+    long long started = metrics_now_ns();
+    if (exec_sql(store, "BEGIN;", "DB error") != 0) return -1;
+    int rc = 0;
+    if (opts->plain) {
+        rc = exec_sql(store,
+                      FTS_DROP_TRIGGERS "UPDATE sessions SET text = tw_text(text) WHERE typeof(text) = 'blob';"
+                      FTS_TRIGGERS "DELETE FROM text_dicts;",
+                      "Compact error");
+    } else {
+        if (opts->retrain || !store->codec || !text_codec_can_compress(store->codec)) {
+            rc = train_dict(store, level, out);
+        } else if (opts->level > 0) {
+            char sql[128];
+            snprintf(sql, sizeof(sql), "UPDATE text_dicts SET level = %d WHERE id = (SELECT MAX(id) FROM text_dicts);",
+                     level);
+            rc = exec_sql(store, sql, "Compact error");
+            if (rc == 0) rc = load_dict(store, 0);
+        }
+        // Rows that did not get smaller stay plain, so no row needs an older dictionary afterwards.
+        if (rc == 0) {
+            rc = exec_sql(store,
+                          FTS_DROP_TRIGGERS "UPDATE sessions SET text = tw_pack(tw_text(text));" FTS_TRIGGERS
+                          "DELETE FROM text_dicts WHERE id < (SELECT MAX(id) FROM text_dicts);",
+                          "Compact error");
+        }
+    }
+    if (rc == 0) rc = exec_sql(store, "COMMIT;", "DB error");
+    if (rc != 0) sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+    // Start over from what is stored now (a new dictionary may have been rolled back).
+    text_codec_free(store->codec);
+    store->codec = NULL;
+    if (load_dict(store, 0) != 0) {
+        text_codec_free(store->codec);
+        store->codec = NULL;
+    }
+    if (rc != 0) return -1;
+    if (session_store_vacuum(store) != 0) return -1;
+    if (text_bytes(store, after) != 0) return -1;
+    fprintf(out, "Texte: %.1f MB -> %.1f MB (%.0f %%), Datenbank: %.1f MB -> %.1f MB, %.1fs\n",
+            before[0] / (1024.0 * 1024.0), after[0] / (1024.0 * 1024.0),
+            before[0] ? 100.0 * after[0] / before[0] : 100.0, before[1] / (1024.0 * 1024.0),
+            after[1] / (1024.0 * 1024.0), (metrics_now_ns() - started) / 1e9);
+    return 0;
+}
+
+// Count and sums come from the trigger-maintained 'all' row, the latest created_at from an
+// index seek, so this costs the same for ten sessions as for a million.
+int session_store_stats(session_store_t *store, store_stats_t *out) {
+    const char *sql = "SELECT COALESCE(t.sessions, 0), COALESCE(t.words, 0), "
+                      "COALESCE((SELECT MAX(created_at) FROM sessions), ''), "
+                      "(SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()) "
+                      "FROM (SELECT 1) LEFT JOIN session_totals t ON t.period = 'all' AND t.bucket = '';";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_STATS, sql);
+    if (!stmt) return -1;
+    int rc = -1;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         out->count = sqlite3_column_int(stmt, 0);
-        const unsigned char *last = sqlite3_column_text(stmt, 1);
+        out->words = sqlite3_column_int64(stmt, 1);
+        const unsigned char *last = sqlite3_column_text(stmt, 2);
         strncpy(out->last_created_at, last ? (const char *)last : "", sizeof(out->last_created_at) - 1);
         out->last_created_at[sizeof(out->last_created_at) - 1] = '\0';
-        out->db_size_bytes = sqlite3_column_int64(stmt, 2);
+        out->db_size_bytes = sqlite3_column_int64(stmt, 3);
+        rc = 0;
+    }
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+// Prints one line per bucket of period ("day", "week" or "month") between from and to
+// (YYYY-MM-DD, inclusive, NULL for open), then the longest and the current writing streak.
+// Reads only session_totals, so the cost grows with the number of buckets, not sessions.
+int session_store_report(session_store_t *store, const char *period, const char *from, const char *to, FILE *out) {
+    if (strcmp(period, "day") != 0 && strcmp(period, "week") != 0 && strcmp(period, "month") != 0) {
+        fprintf(stderr, "Unbekannte Granularität: %s (day, week, month)\n", period);
+        return -1;
+    }
+    if ((from && !valid_day(from)) || (to && !valid_day(to))) {
+        fprintf(stderr, "Ungültiges Datum, erwartet YYYY-MM-DD\n");
+        return -1;
+    }
+    // A week or month counts as in range when it contains any day of the range.
+    const char *sql = "SELECT bucket, sessions, words, chars FROM session_totals "
+                      "WHERE period = ?1 AND sessions > 0 AND bucket >= CASE ?1 "
+                      "WHEN 'week' THEN date(?2, '-6 days', 'weekday 1') "
+                      "WHEN 'month' THEN substr(?2, 1, 7) ELSE ?2 END "
+                      "AND bucket <= ?3 ORDER BY bucket;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_REPORT, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, period, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, from ? from : "0000-01-01", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, to ? to : "9999-12-31", -1, SQLITE_STATIC);
+    fprintf(out, "%-10s %10s %12s %14s\n", period, "Sessions", "Wörter", "Zeichen");
+    long long sum[3] = {0, 0, 0};
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        long long v[3];
+        for (int i = 0; i < 3; i++) {
+            v[i] = sqlite3_column_int64(stmt, i + 1);
+            sum[i] += v[i];
+        }
+        fprintf(out, "%-10s %10lld %12lld %14lld\n", (const char *)sqlite3_column_text(stmt, 0), v[0], v[1], v[2]);
+    }
+    sqlite3_reset(stmt);
+    if (step != SQLITE_DONE) {
+        fprintf(stderr, "Bericht fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    fprintf(out, "%-10s %10lld %12lld %14lld\n", "Summe", sum[0], sum[1], sum[2]);
+
+    // Consecutive days share julianday(day) - row_number(), so each group is one streak.
+    // A streak is current when it reaches the end of the range (or today) or the day before.
+    sql = "WITH d AS (SELECT bucket AS day, julianday(bucket) - ROW_NUMBER() OVER (ORDER BY bucket) AS grp "
+          "FROM session_totals WHERE period = 'day' AND sessions > 0 AND bucket BETWEEN ?1 AND ?2) "
+          "SELECT MIN(day), MAX(day), COUNT(*), MAX(day) >= date(MIN(?2, date('now')), '-1 day') "
+          "FROM d GROUP BY grp ORDER BY MIN(day);";
+    stmt = cached_stmt(store, STMT_STREAKS, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, from ? from : "0000-01-01", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to ? to : "9999-12-31", -1, SQLITE_STATIC);
+    int longest = 0;
+    int current = 0;
+    char longest_from[16] = "";
+    char longest_to[16] = "";
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int days = sqlite3_column_int(stmt, 2);
+        if (days >= longest) {
+            longest = days;
+            snprintf(longest_from, sizeof(longest_from), "%s", (const char *)sqlite3_column_text(stmt, 0));
+            snprintf(longest_to, sizeof(longest_to), "%s", (const char *)sqlite3_column_text(stmt, 1));
+        }
+        current = sqlite3_column_int(stmt, 3) ? days : 0;
+    }
+    sqlite3_reset(stmt);
+    if (step != SQLITE_DONE) {
+        fprintf(stderr, "Bericht fehlgeschlagen: %s\n", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    if (longest > 0) {
+        fprintf(out, "Längste Serie: %d Tage (%s bis %s)\n", longest, longest_from, longest_to);
+    } else {
+        fprintf(out, "Längste Serie: 0 Tage\n");
+    }
+    fprintf(out, "Aktuelle Serie: %d Tage\n", current);
+    return 0;
+}
+
+int session_store_meta_get(session_store_t *store, const char *key, char *buf, size_t len) {
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_META_GET, "SELECT value FROM sync_meta WHERE key = ?");
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char *v = sqlite3_column_text(stmt, 0);
+        snprintf(buf, len, "%s", v ? (const char *)v : "");
         rc = 0;
     }
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+int session_store_meta_set(session_store_t *store, const char *key, const char *value) {
+    const char *sql = "INSERT INTO sync_meta (key, value) VALUES (?, ?) "
+                      "ON CONFLICT(key) DO UPDATE SET value=excluded.value;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_META_SET, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+int session_store_load_checkpoint(session_store_t *store, sync_checkpoint_t *out) {
+    memset(out, 0, sizeof(*out));
+    char buf[64];
+    if (session_store_meta_get(store, "max_id", buf, sizeof(buf)) != 0) return -1;
+    out->max_id = atoi(buf);
+    if (session_store_meta_get(store, "row_count", buf, sizeof(buf)) == 0) out->row_count = atoi(buf);
+    session_store_meta_get(store, "max_created_at", out->max_created_at, sizeof(out->max_created_at));
+    session_store_meta_get(store, "last_sync_at", out->last_sync_at, sizeof(out->last_sync_at));
+    return 0;
+}
+
+// Records the high-water mark of what is stored now and forgets the pages of the sync that
+// completed. Only call after a complete sync.
+int session_store_save_checkpoint(session_store_t *store) {
+    // Sessions moved to sealed shards still count: the server keeps listing them.
+    const char *sql = "SELECT MAX(COALESCE(MAX(id), 0), "
+                      "COALESCE((SELECT CAST(value AS INTEGER) FROM sync_meta WHERE key = 'sealed_max_id'), 0)), "
+                      "COALESCE(MAX(created_at), ''), "
+                      "COALESCE((SELECT sessions FROM session_totals WHERE period = 'all' AND bucket = ''), 0) + "
+                      "COALESCE((SELECT CAST(value AS INTEGER) FROM sync_meta WHERE key = 'sealed_rows'), 0) "
+                      "FROM sessions";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    char max_id[16] = "0";
+    char max_created_at[64] = "";
+    char row_count[16] = "0";
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        snprintf(max_id, sizeof(max_id), "%d", sqlite3_column_int(stmt, 0));
+        snprintf(row_count, sizeof(row_count), "%d", sqlite3_column_int(stmt, 2));
+        const unsigned char *v = sqlite3_column_text(stmt, 1);
+        snprintf(max_created_at, sizeof(max_created_at), "%s", v ? (const char *)v : "");
+    }
+    sqlite3_finalize(stmt);
+
+    char synced_at[32];
+    now_iso(synced_at, sizeof(synced_at));
+    if (sqlite3_exec(store->db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    int rc = 0;
+    rc |= session_store_meta_set(store, "max_id", max_id);
+    rc |= session_store_meta_set(store, "row_count", row_count);
+    rc |= session_store_meta_set(store, "max_created_at", max_created_at);
+    rc |= session_store_meta_set(store, "last_sync_at", synced_at);
+    if (rc == 0 && sqlite3_exec(store->db, "DELETE FROM sync_pages;", NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+    sqlite3_exec(store->db, rc == 0 ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+    return rc;
+}
+
+// Runs inside the transaction that wrote the page's last rows, so a recorded page is always stored.
+int session_store_mark_page(session_store_t *store, int offset, int limit, int total) {
+    const char *sql = "INSERT OR IGNORE INTO sync_pages (page_offset, page_limit, total) VALUES (?, ?, ?);";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_MARK_PAGE, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, offset);
+    sqlite3_bind_int(stmt, 2, limit);
+    sqlite3_bind_int(stmt, 3, total);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+int session_store_load_pages(session_store_t *store, sync_page_t **out, size_t *len) {
+    *out = NULL;
+    *len = 0;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, "SELECT page_offset, page_limit, total FROM sync_pages ORDER BY page_offset;", -1,
+                           &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    size_t cap = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 64;
+            sync_page_t *pages = realloc(*out, cap * sizeof(*pages));
+            if (!pages) break;
+            *out = pages;
+        }
+        (*out)[(*len)++] = (sync_page_t){sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+                                         sqlite3_column_int(stmt, 2)};
+    }
+    sqlite3_finalize(stmt);
+    if (step != SQLITE_DONE) {
+        free(*out);
+        *out = NULL;
+        *len = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// The oldest created_at before day, or 1 when there is none.
+int session_store_oldest_before(session_store_t *store, const char *day, char *buf, size_t len) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, "SELECT MIN(created_at) FROM sessions WHERE created_at < ?;", -1, &stmt,
+                           NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, day, -1, SQLITE_STATIC);
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char *v = sqlite3_column_text(stmt, 0);
+        if (v) snprintf(buf, len, "%s", (const char *)v);
+        rc = v ? 0 : 1;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Copies the sessions created in [from, to) into the store at shard_path, creating it if needed,
+// together with their term counts, signatures and every dictionary their texts may need. Rows already in
+// the shard are updated, so an interrupted copy can simply run again. The shard ends up
+// optimized and without WAL, ready to be opened immutable.
+int session_store_copy_range(session_store_t *store, const char *shard_path, const char *from, const char *to) {
+    const char *src = sqlite3_db_filename(store->db, "main");
+    session_store_t shard = {0};
+    if (!src || session_store_open(&shard, shard_path) != 0) return -1;
+    if (session_store_init_schema(&shard) != 0) {
+        session_store_close(&shard);
+        return -1;
+    }
+    const char *sql =
+        "INSERT OR IGNORE INTO text_dicts SELECT * FROM src.text_dicts;"
+        "INSERT INTO sessions (id, created_at, word_count, char_count, letter_count, text, text_hash, synced_at) "
+        "SELECT id, created_at, word_count, char_count, letter_count, text, text_hash, synced_at "
+        "FROM src.sessions WHERE created_at >= ?1 AND created_at < ?2" UPSERT_CONFLICT ";"
+        "INSERT OR REPLACE INTO session_terms SELECT t.session_id, t.terms FROM src.session_terms t "
+        "JOIN src.sessions s ON s.id = t.session_id WHERE s.created_at >= ?1 AND s.created_at < ?2;"
+        "INSERT OR REPLACE INTO session_sigs SELECT g.* FROM src.session_sigs g "
+        "JOIN src.sessions s ON s.id = g.session_id WHERE s.created_at >= ?1 AND s.created_at < ?2;"
+        "INSERT OR IGNORE INTO session_lsh SELECT l.bucket, l.session_id FROM src.session_lsh l "
+        "JOIN src.sessions s ON s.id = l.session_id WHERE s.created_at >= ?1 AND s.created_at < ?2;";
+    int rc = 0;
+    sqlite3_stmt *attach = NULL;
+    if (sqlite3_prepare_v2(shard.db, "ATTACH ? AS src;", -1, &attach, NULL) != SQLITE_OK) rc = -1;
+    if (rc == 0) {
+        sqlite3_bind_text(attach, 1, src, -1, SQLITE_STATIC);
+        if (sqlite3_step(attach) != SQLITE_DONE) rc = -1;
+    }
+    sqlite3_finalize(attach);
+    if (rc == 0 && exec_sql(&shard, "BEGIN;", "Shard error") != 0) rc = -1;
+    // Bound parameters need one statement at a time.
+    for (const char *tail = sql; rc == 0 && *tail;) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(shard.db, tail, -1, &stmt, &tail) != SQLITE_OK) {
+            rc = -1;
+            break;
+        }
+        if (!stmt) break;
+        if (sqlite3_bind_parameter_count(stmt) > 0) {
+            sqlite3_bind_text(stmt, 1, from, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, to, -1, SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+        sqlite3_finalize(stmt);
+    }
+    if (rc != 0) fprintf(stderr, "Shard error: %s\n", sqlite3_errmsg(shard.db));
+    sqlite3_exec(shard.db, rc == 0 ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+    sqlite3_exec(shard.db, "DETACH src;", NULL, NULL, NULL);
+    if (rc == 0 && exec_sql(&shard,
+                            "INSERT INTO sessions_fts(sessions_fts) VALUES('optimize');"
+                            "PRAGMA journal_mode=DELETE;",
+                            "Shard error") != 0) {
+        rc = -1;
+    }
+    session_store_close(&shard);
+    return rc;
+}
+
+static sqlite3_stmt *range_stmt(sqlite3 *db, const char *sql, const char *from, const char *to) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) return NULL;
+    sqlite3_bind_text(stmt, 1, from, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to, -1, SQLITE_STATIC);
+    return stmt;
+}
+
+// Drops the sessions created in [from, to) once session_store_copy_range put them into their
+// shard, and from then on keeps everything before to out of this store. Their totals and term
+// counts stay behind. *moved is the number of sessions dropped.
+int session_store_seal_range(session_store_t *store, const char *from, const char *to, int *moved) {
+    *moved = 0;
+    char buf[32] = "0";
+    session_store_meta_get(store, "sealed_rows", buf, sizeof(buf));
+    long long rows = atoll(buf);
+    snprintf(buf, sizeof(buf), "0");
+    session_store_meta_get(store, "sealed_max_id", buf, sizeof(buf));
+    int max_id = atoi(buf);
+    char before[16];
+    snprintf(before, sizeof(before), "%s", strcmp(to, store->sealed_before) > 0 ? to : store->sealed_before);
+
+    if (exec_sql(store, "BEGIN;", "Shard error") != 0) return -1;
+    int rc = -1;
+    sqlite3_stmt *stmt =
+        range_stmt(store->db, "SELECT MAX(id) FROM sessions WHERE created_at >= ?1 AND created_at < ?2;", from, to);
+    if (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (sqlite3_column_int(stmt, 0) > max_id) max_id = sqlite3_column_int(stmt, 0);
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    const char *keep[] = {TOTALS_KEEP_RANGE, TERMS_KEEP_RANGE};
+    for (size_t i = 0; rc == 0 && i < sizeof(keep) / sizeof(keep[0]); i++) {
+        stmt = range_stmt(store->db, keep[i], from, to);
+        if (!stmt || sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+        sqlite3_finalize(stmt);
+    }
+    stmt = rc == 0 ? range_stmt(store->db, "DELETE FROM sessions WHERE created_at >= ?1 AND created_at < ?2;", from,
+                                to)
+                   : NULL;
+    if (stmt && sqlite3_step(stmt) == SQLITE_DONE) {
+        *moved = sqlite3_changes(store->db);
+    } else {
+        rc = -1;
+    }
+    sqlite3_finalize(stmt);
+    if (rc == 0) {
+        char value[32];
+        snprintf(value, sizeof(value), "%lld", rows + *moved);
+        rc |= session_store_meta_set(store, "sealed_rows", value);
+        snprintf(value, sizeof(value), "%d", max_id);
+        rc |= session_store_meta_set(store, "sealed_max_id", value);
+        rc |= session_store_meta_set(store, "sealed_before", before);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Shard error: %s\n", sqlite3_errmsg(store->db));
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        *moved = 0;
+        return -1;
+    }
+    if (exec_sql(store, "COMMIT;", "Shard error") != 0) {
+        *moved = 0;
+        return -1;
+    }
+    snprintf(store->sealed_before, sizeof(store->sealed_before), "%s", before);
+    return 0;
+}
+
+// The signature of session id; 1 when it has none.
+int session_store_signature(session_store_t *store, int id, uint32_t mins[MINHASH_PERMS]) {
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_SIG_GET, SIG_GET_SQL);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, id);
+    int step = sqlite3_step(stmt);
+    int rc = step == SQLITE_DONE ? 1 : -1;
+    if (step == SQLITE_ROW) {
+        rc = minhash_decode(sqlite3_column_blob(stmt, 4), (size_t)sqlite3_column_bytes(stmt, 4), mins);
+    }
+    sqlite3_reset(stmt);
+    return rc;
+}
+
+// Sessions other than exclude_id that share at least one LSH band with mins, ascending.
+// *ids is malloc'd (NULL when empty).
+int session_store_lsh_candidates(session_store_t *store, const uint32_t mins[MINHASH_PERMS], int exclude_id, int **ids,
+                                 size_t *len) {
+    *ids = NULL;
+    *len = 0;
+    if (sig_empty(mins)) return 0;
+    char sql[128 + MINHASH_BANDS * 3];
+    char *w = sql + sprintf(sql, "SELECT DISTINCT session_id FROM session_lsh WHERE bucket IN (");
+    for (int b = 0; b < MINHASH_BANDS; b++) w += sprintf(w, b ? ",?" : "?");
+    sprintf(w, ") AND session_id != ? ORDER BY session_id;");
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    int64_t keys[MINHASH_BANDS];
+    minhash_bands(mins, keys);
+    for (int b = 0; b < MINHASH_BANDS; b++) sqlite3_bind_int64(stmt, b + 1, keys[b]);
+    sqlite3_bind_int(stmt, MINHASH_BANDS + 1, exclude_id);
+    size_t cap = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 64;
+            int *tmp = realloc(*ids, cap * sizeof(int));
+            if (!tmp) break;
+            *ids = tmp;
+        }
+        (*ids)[(*len)++] = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (step != SQLITE_DONE) {
+        free(*ids);
+        *ids = NULL;
+        *len = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void detach_shards(session_store_t *store, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char sql[48];
+        snprintf(sql, sizeof(sql), "DETACH shard%zu;", i);
+        sqlite3_exec(store->db, sql, NULL, NULL, NULL);
+    }
+}
+
+// Calls fn once per LSH bucket that holds more than one session, with its ids ascending. The
+// sealed shards at shards[0..nshards) are attached for the scan, so a bucket spans all of them
+// (SQLite merges the ordered tables, nothing is sorted; it attaches at most 10 by default); a
+// session in two stores counts once.
+int session_store_lsh_buckets(session_store_t *store, const char *const *shards, size_t nshards, store_bucket_fn fn,
+                              void *userdata) {
+    size_t attached = 0;
+    size_t sql_cap = 96 + nshards * 64;
+    char *sql = malloc(sql_cap);
+    int rc = sql ? 0 : -1;
+    size_t n = rc == 0 ? (size_t)snprintf(sql, sql_cap, "SELECT bucket, session_id FROM main.session_lsh") : 0;
+    for (; rc == 0 && attached < nshards; attached++) {
+        sqlite3_stmt *attach = NULL;
+        char name[32];
+        snprintf(name, sizeof(name), "shard%zu", attached);
+        if (sqlite3_prepare_v2(store->db, "ATTACH ? AS ?;", -1, &attach, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(attach, 1, shards[attached], -1, SQLITE_STATIC);
+            sqlite3_bind_text(attach, 2, name, -1, SQLITE_STATIC);
+            if (sqlite3_step(attach) != SQLITE_DONE) rc = -1;
+        } else {
+            rc = -1;
+        }
+        sqlite3_finalize(attach);
+        if (rc != 0) {
+            fprintf(stderr, "%s: %s\n", shards[attached], sqlite3_errmsg(store->db));
+            break;
+        }
+        n += (size_t)snprintf(sql + n, sql_cap - n, " UNION SELECT bucket, session_id FROM %s.session_lsh", name);
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (rc == 0) snprintf(sql + n, sql_cap - n, " ORDER BY 1, 2;");
+    if (rc == 0 && sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) rc = -1;
+    free(sql);
+    if (rc != 0) {
+        detach_shards(store, attached);
+        return -1;
+    }
+    int *ids = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    int64_t bucket = 0;
+    int step;
+    while (rc == 0 && (step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t b = sqlite3_column_int64(stmt, 0);
+        if (len > 0 && b != bucket) {
+            if (len > 1 && fn(userdata, ids, len) != 0) rc = -1;
+            len = 0;
+        }
+        bucket = b;
+        if (len == cap) {
+            cap = cap ? cap * 2 : 16;
+            int *tmp = realloc(ids, cap * sizeof(int));
+            if (!tmp) {
+                rc = -1;
+                break;
+            }
+            ids = tmp;
+        }
+        ids[len++] = sqlite3_column_int(stmt, 1);
+    }
+    if (rc == 0 && step != SQLITE_DONE) rc = -1;
+    if (rc == 0 && len > 1 && fn(userdata, ids, len) != 0) rc = -1;
+    sqlite3_finalize(stmt);
+    free(ids);
+    detach_shards(store, attached);
+    return rc;
+}
+
+// Queues the documents for session_store_pending_documents, unless their head is already mirrored.
+int session_store_queue_documents(session_store_t *store, const doc_ref_t *refs, size_t len) {
+    if (len == 0) return 0;
+    const char *sql = "INSERT INTO doc_pending (document_id, head_id) SELECT ?1, ?2 WHERE NOT EXISTS ("
+                      "SELECT 1 FROM doc_versions WHERE document_id = ?1 AND session_id = ?2) "
+                      "ON CONFLICT (document_id) DO UPDATE SET head_id = max(head_id, excluded.head_id);";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    int rc = exec_sql(store, "BEGIN;", "DB error");
+    for (size_t i = 0; rc == 0 && i < len; i++) {
+        sqlite3_bind_int(stmt, 1, refs[i].document_id);
+        sqlite3_bind_int(stmt, 2, refs[i].head_id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (rc == 0) return exec_sql(store, "COMMIT;", "DB error");
+    sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+    return -1;
+}
+
+int session_store_pending_documents(session_store_t *store, doc_ref_t **out, size_t *len) {
+    *out = NULL;
+    *len = 0;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, "SELECT document_id, head_id FROM doc_pending ORDER BY document_id;", -1,
+                           &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    size_t cap = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 64;
+            doc_ref_t *refs = realloc(*out, cap * sizeof(*refs));
+            if (!refs) break;
+            *out = refs;
+        }
+        (*out)[(*len)++] = (doc_ref_t){sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1)};
+    }
+    sqlite3_finalize(stmt);
+    if (step != SQLITE_DONE) {
+        free(*out);
+        *out = NULL;
+        *len = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int session_store_document_synced(session_store_t *store, int document_id) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, "DELETE FROM doc_pending WHERE document_id = ?;", -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+    sqlite3_bind_int(stmt, 1, document_id);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+typedef struct {
+    int version;
+    int session_id;
+    int keyframe;
+    long long chain; // delta bytes since the keyframe
+} doc_head_t;
+
+// The newest stored version of a document; 1 when it has none.
+static int doc_head(session_store_t *store, int document_id, doc_head_t *out) {
+    memset(out, 0, sizeof(*out));
+    const char *sql = "SELECT version, session_id, keyframe, chain FROM doc_versions WHERE document_id = ? "
+                      "ORDER BY version DESC LIMIT 1;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_DOC_HEAD, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, document_id);
+    int step = sqlite3_step(stmt);
+    if (step == SQLITE_ROW) {
+        out->version = sqlite3_column_int(stmt, 0);
+        out->session_id = sqlite3_column_int(stmt, 1);
+        out->keyframe = sqlite3_column_int(stmt, 2);
+        out->chain = sqlite3_column_int64(stmt, 3);
+    }
+    sqlite3_reset(stmt);
+    return step == SQLITE_ROW ? 0 : step == SQLITE_DONE ? 1 : -1;
+}
+
+// How many versions of the document are stored and the session of the newest; 1 when none are.
+int session_store_doc_head(session_store_t *store, int document_id, int *versions, int *session_id) {
+    doc_head_t head;
+    int rc = doc_head(store, document_id, &head);
+    *versions = head.version;
+    *session_id = head.session_id;
+    return rc;
+}
+
+// Rebuilds a version from the keyframe before it; *text is malloc'ed and NUL-terminated.
+// 1 when the document has no such version.
+int session_store_doc_text(session_store_t *store, int document_id, int version, char **text, size_t *len) {
+    const char *sql = "SELECT tw_text(text), delta FROM doc_versions WHERE document_id = ?1 AND version BETWEEN "
+                      "(SELECT keyframe FROM doc_versions WHERE document_id = ?1 AND version = ?2) AND ?2 "
+                      "ORDER BY version;";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_DOC_CHAIN, sql);
+    if (!stmt) return -1;
+    sqlite3_bind_int(stmt, 1, document_id);
+    sqlite3_bind_int(stmt, 2, version);
+    char *cur = NULL;
+    size_t cur_len = 0;
+    int rc = 0;
+    int step;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        char *next = NULL;
+        size_t next_len = 0;
+        if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            next_len = (size_t)sqlite3_column_bytes(stmt, 0);
+            next = malloc(next_len + 1);
+            if (next) memcpy(next, sqlite3_column_text(stmt, 0), next_len + 1);
+        } else if (cur && delta_apply(cur, cur_len, sqlite3_column_blob(stmt, 1), (size_t)sqlite3_column_bytes(stmt, 1),
+                                      &next, &next_len) != 0) {
+            next = NULL;
+        }
+        free(cur);
+        cur = next;
+        cur_len = next_len;
+        if (!cur) {
+            rc = -1;
+            break;
+        }
+    }
+    if (rc == 0 && step != SQLITE_DONE) rc = -1;
+    sqlite3_reset(stmt);
+    if (rc == 0 && !cur) rc = 1;
+    if (rc != 0) {
+        free(cur);
+        return rc;
+    }
+    *text = cur;
+    *len = cur_len;
+    return 0;
+}
+
+// Appends versions after the document's newest stored one, each as a delta against its
+// predecessor. Every STORE_KEYFRAME_EVERY versions, and whenever the deltas since the last
+// keyframe would add up to more than the text, a version is stored in full instead, so
+// rebuilding any version reads a bounded number of rows and about twice its size. *stored
+// (optional) grows by the bytes written, before compression of the keyframes.
+int session_store_add_versions(session_store_t *store, int document_id, const session_t *versions, size_t len,
+                               long long *stored) {
+    if (len == 0) return 0;
+    doc_head_t head;
+    int found = doc_head(store, document_id, &head);
+    if (found < 0) return -1;
+    char *owned = NULL;
+    const char *prev = NULL;
+    size_t prev_len = 0;
+    if (found == 0) {
+        if (session_store_doc_text(store, document_id, head.version, &owned, &prev_len) != 0) return -1;
+        prev = owned;
+    }
+    const char *sql = "INSERT INTO doc_versions (document_id, version, session_id, parent_id, created_at, word_count, "
+                      "size, keyframe, chain, text, delta) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, tw_pack(?), ?);";
+    sqlite3_stmt *stmt = cached_stmt(store, STMT_DOC_ADD, sql);
+    if (!stmt || exec_sql(store, "BEGIN;", "DB error") != 0) {
+        free(owned);
+        return -1;
+    }
+    int rc = 0;
+    long long written = 0;
+    for (size_t i = 0; rc == 0 && i < len; i++) {
+        const session_t *v = &versions[i];
+        size_t text_len = strlen(v->text);
+        int version = head.version + 1;
+        char *delta = NULL;
+        size_t delta_len = 0;
+        int key = !prev || version - head.keyframe >= STORE_KEYFRAME_EVERY;
+        if (!key && delta_encode(prev, prev_len, v->text, text_len, &delta, &delta_len) != 0) {
+            rc = -1;
+            break;
+        }
+        if (!key && head.chain + (long long)delta_len > (long long)text_len) key = 1;
+        head.version = version;
+        head.session_id = v->id;
+        head.keyframe = key ? version : head.keyframe;
+        head.chain = key ? 0 : head.chain + (long long)delta_len;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        sqlite3_bind_int(stmt, 1, document_id);
+        sqlite3_bind_int(stmt, 2, version);
+        sqlite3_bind_int(stmt, 3, v->id);
+        if (v->parent_id) sqlite3_bind_int(stmt, 4, v->parent_id);
+        sqlite3_bind_text(stmt, 5, v->created_at, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 6, v->word_count);
+        sqlite3_bind_int64(stmt, 7, (sqlite3_int64)text_len);
+        sqlite3_bind_int(stmt, 8, head.keyframe);
+        sqlite3_bind_int64(stmt, 9, head.chain);
+        if (key) sqlite3_bind_text(stmt, 10, v->text, (int)text_len, SQLITE_STATIC);
+        else sqlite3_bind_blob(stmt, 11, delta, (int)delta_len, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+        sqlite3_reset(stmt);
+        written += key ? (long long)text_len : (long long)delta_len;
+        free(delta);
+        prev = v->text;
+        prev_len = text_len;
+    }
+    free(owned);
+    if (rc == 0 && exec_sql(store, "COMMIT;", "DB error") == 0) {
+        if (stored) *stored += written;
+        return 0;
+    }
+    sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+    return -1;
+}
+
+// For a history the server rewrote: the document is fetched again from its first version.
+int session_store_drop_versions(session_store_t *store, int document_id) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, "DELETE FROM doc_versions WHERE document_id = ?;", -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+    sqlite3_bind_int(stmt, 1, document_id);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Calls fn for each stored version of the document, oldest first.
+int session_store_doc_versions(session_store_t *store, int document_id, doc_version_fn fn, void *userdata) {
+    const char *sql = "SELECT version, session_id, parent_id, word_count, keyframe, size, "
+                      "length(CAST(COALESCE(text, delta) AS BLOB)), created_at FROM doc_versions "
+                      "WHERE document_id = ? ORDER BY version;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    sqlite3_bind_int(stmt, 1, document_id);
+    int rc = 0;
+    int step;
+    while (rc == 0 && (step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        doc_version_t v = {
+            .version = sqlite3_column_int(stmt, 0),
+            .session_id = sqlite3_column_int(stmt, 1),
+            .parent_id = sqlite3_column_int(stmt, 2),
+            .word_count = sqlite3_column_int(stmt, 3),
+            .keyframe = sqlite3_column_int(stmt, 4),
+            .size = sqlite3_column_int64(stmt, 5),
+            .stored = sqlite3_column_int64(stmt, 6),
+            .created_at = (const char *)sqlite3_column_text(stmt, 7),
+        };
+        if (fn(userdata, &v) != 0) rc = -1;
+    }
+    if (rc == 0 && step != SQLITE_DONE) rc = -1;
     sqlite3_finalize(stmt);
     return rc;
 }
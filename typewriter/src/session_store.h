@@ -1,26 +1,186 @@
 #ifndef SESSION_STORE_H
 #define SESSION_STORE_H
 
+#include "metrics.h"
+#include "minhash.h"
+#include "text_codec.h"
+#include "text_stats.h"
 #include "typewriter_api.h"
 #include <sqlite3.h>
 #include <stddef.h>
+#include <stdio.h>
+
+#define STORE_STMT_COUNT 28
+// PRAGMA user_version after every migration in session_store_init_schema has run.
+#define STORE_SCHEMA_VERSION 9
+#define STORE_BULK_ROWS 64
+#define STORE_SCAN_MMAP_BYTES (1LL << 30)
+// A document version is stored in full at least this often (see session_store_add_versions).
+#define STORE_KEYFRAME_EVERY 16
+
+typedef struct {
+    int synchronous_off;
+    int defer_fts;
+} store_bulk_opts_t;
 
 typedef struct {
     sqlite3 *db;
+    sqlite3_stmt *stmts[STORE_STMT_COUNT];
+    long long synced_at_sec;
+    char synced_at[32];
+    int bulk;
+    int bulk_defer_fts;
+    int saved_synchronous;
+    int saved_cache_size;
+    int saved_temp_store;
+    metrics_t *metrics;
+    text_terms_t terms;
+    minhash_t *minhash; // created on the first indexed row
+    char *scratch;
+    size_t scratch_cap;
+    long long count_mismatches; // written rows whose server counts differ from text_stats_scan
+    text_codec_t *codec;        // created once a dictionary or compressed text is seen
+    char sealed_before[16];     // rows created before this day belong to sealed shards (see shard.h)
+    long long sealed_skipped;   // rows for sealed shards that upserts left alone
 } session_store_t;
 
+// One search result; created_at and snippet are malloc'd (see session_store_free_hits).
+typedef struct {
+    int id;
+    int word_count;
+    int shard;   // which store produced it, for callers that merge several
+    double rank; // bm25 within that store, lower is better
+    char *created_at;
+    char *snippet; // NULL until session_store_snippets when searched without snippets
+} search_hit_t;
+
 typedef struct {
     int count;
+    long long words;
     char last_created_at[64];
     long long db_size_bytes;
 } store_stats_t;
 
+// Sessions to scan: ids and created_at days (YYYY-MM-DD) are inclusive; 0 or NULL leaves a
+// bound open.
+typedef struct {
+    int from_id;
+    int to_id;
+    const char *from;
+    const char *to;
+} store_range_t;
+
+// One row of a scan, borrowed from the store; the strings are NUL-terminated.
+typedef struct {
+    int id;
+    int word_count;
+    int char_count;
+    int letter_count;
+    const char *created_at;
+    size_t created_at_len;
+    const char *text;
+    size_t text_len;
+} store_row_t;
+
+// Receives the ids of one LSH bucket (ascending). Returning non-zero stops the iteration.
+typedef int (*store_bucket_fn)(void *userdata, const int *ids, size_t len);
+
+// Receives each scanned row. Returning non-zero stops the scan.
+typedef int (*store_row_fn)(void *userdata, const store_row_t *row);
+
+typedef struct {
+    int level;   // zstd level for the texts, 0 for the default
+    int retrain; // train a new dictionary even if the store has one
+    int plain;   // store all texts uncompressed again and drop the dictionaries
+} store_compact_opts_t;
+
+typedef struct {
+    int max_id;
+    int row_count;
+    char max_created_at[64];
+    char last_sync_at[32];
+} sync_checkpoint_t;
+
+// A page of an unfinished full sync that is already stored: offset and limit as requested, and
+// the server's total at the time, which tells how far the offset has moved since.
+typedef struct {
+    int offset;
+    int limit;
+    int total;
+} sync_page_t;
+
+// A document whose versions need fetching: head_id is the newest session sync saw of it.
+typedef struct {
+    int document_id;
+    int head_id;
+} doc_ref_t;
+
+// One stored version of a document, borrowed from the store.
+typedef struct {
+    int version; // 1-based, oldest first
+    int session_id;
+    int parent_id;
+    int word_count;
+    int keyframe;     // the version stored in full that this one is rebuilt from
+    long long size;   // bytes of the text
+    long long stored; // bytes it takes in the store
+    const char *created_at;
+} doc_version_t;
+
+// Receives each version. Returning non-zero stops the iteration.
+typedef int (*doc_version_fn)(void *userdata, const doc_version_t *v);
+
 int session_store_open(session_store_t *store, const char *path);
+int session_store_open_readonly(session_store_t *store, const char *path);
+int session_store_open_immutable(session_store_t *store, const char *path);
+int session_store_open_reader(session_store_t *store, const char *path);
 void session_store_close(session_store_t *store);
+int session_store_set_metrics(session_store_t *store, metrics_t *m);
 int session_store_init_schema(session_store_t *store);
 int session_store_upsert(session_store_t *store, const session_t *s);
+int session_store_bulk_begin(session_store_t *store, const store_bulk_opts_t *opts);
+int session_store_bulk_insert(session_store_t *store, const session_t *rows, size_t len, size_t *unchanged);
+int session_store_bulk_end(session_store_t *store);
 int session_store_get(session_store_t *store, int id, session_t *out);
-int session_store_search(session_store_t *store, const char *query, int limit);
+int session_store_contains(session_store_t *store, int id);
+int session_store_search(session_store_t *store, const char *query, int limit, FILE *out);
+int session_store_search_hits(session_store_t *store, const char *query, int limit, int snippets, search_hit_t **out,
+                              size_t *len);
+int session_store_snippets(session_store_t *store, const char *query, search_hit_t *hits, size_t len);
+void session_store_print_hits(const search_hit_t *hits, size_t len, FILE *out);
+void session_store_free_hits(search_hit_t *hits, size_t len);
+int session_store_match_ids(session_store_t *store, const char *query, int **ids, size_t *len);
+int session_store_each(session_store_t *store, const int *ids, size_t len, session_cb fn, void *userdata);
+int session_store_scan(session_store_t *store, const store_range_t *range, store_row_fn fn, void *userdata);
+int session_store_top_terms(session_store_t *store, int id, int limit, FILE *out);
+int session_store_optimize(session_store_t *store, int merge_pages);
+int session_store_vacuum(session_store_t *store);
+int session_store_copy_to(session_store_t *store, const char *path);
+int session_store_compact(session_store_t *store, const store_compact_opts_t *opts, FILE *out);
 int session_store_stats(session_store_t *store, store_stats_t *out);
+int session_store_report(session_store_t *store, const char *period, const char *from, const char *to, FILE *out);
+int session_store_meta_get(session_store_t *store, const char *key, char *buf, size_t len);
+int session_store_meta_set(session_store_t *store, const char *key, const char *value);
+int session_store_load_checkpoint(session_store_t *store, sync_checkpoint_t *out);
+int session_store_save_checkpoint(session_store_t *store);
+int session_store_mark_page(session_store_t *store, int offset, int limit, int total);
+int session_store_load_pages(session_store_t *store, sync_page_t **out, size_t *len);
+int session_store_signature(session_store_t *store, int id, uint32_t mins[MINHASH_PERMS]);
+int session_store_lsh_candidates(session_store_t *store, const uint32_t mins[MINHASH_PERMS], int exclude_id, int **ids,
+                                 size_t *len);
+int session_store_lsh_buckets(session_store_t *store, const char *const *shards, size_t nshards, store_bucket_fn fn,
+                              void *userdata);
+int session_store_queue_documents(session_store_t *store, const doc_ref_t *refs, size_t len);
+int session_store_pending_documents(session_store_t *store, doc_ref_t **out, size_t *len);
+int session_store_document_synced(session_store_t *store, int document_id);
+int session_store_doc_head(session_store_t *store, int document_id, int *versions, int *session_id);
+int session_store_add_versions(session_store_t *store, int document_id, const session_t *versions, size_t len,
+                               long long *stored);
+int session_store_drop_versions(session_store_t *store, int document_id);
+int session_store_doc_versions(session_store_t *store, int document_id, doc_version_fn fn, void *userdata);
+int session_store_doc_text(session_store_t *store, int document_id, int version, char **text, size_t *len);
+int session_store_oldest_before(session_store_t *store, const char *day, char *buf, size_t len);
+int session_store_copy_range(session_store_t *store, const char *shard_path, const char *from, const char *to);
+int session_store_seal_range(session_store_t *store, const char *from, const char *to, int *moved);
 
 #endif // SESSION_STORE_H
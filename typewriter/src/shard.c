@@ -0,0 +1,412 @@
+#include "shard.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *shard_manifest_path(const char *db_path) {
+    size_t len = strlen(db_path) + sizeof(".shards");
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s.shards", db_path);
+    return path;
+}
+
+// file relative to the directory db_path is in, unless it is absolute.
+static char *resolve(const char *db_path, const char *file) {
+    const char *slash = strrchr(db_path, '/');
+    size_t dir = file[0] == '/' || !slash ? 0 : (size_t)(slash - db_path) + 1;
+    size_t len = dir + strlen(file) + 1;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%.*s%s", (int)dir, db_path, file);
+    return path;
+}
+
+static shard_entry_t *manifest_add(shard_manifest_t *m, const char *db_path, int year, const char *file) {
+    shard_entry_t *items = realloc(m->items, (m->len + 1) * sizeof(shard_entry_t));
+    if (!items) return NULL;
+    m->items = items;
+    size_t at = m->len;
+    while (at > 0 && items[at - 1].year > year) at--;
+    memmove(&items[at + 1], &items[at], (m->len - at) * sizeof(shard_entry_t));
+    items[at].year = year;
+    items[at].file = strdup(file);
+    items[at].path = resolve(db_path, file);
+    m->len++;
+    return items[at].file && items[at].path ? &items[at] : NULL;
+}
+
+void shard_manifest_free(shard_manifest_t *m) {
+    for (size_t i = 0; i < m->len; i++) {
+        free(m->items[i].file);
+        free(m->items[i].path);
+    }
+    free(m->items);
+    m->items = NULL;
+    m->len = 0;
+}
+
+int shard_manifest_load(const char *db_path, shard_manifest_t *m) {
+    m->items = NULL;
+    m->len = 0;
+    char *path = shard_manifest_path(db_path);
+    if (!path) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        free(path);
+        return 0;
+    }
+    char line[4096];
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        int year = 0;
+        int n = 0;
+        if (sscanf(line, "%d %n", &year, &n) != 1 || line[n] == '\0') {
+            fprintf(stderr, "Ungültige Zeile in %s: %s\n", path, line);
+            rc = -1;
+        } else {
+            rc = manifest_add(m, db_path, year, line + n) ? 0 : -1;
+        }
+    }
+    fclose(f);
+    free(path);
+    if (rc != 0) shard_manifest_free(m);
+    return rc;
+}
+
+// Written next to the old one and renamed over it, so readers never see half a manifest.
+static int manifest_save(const char *db_path, const shard_manifest_t *m) {
+    char *path = shard_manifest_path(db_path);
+    char *tmp = path ? malloc(strlen(path) + 5) : NULL;
+    if (!tmp) {
+        free(path);
+        return -1;
+    }
+    sprintf(tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    int rc = -1;
+    if (f) {
+        rc = 0;
+        for (size_t i = 0; i < m->len; i++) {
+            if (fprintf(f, "%d %s\n", m->items[i].year, m->items[i].file) < 0) rc = -1;
+        }
+        if (fclose(f) != 0) rc = -1;
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Manifest konnte nicht geschrieben werden: %s\n", path);
+        remove(tmp);
+    }
+    free(tmp);
+    free(path);
+    return rc;
+}
+
+// sessions.db becomes sessions-2024.db, next to it.
+static void shard_file(const char *db_path, int year, char *buf, size_t len) {
+    const char *slash = strrchr(db_path, '/');
+    const char *base = slash ? slash + 1 : db_path;
+    size_t n = strlen(base);
+    if (n > 3 && strcmp(base + n - 3, ".db") == 0) n -= 3;
+    snprintf(buf, len, "%.*s-%d.db", (int)n, base, year);
+}
+
+int shard_split(session_store_t *store, const char *db_path, int before_year, FILE *out) {
+    shard_manifest_t m;
+    if (shard_manifest_load(db_path, &m) != 0) return -1;
+    char before[24];
+    snprintf(before, sizeof(before), "%04d-01-01", before_year);
+    int rc = 0;
+    int shards = 0;
+    char oldest[64];
+    int found;
+    while (rc == 0 && (found = session_store_oldest_before(store, before, oldest, sizeof(oldest))) == 0) {
+        int year = 0;
+        if (sscanf(oldest, "%4d-", &year) != 1 || year <= 0) {
+            fprintf(stderr, "Unbekanntes Datum: %s\n", oldest);
+            rc = -1;
+            break;
+        }
+        char from[24];
+        char to[24];
+        snprintf(from, sizeof(from), "%04d-01-01", year);
+        snprintf(to, sizeof(to), "%04d-01-01", year + 1);
+        shard_entry_t *shard = NULL;
+        for (size_t i = 0; i < m.len; i++) {
+            if (m.items[i].year == year) shard = &m.items[i];
+        }
+        if (!shard) {
+            char file[512];
+            shard_file(db_path, year, file, sizeof(file));
+            if (!(shard = manifest_add(&m, db_path, year, file))) {
+                rc = -1;
+                break;
+            }
+        }
+        // The shard is listed before the rows leave this store, so a crash in between leaves
+        // them in both places (search drops the duplicates), never in neither.
+        const char *path = shard->path;
+        int moved = 0;
+        if (session_store_copy_range(store, path, from, to) != 0 || manifest_save(db_path, &m) != 0 ||
+            session_store_seal_range(store, from, to, &moved) != 0) {
+            rc = -1;
+            break;
+        }
+        fprintf(out, "%d: %d Sessions nach %s verschoben\n", year, moved, path);
+        shards++;
+    }
+    if (rc == 0 && found < 0) rc = -1;
+    if (rc == 0 && shards == 0) fprintf(out, "Keine Sessions vor %s, nichts zu tun.\n", before);
+    // The deletes leave the index full of tombstones and the file at its old size.
+    if (rc == 0 && shards > 0 && (session_store_optimize(store, 0) != 0 || session_store_vacuum(store) != 0)) rc = -1;
+    shard_manifest_free(&m);
+    return rc;
+}
+
+typedef struct {
+    pthread_mutex_t mu;
+    pthread_cond_t done_cond;
+    size_t pending;
+} shard_wait_t;
+
+typedef struct {
+    shard_wait_t *wait;
+    session_store_t *store;
+    int shard;
+    const char *query;
+    int limit;
+    search_hit_t *hits;
+    size_t len;
+    int rc;
+} shard_job_t;
+
+static void search_worker(void *worker_ctx, void *arg) {
+    (void)worker_ctx;
+    shard_job_t *job = arg;
+    job->rc = session_store_search_hits(job->store, job->query, job->limit, 0, &job->hits, &job->len);
+    for (size_t i = 0; i < job->len; i++) job->hits[i].shard = job->shard;
+    pthread_mutex_lock(&job->wait->mu);
+    job->wait->pending--;
+    pthread_cond_broadcast(&job->wait->done_cond);
+    pthread_mutex_unlock(&job->wait->mu);
+}
+
+int shard_reader_open(shard_reader_t *r, session_store_t *current, const char *db_path, int threads) {
+    memset(r, 0, sizeof(*r));
+    r->current = current;
+    shard_manifest_t *m = &r->manifest;
+    if (shard_manifest_load(db_path, m) != 0) return -1;
+    if (m->len == 0) return 0;
+    snprintf(r->current_from, sizeof(r->current_from), "%04d-01-01", m->items[m->len - 1].year + 1);
+    r->sealed = calloc(m->len, sizeof(session_store_t));
+    int rc = r->sealed ? 0 : -1;
+    for (size_t i = 0; rc == 0 && i < m->len; i++, r->count++) {
+        rc = session_store_open_immutable(&r->sealed[i], m->items[i].path);
+    }
+    // One job per shard, the current one included; more threads would only sit idle.
+    if (rc == 0 && threads > 1) {
+        r->threads = threads < (int)r->count + 1 ? threads : (int)r->count + 1;
+        if (thread_pool_init(&r->pool, r->threads, r->count + 1, search_worker, NULL) != 0) r->threads = 0;
+    }
+    if (rc != 0) shard_reader_close(r);
+    return rc;
+}
+
+void shard_reader_close(shard_reader_t *r) {
+    if (r->threads > 0) thread_pool_destroy(&r->pool);
+    for (size_t i = 0; i < r->count; i++) session_store_close(&r->sealed[i]);
+    free(r->sealed);
+    shard_manifest_free(&r->manifest);
+    r->sealed = NULL;
+    r->count = 0;
+    r->threads = 0;
+    r->current_from[0] = '\0';
+}
+
+session_store_t *shard_reader_store(shard_reader_t *r, int shard) {
+    return shard == 0 ? r->current : &r->sealed[shard - 1];
+}
+
+static int by_rank(const void *a, const void *b) {
+    const search_hit_t *x = a;
+    const search_hit_t *y = b;
+    if (x->rank != y->rank) return x->rank < y->rank ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+int shard_reader_search(shard_reader_t *r, const char *query, int limit, FILE *out) {
+    if (r->count == 0) return session_store_search(r->current, query, limit, out);
+    size_t njobs = r->count + 1;
+    shard_job_t *jobs = calloc(njobs, sizeof(shard_job_t));
+    if (!jobs) return -1;
+    shard_wait_t wait = {.pending = njobs};
+    pthread_mutex_init(&wait.mu, NULL);
+    pthread_cond_init(&wait.done_cond, NULL);
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i] = (shard_job_t){&wait, shard_reader_store(r, (int)i), (int)i, query, limit, NULL, 0, 0};
+        if (r->threads == 0 || thread_pool_submit(&r->pool, &jobs[i]) != 0) search_worker(NULL, &jobs[i]);
+    }
+    pthread_mutex_lock(&wait.mu);
+    while (wait.pending > 0) pthread_cond_wait(&wait.done_cond, &wait.mu);
+    pthread_mutex_unlock(&wait.mu);
+    pthread_cond_destroy(&wait.done_cond);
+    pthread_mutex_destroy(&wait.mu);
+
+    // Every shard's own top limit together holds the global top limit. Snippets cost a
+    // decompression and a tokenizer pass each, so only the hits that are kept get one.
+    int rc = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        if (jobs[i].rc != 0) rc = -1;
+        total += jobs[i].len;
+    }
+    search_hit_t *all = rc == 0 && total > 0 ? malloc(total * sizeof(search_hit_t)) : NULL;
+    if (total > 0 && !all) rc = -1;
+    size_t n = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        if (!all) {
+            session_store_free_hits(jobs[i].hits, jobs[i].len);
+            continue;
+        }
+        if (jobs[i].len > 0) memcpy(all + n, jobs[i].hits, jobs[i].len * sizeof(search_hit_t));
+        n += jobs[i].len;
+        free(jobs[i].hits);
+    }
+    free(jobs);
+    if (rc != 0) {
+        session_store_free_hits(all, n);
+        return -1;
+    }
+    if (n > 0) qsort(all, n, sizeof(search_hit_t), by_rank);
+    // A session in two shards (an interrupted shard run) keeps its better hit.
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        int dup = 0;
+        for (size_t k = 0; k < kept && !dup; k++) dup = all[k].id == all[i].id;
+        if (dup || (int)kept >= limit) {
+            free(all[i].created_at);
+            continue;
+        }
+        all[kept++] = all[i];
+    }
+    for (size_t i = 0; i < kept && rc == 0; i++) {
+        rc = session_store_snippets(shard_reader_store(r, all[i].shard), query, &all[i], 1);
+    }
+    if (rc == 0) session_store_print_hits(all, kept, out);
+    session_store_free_hits(all, kept);
+    return rc;
+}
+
+int shard_reader_get(shard_reader_t *r, int id, session_t *out) {
+    int rc = session_store_get(r->current, id, out);
+    for (size_t i = r->count; rc == 1 && i > 0; i--) rc = session_store_get(&r->sealed[i - 1], id, out);
+    return rc;
+}
+
+session_store_t *shard_reader_find(shard_reader_t *r, int id) {
+    if (session_store_contains(r->current, id) == 1) return r->current;
+    for (size_t i = r->count; i > 0; i--) {
+        if (session_store_contains(&r->sealed[i - 1], id) == 1) return &r->sealed[i - 1];
+    }
+    return NULL;
+}
+
+// Sealed shards first, oldest year first; the current store last.
+static session_store_t *nth_store(shard_reader_t *r, size_t i) {
+    return i < r->count ? &r->sealed[i] : r->current;
+}
+
+static int is_leftover(const shard_reader_t *r, session_store_t *store, const char *created_at) {
+    return store == r->current && r->current_from[0] && created_at && strcmp(created_at, r->current_from) < 0;
+}
+
+int shard_reader_scan(shard_reader_t *r, const store_range_t *range, store_row_fn fn, void *userdata) {
+    store_range_t current = *range;
+    if (r->current_from[0] && (!current.from || strcmp(current.from, r->current_from) < 0)) {
+        current.from = r->current_from;
+    }
+    int rc = 0;
+    for (size_t i = 0; rc == 0 && i <= r->count; i++) {
+        rc = session_store_scan(nth_store(r, i), i < r->count ? range : &current, fn, userdata);
+    }
+    return rc;
+}
+
+typedef struct {
+    shard_reader_t *r;
+    session_store_t *store;
+    session_cb fn;
+    void *userdata;
+} each_ctx_t;
+
+static int each_row(void *userdata, const session_t *s) {
+    each_ctx_t *c = userdata;
+    if (is_leftover(c->r, c->store, s->created_at)) return 0;
+    return c->fn(c->userdata, s);
+}
+
+int shard_reader_each(shard_reader_t *r, const int *ids, size_t len, session_cb fn, void *userdata) {
+    if (r->count == 0) return session_store_each(r->current, ids, len, fn, userdata);
+    each_ctx_t c = {r, NULL, fn, userdata};
+    int rc = 0;
+    for (size_t i = 0; rc == 0 && i <= r->count; i++) {
+        c.store = nth_store(r, i);
+        rc = session_store_each(c.store, ids, len, each_row, &c);
+    }
+    return rc;
+}
+
+int shard_reader_signature(shard_reader_t *r, int id, uint32_t mins[MINHASH_PERMS]) {
+    session_store_t *store = shard_reader_find(r, id);
+    return store ? session_store_signature(store, id, mins) : 1;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+int shard_reader_lsh_candidates(shard_reader_t *r, const uint32_t mins[MINHASH_PERMS], int exclude_id, int **ids,
+                                size_t *len) {
+    if (session_store_lsh_candidates(r->current, mins, exclude_id, ids, len) != 0) return -1;
+    for (size_t i = 0; i < r->count; i++) {
+        int *more = NULL;
+        size_t n = 0;
+        if (session_store_lsh_candidates(&r->sealed[i], mins, exclude_id, &more, &n) != 0) {
+            free(*ids);
+            *ids = NULL;
+            *len = 0;
+            return -1;
+        }
+        int *all = n > 0 ? realloc(*ids, (*len + n) * sizeof(int)) : *ids;
+        if (n > 0 && !all) {
+            free(more);
+            free(*ids);
+            *ids = NULL;
+            *len = 0;
+            return -1;
+        }
+        if (n > 0) memcpy(all + *len, more, n * sizeof(int));
+        *ids = all;
+        *len += n;
+        free(more);
+    }
+    if (r->count == 0 || *len == 0) return 0;
+    qsort(*ids, *len, sizeof(int), cmp_int);
+    size_t kept = 0;
+    for (size_t i = 0; i < *len; i++) {
+        if (kept == 0 || (*ids)[i] != (*ids)[kept - 1]) (*ids)[kept++] = (*ids)[i];
+    }
+    *len = kept;
+    return 0;
+}
+
+int shard_reader_lsh_buckets(shard_reader_t *r, store_bucket_fn fn, void *userdata) {
+    const char **paths = r->count > 0 ? malloc(r->count * sizeof(char *)) : NULL;
+    if (r->count > 0 && !paths) return -1;
+    for (size_t i = 0; i < r->count; i++) paths[i] = r->manifest.items[i].path;
+    int rc = session_store_lsh_buckets(r->current, paths, r->count, fn, userdata);
+    free(paths);
+    return rc;
+}
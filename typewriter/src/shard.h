@@ -0,0 +1,81 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "session_store.h"
+#include "thread_pool.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// Time-based shards: the store at --db is the current shard and takes every write; the shard
+// command moves the sessions of past years into one sealed store per year. The manifest
+// <db>.shards lists the sealed ones, one "YEAR FILE" line each, FILE relative to the
+// manifest's directory. Without a manifest a store is a single shard, as before.
+typedef struct {
+    int year;
+    char *file; // as written in the manifest
+    char *path; // file resolved against the manifest's directory
+} shard_entry_t;
+
+typedef struct {
+    shard_entry_t *items; // ascending by year
+    size_t len;
+} shard_manifest_t;
+
+// "<db_path>.shards", malloc'd.
+char *shard_manifest_path(const char *db_path);
+// A missing manifest is not an error: *m is left empty.
+int shard_manifest_load(const char *db_path, shard_manifest_t *m);
+void shard_manifest_free(shard_manifest_t *m);
+
+// Moves every session of store created before January 1st of before_year into its year's
+// sealed shard next to db_path and records the shard in the manifest. Safe to run again after
+// an interruption. Returns 0 or -1.
+int shard_split(session_store_t *store, const char *db_path, int before_year, FILE *out);
+
+// Reads the current store and every sealed shard of its manifest. The sealed shards are
+// opened immutable and stay open, so their pages stay cached between queries.
+typedef struct {
+    session_store_t *current; // borrowed
+    session_store_t *sealed;  // in manifest order, oldest year first
+    size_t count;
+    shard_manifest_t manifest;
+    char current_from[24]; // "YEAR-01-01" after the newest sealed year, "" without shards
+    thread_pool_t pool;
+    int threads; // 0: the shards are searched one after another on the caller's thread
+} shard_reader_t;
+
+int shard_reader_open(shard_reader_t *r, session_store_t *current, const char *db_path, int threads);
+void shard_reader_close(shard_reader_t *r);
+
+// Shard 0 is the current store, 1 to count the sealed shards in manifest order.
+session_store_t *shard_reader_store(shard_reader_t *r, int shard);
+
+// Runs query on every shard in parallel and prints the global top limit, merged by bm25.
+// bm25 uses each shard's own term statistics, so ranks from different years are close to
+// but not exactly what a single store would compute.
+int shard_reader_search(shard_reader_t *r, const char *query, int limit, FILE *out);
+
+// Looks id up in the current store first, then in the sealed shards. Returns like
+// session_store_get: 1 when no store has it.
+int shard_reader_get(shard_reader_t *r, int id, session_t *out);
+
+// The store that holds session id, in the order of shard_reader_get; NULL when none does.
+session_store_t *shard_reader_find(shard_reader_t *r, int id);
+
+// The functions below cover every shard, the sealed ones first (oldest year first), then the
+// current store. Rows the current store still has from before current_from are left out:
+// only an interrupted shard run leaves them there, and their shard has them too.
+
+// session_store_scan per shard, so rows come in id order within each shard.
+int shard_reader_scan(shard_reader_t *r, const store_range_t *range, store_row_fn fn, void *userdata);
+// session_store_each per shard: fn sees each of ids once, grouped by shard.
+int shard_reader_each(shard_reader_t *r, const int *ids, size_t len, session_cb fn, void *userdata);
+// session_store_signature of the shard that holds id; 1 when none has one.
+int shard_reader_signature(shard_reader_t *r, int id, uint32_t mins[MINHASH_PERMS]);
+// session_store_lsh_candidates of every shard together, ascending and without duplicates.
+int shard_reader_lsh_candidates(shard_reader_t *r, const uint32_t mins[MINHASH_PERMS], int exclude_id, int **ids,
+                                size_t *len);
+// session_store_lsh_buckets with the sealed shards attached to the current store's connection.
+int shard_reader_lsh_buckets(shard_reader_t *r, store_bucket_fn fn, void *userdata);
+
+#endif // SHARD_H
@@ -0,0 +1,297 @@
+#include "similar.h"
+#include "minhash.h"
+#include "text_stats.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Signature estimates are off by about 0.06 at 64 permutations; a candidate more than this
+// below the threshold is dropped without loading its text.
+#define SIMILAR_SLACK 0.2
+// Buckets up to this size contribute all their pairs, larger ones (boilerplate texts) only
+// each session's next SIMILAR_WINDOW neighbours, which union-find still joins into one group.
+#define SIMILAR_FULL_BUCKET 64
+#define SIMILAR_WINDOW 32
+
+static void shingle_text(minhash_t *m, const char *text) {
+    text_stats_t st;
+    minhash_reset(m);
+    text_stats_scan(text, strlen(text), &st, minhash_add, m);
+    minhash_finish(m);
+}
+
+typedef struct {
+    int id;
+    double similarity;
+    int word_count;
+    char *created_at;
+} similar_hit_t;
+
+typedef struct {
+    const similar_config_t *cfg;
+    minhash_t query;
+    minhash_t other;
+    similar_hit_t *hits;
+    size_t len;
+    size_t cap;
+} similar_ctx_t;
+
+static int load_query(void *userdata, const session_t *s) {
+    similar_ctx_t *ctx = userdata;
+    shingle_text(&ctx->query, s->text);
+    return ctx->query.failed ? -1 : 0;
+}
+
+static int check_candidate(void *userdata, const session_t *s) {
+    similar_ctx_t *ctx = userdata;
+    shingle_text(&ctx->other, s->text);
+    if (ctx->other.failed) return -1;
+    double j = minhash_jaccard(&ctx->query, &ctx->other);
+    if (j < ctx->cfg->threshold) return 0;
+    if (ctx->len == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : 16;
+        similar_hit_t *hits = realloc(ctx->hits, cap * sizeof(similar_hit_t));
+        if (!hits) return -1;
+        ctx->hits = hits;
+        ctx->cap = cap;
+    }
+    ctx->hits[ctx->len++] = (similar_hit_t){s->id, j, s->word_count, strdup(s->created_at ? s->created_at : "")};
+    return 0;
+}
+
+static int by_similarity(const void *a, const void *b) {
+    const similar_hit_t *x = a;
+    const similar_hit_t *y = b;
+    if (x->similarity != y->similarity) return x->similarity > y->similarity ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+int similar_run(shard_reader_t *shards, int id, const similar_config_t *cfg, FILE *out) {
+    uint32_t mins[MINHASH_PERMS];
+    int rc = shard_reader_signature(shards, id, mins);
+    if (rc != 0) {
+        if (rc > 0) fprintf(stderr, "Session %d nicht gefunden\n", id);
+        return rc;
+    }
+    int *ids = NULL;
+    size_t len = 0;
+    if (shard_reader_lsh_candidates(shards, mins, id, &ids, &len) != 0) return -1;
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t other[MINHASH_PERMS];
+        if (shard_reader_signature(shards, ids[i], other) != 0) continue;
+        if (minhash_estimate(mins, other) >= cfg->threshold - SIMILAR_SLACK) ids[n++] = ids[i];
+    }
+
+    similar_ctx_t ctx = {.cfg = cfg};
+    minhash_init(&ctx.query, 1);
+    minhash_init(&ctx.other, 1);
+    rc = shard_reader_each(shards, &id, 1, load_query, &ctx);
+    if (rc == 0 && n > 0) rc = shard_reader_each(shards, ids, n, check_candidate, &ctx);
+    if (rc == 0) {
+        if (ctx.len > 0) qsort(ctx.hits, ctx.len, sizeof(similar_hit_t), by_similarity);
+        fprintf(out, "Ähnlich zu #%d (%zu Kandidaten, %zu geprüft):\n", id, len, n);
+        for (size_t i = 0; i < ctx.len && (int)i < cfg->limit; i++) {
+            const similar_hit_t *h = &ctx.hits[i];
+            fprintf(out, "- #%d (%s) [%d Wörter] %.2f\n", h->id, h->created_at ? h->created_at : "", h->word_count,
+                    h->similarity);
+        }
+        if (ctx.len == 0) fprintf(out, "Keine Session mit Ähnlichkeit >= %.2f.\n", cfg->threshold);
+    }
+    for (size_t i = 0; i < ctx.len; i++) free(ctx.hits[i].created_at);
+    free(ctx.hits);
+    minhash_free(&ctx.query);
+    minhash_free(&ctx.other);
+    free(ids);
+    return rc;
+}
+
+typedef struct {
+    uint64_t *pairs; // smaller id in the high half
+    size_t len;
+    size_t cap;
+} pair_list_t;
+
+static int add_pair(pair_list_t *p, int a, int b) {
+    if (p->len == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 1024;
+        uint64_t *pairs = realloc(p->pairs, cap * sizeof(uint64_t));
+        if (!pairs) return -1;
+        p->pairs = pairs;
+        p->cap = cap;
+    }
+    p->pairs[p->len++] = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+    return 0;
+}
+
+static int collect_pairs(void *userdata, const int *ids, size_t len) {
+    pair_list_t *p = userdata;
+    size_t window = len <= SIMILAR_FULL_BUCKET ? len : SIMILAR_WINDOW + 1;
+    for (size_t i = 0; i < len; i++) {
+        for (size_t j = i + 1; j < len && j < i + window; j++) {
+            if (add_pair(p, ids[i], ids[j]) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    int id;
+    uint32_t mins[MINHASH_PERMS];
+    int wanted; // in a pair that passed the estimate
+    uint64_t *set;
+    size_t set_len;
+    int parent;
+} dedupe_node_t;
+
+typedef struct {
+    dedupe_node_t *nodes;
+    size_t len;
+    minhash_t m;
+} dedupe_ctx_t;
+
+static dedupe_node_t *find_node(const dedupe_ctx_t *ctx, int id) {
+    size_t lo = 0;
+    size_t hi = ctx->len;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ctx->nodes[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < ctx->len && ctx->nodes[lo].id == id ? &ctx->nodes[lo] : NULL;
+}
+
+static int load_set(void *userdata, const session_t *s) {
+    dedupe_ctx_t *ctx = userdata;
+    dedupe_node_t *node = find_node(ctx, s->id);
+    if (!node) return 0;
+    shingle_text(&ctx->m, s->text);
+    if (ctx->m.failed) return -1;
+    if (ctx->m.set_len == 0) return 0;
+    node->set = malloc(ctx->m.set_len * sizeof(uint64_t));
+    if (!node->set) return -1;
+    memcpy(node->set, ctx->m.set, ctx->m.set_len * sizeof(uint64_t));
+    node->set_len = ctx->m.set_len;
+    return 0;
+}
+
+static int root(dedupe_node_t *nodes, int i) {
+    while (nodes[i].parent != i) {
+        nodes[i].parent = nodes[nodes[i].parent].parent;
+        i = nodes[i].parent;
+    }
+    return i;
+}
+
+int similar_dedupe(shard_reader_t *shards, const similar_config_t *cfg, FILE *out) {
+    long long started = metrics_now_ns();
+    pair_list_t p = {0};
+    if (shard_reader_lsh_buckets(shards, collect_pairs, &p) != 0) {
+        free(p.pairs);
+        return -1;
+    }
+    // Pairs sharing several bands come once per band.
+    size_t npairs = 0;
+    if (p.len > 0) qsort(p.pairs, p.len, sizeof(uint64_t), cmp_u64);
+    for (size_t i = 0; i < p.len; i++) {
+        if (npairs == 0 || p.pairs[i] != p.pairs[npairs - 1]) p.pairs[npairs++] = p.pairs[i];
+    }
+
+    int *ids = npairs > 0 ? malloc(npairs * 2 * sizeof(int)) : NULL;
+    dedupe_ctx_t ctx = {0};
+    int rc = npairs > 0 && !ids ? -1 : 0;
+    size_t nids = 0;
+    for (size_t i = 0; rc == 0 && i < npairs; i++) {
+        ids[nids++] = (int)(p.pairs[i] >> 32);
+        ids[nids++] = (int)(uint32_t)p.pairs[i];
+    }
+    if (nids > 0) qsort(ids, nids, sizeof(int), cmp_int);
+    size_t n = 0;
+    for (size_t i = 0; i < nids; i++) {
+        if (n == 0 || ids[i] != ids[n - 1]) ids[n++] = ids[i];
+    }
+    ctx.nodes = n > 0 ? calloc(n, sizeof(dedupe_node_t)) : NULL;
+    if (n > 0 && !ctx.nodes) rc = -1;
+    for (size_t i = 0; rc == 0 && i < n; i++) {
+        ctx.nodes[i].id = ids[i];
+        ctx.nodes[i].parent = (int)i;
+        if (shard_reader_signature(shards, ids[i], ctx.nodes[i].mins) < 0) rc = -1;
+    }
+    ctx.len = n;
+
+    size_t estimated = 0;
+    for (size_t i = 0; rc == 0 && i < npairs; i++) {
+        dedupe_node_t *a = find_node(&ctx, (int)(p.pairs[i] >> 32));
+        dedupe_node_t *b = find_node(&ctx, (int)(uint32_t)p.pairs[i]);
+        if (minhash_estimate(a->mins, b->mins) < cfg->threshold - SIMILAR_SLACK) continue;
+        a->wanted = b->wanted = 1;
+        p.pairs[estimated++] = p.pairs[i];
+    }
+    size_t nwanted = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (ctx.nodes[i].wanted) ids[nwanted++] = ctx.nodes[i].id;
+    }
+    minhash_init(&ctx.m, 1);
+    if (rc == 0 && nwanted > 0) rc = shard_reader_each(shards, ids, nwanted, load_set, &ctx);
+
+    for (size_t i = 0; rc == 0 && i < estimated; i++) {
+        dedupe_node_t *a = find_node(&ctx, (int)(p.pairs[i] >> 32));
+        dedupe_node_t *b = find_node(&ctx, (int)(uint32_t)p.pairs[i]);
+        if (!a->set || !b->set) continue;
+        if (minhash_set_jaccard(a->set, a->set_len, b->set, b->set_len) < cfg->threshold) continue;
+        int ra = root(ctx.nodes, (int)(a - ctx.nodes));
+        int rb = root(ctx.nodes, (int)(b - ctx.nodes));
+        // The smaller index stays the root, so a group prints from its oldest id.
+        if (ra != rb) ctx.nodes[ra > rb ? ra : rb].parent = ra < rb ? ra : rb;
+    }
+
+    // Chains every group's members behind its root, in id order.
+    int *next = n > 0 ? malloc(n * 2 * sizeof(int)) : NULL;
+    if (n > 0 && !next) rc = -1;
+    if (rc == 0) {
+        int *last = next + n;
+        for (size_t i = 0; i < n; i++) {
+            int r = root(ctx.nodes, (int)i);
+            next[i] = -1;
+            if (r != (int)i) next[last[r]] = (int)i;
+            last[r] = (int)i;
+        }
+        size_t groups = 0;
+        size_t members = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (ctx.nodes[i].parent != (int)i || next[i] < 0) continue;
+            fprintf(out, "-");
+            for (int k = (int)i; k >= 0; k = next[k]) {
+                fprintf(out, " #%d", ctx.nodes[k].id);
+                members++;
+            }
+            fputc('\n', out);
+            groups++;
+        }
+        fprintf(out, "%zu Gruppen mit %zu Sessions (Ähnlichkeit >= %.2f); %zu Kandidatenpaare, %zu exakt geprüft, "
+                     "%.1f ms\n",
+                groups, members, cfg->threshold, npairs, estimated, (double)(metrics_now_ns() - started) / 1e6);
+    }
+    free(next);
+    for (size_t i = 0; i < n; i++) free(ctx.nodes[i].set);
+    free(ctx.nodes);
+    minhash_free(&ctx.m);
+    free(ids);
+    free(p.pairs);
+    return rc;
+}
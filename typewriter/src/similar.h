@@ -0,0 +1,22 @@
+#ifndef SIMILAR_H
+#define SIMILAR_H
+
+#include "shard.h"
+#include <stdio.h>
+
+typedef struct {
+    double threshold; // minimum Jaccard similarity of the word 3-gram sets, 0..1
+    int limit;        // results for similar_run
+} similar_config_t;
+
+// Prints the sessions whose text is at least cfg->threshold similar to session id's, most
+// similar first. Candidates come from the LSH buckets every shard keeps (see minhash.h), so the
+// cost follows the number of near neighbours, not the size of the store; each candidate is then
+// checked exactly. Returns 0, 1 when id is unknown, or -1.
+int similar_run(shard_reader_t *shards, int id, const similar_config_t *cfg, FILE *out);
+
+// Prints every group of sessions that are pairwise connected by a similarity of at least
+// cfg->threshold, across all shards. Returns 0 or -1.
+int similar_dedupe(shard_reader_t *shards, const similar_config_t *cfg, FILE *out);
+
+#endif // SIMILAR_H
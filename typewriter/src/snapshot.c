@@ -0,0 +1,454 @@
+#include "snapshot.h"
+#include "http_client.h"
+#include "session_store.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef TYPEWRITER_ZSTD
+#include <zstd.h>
+#endif
+
+#define SNAPSHOT_MAGIC "TWS1"
+// magic, schema version, database bytes, max_id, row_count, length of max_created_at
+#define HEADER_FIXED 25
+#define CHUNK_HEAD 12
+#define READ_BYTES (1u << 20)
+#define DEFAULT_LEVEL 3
+
+static void crc_init(uint32_t table[256]) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+}
+
+// Continues crc over data; start with 0.
+static uint32_t crc_update(const uint32_t table[256], uint32_t crc, const void *data, size_t n) {
+    const unsigned char *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static double seconds_since(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+// Compresses a chunk into dst (at least n bytes). Returns the frame size, or 0 if the chunk
+// stays plain: without zstd, or when the frame would not be smaller.
+static size_t chunk_compress(void *cctx, void *dst, const void *src, size_t n, int level) {
+#ifdef TYPEWRITER_ZSTD
+    size_t r = ZSTD_compressCCtx(cctx, dst, n, src, n, level);
+    return ZSTD_isError(r) || r >= n ? 0 : r;
+#else
+    (void)cctx;
+    (void)dst;
+    (void)src;
+    (void)n;
+    (void)level;
+    return 0;
+#endif
+}
+
+// -2 if the build cannot read zstd frames at all.
+static int chunk_decompress(void *dctx, void *dst, size_t n, const void *src, size_t stored) {
+#ifdef TYPEWRITER_ZSTD
+    size_t r = ZSTD_decompressDCtx(dctx, dst, n, src, stored);
+    return !ZSTD_isError(r) && r == n ? 0 : -1;
+#else
+    (void)dctx;
+    (void)dst;
+    (void)n;
+    (void)src;
+    (void)stored;
+    fprintf(stderr, "Snapshot ist zstd-komprimiert, typewriter wurde ohne zstd gebaut (make ZSTD=1)\n");
+    return -2;
+#endif
+}
+
+// Streams the database file at path to out as a snapshot with the given cursor.
+static int write_snapshot(const char *path, const sync_checkpoint_t *cp, int level, FILE *out, long long *written) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fileno(in), &st) != 0) {
+        perror(path);
+        fclose(in);
+        return -1;
+    }
+    posix_fadvise(fileno(in), 0, 0, POSIX_FADV_SEQUENTIAL);
+    uint32_t table[256];
+    crc_init(table);
+    unsigned char *raw = malloc(SNAPSHOT_CHUNK_BYTES);
+    unsigned char *frame = malloc(SNAPSHOT_CHUNK_BYTES);
+    void *cctx = NULL;
+#ifdef TYPEWRITER_ZSTD
+    cctx = ZSTD_createCCtx();
+    if (!cctx) level = -1;
+#endif
+    int rc = raw && frame && level >= 0 ? 0 : -1;
+
+    unsigned char hdr[HEADER_FIXED + 255 + 4];
+    size_t created_len = strlen(cp->max_created_at);
+    if (created_len > 255) created_len = 255;
+    memcpy(hdr, SNAPSHOT_MAGIC, 4);
+    put_u32(hdr + 4, STORE_SCHEMA_VERSION);
+    put_u32(hdr + 8, (uint32_t)((uint64_t)st.st_size >> 32));
+    put_u32(hdr + 12, (uint32_t)st.st_size);
+    put_u32(hdr + 16, (uint32_t)cp->max_id);
+    put_u32(hdr + 20, (uint32_t)cp->row_count);
+    hdr[24] = (unsigned char)created_len;
+    memcpy(hdr + HEADER_FIXED, cp->max_created_at, created_len);
+    size_t hdr_len = HEADER_FIXED + created_len;
+    put_u32(hdr + hdr_len, crc_update(table, 0, hdr, hdr_len));
+    hdr_len += 4;
+    if (rc == 0 && fwrite(hdr, 1, hdr_len, out) != hdr_len) rc = -1;
+    *written = (long long)hdr_len;
+
+    uint32_t whole = 0;
+    size_t n;
+    while (rc == 0 && (n = fread(raw, 1, SNAPSHOT_CHUNK_BYTES, in)) > 0) {
+        uint32_t crc = crc_update(table, 0, raw, n);
+        whole = crc_update(table, whole, raw, n);
+        size_t stored = chunk_compress(cctx, frame, raw, n, level);
+        unsigned char head[CHUNK_HEAD];
+        put_u32(head, (uint32_t)n);
+        put_u32(head + 4, (uint32_t)(stored ? stored : n));
+        put_u32(head + 8, crc);
+        if (fwrite(head, 1, sizeof(head), out) != sizeof(head) ||
+            fwrite(stored ? frame : raw, 1, stored ? stored : n, out) != (stored ? stored : n)) {
+            rc = -1;
+        }
+        *written += (long long)(sizeof(head) + (stored ? stored : n));
+    }
+    if (ferror(in)) {
+        perror(path);
+        rc = -1;
+    }
+    unsigned char end[CHUNK_HEAD] = {0};
+    put_u32(end + 8, whole);
+    if (rc == 0 && fwrite(end, 1, sizeof(end), out) != sizeof(end)) rc = -1;
+    *written += (long long)sizeof(end);
+    if (rc == 0 && fflush(out) != 0) rc = -1;
+#ifdef TYPEWRITER_ZSTD
+    ZSTD_freeCCtx(cctx);
+#endif
+    free(raw);
+    free(frame);
+    fclose(in);
+    return rc;
+}
+
+int snapshot_create(const char *db_path, const snapshot_config_t *cfg, FILE *out) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.snapshot-XXXXXX", db_path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        perror(tmp);
+        return -1;
+    }
+    close(fd);
+
+    session_store_t store = {0};
+    int rc = session_store_open_reader(&store, db_path);
+    if (rc == 0) rc = session_store_copy_to(&store, tmp);
+    session_store_close(&store);
+    double copy_secs = seconds_since(&t0);
+
+    // The cursor and the counts come from the copy, so they match what the snapshot holds.
+    sync_checkpoint_t cp = {0};
+    store_stats_t stats = {0};
+    char sealed_before[16] = "";
+    session_store_t copy = {0};
+    if (rc == 0) rc = session_store_open_readonly(&copy, tmp);
+    if (rc == 0) {
+        session_store_load_checkpoint(&copy, &cp);
+        rc = session_store_stats(&copy, &stats);
+        session_store_meta_get(&copy, "sealed_before", sealed_before, sizeof(sealed_before));
+    }
+    session_store_close(&copy);
+
+    long long written = 0;
+    int level = cfg && cfg->level > 0 ? cfg->level : DEFAULT_LEVEL;
+    if (rc == 0) rc = write_snapshot(tmp, &cp, level, out, &written);
+    unlink(tmp);
+    if (rc != 0) {
+        fprintf(stderr, "Snapshot fehlgeschlagen\n");
+        return -1;
+    }
+    if (sealed_before[0]) {
+        fprintf(stderr, "Hinweis: Sessions vor %s liegen in versiegelten Shards und fehlen im Snapshot\n",
+                sealed_before);
+    }
+    if (!cp.max_id) {
+        fprintf(stderr, "Hinweis: Store ohne abgeschlossenen Sync, nach dem Restore folgt ein voller Sync\n");
+    }
+    double secs = seconds_since(&t0);
+    fprintf(stderr, "Snapshot: %d Sessions bis id %d, %.1f MB Datenbank -> %.1f MB in %.2fs (Kopie %.2fs)\n",
+            stats.count, cp.max_id, stats.db_size_bytes / (1024.0 * 1024.0), written / (1024.0 * 1024.0), secs,
+            copy_secs);
+    return 0;
+}
+
+enum { RESTORE_HEADER, RESTORE_CHUNKS, RESTORE_DONE, RESTORE_FAILED };
+
+typedef struct {
+    FILE *out;
+    int state;
+    unsigned char *buf; // the header, or one chunk with its head, as it comes in
+    size_t len;
+    unsigned char *raw;
+    void *dctx;
+    uint32_t table[256];
+    uint32_t whole;
+    unsigned long long db_bytes;
+    unsigned long long written;
+    long long received;
+} restore_t;
+
+static int restore_fail(restore_t *r, const char *why) {
+    fprintf(stderr, "Snapshot ungültig: %s\n", why);
+    r->state = RESTORE_FAILED;
+    return -1;
+}
+
+// Bytes the unit being read takes in all, as far as its start already tells.
+static size_t restore_need(const restore_t *r) {
+    if (r->state == RESTORE_HEADER) return r->len < HEADER_FIXED ? HEADER_FIXED : HEADER_FIXED + r->buf[24] + 4;
+    return r->len < CHUNK_HEAD ? CHUNK_HEAD : CHUNK_HEAD + get_u32(r->buf + 4);
+}
+
+static int restore_header(restore_t *r) {
+    const unsigned char *h = r->buf;
+    size_t n = HEADER_FIXED + h[24];
+    if (memcmp(h, SNAPSHOT_MAGIC, 4) != 0) return restore_fail(r, "kein typewriter-Snapshot");
+    if (crc_update(r->table, 0, h, n) != get_u32(h + n)) return restore_fail(r, "Prüfsumme des Headers");
+    int version = (int)get_u32(h + 4);
+    if (version > STORE_SCHEMA_VERSION) {
+        fprintf(stderr, "Snapshot hat Schema-Version %d, unterstützt wird bis %d\n", version, STORE_SCHEMA_VERSION);
+        r->state = RESTORE_FAILED;
+        return -1;
+    }
+    r->db_bytes = (unsigned long long)get_u32(h + 8) << 32 | get_u32(h + 12);
+    fprintf(stderr, "Snapshot: Stand id %u (%u Sessions, bis %.*s), %.1f MB Datenbank\n", get_u32(h + 16),
+            get_u32(h + 20), (int)h[24], (const char *)h + HEADER_FIXED, r->db_bytes / (1024.0 * 1024.0));
+    r->state = RESTORE_CHUNKS;
+    return 0;
+}
+
+static int restore_chunk(restore_t *r) {
+    uint32_t n = get_u32(r->buf);
+    uint32_t stored = get_u32(r->buf + 4);
+    uint32_t crc = get_u32(r->buf + 8);
+    if (n == 0 && stored == 0) {
+        if (r->written != r->db_bytes || crc != r->whole) return restore_fail(r, "unvollständig oder beschädigt");
+        r->state = RESTORE_DONE;
+        return 0;
+    }
+    const unsigned char *data = r->buf + CHUNK_HEAD;
+    if (stored < n) {
+        int rc = chunk_decompress(r->dctx, r->raw, n, data, stored);
+        if (rc == -2) r->state = RESTORE_FAILED;
+        if (rc != 0) return rc == -2 ? -1 : restore_fail(r, "Chunk nicht lesbar");
+        data = r->raw;
+    }
+    if (crc_update(r->table, 0, data, n) != crc) return restore_fail(r, "Prüfsumme eines Chunks");
+    if (r->written + n > r->db_bytes) return restore_fail(r, "mehr Daten als angegeben");
+    if (fwrite(data, 1, n, r->out) != n) {
+        perror("Restore");
+        r->state = RESTORE_FAILED;
+        return -1;
+    }
+    r->whole = crc_update(r->table, r->whole, data, n);
+    r->written += n;
+    return 0;
+}
+
+// Takes the snapshot in pieces of any size, as they are read or arrive; an http_write_fn.
+static int restore_feed(void *userdata, const char *data, size_t n) {
+    restore_t *r = userdata;
+    r->received += (long long)n;
+    while (n > 0 && r->state != RESTORE_FAILED) {
+        if (r->state == RESTORE_DONE) return restore_fail(r, "Daten nach dem Ende");
+        size_t need = restore_need(r);
+        size_t take = need - r->len < n ? need - r->len : n;
+        memcpy(r->buf + r->len, data, take);
+        r->len += take;
+        data += take;
+        n -= take;
+        // A chunk head is checked before its bytes are gathered: the buffer holds one chunk.
+        if (r->state == RESTORE_CHUNKS && r->len == CHUNK_HEAD) {
+            uint32_t size = get_u32(r->buf), stored = get_u32(r->buf + 4);
+            if (size > SNAPSHOT_CHUNK_BYTES || stored > size || (stored == 0) != (size == 0)) {
+                return restore_fail(r, "Chunk-Größe");
+            }
+        }
+        if (r->len < restore_need(r)) continue;
+        if (r->state == RESTORE_HEADER) restore_header(r);
+        else restore_chunk(r);
+        r->len = 0;
+    }
+    return r->state == RESTORE_FAILED;
+}
+
+static int restore_read(const char *source, restore_t *r) {
+    if (strncmp(source, "http://", 7) == 0 || strncmp(source, "https://", 8) == 0) {
+        // No API key: a snapshot may come from any static file server. No overall timeout
+        // either, a large one takes minutes.
+        http_client_t client;
+        if (http_client_init(&client, source, "") != 0) return -1;
+        client.timeout_ms = 0;
+        long status = 0;
+        int rc = http_get_stream(&client, "", NULL, restore_feed, r, &status);
+        http_client_cleanup(&client);
+        if (r->state == RESTORE_FAILED) return -1;
+        if (rc != 0 || status != 200) {
+            fprintf(stderr, "Snapshot-Download fehlgeschlagen (HTTP %ld): %s\n", status, source);
+            return -1;
+        }
+        return 0;
+    }
+    FILE *in = strcmp(source, "-") == 0 ? stdin : fopen(source, "rb");
+    if (!in) {
+        perror(source);
+        return -1;
+    }
+    posix_fadvise(fileno(in), 0, 0, POSIX_FADV_SEQUENTIAL);
+    char *block = malloc(READ_BYTES);
+    int rc = block ? 0 : -1;
+    size_t n;
+    while (rc == 0 && (n = fread(block, 1, READ_BYTES, in)) > 0) {
+        if (restore_feed(r, block, n) != 0) rc = -1;
+    }
+    if (rc == 0 && ferror(in)) {
+        perror(source);
+        rc = -1;
+    }
+    free(block);
+    if (in != stdin) fclose(in);
+    return rc;
+}
+
+// 1 when another connection has the store at db_path open (serve, watch, a sync): in WAL mode each
+// of them holds a shared lock on the file, so an exclusive one cannot be had. 0 when it is free or
+// does not exist, -1 on error. The lock is let go again, installing only takes a moment.
+static int store_in_use(const char *db_path) {
+    if (access(db_path, F_OK) != 0) return 0;
+    sqlite3 *db = NULL;
+    int rc = sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READWRITE, NULL);
+    if (rc == SQLITE_OK) rc = sqlite3_exec(db, "PRAGMA locking_mode=EXCLUSIVE; BEGIN EXCLUSIVE;", NULL, NULL, NULL);
+    int busy = rc == SQLITE_BUSY || rc == SQLITE_LOCKED;
+    if (rc != SQLITE_OK && !busy) fprintf(stderr, "%s: %s\n", db_path, db ? sqlite3_errmsg(db) : "kein Speicher");
+    if (rc == SQLITE_OK) sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+    sqlite3_close(db);
+    if (busy) {
+        fprintf(stderr, "%s ist geöffnet (serve, watch oder sync läuft?); erst beenden, dann ersetzen\n", db_path);
+    }
+    return busy ? 1 : rc == SQLITE_OK ? 0 : -1;
+}
+
+// mkstemp creates the file 0600; the store gets the mode a new file would have.
+static int restore_chmod(int fd) {
+    mode_t mask = umask(0);
+    umask(mask);
+    return fchmod(fd, 0666 & ~mask);
+}
+
+// Replaces db_path with the restored file, together with a WAL of the old store that would
+// otherwise be replayed into the new one.
+static int restore_install(const char *tmp, const char *db_path) {
+    if (store_in_use(db_path) != 0) return -1;
+    char side[4200];
+    const char *suffixes[] = {"-wal", "-shm"};
+    for (int i = 0; i < 2; i++) {
+        snprintf(side, sizeof(side), "%s%s", db_path, suffixes[i]);
+        unlink(side);
+    }
+    if (rename(tmp, db_path) != 0) {
+        perror(db_path);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_restore(const char *source, const char *db_path, int force) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!force && access(db_path, F_OK) == 0) {
+        fprintf(stderr, "%s existiert schon (--force ersetzt die Datenbank)\n", db_path);
+        return -1;
+    }
+    // Checked again before the store is replaced; this only spares a download that cannot be used.
+    if (store_in_use(db_path) != 0) return -1;
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.restore-XXXXXX", db_path);
+    int fd = mkstemp(tmp);
+    if (fd < 0 || restore_chmod(fd) != 0) {
+        perror(tmp);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return -1;
+    }
+    restore_t r = {.out = fdopen(fd, "wb"), .buf = malloc(CHUNK_HEAD + SNAPSHOT_CHUNK_BYTES),
+                   .raw = malloc(SNAPSHOT_CHUNK_BYTES)};
+    crc_init(r.table);
+#ifdef TYPEWRITER_ZSTD
+    r.dctx = ZSTD_createDCtx();
+#endif
+    int rc = r.out && r.buf && r.raw ? 0 : -1;
+    if (!r.out) close(fd);
+    if (rc == 0) rc = restore_read(source, &r);
+    if (rc == 0 && r.state != RESTORE_DONE) rc = restore_fail(&r, "endet vorzeitig");
+    if (r.out && (fflush(r.out) != 0 || fsync(fileno(r.out)) != 0)) rc = -1;
+    if (r.out && fclose(r.out) != 0) rc = -1;
+#ifdef TYPEWRITER_ZSTD
+    ZSTD_freeDCtx(r.dctx);
+#endif
+    free(r.buf);
+    free(r.raw);
+
+    // A snapshot of an older version is migrated before it takes the store's place.
+    if (rc == 0) {
+        session_store_t store = {0};
+        rc = session_store_open(&store, tmp);
+        if (rc == 0) rc = session_store_init_schema(&store);
+        session_store_close(&store);
+    }
+    if (rc == 0) rc = restore_install(tmp, db_path);
+    if (rc != 0) {
+        unlink(tmp);
+        fprintf(stderr, "Restore fehlgeschlagen\n");
+        return -1;
+    }
+    double secs = seconds_since(&t0);
+    fprintf(stderr, "Restore: %.1f MB gelesen, %.1f MB Datenbank in %.2fs (%.1f MB/s)\n",
+            r.received / (1024.0 * 1024.0), r.written / (1024.0 * 1024.0), secs,
+            secs > 0 ? r.written / (1024.0 * 1024.0) / secs : 0.0);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+
+// A snapshot is a whole store in one stream: a machine that restores it has every session, the
+// built FTS index and the sync cursor, and only needs an incremental sync for what is newer.
+// Format (integers big-endian, CRC-32 as in zlib):
+//   header  "TWS1" | u32 schema version | u64 database bytes | u32 max_id | u32 row_count
+//           | u8 length + max_created_at | u32 CRC of the header so far
+//   chunks  u32 length | u32 stored length | u32 CRC of the chunk's bytes | stored bytes
+//           (a zstd frame, or the bytes themselves when the stored length equals the length)
+//   end     u32 0 | u32 0 | u32 CRC of the whole database
+// The chunks together are the SQLite database file. Sealed shards are not included.
+#define SNAPSHOT_CHUNK_BYTES (4u << 20)
+
+typedef struct {
+    int level; // zstd level for the chunks, 0 for the default; without zstd they stay plain
+} snapshot_config_t;
+
+// Copies the store at db_path (over a read-only connection, so a sync may keep running) into a
+// compact file next to it and streams that to out as a snapshot. Returns 0 or -1.
+int snapshot_create(const char *db_path, const snapshot_config_t *cfg, FILE *out);
+
+// Loads the snapshot at source (a file, "-" for stdin, or an http(s) URL) into a new store at
+// db_path, reading it front to back once. The store only appears at db_path once every chunk
+// has checked out; an existing one is replaced only with force. Returns 0 or -1.
+int snapshot_restore(const char *source, const char *db_path, int force);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,123 @@
+#include "sse.h"
+#include <stdlib.h>
+#include <string.h>
+
+void sse_stream_init(sse_stream_t *s, sse_event_cb cb, void *userdata) {
+    memset(s, 0, sizeof(*s));
+    s->cb = cb;
+    s->userdata = userdata;
+}
+
+// Forget the pending line and event (e.g. after a reconnect) but keep the buffers.
+void sse_stream_reset(sse_stream_t *s) {
+    s->error = 0;
+    s->skip_lf = 0;
+    s->event[0] = '\0';
+    s->line_len = 0;
+    s->data_len = 0;
+}
+
+void sse_stream_free(sse_stream_t *s) {
+    free(s->line);
+    free(s->data);
+    s->line = NULL;
+    s->data = NULL;
+    s->line_cap = s->data_cap = 0;
+    s->line_len = s->data_len = 0;
+}
+
+static int grow(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return 0;
+    if (need > SSE_MAX_LINE) return -1;
+    size_t n = *cap ? *cap : 256;
+    while (n < need) n *= 2;
+    char *p = realloc(*buf, n);
+    if (!p) return -1;
+    *buf = p;
+    *cap = n;
+    return 0;
+}
+
+static int dispatch(sse_stream_t *s) {
+    // An event without data lines is dropped, as in the browser's EventSource.
+    if (s->data_len == 0) {
+        s->event[0] = '\0';
+        return 0;
+    }
+    s->data_len--; // the newline after the last data line
+    s->data[s->data_len] = '\0';
+    int rc = s->cb(s->userdata, s->event[0] ? s->event : "message", s->data, s->data_len);
+    s->event[0] = '\0';
+    s->data_len = 0;
+    return rc;
+}
+
+static int field(sse_stream_t *s, const char *line, size_t len) {
+    if (len == 0) return dispatch(s);
+    if (line[0] == ':') return 0; // comment, used as keep-alive
+    const char *colon = memchr(line, ':', len);
+    size_t name_len = colon ? (size_t)(colon - line) : len;
+    const char *value = colon ? colon + 1 : line + len;
+    size_t value_len = (size_t)(line + len - value);
+    if (value_len > 0 && value[0] == ' ') {
+        value++;
+        value_len--;
+    }
+    if (name_len == 4 && memcmp(line, "data", 4) == 0) {
+        if (grow(&s->data, &s->data_cap, s->data_len + value_len + 2) != 0) return -1;
+        memcpy(s->data + s->data_len, value, value_len);
+        s->data_len += value_len;
+        s->data[s->data_len++] = '\n';
+    } else if (name_len == 5 && memcmp(line, "event", 5) == 0) {
+        size_t n = value_len < sizeof(s->event) - 1 ? value_len : sizeof(s->event) - 1;
+        memcpy(s->event, value, n);
+        s->event[n] = '\0';
+    } else if (name_len == 5 && memcmp(line, "retry", 5) == 0) {
+        long ms = 0;
+        size_t i = 0;
+        while (i < value_len && value[i] >= '0' && value[i] <= '9' && ms < 3600000) ms = ms * 10 + (value[i++] - '0');
+        if (i == value_len && i > 0) s->retry_ms = ms;
+    }
+    // `id` is not used: callers catch up on their own after a reconnect.
+    return 0;
+}
+
+// Lines end in LF, CR or CRLF; a CRLF may be split across chunks.
+int sse_stream_feed(sse_stream_t *s, const char *data, size_t len) {
+    if (s->error) return -1;
+    size_t i = 0;
+    if (s->skip_lf && len > 0) {
+        if (data[0] == '\n') i = 1;
+        s->skip_lf = 0;
+    }
+    while (i < len) {
+        size_t start = i;
+        while (i < len && data[i] != '\n' && data[i] != '\r') i++;
+        const char *line = data + start;
+        size_t line_len = i - start;
+        if (i == len) {
+            // Incomplete line: keep it for the next chunk.
+            if (grow(&s->line, &s->line_cap, s->line_len + line_len + 1) != 0) goto fail;
+            memcpy(s->line + s->line_len, line, line_len);
+            s->line_len += line_len;
+            break;
+        }
+        if (data[i] == '\r') {
+            if (i + 1 < len && data[i + 1] == '\n') i++;
+            else if (i + 1 == len) s->skip_lf = 1;
+        }
+        i++;
+        if (s->line_len > 0) {
+            if (grow(&s->line, &s->line_cap, s->line_len + line_len + 1) != 0) goto fail;
+            memcpy(s->line + s->line_len, line, line_len);
+            line = s->line;
+            line_len += s->line_len;
+            s->line_len = 0;
+        }
+        if (field(s, line, line_len) != 0) goto fail;
+    }
+    return 0;
+fail:
+    s->error = 1;
+    return -1;
+}
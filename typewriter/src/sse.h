@@ -0,0 +1,36 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include <stddef.h>
+
+// Limit for one line and for the data of one event; longer input is a parse error.
+#define SSE_MAX_LINE (16 * 1024 * 1024)
+
+// event is the event's type ("message" if it had none); data is the joined data lines,
+// NUL-terminated and without the final newline. Both are only valid during the call.
+// Returning non-zero aborts parsing.
+typedef int (*sse_event_cb)(void *userdata, const char *event, const char *data, size_t len);
+
+// Incremental parser for text/event-stream: input can be fed in arbitrary chunks, and only
+// the current line and the event being assembled are buffered.
+typedef struct {
+    sse_event_cb cb;
+    void *userdata;
+    int error;
+    int skip_lf;   // the previous chunk ended in CR, so a leading LF ends nothing
+    long retry_ms; // last `retry:` field, 0 if the server sent none
+    char event[64];
+    char *line;
+    size_t line_len;
+    size_t line_cap;
+    char *data;
+    size_t data_len;
+    size_t data_cap;
+} sse_stream_t;
+
+void sse_stream_init(sse_stream_t *s, sse_event_cb cb, void *userdata);
+void sse_stream_reset(sse_stream_t *s);
+int sse_stream_feed(sse_stream_t *s, const char *data, size_t len);
+void sse_stream_free(sse_stream_t *s);
+
+#endif // SSE_H
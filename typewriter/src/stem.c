@@ -0,0 +1,204 @@
+#include "stem.h"
+#include <string.h>
+
+// While stemming, a word is one byte per letter: lowercase ASCII plus these stand-ins for the
+// umlauts the prelude makes of "ae", "oe" and "ue", and for u and y between vowels, which the
+// algorithm treats as consonants.
+#define AE 'A'
+#define OE 'O'
+#define UE 'V'
+#define U_CONS 'U'
+#define Y_CONS 'Y'
+
+static int is_vowel(char c) {
+    switch (c) {
+    case 'a': case 'e': case 'i': case 'o': case 'u': case 'y': case AE: case OE: case UE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_s_ending(char c) {
+    return c && strchr("bdfghklmnrt", c) != NULL;
+}
+
+static int is_st_ending(char c) {
+    return c && strchr("bdfghklmnt", c) != NULL;
+}
+
+static int is_et_ending(char c) {
+    return c && strchr("dfgklmnrstz" "U" "A", c) != NULL;
+}
+
+// Whether w[0..n) ends with s.
+static int ends(const char *w, size_t n, const char *s) {
+    size_t k = strlen(s);
+    return n >= k && memcmp(w + n - k, s, k) == 0;
+}
+
+// The longest of the suffixes (NULL-terminated) that w[0..n) ends with; its index, or -1.
+static int longest(const char *w, size_t n, const char *const *suffixes) {
+    int best = -1;
+    size_t best_len = 0;
+    for (int i = 0; suffixes[i]; i++) {
+        size_t k = strlen(suffixes[i]);
+        if (k > best_len && ends(w, n, suffixes[i])) {
+            best = i;
+            best_len = k;
+        }
+    }
+    return best;
+}
+
+// Marks u and y between vowels, then turns "ae", "oe", "ue" into umlauts (but leaves "qu").
+static size_t prelude(char *w, size_t n) {
+    for (size_t i = 0; i + 2 < n; i++) {
+        if (!is_vowel(w[i]) || !is_vowel(w[i + 2])) continue;
+        if (w[i + 1] == 'u') w[i + 1] = U_CONS;
+        else if (w[i + 1] == 'y') w[i + 1] = Y_CONS;
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < n;) {
+        if (i + 1 < n && w[i] == 'q' && w[i + 1] == 'u') {
+            w[out++] = w[i++];
+            w[out++] = w[i++];
+        } else if (i + 1 < n && w[i + 1] == 'e' && (w[i] == 'a' || w[i] == 'o' || w[i] == 'u')) {
+            w[out++] = w[i] == 'a' ? AE : w[i] == 'o' ? OE : UE;
+            i += 2;
+        } else {
+            w[out++] = w[i++];
+        }
+    }
+    return out;
+}
+
+// Start of the region after the first non-vowel that follows a vowel, searching from `from`;
+// n if there is none.
+static size_t region_after(const char *w, size_t n, size_t from) {
+    size_t i = from;
+    while (i < n && !is_vowel(w[i])) i++;
+    if (i == n) return n;
+    i++;
+    while (i < n && is_vowel(w[i])) i++;
+    return i < n ? i + 1 : n;
+}
+
+static void step1(char *w, size_t *n, size_t p1) {
+    static const char *const suffixes[] = {"e", "em", "en", "erinnen", "erin", "ln", "ern", "er", "s", "es", "lns",
+                                           NULL};
+    int k = longest(w, *n, suffixes);
+    if (k < 0) return;
+    size_t start = *n - strlen(suffixes[k]);
+    if (start < p1) return;
+    const char *s = suffixes[k];
+    if (strcmp(s, "em") == 0) {
+        if (!ends(w, start, "syst")) *n = start;
+    } else if (strcmp(s, "e") == 0 || strcmp(s, "en") == 0 || strcmp(s, "es") == 0) {
+        *n = start;
+        if (ends(w, *n, "niss")) (*n)--;
+    } else if (strcmp(s, "s") == 0) {
+        if (start > 0 && is_s_ending(w[start - 1])) *n = start;
+    } else if (strcmp(s, "ln") == 0 || strcmp(s, "lns") == 0) {
+        *n = start + 1; // keeps the l
+    } else {
+        *n = start;
+    }
+}
+
+static void step2(char *w, size_t *n, size_t p1) {
+    static const char *const suffixes[] = {"en", "er", "et", "st", "est", NULL};
+    static const char *const et_exceptions[] = {"tick", "plan", "geordn", "intern", "tr", NULL};
+    int k = longest(w, *n, suffixes);
+    if (k < 0) return;
+    size_t start = *n - strlen(suffixes[k]);
+    if (start < p1) return;
+    const char *s = suffixes[k];
+    if (strcmp(s, "st") == 0) {
+        // A valid ending before it, and at least three letters before that.
+        if (start >= 4 && is_st_ending(w[start - 1])) *n = start;
+    } else if (strcmp(s, "et") == 0) {
+        if (start > 0 && is_et_ending(w[start - 1]) && longest(w, start, et_exceptions) < 0) *n = start;
+    } else {
+        *n = start;
+    }
+}
+
+static void step3(char *w, size_t *n, size_t p1, size_t p2) {
+    static const char *const suffixes[] = {"end", "ig", "ung", "lich", "isch", "ik", "heit", "keit", NULL};
+    int k = longest(w, *n, suffixes);
+    if (k < 0) return;
+    size_t start = *n - strlen(suffixes[k]);
+    if (start < p2) return;
+    const char *s = suffixes[k];
+    int preceded_by_e = start > 0 && w[start - 1] == 'e';
+    if (strcmp(s, "end") == 0 || strcmp(s, "ung") == 0) {
+        *n = start;
+        if (ends(w, *n, "ig") && *n - 2 >= p2 && !(*n > 2 && w[*n - 3] == 'e')) *n -= 2;
+    } else if (strcmp(s, "ig") == 0 || strcmp(s, "isch") == 0 || strcmp(s, "ik") == 0) {
+        if (!preceded_by_e) *n = start;
+    } else if (strcmp(s, "lich") == 0 || strcmp(s, "heit") == 0) {
+        *n = start;
+        if ((ends(w, *n, "er") || ends(w, *n, "en")) && *n - 2 >= p1) *n -= 2;
+    } else { // keit
+        *n = start;
+        static const char *const more[] = {"ig", "lich", NULL};
+        int m = longest(w, *n, more);
+        if (m >= 0 && *n - strlen(more[m]) >= p2) *n -= strlen(more[m]);
+    }
+}
+
+size_t stem_german(const char *word, size_t len, char *out) {
+    if (len == 0 || len > STEM_MAX_WORD) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (word[i] < 'a' || word[i] > 'z') return 0;
+    }
+    char w[STEM_MAX_WORD];
+    memcpy(w, word, len);
+    size_t n = prelude(w, len);
+
+    // R1 starts after the first non-vowel following a vowel, but not before the fourth letter;
+    // R2 is the same again within R1. Words under three letters have neither.
+    size_t p1 = n, p2 = n;
+    if (n >= 3) {
+        size_t r1 = region_after(w, n, 0);
+        p1 = r1 < 3 ? 3 : r1;
+        p2 = r1 < n ? region_after(w, n, r1) : n;
+    }
+    step1(w, &n, p1);
+    step2(w, &n, p1);
+    step3(w, &n, p1, p2);
+    // The Snowball algorithm's last step removes "'s"-style endings; tokens never contain '.
+
+    for (size_t i = 0; i < n; i++) {
+        switch (w[i]) {
+        case AE: out[i] = 'a'; break;
+        case OE: out[i] = 'o'; break;
+        case UE: case U_CONS: out[i] = 'u'; break;
+        case Y_CONS: out[i] = 'y'; break;
+        default: out[i] = w[i];
+        }
+    }
+    return n;
+}
+
+size_t stem_cached(stem_cache_t *cache, const char *word, size_t len, char *out) {
+    if (len == 0 || len > STEM_CACHE_WORD) return stem_german(word, len, out);
+    unsigned int h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)word[i]) * 16777619u;
+    stem_slot_t *slot = &cache->slots[h % STEM_CACHE_SLOTS];
+    if (slot->len == len && memcmp(slot->word, word, len) == 0) {
+        cache->hits++;
+        memcpy(out, slot->stem, slot->stem_len);
+        return slot->stem_len;
+    }
+    cache->misses++;
+    size_t n = stem_german(word, len, out);
+    if (n == 0) return 0;
+    // A stem is never longer than its word, so it fits the slot too.
+    slot->len = (unsigned char)len;
+    slot->stem_len = (unsigned char)n;
+    memcpy(slot->word, word, len);
+    memcpy(slot->stem, out, n);
+    return n;
+}
@@ -0,0 +1,38 @@
+#ifndef STEM_H
+#define STEM_H
+
+#include <stddef.h>
+
+// Longest word stem_german accepts; longer words are left as they are.
+#define STEM_MAX_WORD 64
+
+// The Snowball German stemmer (snowballstem.org, version 3: "ae", "oe" and "ue" count as umlauts,
+// "-erin(nen)" and "-ln(s)" are endings) for a word of lowercase ASCII letters, with umlauts
+// already folded to their base vowel and ß to "ss". Writes the stem to out (at most len bytes,
+// not terminated) and returns its length, or 0 if word is not such a word.
+size_t stem_german(const char *word, size_t len, char *out);
+
+// Direct-mapped cache of recent word -> stem results: a word hashes to one slot and replaces
+// whatever was there. Running text repeats its words a lot, so most lookups are hits.
+#define STEM_CACHE_SLOTS 4096
+// Longer words are stemmed without the cache.
+#define STEM_CACHE_WORD 30
+
+typedef struct {
+    unsigned char len; // 0 for an empty slot
+    unsigned char stem_len;
+    char word[STEM_CACHE_WORD];
+    char stem[STEM_CACHE_WORD];
+} stem_slot_t;
+
+typedef struct {
+    stem_slot_t slots[STEM_CACHE_SLOTS];
+    unsigned long long hits;
+    unsigned long long misses;
+} stem_cache_t;
+
+// stem_german through the cache, which must start zeroed. Not thread-safe: one cache per thread
+// or per connection.
+size_t stem_cached(stem_cache_t *cache, const char *word, size_t len, char *out);
+
+#endif // STEM_H
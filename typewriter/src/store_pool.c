@@ -0,0 +1,223 @@
+#include "store_pool.h"
+#include "queue.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes committed in one transaction at most.
+#define POOL_MAX_GROUP 64
+// A reader can briefly see SQLITE_BUSY while the writer checkpoints the WAL.
+#define POOL_BUSY_TIMEOUT_MS 5000
+
+typedef struct pool_reader {
+    store_pool_t *pool;
+    session_store_t store;
+    struct pool_reader *next_all;
+    struct pool_reader *next_idle;
+} pool_reader_t;
+
+typedef struct {
+    store_write_fn fn;
+    void *userdata;
+    int rc;
+    int done;
+} write_job_t;
+
+struct store_pool {
+    char *path;
+    int max_idle;
+    pthread_key_t key; // the thread's pool_reader_t
+    pthread_mutex_t mu;
+    pthread_cond_t done_cv; // a group of writes was committed
+    pool_reader_t *all;     // every open reader, assigned or idle
+    pool_reader_t *idle;
+    int nidle;
+    session_store_t writer_store;
+    queue_t writes;
+    pthread_t writer;
+};
+
+static void reader_free(pool_reader_t *r) {
+    session_store_close(&r->store);
+    free(r);
+}
+
+// Thread exit: the connection goes back to the pool, or is closed if enough are idle.
+static void reader_release(void *arg) {
+    pool_reader_t *r = arg;
+    store_pool_t *pool = r->pool;
+    pthread_mutex_lock(&pool->mu);
+    if (pool->nidle < pool->max_idle) {
+        r->next_idle = pool->idle;
+        pool->idle = r;
+        pool->nidle++;
+        r = NULL;
+    } else {
+        pool_reader_t **p = &pool->all;
+        while (*p != r) p = &(*p)->next_all;
+        *p = r->next_all;
+    }
+    pthread_mutex_unlock(&pool->mu);
+    if (r) reader_free(r);
+}
+
+static void run_group(store_pool_t *pool, write_job_t **jobs, size_t n) {
+    sqlite3 *db = pool->writer_store.db;
+    int begun = sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+    for (size_t i = 0; i < n; i++) {
+        if (!begun || sqlite3_exec(db, "SAVEPOINT pool_write;", NULL, NULL, NULL) != SQLITE_OK) {
+            jobs[i]->rc = -1;
+            continue;
+        }
+        jobs[i]->rc = jobs[i]->fn(&pool->writer_store, jobs[i]->userdata);
+        if (jobs[i]->rc != 0) sqlite3_exec(db, "ROLLBACK TO pool_write;", NULL, NULL, NULL);
+        sqlite3_exec(db, "RELEASE pool_write;", NULL, NULL, NULL);
+    }
+    if (begun && sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "DB Fehler beim Commit: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        for (size_t i = 0; i < n; i++) jobs[i]->rc = -1;
+    }
+    pthread_mutex_lock(&pool->mu);
+    for (size_t i = 0; i < n; i++) jobs[i]->done = 1;
+    pthread_cond_broadcast(&pool->done_cv);
+    pthread_mutex_unlock(&pool->mu);
+}
+
+// The single writer: takes one queued write, plus whatever else is queued by then.
+static void *writer_main(void *arg) {
+    store_pool_t *pool = arg;
+    write_job_t *jobs[POOL_MAX_GROUP];
+    write_job_t *job;
+    while ((job = queue_pop(&pool->writes))) {
+        size_t n = 0;
+        jobs[n++] = job;
+        while (n < POOL_MAX_GROUP && (job = queue_try_pop(&pool->writes))) jobs[n++] = job;
+        run_group(pool, jobs, n);
+    }
+    return NULL;
+}
+
+store_pool_t *store_pool_open(const char *path, const store_pool_opts_t *opts) {
+    if (!sqlite3_threadsafe()) {
+        fprintf(stderr, "SQLite ist ohne Thread-Unterstützung gebaut\n");
+        return NULL;
+    }
+    store_pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->max_idle = opts && opts->max_idle > 0 ? opts->max_idle : 8;
+    int queue_cap = opts && opts->write_queue > 0 ? opts->write_queue : 64;
+    pool->path = strdup(path);
+    if (!pool->path || session_store_open(&pool->writer_store, path) != 0) goto fail_store;
+    if (session_store_init_schema(&pool->writer_store) != 0) goto fail_store;
+    sqlite3_busy_timeout(pool->writer_store.db, POOL_BUSY_TIMEOUT_MS);
+    if (queue_init(&pool->writes, (size_t)queue_cap) != 0) goto fail_store;
+    if (pthread_key_create(&pool->key, reader_release) != 0) goto fail_queue;
+    pthread_mutex_init(&pool->mu, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+    if (pthread_create(&pool->writer, NULL, writer_main, pool) != 0) {
+        pthread_cond_destroy(&pool->done_cv);
+        pthread_mutex_destroy(&pool->mu);
+        pthread_key_delete(pool->key);
+        goto fail_queue;
+    }
+    return pool;
+
+fail_queue:
+    queue_destroy(&pool->writes);
+fail_store:
+    session_store_close(&pool->writer_store);
+    free(pool->path);
+    free(pool);
+    return NULL;
+}
+
+void store_pool_close(store_pool_t *pool) {
+    if (!pool) return;
+    queue_close(&pool->writes);
+    pthread_join(pool->writer, NULL);
+    queue_destroy(&pool->writes);
+    // No destructor runs for the key after this, so live threads no longer hand back readers.
+    pthread_key_delete(pool->key);
+    while (pool->all) {
+        pool_reader_t *r = pool->all;
+        pool->all = r->next_all;
+        reader_free(r);
+    }
+    session_store_close(&pool->writer_store);
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_mutex_destroy(&pool->mu);
+    free(pool->path);
+    free(pool);
+}
+
+session_store_t *store_pool_reader(store_pool_t *pool) {
+    pool_reader_t *r = pthread_getspecific(pool->key);
+    if (r) return &r->store;
+    pthread_mutex_lock(&pool->mu);
+    r = pool->idle;
+    if (r) {
+        pool->idle = r->next_idle;
+        pool->nidle--;
+    }
+    pthread_mutex_unlock(&pool->mu);
+    if (!r) {
+        r = calloc(1, sizeof(*r));
+        if (!r) return NULL;
+        r->pool = pool;
+        if (session_store_open_readonly(&r->store, pool->path) != 0) {
+            free(r);
+            return NULL;
+        }
+        sqlite3_busy_timeout(r->store.db, POOL_BUSY_TIMEOUT_MS);
+        pthread_mutex_lock(&pool->mu);
+        r->next_all = pool->all;
+        pool->all = r;
+        pthread_mutex_unlock(&pool->mu);
+    }
+    if (pthread_setspecific(pool->key, r) != 0) {
+        reader_release(r);
+        return NULL;
+    }
+    return &r->store;
+}
+
+int store_pool_get(store_pool_t *pool, int id, session_t *out) {
+    session_store_t *store = store_pool_reader(pool);
+    return store ? session_store_get(store, id, out) : -1;
+}
+
+int store_pool_search(store_pool_t *pool, const char *query, int limit, search_hit_t **out, size_t *len) {
+    session_store_t *store = store_pool_reader(pool);
+    return store ? session_store_search_hits(store, query, limit, 1, out, len) : -1;
+}
+
+int store_pool_stats(store_pool_t *pool, store_stats_t *out) {
+    session_store_t *store = store_pool_reader(pool);
+    return store ? session_store_stats(store, out) : -1;
+}
+
+int store_pool_exec(store_pool_t *pool, store_write_fn fn, void *userdata) {
+    write_job_t job = {.fn = fn, .userdata = userdata};
+    if (queue_push(&pool->writes, &job) != 0) return -1;
+    pthread_mutex_lock(&pool->mu);
+    while (!job.done) pthread_cond_wait(&pool->done_cv, &pool->mu);
+    pthread_mutex_unlock(&pool->mu);
+    return job.rc;
+}
+
+typedef struct {
+    const session_t *rows;
+    size_t len;
+} write_rows_t;
+
+static int write_rows(session_store_t *store, void *userdata) {
+    write_rows_t *w = userdata;
+    return session_store_bulk_insert(store, w->rows, w->len, NULL);
+}
+
+int store_pool_write(store_pool_t *pool, const session_t *rows, size_t len) {
+    write_rows_t w = {rows, len};
+    return store_pool_exec(pool, write_rows, &w);
+}
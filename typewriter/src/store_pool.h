@@ -0,0 +1,50 @@
+#ifndef STORE_POOL_H
+#define STORE_POOL_H
+
+#include "session_store.h"
+#include <stddef.h>
+
+// A store handle for programs that use one database from many threads. A session_store_t is
+// one connection and must only be used by one thread at a time; the pool hands every reading
+// thread its own read-only connection (opened on the thread's first read, returned to the
+// pool when the thread exits) and runs every write on a single writer thread that owns the
+// only read-write connection. Writes queued at the same time are committed together, each in
+// its own savepoint, so one failing write does not undo the others.
+//
+// Every function below may be called from any thread, except that store_pool_close must only
+// run once no other thread uses the pool any more.
+typedef struct store_pool store_pool_t;
+
+typedef struct {
+    int max_idle;    // read connections kept open for new threads after their thread exited, default 8
+    int write_queue; // writes that may wait for the writer before store_pool_write blocks, default 64
+} store_pool_opts_t;
+
+// Runs on the writer thread inside the pool's transaction, so it must not BEGIN or COMMIT itself
+// (session_store_bulk_insert and upsert qualify). Return non-zero to roll back this write only.
+typedef int (*store_write_fn)(session_store_t *store, void *userdata);
+
+// Opens path read-write for the writer thread, migrating it if needed (see
+// session_store_init_schema). opts may be NULL. Returns NULL on error.
+store_pool_t *store_pool_open(const char *path, const store_pool_opts_t *opts);
+// Finishes the queued writes, then closes every connection, including those still assigned
+// to live threads.
+void store_pool_close(store_pool_t *pool);
+
+// The calling thread's read connection, or NULL on error. It stays valid until the thread exits
+// or the pool is closed and must not be passed to other threads. Any read-only session_store_*
+// function may be called on it.
+session_store_t *store_pool_reader(store_pool_t *pool);
+// Shortcuts over store_pool_reader. store_pool_get returns like session_store_get: 0, 1 when there
+// is no session id, -1 on error.
+int store_pool_get(store_pool_t *pool, int id, session_t *out);
+int store_pool_search(store_pool_t *pool, const char *query, int limit, search_hit_t **out, size_t *len);
+int store_pool_stats(store_pool_t *pool, store_stats_t *out);
+
+// Runs fn on the writer and waits until its transaction is committed. Returns fn's result, or -1
+// if the commit failed.
+int store_pool_exec(store_pool_t *pool, store_write_fn fn, void *userdata);
+// Upserts rows (see session_store_bulk_insert) and waits for the commit. Returns 0 or -1.
+int store_pool_write(store_pool_t *pool, const session_t *rows, size_t len);
+
+#endif // STORE_POOL_H
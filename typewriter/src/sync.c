@@ -1,50 +1,623 @@
 #include "sync.h"
+#include "history.h"
+#include "queue.h"
+#include "tuner.h"
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-static int known_session(session_store_t *store, int id) {
-    session_t tmp = {0};
-    int rc = session_store_get(store, id, &tmp);
-    session_free(&tmp);
-    return rc == 0;
+#define MAX_CONCURRENCY 32
+// The server returns at most this many sessions per page.
+#define MAX_PAGE_LIMIT 1000
+
+// Sessions travel from the streaming parser to the writer in batches of at most
+// STORE_BULK_ROWS; `last` marks the final batch of a page.
+typedef struct {
+    int offset;
+    int limit;
+    int last;
+    session_batch_t rows;
+} sync_batch_t;
+
+typedef struct {
+    session_store_t *store;
+    int total;
+    int track_pages; // full syncs record each stored page so an interrupted run can resume
+    queue_t write_q;
+    int stop_at_id;
+    pthread_mutex_t mu;
+    int failed;
+    int reached;
+    int failed_pages;
+    int pages;
+    long long rows;
+    long long unchanged;
+    // Documents with a new version, whose history is fetched once the sessions are stored.
+    // Only the thread running the transfers touches these.
+    doc_ref_t *docs;
+    size_t ndocs;
+    size_t docs_cap;
+    metrics_t metrics;
+} sync_ctx_t;
+
+// One in-flight page: its parser and the batch currently being filled.
+typedef struct {
+    sync_ctx_t *ctx;
+    int offset;
+    int limit;
+    int rows; // sessions parsed by the current attempt
+    int attempt;
+    double due; // when a failed page may be requested again
+    api_sessions_parser_t *parser;
+    sync_batch_t *batch;
+    int first_id;
+    int last_id;
+    int min_id;
+} sync_fetch_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static sync_batch_t *batch_new(int offset, int limit) {
+    sync_batch_t *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->offset = offset;
+    b->limit = limit;
+    session_batch_init(&b->rows);
+    return b;
+}
+
+static void batch_free(sync_batch_t *b) {
+    if (!b) return;
+    session_batch_free(&b->rows);
+    free(b);
+}
+
+static void set_failed(sync_ctx_t *ctx) {
+    pthread_mutex_lock(&ctx->mu);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->mu);
+}
+
+static int has_failed(sync_ctx_t *ctx) {
+    pthread_mutex_lock(&ctx->mu);
+    int failed = ctx->failed;
+    pthread_mutex_unlock(&ctx->mu);
+    return failed;
+}
+
+// A page that used up its retries: the others carry on, but the sync stays incomplete.
+static void page_failed(sync_ctx_t *ctx) {
+    metrics_add(&ctx->metrics, METRIC_PAGES_FAILED, 1);
+    pthread_mutex_lock(&ctx->mu);
+    ctx->failed_pages++;
+    pthread_mutex_unlock(&ctx->mu);
+}
+
+static int has_reached(sync_ctx_t *ctx) {
+    pthread_mutex_lock(&ctx->mu);
+    int reached = ctx->reached;
+    pthread_mutex_unlock(&ctx->mu);
+    return reached;
+}
+
+// Incremental mode with newest-first paging: once a session at or below the stored
+// high-water mark shows up, everything after it is already synced.
+static void check_reached(sync_ctx_t *ctx, int id) {
+    if (ctx->stop_at_id <= 0 || id > ctx->stop_at_id) return;
+    pthread_mutex_lock(&ctx->mu);
+    ctx->reached = 1;
+    pthread_mutex_unlock(&ctx->mu);
+}
+
+static int write_batch(sync_ctx_t *ctx, const sync_batch_t *b, long long *unchanged) {
+    session_store_t *store = ctx->store;
+    if (sqlite3_exec(store->db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    size_t same = 0;
+    if (session_store_bulk_insert(store, b->rows.items, b->rows.len, &same) != 0 ||
+        (b->last && ctx->track_pages && session_store_mark_page(store, b->offset, b->limit, ctx->total) != 0)) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    long long started = metrics_now_ns();
+    if (sqlite3_exec(store->db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    metrics_time_since(store->metrics, METRIC_T_COMMIT, started);
+    *unchanged += (long long)same;
+    return 0;
+}
+
+// Single SQLite writer: every batch is committed in its own transaction.
+static void *writer_main(void *arg) {
+    sync_ctx_t *ctx = arg;
+    sync_batch_t *b;
+    while ((b = queue_pop(&ctx->write_q))) {
+        long long unchanged = 0;
+        if (write_batch(ctx, b, &unchanged) != 0) {
+            fprintf(stderr, "DB Fehler bei offset %d: %s\n", b->offset, sqlite3_errmsg(ctx->store->db));
+            set_failed(ctx);
+        } else {
+            metrics_add(&ctx->metrics, METRIC_BATCHES, 1);
+            if (b->last) metrics_add(&ctx->metrics, METRIC_PAGES, 1);
+            pthread_mutex_lock(&ctx->mu);
+            ctx->rows += (long long)b->rows.len;
+            ctx->unchanged += unchanged;
+            if (b->last) {
+                ctx->pages++;
+                printf("Page %d synced (%lld/%d)\n", ctx->pages, ctx->rows, ctx->total);
+            }
+            pthread_mutex_unlock(&ctx->mu);
+        }
+        batch_free(b);
+    }
+    return NULL;
+}
+
+static int flush_batch(sync_fetch_t *f, int last) {
+    sync_batch_t *b = f->batch;
+    if (!b) {
+        if (!last) return 0;
+        b = batch_new(f->offset, f->limit);
+        if (!b) return -1;
+    }
+    f->batch = NULL;
+    b->last = last;
+    long long started = metrics_now_ns();
+    int rc = queue_push(&f->ctx->write_q, b);
+    metrics_time_since(&f->ctx->metrics, METRIC_T_QUEUE_WAIT, started);
+    if (rc != 0) {
+        batch_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+static int note_document(sync_ctx_t *ctx, const session_t *s) {
+    if (ctx->ndocs == ctx->docs_cap) {
+        size_t cap = ctx->docs_cap ? ctx->docs_cap * 2 : 64;
+        doc_ref_t *docs = realloc(ctx->docs, cap * sizeof(*docs));
+        if (!docs) return -1;
+        ctx->docs = docs;
+        ctx->docs_cap = cap;
+    }
+    ctx->docs[ctx->ndocs++] = (doc_ref_t){s->document_id, s->id};
+    return 0;
+}
+
+// Runs inside the curl write callback: sessions are batched while the page is still arriving.
+static int on_session(void *userdata, const session_t *s) {
+    sync_fetch_t *f = userdata;
+    if (!f->batch) {
+        f->batch = batch_new(f->offset, f->limit);
+        if (!f->batch) return -1;
+    }
+    f->rows++;
+    if (!f->first_id) f->first_id = s->id;
+    f->last_id = s->id;
+    if (!f->min_id || s->id < f->min_id) f->min_id = s->id;
+    check_reached(f->ctx, s->id);
+    if (s->document_id > 0 && s->parent_id > 0 && note_document(f->ctx, s) != 0) return -1;
+    if (session_batch_push(&f->batch->rows, s) != 0) return -1;
+    if (f->batch->rows.len == STORE_BULK_ROWS) return flush_batch(f, 0);
+    return 0;
+}
+
+static sync_fetch_t *fetch_new(sync_ctx_t *ctx, int offset, int limit) {
+    sync_fetch_t *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->ctx = ctx;
+    f->offset = offset;
+    f->limit = limit;
+    f->parser = api_sessions_parser_new(on_session, f);
+    if (!f->parser) {
+        free(f);
+        return NULL;
+    }
+    api_sessions_parser_set_metrics(f->parser, &ctx->metrics);
+    return f;
+}
+
+static void fetch_free(sync_fetch_t *f) {
+    if (!f) return;
+    api_sessions_parser_free(f->parser);
+    batch_free(f->batch);
+    free(f);
+}
+
+// Failed pages wait in `waiting` until their backoff is over and count against the
+// concurrency meanwhile. pause_until holds back every request after a 429/503 with Retry-After.
+// New pages are requested with the tuner's page size and concurrency unless the sync is fixed;
+// a retry keeps the range of its first attempt.
+typedef struct {
+    sync_ctx_t *ctx;
+    http_client_t *client;
+    http_multi_t *multi;
+    tuner_t tuner;
+    int adaptive;
+    int limit;
+    int concurrency;
+    int retries;
+    sync_fetch_t *waiting[MAX_CONCURRENCY];
+    int nwaiting;
+    double pause_until;
+    int dropped; // pages given up on because the request budget ran out
+} fetch_state_t;
+
+static void on_page_done(void *arg, void *userdata, int rc, long status, http_buffer_t *body,
+                         const http_timing_t *timing) {
+    (void)body;
+    fetch_state_t *fs = arg;
+    sync_fetch_t *f = userdata;
+    if (has_failed(fs->ctx)) {
+        fetch_free(f);
+        return;
+    }
+    pagination_t pg = {0};
+    if (rc == 0 && status == 200 && api_sessions_parser_finish(f->parser, &pg) == 0) {
+        if (fs->adaptive) tuner_page_ok(&fs->tuner, f->rows, timing->bytes, timing->total_ms / 1000.0, now_sec());
+        if (flush_batch(f, 1) != 0) set_failed(fs->ctx);
+        fetch_free(f);
+        return;
+    }
+    // Batches already handed to the writer are kept; re-upserting them is a no-op.
+    batch_free(f->batch);
+    f->batch = NULL;
+    f->rows = 0;
+    // A 200 that did not parse was cut short and is retried like a transport error.
+    int retry = status == 200 || http_should_retry(rc, status);
+    if (retry && fs->adaptive) {
+        int timed_out = status == 408 || status == 504 ||
+                        (rc != 0 && timing->total_ms >= fs->client->timeout_ms * 0.9);
+        tuner_page_failed(&fs->tuner, timed_out, now_sec());
+    }
+    if (retry && f->attempt + 1 < fs->retries && http_budget_exhausted(fs->client)) {
+        fs->dropped++;
+        fetch_free(f);
+        return;
+    }
+    if (retry && ++f->attempt < fs->retries) {
+        long wait_ms = http_backoff_ms(fs->client, f->attempt, timing->retry_after_ms);
+        f->due = now_sec() + wait_ms / 1000.0;
+        if ((status == 429 || status == 503) && timing->retry_after_ms > 0 && f->due > fs->pause_until) {
+            fs->pause_until = f->due;
+        }
+        fs->waiting[fs->nwaiting++] = f;
+        metrics_add(&fs->ctx->metrics, METRIC_HTTP_RETRIES, 1);
+        metrics_add_ns(&fs->ctx->metrics, METRIC_T_BACKOFF, (long long)wait_ms * 1000000);
+        return;
+    }
+    fprintf(stderr, "API Fehler bei offset %d (HTTP %ld), Page übersprungen\n", f->offset, status);
+    page_failed(fs->ctx);
+    fetch_free(f);
+}
+
+// Requests failed pages whose backoff is over. Returns -1 if the request budget ran out.
+static int retry_due(fetch_state_t *fs, double now) {
+    int i = 0;
+    while (i < fs->nwaiting) {
+        sync_fetch_t *f = fs->waiting[i];
+        if (f->due > now) {
+            i++;
+            continue;
+        }
+        fs->waiting[i] = fs->waiting[--fs->nwaiting];
+        if (api_queue_sessions_page(fs->multi, f->limit, f->offset, f->parser, f) != 0) {
+            fetch_free(f);
+            if (http_budget_exhausted(fs->client)) {
+                fs->dropped++;
+                return -1;
+            }
+            set_failed(fs->ctx);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static void drop_waiting(fetch_state_t *fs) {
+    while (fs->nwaiting > 0) {
+        fetch_free(fs->waiting[--fs->nwaiting]);
+        fs->dropped++;
+    }
+}
+
+// When the next waiting page, or any page after a pause, may be requested; 0 if nothing waits.
+static double next_wake(const fetch_state_t *fs, int more) {
+    double wake = 0;
+    for (int i = 0; i < fs->nwaiting; i++) {
+        if (wake == 0 || fs->waiting[i]->due < wake) wake = fs->waiting[i]->due;
+    }
+    if ((fs->nwaiting > 0 || more) && wake < fs->pause_until) wake = fs->pause_until;
+    return wake;
+}
+
+static int cmp_page_offset(const void *a, const void *b) {
+    const sync_page_t *x = a, *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Walks [pos, total) page by page, skipping the ranges in done (sorted by offset). Pages may
+// overlap done ranges that do not line up with them, and each page may have its own size.
+typedef struct {
+    int pos;
+    size_t i;
+} page_cursor_t;
+
+// Offset of the next page still needed, or -1 once [pos, total) is covered.
+static int cursor_peek(page_cursor_t *c, int total, const sync_page_t *done, size_t ndone) {
+    while (c->pos < total) {
+        while (c->i < ndone && done[c->i].offset + done[c->i].limit <= c->pos) c->i++;
+        if (c->i < ndone && done[c->i].offset <= c->pos) {
+            c->pos = done[c->i].offset + done[c->i].limit;
+            continue;
+        }
+        return c->pos;
+    }
+    return -1;
+}
+
+// How many pages of limit sessions are still needed from c on.
+static int cursor_left(page_cursor_t c, int limit, int total, const sync_page_t *done, size_t ndone) {
+    int n = 0;
+    int offset;
+    while ((offset = cursor_peek(&c, total, done, ndone)) >= 0) {
+        c.pos = offset + limit;
+        n++;
+    }
+    return n;
+}
+
+// Places the stored pages of an interrupted sync at today's offsets: with newest-first paging
+// everything moved back by the sessions added since. Pages recorded at a larger total (the
+// server deleted sessions) cannot be placed and are fetched again.
+static size_t map_done_pages(sync_page_t *pages, size_t len, int total, int newest_first) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (pages[i].total > total) continue;
+        pages[n] = pages[i];
+        if (newest_first) pages[n].offset += total - pages[i].total;
+        n++;
+    }
+    qsort(pages, n, sizeof(*pages), cmp_page_offset);
+    return n;
 }
 
 int perform_sync(http_client_t *client, session_store_t *store, const sync_config_t *cfg) {
     int limit = cfg && cfg->page_limit > 0 ? cfg->page_limit : 200;
-    if (limit > 1000) limit = 1000;
+    if (limit > MAX_PAGE_LIMIT) limit = MAX_PAGE_LIMIT;
+    int concurrency = cfg && cfg->concurrency > 0 ? cfg->concurrency : 4;
+    if (concurrency > MAX_CONCURRENCY) concurrency = MAX_CONCURRENCY;
+    int adaptive = !(cfg && cfg->fixed);
+    tuner_bounds_t bounds = {
+        .min_limit = cfg && cfg->page_min > 0 ? cfg->page_min : 20,
+        .max_limit = cfg && cfg->page_max > 0 && cfg->page_max < MAX_PAGE_LIMIT ? cfg->page_max : MAX_PAGE_LIMIT,
+        .min_concurrency = 1,
+        .max_concurrency = cfg && cfg->max_concurrency > 0 ? cfg->max_concurrency : 16,
+        // Well below the request timeout, so a page that grew too large is noticed before it fails.
+        .target_sec = client->timeout_ms > 0 && client->timeout_ms < 8000 ? client->timeout_ms / 4000.0 : 2.0,
+    };
+    if (bounds.max_concurrency > MAX_CONCURRENCY) bounds.max_concurrency = MAX_CONCURRENCY;
+    if (bounds.min_limit > bounds.max_limit) bounds.min_limit = bounds.max_limit;
+    if (adaptive && limit < bounds.min_limit) limit = bounds.min_limit;
+    if (adaptive && limit > bounds.max_limit) limit = bounds.max_limit;
+    if (adaptive && concurrency > bounds.max_concurrency) concurrency = bounds.max_concurrency;
 
-    int offset = 0;
-    int total = 0;
-    int page = 0;
+    sync_checkpoint_t cp = {0};
+    int incremental = cfg && cfg->incremental;
+    int have_checkpoint = session_store_load_checkpoint(store, &cp) == 0;
+    if (incremental && !have_checkpoint) {
+        printf("Kein Checkpoint gefunden, führe vollständigen Sync aus.\n");
+        incremental = 0;
+    }
+    // Without a checkpoint this is an initial import: relax durability and build FTS at the end.
+    int bulk = (cfg && cfg->bulk) || !have_checkpoint;
+    if (incremental)
+        printf("Starte inkrementellen Sync ab #%d (letzter Sync %s, concurrency %d%s)...\n", cp.max_id,
+               cp.last_sync_at, concurrency, adaptive ? ", adaptiv" : "");
+    else
+        printf("Starte Sync (concurrency %d%s)...\n", concurrency, adaptive ? ", adaptiv" : "");
+    double started = now_sec();
 
-    printf("Starte Sync...\n");
-    while (1) {
-        session_t *sessions = NULL;
-        size_t len = 0;
-        pagination_t pg = {0};
-        if (api_list_sessions_page(client, limit, offset, &sessions, &len, &pg) != 0) {
-            fprintf(stderr, "API Fehler bei offset %d\n", offset);
-            return -1;
-        }
+    // Pages stored by an interrupted full sync. An incremental sync is cheap to redo and
+    // finds its own starting point, so it ignores them.
+    sync_page_t *done = NULL;
+    size_t ndone = 0;
+    if (!incremental && session_store_load_pages(store, &done, &ndone) != 0) {
+        fprintf(stderr, "Sync-Fortschritt nicht lesbar: %s\n", sqlite3_errmsg(store->db));
+    }
 
-        if (page == 0) total = pg.total;
-        if (len == 0) {
-            sessions_free(sessions, len);
-            break;
+    sync_ctx_t ctx = {0};
+    ctx.store = store;
+    ctx.track_pages = !incremental;
+    metrics_init(&ctx.metrics);
+    client->metrics = &ctx.metrics;
+    long long mismatches_before = store->count_mismatches;
+    long long skipped_before = store->sealed_skipped;
+    // Insert/update counting costs a trigger per row, so the store is only instrumented on request.
+    int want_metrics = cfg && (cfg->metrics_json || cfg->metrics_interval > 0);
+    if (want_metrics && session_store_set_metrics(store, &ctx.metrics) != 0) {
+        fprintf(stderr, "Metrics für die DB nicht verfügbar: %s\n", sqlite3_errmsg(store->db));
+    }
+    metrics_reporter_t reporter;
+    metrics_reporter_start(&reporter, &ctx.metrics, cfg ? cfg->metrics_interval : 0, cfg ? cfg->metrics_file : NULL);
+    pthread_mutex_init(&ctx.mu, NULL);
+    if (queue_init(&ctx.write_q, (size_t)(adaptive ? bounds.max_concurrency : concurrency) * 2) != 0) {
+        pthread_mutex_destroy(&ctx.mu);
+        metrics_reporter_stop(&reporter);
+        client->metrics = NULL;
+        session_store_set_metrics(store, NULL);
+        free(done);
+        return -1;
+    }
+    store_bulk_opts_t bulk_opts = {.synchronous_off = 0, .defer_fts = 1};
+    if (bulk && session_store_bulk_begin(store, &bulk_opts) != 0) {
+        fprintf(stderr, "Bulk-Modus nicht verfügbar: %s\n", sqlite3_errmsg(store->db));
+    }
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writer_main, &ctx) != 0) {
+        fprintf(stderr, "Writer-Thread konnte nicht gestartet werden\n");
+        if (bulk) session_store_bulk_end(store);
+        queue_destroy(&ctx.write_q);
+        pthread_mutex_destroy(&ctx.mu);
+        metrics_reporter_stop(&reporter);
+        client->metrics = NULL;
+        session_store_set_metrics(store, NULL);
+        free(done);
+        return -1;
+    }
+
+    // The first page is fetched on its own: it tells us how many pages to schedule.
+    sync_fetch_t *first = fetch_new(&ctx, 0, limit);
+    pagination_t pg = {0};
+    int next_offset = 0;
+    page_cursor_t cursor = {0};
+    if (!first || api_stream_sessions_page(client, limit, 0, on_session, first, &pg) != 0) {
+        fprintf(stderr, "API Fehler bei offset %d\n", 0);
+        set_failed(&ctx);
+    } else {
+        ctx.total = pg.total;
+        next_offset = limit;
+        if (flush_batch(first, 1) != 0) set_failed(&ctx);
+        if (incremental && first->first_id) {
+            if (first->first_id >= first->last_id) {
+                ctx.stop_at_id = cp.max_id;
+                check_reached(&ctx, first->min_id);
+            } else if (cp.row_count - limit > next_offset) {
+                // Oldest-first paging: new sessions sit at the end, skip what we already have
+                // but re-read one page of overlap.
+                next_offset = cp.row_count - limit;
+            }
+        }
+        if (ndone > 0) {
+            size_t stored = ndone;
+            ndone = map_done_pages(done, ndone, ctx.total, first->first_id >= first->last_id);
+            if (ndone < stored) {
+                printf("%zu gespeicherte Pages passen nicht mehr und werden neu geholt.\n", stored - ndone);
+            }
         }
+        cursor.pos = next_offset;
+        int all = ctx.total > next_offset ? (ctx.total - next_offset + limit - 1) / limit : 0;
+        int left = cursor_left(cursor, limit, ctx.total, done, ndone);
+        if (ndone > 0 && left < all) {
+            metrics_add(&ctx.metrics, METRIC_PAGES_RESUMED, (unsigned long long)(all - left));
+            printf("Setze unterbrochenen Sync fort: %d von %d Pages schon gespeichert.\n", all - left, all + 1);
+        }
+    }
+    fetch_free(first);
 
-        sqlite3_exec(store->db, "BEGIN;", NULL, NULL, NULL);
-        for (size_t i = 0; i < len; i++) {
-            session_store_upsert(store, &sessions[i]);
+    http_multi_t *multi = has_failed(&ctx) ? NULL : http_multi_new(client);
+    if (!multi) set_failed(&ctx);
+    fetch_state_t fs = {.ctx = &ctx, .client = client, .multi = multi, .adaptive = adaptive, .limit = limit,
+                        .concurrency = concurrency};
+    fs.retries = client->retries > 0 ? client->retries : 1;
+    tuner_init(&fs.tuner, &bounds, limit, concurrency, now_sec());
+    int out_of_budget = 0;
+    // After a failure no new pages are scheduled, but in-flight transfers are drained.
+    while (multi) {
+        if (adaptive) {
+            fs.limit = fs.tuner.limit;
+            fs.concurrency = fs.tuner.concurrency;
+            metrics_set(&ctx.metrics, METRIC_TUNER_BACKOFFS, (unsigned long long)fs.tuner.backoffs);
+        }
+        metrics_set(&ctx.metrics, METRIC_PAGE_LIMIT, (unsigned long long)fs.limit);
+        metrics_set(&ctx.metrics, METRIC_CONCURRENCY, (unsigned long long)fs.concurrency);
+        int stop = has_failed(&ctx) || has_reached(&ctx) || out_of_budget;
+        if (stop) drop_waiting(&fs);
+        int more = !stop && cursor_peek(&cursor, ctx.total, done, ndone) >= 0;
+        if (http_multi_inflight(multi) == 0 && fs.nwaiting == 0 && !more) break;
+        double now = now_sec();
+        if (!stop && now >= fs.pause_until) {
+            if (retry_due(&fs, now) != 0) out_of_budget = 1;
+            int offset;
+            while (!out_of_budget && !has_failed(&ctx) && http_multi_inflight(multi) + fs.nwaiting < fs.concurrency &&
+                   (offset = cursor_peek(&cursor, ctx.total, done, ndone)) >= 0) {
+                sync_fetch_t *f = fetch_new(&ctx, offset, fs.limit);
+                if (!f || api_queue_sessions_page(multi, fs.limit, offset, f->parser, f) != 0) {
+                    fetch_free(f);
+                    if (http_budget_exhausted(client)) out_of_budget = 1;
+                    else set_failed(&ctx);
+                    break;
+                }
+                cursor.pos = offset + fs.limit;
+                tuner_requested(&fs.tuner);
+            }
+            more = !out_of_budget && cursor_peek(&cursor, ctx.total, done, ndone) >= 0;
         }
-        sqlite3_exec(store->db, "COMMIT;", NULL, NULL, NULL);
-        sessions_free(sessions, len);
+        double wake = next_wake(&fs, more);
+        int timeout_ms = 1000;
+        if (wake > 0) timeout_ms = wake > now ? (int)((wake - now) * 1000) + 1 : 0;
+        if (timeout_ms > 1000) timeout_ms = 1000;
+        if (http_multi_inflight(multi) > 0) {
+            if (http_multi_poll(multi, timeout_ms, on_page_done, &fs) != 0) set_failed(&ctx);
+        } else if (timeout_ms > 0) {
+            struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+    }
+    drop_waiting(&fs);
+    http_multi_free(multi);
+    int unfetched = has_reached(&ctx) ? 0 : cursor_left(cursor, fs.limit, ctx.total, done, ndone) + fs.dropped;
+    free(done);
+
+    queue_close(&ctx.write_q);
+    pthread_join(writer, NULL);
+    queue_destroy(&ctx.write_q);
+    pthread_mutex_destroy(&ctx.mu);
 
-        offset += (int)len;
-        page++;
-        printf("Page %d synced (%d/%d)\n", page, offset, total);
-        if (offset >= total) break;
+    int incomplete = ctx.failed_pages > 0 || unfetched > 0;
+    if (bulk && session_store_bulk_end(store) != 0) ctx.failed = 1;
+    if (!ctx.failed && !incomplete && session_store_save_checkpoint(store) != 0) {
+        fprintf(stderr, "Checkpoint konnte nicht gespeichert werden: %s\n", sqlite3_errmsg(store->db));
     }
+    if (!ctx.failed && session_store_queue_documents(store, ctx.docs, ctx.ndocs) != 0) {
+        fprintf(stderr, "Dokumente konnten nicht vorgemerkt werden: %s\n", sqlite3_errmsg(store->db));
+        ctx.failed = 1;
+    }
+    free(ctx.docs);
 
-    return 0;
+    metrics_reporter_stop(&reporter);
+    client->metrics = NULL;
+    session_store_set_metrics(store, NULL);
+
+    double elapsed = now_sec() - started;
+    if (elapsed <= 0) elapsed = 1e-9;
+    unsigned long long bytes = metrics_get(&ctx.metrics, METRIC_PARSE_BYTES);
+    unsigned long long requests = metrics_get(&ctx.metrics, METRIC_HTTP_REQUESTS);
+    printf("Sync fertig: %lld Sessions (%lld unverändert), %d Pages in %.2fs (%.1f Sessions/s, %.2f MB/s)\n",
+           ctx.rows, ctx.unchanged, ctx.pages, elapsed, ctx.rows / elapsed, bytes / elapsed / (1024.0 * 1024.0));
+    if (store->count_mismatches > mismatches_before) {
+        printf("Warnung: %lld Sessions mit abweichenden Wort-/Zeichen-/Buchstabenzahlen (Server vs. lokal)\n",
+               store->count_mismatches - mismatches_before);
+    }
+    if (store->sealed_skipped > skipped_before) {
+        printf("%lld Sessions aus versiegelten Jahren übersprungen; Änderungen daran übernimmt der Shard nicht\n",
+               store->sealed_skipped - skipped_before);
+    }
+    if (adaptive && fs.tuner.pages > 0) {
+        printf("Adaptiv: Pagegröße %d → %d (Ø %lld, max %d), concurrency %d → %d (max %d), %d× zurückgenommen\n",
+               fs.tuner.start_limit, fs.tuner.limit, fs.tuner.page_rows / fs.tuner.pages, fs.tuner.peak_limit,
+               fs.tuner.start_concurrency, fs.tuner.concurrency, fs.tuner.peak_concurrency, fs.tuner.backoffs);
+    }
+    if (requests > 0) {
+        printf("HTTP: %llu Requests, %llu neue Verbindungen, Ø TTFB %.1f ms\n", requests,
+               metrics_get(&ctx.metrics, METRIC_HTTP_CONNECTS), metrics_ms(&ctx.metrics, METRIC_T_TTFB) / requests);
+    }
+    if (unfetched > 0 && http_budget_exhausted(client)) {
+        fprintf(stderr, "Request-Budget von %ld Requests aufgebraucht.\n", client->max_requests);
+    }
+    if (incomplete && !ctx.failed) {
+        fprintf(stderr, "Sync unvollständig: %d Pages fehlgeschlagen, %d nicht abgerufen. "
+                        "Ein erneuter Aufruf von sync holt sie nach.\n",
+                ctx.failed_pages, unfetched);
+    }
+    if (cfg && cfg->metrics_file) metrics_write_file(&ctx.metrics, cfg->metrics_file);
+    if (cfg && cfg->metrics_json) metrics_write_json(&ctx.metrics, stdout);
+    // Versions of documents queued by this or an earlier run; they do not hold up the checkpoint.
+    // Fetching them costs a request per document, so only syncs that ask for it do.
+    if (cfg && cfg->history && !ctx.failed && history_sync(client, store, fs.concurrency) != 0) incomplete = 1;
+    return ctx.failed || incomplete ? -1 : 0;
 }
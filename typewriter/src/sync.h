@@ -5,7 +5,20 @@
 #include "session_store.h"
 
 typedef struct {
-    int page_limit;
+    int page_limit;  // size of the first page
+    int concurrency; // requests in flight at the start
+    // Unless fixed is set, page size and concurrency are tuned while the sync runs (see tuner.h),
+    // within page_min..page_max (default 20..1000) and 1..max_concurrency (default 16).
+    int fixed;
+    int page_min;
+    int page_max;
+    int max_concurrency;
+    int incremental;
+    int bulk;
+    int history; // fetch the versions of edited documents once the sessions are stored (history.h)
+    int metrics_json;
+    int metrics_interval;
+    const char *metrics_file;
 } sync_config_t;
 
 int perform_sync(http_client_t *client, session_store_t *store, const sync_config_t *cfg);
@@ -0,0 +1,210 @@
+#include "text_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef TYPEWRITER_ZSTD
+
+#include <zdict.h>
+#include <zstd.h>
+
+typedef struct {
+    unsigned id;
+    ZSTD_DDict *ddict;
+} codec_dict_t;
+
+struct text_codec {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    ZSTD_CDict *cdict; // current dictionary, for compression
+    codec_dict_t *dicts;
+    size_t ndicts;
+};
+
+int text_codec_enabled(void) {
+    return 1;
+}
+
+text_codec_t *text_codec_new(void) {
+    text_codec_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->cctx = ZSTD_createCCtx();
+    c->dctx = ZSTD_createDCtx();
+    if (!c->cctx || !c->dctx) {
+        text_codec_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void text_codec_free(text_codec_t *c) {
+    if (!c) return;
+    for (size_t i = 0; i < c->ndicts; i++) ZSTD_freeDDict(c->dicts[i].ddict);
+    free(c->dicts);
+    ZSTD_freeCDict(c->cdict);
+    ZSTD_freeCCtx(c->cctx);
+    ZSTD_freeDCtx(c->dctx);
+    free(c);
+}
+
+size_t text_codec_train(void *dict, size_t cap, const void *samples, const size_t *sizes, unsigned n) {
+    size_t rc = ZDICT_trainFromBuffer(dict, cap, samples, sizes, n);
+    if (ZDICT_isError(rc)) {
+        fprintf(stderr, "Wörterbuch-Training fehlgeschlagen: %s\n", ZDICT_getErrorName(rc));
+        return 0;
+    }
+    return rc;
+}
+
+unsigned text_codec_dict_id(const void *dict, size_t len) {
+    return ZSTD_getDictID_fromDict(dict, len);
+}
+
+unsigned text_codec_frame_dict_id(const void *frame, size_t len) {
+    return ZSTD_getDictID_fromFrame(frame, len);
+}
+
+static const ZSTD_DDict *find_dict(const text_codec_t *c, unsigned id) {
+    for (size_t i = 0; i < c->ndicts; i++) {
+        if (c->dicts[i].id == id) return c->dicts[i].ddict;
+    }
+    return NULL;
+}
+
+int text_codec_has_dict(const text_codec_t *c, unsigned id) {
+    return find_dict(c, id) != NULL;
+}
+
+int text_codec_can_compress(const text_codec_t *c) {
+    return c->cdict != NULL;
+}
+
+int text_codec_add_dict(text_codec_t *c, const void *dict, size_t len, int level) {
+    unsigned id = ZSTD_getDictID_fromDict(dict, len);
+    if (id == 0) return -1;
+    if (!find_dict(c, id)) {
+        codec_dict_t *dicts = realloc(c->dicts, (c->ndicts + 1) * sizeof(*dicts));
+        if (!dicts) return -1;
+        c->dicts = dicts;
+        ZSTD_DDict *ddict = ZSTD_createDDict(dict, len);
+        if (!ddict) return -1;
+        c->dicts[c->ndicts++] = (codec_dict_t){.id = id, .ddict = ddict};
+    }
+    if (level > 0) {
+        ZSTD_CDict *cdict = ZSTD_createCDict(dict, len, level);
+        if (!cdict) return -1;
+        ZSTD_freeCDict(c->cdict);
+        c->cdict = cdict;
+    }
+    return 0;
+}
+
+size_t text_codec_bound(size_t len) {
+    return ZSTD_compressBound(len);
+}
+
+size_t text_codec_compress(text_codec_t *c, void *dst, size_t cap, const char *text, size_t len) {
+    if (!c->cdict) return 0;
+    size_t rc = ZSTD_compress_usingCDict(c->cctx, dst, cap, text, len, c->cdict);
+    return ZSTD_isError(rc) ? 0 : rc;
+}
+
+long long text_codec_text_size(const void *frame, size_t len) {
+    unsigned long long n = ZSTD_getFrameContentSize(frame, len);
+    if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR) return -1;
+    return (long long)n;
+}
+
+int text_codec_decompress(text_codec_t *c, char *dst, size_t cap, const void *frame, size_t len) {
+    const ZSTD_DDict *ddict = find_dict(c, ZSTD_getDictID_fromFrame(frame, len));
+    if (!ddict) return -1;
+    size_t rc = ZSTD_decompress_usingDDict(c->dctx, dst, cap, frame, len, ddict);
+    return ZSTD_isError(rc) ? -1 : 0;
+}
+
+#else
+
+struct text_codec {
+    int unused;
+};
+
+int text_codec_enabled(void) {
+    return 0;
+}
+
+text_codec_t *text_codec_new(void) {
+    return calloc(1, sizeof(text_codec_t));
+}
+
+void text_codec_free(text_codec_t *c) {
+    free(c);
+}
+
+size_t text_codec_train(void *dict, size_t cap, const void *samples, const size_t *sizes, unsigned n) {
+    (void)dict;
+    (void)cap;
+    (void)samples;
+    (void)sizes;
+    (void)n;
+    return 0;
+}
+
+unsigned text_codec_dict_id(const void *dict, size_t len) {
+    (void)dict;
+    (void)len;
+    return 0;
+}
+
+unsigned text_codec_frame_dict_id(const void *frame, size_t len) {
+    (void)frame;
+    (void)len;
+    return 0;
+}
+
+int text_codec_add_dict(text_codec_t *c, const void *dict, size_t len, int level) {
+    (void)c;
+    (void)dict;
+    (void)len;
+    (void)level;
+    return -1;
+}
+
+int text_codec_has_dict(const text_codec_t *c, unsigned id) {
+    (void)c;
+    (void)id;
+    return 0;
+}
+
+int text_codec_can_compress(const text_codec_t *c) {
+    (void)c;
+    return 0;
+}
+
+size_t text_codec_bound(size_t len) {
+    return len;
+}
+
+size_t text_codec_compress(text_codec_t *c, void *dst, size_t cap, const char *text, size_t len) {
+    (void)c;
+    (void)dst;
+    (void)cap;
+    (void)text;
+    (void)len;
+    return 0;
+}
+
+long long text_codec_text_size(const void *frame, size_t len) {
+    (void)frame;
+    (void)len;
+    return -1;
+}
+
+int text_codec_decompress(text_codec_t *c, char *dst, size_t cap, const void *frame, size_t len) {
+    (void)c;
+    (void)dst;
+    (void)cap;
+    (void)frame;
+    (void)len;
+    return -1;
+}
+
+#endif
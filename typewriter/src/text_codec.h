@@ -0,0 +1,44 @@
+#ifndef TEXT_CODEC_H
+#define TEXT_CODEC_H
+
+#include <stddef.h>
+
+// zstd compression of session texts with dictionaries trained from the corpus. Only built
+// with `make ZSTD=1`; otherwise every function reports failure and texts stay plain.
+// Each codec owns its own compression and decompression contexts, so use one per thread.
+typedef struct text_codec text_codec_t;
+
+// 1 when built with zstd.
+int text_codec_enabled(void);
+
+text_codec_t *text_codec_new(void);
+void text_codec_free(text_codec_t *c);
+
+// Trains a dictionary of at most cap bytes from n samples stored back to back. Returns its
+// length, or 0 (with a message on stderr) if the samples are too few or too small.
+size_t text_codec_train(void *dict, size_t cap, const void *samples, const size_t *sizes, unsigned n);
+
+// The id zstd embeds in every frame compressed with dict; 0 if dict is not a zstd dictionary.
+unsigned text_codec_dict_id(const void *dict, size_t len);
+// Dictionary id a frame was compressed with; 0 if none or not a frame.
+unsigned text_codec_frame_dict_id(const void *frame, size_t len);
+
+// Makes dict available for decompression. With level > 0 it also becomes the dictionary new
+// texts are compressed with, at that zstd level. Returns 0 or -1.
+int text_codec_add_dict(text_codec_t *c, const void *dict, size_t len, int level);
+int text_codec_has_dict(const text_codec_t *c, unsigned id);
+// 1 once a dictionary for compression was added.
+int text_codec_can_compress(const text_codec_t *c);
+
+// Worst-case frame size for len bytes of text.
+size_t text_codec_bound(size_t len);
+// Compresses text with the current dictionary into dst. Returns the frame size, or 0 if there
+// is no dictionary or dst is too small.
+size_t text_codec_compress(text_codec_t *c, void *dst, size_t cap, const char *text, size_t len);
+// Size of the text in frame, or -1 if frame is not a complete zstd frame.
+long long text_codec_text_size(const void *frame, size_t len);
+// Decompresses frame into dst (cap must hold text_codec_text_size bytes). Its dictionary must
+// have been added. Returns 0 or -1.
+int text_codec_decompress(text_codec_t *c, char *dst, size_t cap, const void *frame, size_t len);
+
+#endif // TEXT_CODEC_H
@@ -0,0 +1,381 @@
+#include "text_stats.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_STATS_X86 1
+#include <immintrin.h>
+#endif
+
+#define BLOCK 32
+
+// CP_TOKEN: part of a token but not a letter (digits, combining marks).
+enum { CP_OTHER, CP_SPACE, CP_LETTER, CP_TOKEN };
+
+// Byte classes of one 32-byte block, bit i for byte i. Umlauts and ß are handled on the masks
+// too; any other non-ASCII code point is rare enough in German text to be decoded one at a time.
+typedef struct {
+    uint32_t space; // ASCII whitespace
+    uint32_t cont;  // UTF-8 continuation bytes
+    uint32_t alpha; // ASCII letters
+    uint32_t alnum; // ASCII letters and digits
+    uint32_t lead;  // lead bytes of multi-byte sequences
+    uint32_t c3;    // 0xC3, the lead byte of À-ÿ (umlauts, ß)
+    uint32_t x97;   // 0x97 or 0xB7, which after 0xC3 are × and ÷ rather than letters
+} block_masks_t;
+
+// Decodes the sequence at s[i]; an invalid or truncated one counts as a single byte.
+static uint32_t decode_cp(const unsigned char *s, size_t len, size_t i, size_t *n) {
+    uint32_t c = s[i];
+    size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    *n = 1;
+    if (c >= 0xF8 || extra == 0 || i + extra >= len) return c;
+    uint32_t cp = c & (0x3Fu >> extra);
+    for (size_t k = 1; k <= extra; k++) {
+        if ((s[i + k] & 0xC0) != 0x80) return c;
+        cp = (cp << 6) | (s[i + k] & 0x3F);
+    }
+    *n = extra + 1;
+    return cp;
+}
+
+// Non-ASCII code points only. Approximates Unicode's White_Space and letter categories for
+// the scripts that matter here; punctuation, symbols and emoji are CP_OTHER.
+static int classify_cp(uint32_t cp) {
+    if (cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 ||
+        cp == 0x202F || cp == 0x205F || cp == 0x3000) {
+        return CP_SPACE;
+    }
+    if (cp == 0xAA || cp == 0xB5 || cp == 0xBA) return CP_LETTER;
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return CP_OTHER;
+    if (cp < 0x2C2) return CP_LETTER;
+    if (cp >= 0x300 && cp < 0x370) return CP_TOKEN;
+    if (cp < 0x370 || (cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F)) return CP_OTHER;
+    if ((cp >= 0xD800 && cp <= 0xF8FF) || (cp >= 0xFE00 && cp <= 0xFE0F) || cp >= 0x1F000) return CP_OTHER;
+    return CP_LETTER;
+}
+
+void text_stats_scan_naive(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata) {
+    const unsigned char *u = (const unsigned char *)text;
+    text_stats_t st = {0, 0, 0};
+    int in_word = 0;
+    int in_token = 0;
+    size_t token_start = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t n;
+        uint32_t cp = decode_cp(u, len, i, &n);
+        int cls;
+        if (n == 1 && cp < 0x80) {
+            cls = cp == ' ' || (cp >= 9 && cp <= 13)    ? CP_SPACE
+                  : ((cp | 0x20) - 'a') < 26            ? CP_LETTER
+                  : cp >= '0' && cp <= '9'              ? CP_TOKEN
+                                                        : CP_OTHER;
+        } else {
+            cls = n == 1 ? CP_OTHER : classify_cp(cp);
+        }
+        if (n > 1 || (cp & 0xC0) != 0x80) st.chars++;
+        if (cls == CP_LETTER) st.letters++;
+        if (cls != CP_SPACE && !in_word) st.words++;
+        in_word = cls != CP_SPACE;
+        int word_char = cls == CP_LETTER || cls == CP_TOKEN;
+        if (word_char && !in_token) token_start = i;
+        if (!word_char && in_token && fn) fn(userdata, text + token_start, i - token_start);
+        in_token = word_char;
+        i += n;
+    }
+    if (in_token && fn) fn(userdata, text + token_start, len - token_start);
+    *out = st;
+}
+
+static inline __attribute__((always_inline)) block_masks_t masks_scalar(const unsigned char *p) {
+    block_masks_t m = {0, 0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < BLOCK; i++) {
+        unsigned char c = p[i];
+        uint32_t bit = 1u << i;
+        if (c == ' ' || (c >= 9 && c <= 13)) m.space |= bit;
+        if ((c & 0xC0) == 0x80) m.cont |= bit;
+        if ((unsigned char)((c | 0x20) - 'a') < 26) m.alpha |= bit;
+        if ((unsigned char)(c - '0') < 10) m.alnum |= bit;
+        if (c >= 0xC0) m.lead |= bit;
+        if (c == 0xC3) m.c3 |= bit;
+        if (c == 0x97 || c == 0xB7) m.x97 |= bit;
+    }
+    m.alnum |= m.alpha;
+    return m;
+}
+
+// Masks -> counts and token boundaries. Inlined into each implementation so the mask
+// function is inlined too and compiled for that instruction set.
+static inline __attribute__((always_inline)) void
+scan_blocks(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata,
+            block_masks_t (*masks)(const unsigned char *)) {
+    const unsigned char *u = (const unsigned char *)text;
+    unsigned char tail[BLOCK];
+    long chars = 0;
+    long letters = 0;
+    long words = 0;
+    uint32_t prev_space = 1; // start of text counts as whitespace
+    uint32_t prev_word = 0;
+    uint32_t spill_space = 0; // bytes of a code point that started in the previous block
+    uint32_t spill_word = 0;
+    size_t token_start = 0;
+    int open_token = 0;
+    for (size_t off = 0; off < len; off += BLOCK) {
+        size_t left = len - off;
+        uint32_t valid = left >= BLOCK ? 0xFFFFFFFFu : (1u << left) - 1;
+        block_masks_t m;
+        if (left >= BLOCK) {
+            m = masks(u + off);
+        } else {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, u + off, left);
+            m = masks(tail);
+        }
+        uint32_t space = m.space | spill_space;
+        uint32_t word = m.alnum | spill_word;
+        spill_space = spill_word = 0;
+        chars += __builtin_popcount(~m.cont & valid);
+        letters += __builtin_popcount(m.alpha);
+        // 0xC3 + continuation byte is a Latin-1 letter unless it is × or ÷. A pair that
+        // straddles the block boundary goes through the decoder below instead.
+        uint32_t latin1 = m.c3 & (m.cont >> 1) & ~(m.x97 >> 1) & 0x7FFFFFFFu;
+        letters += __builtin_popcount(latin1);
+        word |= latin1 | (latin1 << 1);
+        for (uint32_t leads = m.lead & valid & ~latin1; leads; leads &= leads - 1) {
+            int bit = __builtin_ctz(leads);
+            size_t n;
+            uint32_t cp = decode_cp(u, len, off + (size_t)bit, &n);
+            int cls = n == 1 ? CP_OTHER : classify_cp(cp);
+            if (cls == CP_OTHER) continue;
+            uint64_t bytes = ((1ULL << n) - 1) << bit;
+            if (cls == CP_SPACE) {
+                space |= (uint32_t)bytes;
+                spill_space = (uint32_t)(bytes >> 32);
+            } else {
+                letters += cls == CP_LETTER;
+                word |= (uint32_t)bytes;
+                spill_word = (uint32_t)(bytes >> 32);
+            }
+        }
+        // A word starts at every non-space byte that follows a space.
+        words += __builtin_popcount(~space & valid & ((space << 1) | prev_space));
+        prev_space = space >> 31;
+        if (fn) {
+            word &= valid;
+            uint32_t shifted = (word << 1) | prev_word;
+            uint32_t edges = (word & ~shifted) | (~word & shifted & valid);
+            for (; edges; edges &= edges - 1) {
+                int bit = __builtin_ctz(edges);
+                if (word & (1u << bit)) {
+                    token_start = off + (size_t)bit;
+                } else {
+                    fn(userdata, text + token_start, off + (size_t)bit - token_start);
+                }
+            }
+            prev_word = word >> 31;
+            open_token = (word >> (left < BLOCK ? left - 1 : BLOCK - 1)) & 1;
+        }
+    }
+    if (open_token) fn(userdata, text + token_start, len - token_start);
+    out->words = (int)words;
+    out->chars = (int)chars;
+    out->letters = (int)letters;
+}
+
+static void scan_scalar(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata) {
+    scan_blocks(text, len, out, fn, userdata, masks_scalar);
+}
+
+#ifdef TEXT_STATS_X86
+__attribute__((target("avx2"))) static inline __attribute__((always_inline)) block_masks_t
+masks_avx2(const unsigned char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    // Unsigned range checks: x in [lo, lo + n] <=> min(x - lo, n) == x - lo.
+    __m256i a = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(25)), a);
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i digit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i c = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(c, _mm256_set1_epi8(4)), c),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    __m256i cont = _mm256_cmpeq_epi8(_mm256_and_si256(v, _mm256_set1_epi8((char)0xC0)), _mm256_set1_epi8((char)0x80));
+    __m256i lead = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8((char)0xC0)), v);
+    __m256i c3 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0xC3));
+    __m256i x97 = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0x97)),
+                                  _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0xB7)));
+    block_masks_t m;
+    m.space = (uint32_t)_mm256_movemask_epi8(space);
+    m.cont = (uint32_t)_mm256_movemask_epi8(cont);
+    m.alpha = (uint32_t)_mm256_movemask_epi8(alpha);
+    m.alnum = m.alpha | (uint32_t)_mm256_movemask_epi8(digit);
+    m.lead = (uint32_t)_mm256_movemask_epi8(lead);
+    m.c3 = (uint32_t)_mm256_movemask_epi8(c3);
+    m.x97 = (uint32_t)_mm256_movemask_epi8(x97);
+    return m;
+}
+
+__attribute__((target("avx2"))) static void scan_avx2(const char *text, size_t len, text_stats_t *out,
+                                                      text_token_fn fn, void *userdata) {
+    scan_blocks(text, len, out, fn, userdata, masks_avx2);
+}
+
+// SSE4.2's string compare does the character-class tests (whitespace set, letter and digit
+// ranges) on 16 bytes at once. Its implicit length stops at NUL, which only the zeroed tail has.
+__attribute__((target("sse4.2"))) static inline __attribute__((always_inline)) block_masks_t
+masks_sse42(const unsigned char *p) {
+    const __m128i space_set = _mm_setr_epi8(' ', '\t', '\n', '\v', '\f', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i alpha_ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i alnum_ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    block_masks_t m = {0, 0, 0, 0, 0, 0, 0};
+    for (int h = 0; h < 2; h++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * h));
+        int shift = 16 * h;
+        m.space |= (uint32_t)_mm_cvtsi128_si32(
+                       _mm_cmpistrm(space_set, v, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK))
+                   << shift;
+        m.alpha |= (uint32_t)_mm_cvtsi128_si32(
+                       _mm_cmpistrm(alpha_ranges, v, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK))
+                   << shift;
+        m.alnum |= (uint32_t)_mm_cvtsi128_si32(
+                       _mm_cmpistrm(alnum_ranges, v, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK))
+                   << shift;
+        __m128i cont = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xC0)), _mm_set1_epi8((char)0x80));
+        __m128i lead = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8((char)0xC0)), v);
+        m.cont |= (uint32_t)_mm_movemask_epi8(cont) << shift;
+        m.lead |= (uint32_t)_mm_movemask_epi8(lead) << shift;
+        m.c3 |= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xC3))) << shift;
+        m.x97 |= (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)0x97)),
+                                                          _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xB7))))
+                 << shift;
+    }
+    return m;
+}
+
+__attribute__((target("sse4.2"))) static void scan_sse42(const char *text, size_t len, text_stats_t *out,
+                                                         text_token_fn fn, void *userdata) {
+    scan_blocks(text, len, out, fn, userdata, masks_sse42);
+}
+#endif
+
+typedef void (*scan_fn)(const char *, size_t, text_stats_t *, text_token_fn, void *);
+
+static scan_fn impl_fn = scan_scalar;
+static const char *impl_name = "scalar";
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+
+static void pick_impl(void) {
+#ifdef TEXT_STATS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        impl_fn = scan_avx2;
+        impl_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        impl_fn = scan_sse42;
+        impl_name = "sse4.2";
+    }
+#endif
+}
+
+void text_stats_scan(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata) {
+    pthread_once(&impl_once, pick_impl);
+    impl_fn(text, len, out, fn, userdata);
+}
+
+const char *text_stats_impl(void) {
+    pthread_once(&impl_once, pick_impl);
+    return impl_name;
+}
+
+int text_stats_set_impl(const char *name) {
+    pthread_once(&impl_once, pick_impl);
+    if (strcmp(name, "scalar") == 0) {
+        impl_fn = scan_scalar;
+#ifdef TEXT_STATS_X86
+    } else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        impl_fn = scan_avx2;
+    } else if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        impl_fn = scan_sse42;
+#endif
+    } else {
+        return -1;
+    }
+    impl_name = strcmp(name, "scalar") == 0 ? "scalar" : strcmp(name, "avx2") == 0 ? "avx2" : "sse4.2";
+    return 0;
+}
+
+void text_terms_reset(text_terms_t *t) {
+    if (t->slots) memset(t->slots, 0, t->cap * sizeof(text_term_t));
+    t->len = 0;
+    t->arena_len = 0;
+    t->failed = 0;
+}
+
+void text_terms_free(text_terms_t *t) {
+    free(t->slots);
+    free(t->arena);
+    memset(t, 0, sizeof(*t));
+}
+
+static int terms_grow(text_terms_t *t) {
+    size_t cap = t->cap ? t->cap * 2 : 256;
+    text_term_t *slots = calloc(cap, sizeof(text_term_t));
+    if (!slots) return -1;
+    for (size_t i = 0; i < t->cap; i++) {
+        if (t->slots[i].count == 0) continue;
+        size_t j = t->slots[i].hash & (cap - 1);
+        while (slots[j].count) j = (j + 1) & (cap - 1);
+        slots[j] = t->slots[i];
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+    return 0;
+}
+
+void text_terms_add(void *userdata, const char *token, size_t len) {
+    text_terms_t *t = userdata;
+    if (t->failed) return;
+    if ((t->len + 1) * 4 > t->cap * 3 && terms_grow(t) != 0) {
+        t->failed = 1;
+        return;
+    }
+    if (t->arena_len + len > t->arena_cap) {
+        size_t cap = t->arena_cap ? t->arena_cap : 4096;
+        while (cap < t->arena_len + len) cap *= 2;
+        char *arena = realloc(t->arena, cap);
+        if (!arena) {
+            t->failed = 1;
+            return;
+        }
+        t->arena = arena;
+        t->arena_cap = cap;
+    }
+    // Lowercase into the arena tail; it only becomes part of the arena for a new term.
+    unsigned char *dst = (unsigned char *)t->arena + t->arena_len;
+    const unsigned char *src = (const unsigned char *)token;
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = src[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 0x20;
+        } else if (i > 0 && src[i - 1] == 0xC3 && c >= 0x80 && c <= 0x9E && c != 0x97) {
+            c += 0x20; // À-Þ -> à-þ
+        }
+        dst[i] = c;
+        h = (h ^ c) * 16777619u;
+    }
+    size_t j = h & (t->cap - 1);
+    for (; t->slots[j].count; j = (j + 1) & (t->cap - 1)) {
+        text_term_t *s = &t->slots[j];
+        if (s->hash == h && s->len == len && memcmp(t->arena + s->offset, dst, len) == 0) {
+            s->count++;
+            return;
+        }
+    }
+    t->slots[j] = (text_term_t){.offset = t->arena_len, .len = len, .hash = h, .count = 1};
+    t->arena_len += len;
+    t->len++;
+}
@@ -0,0 +1,54 @@
+#ifndef TEXT_STATS_H
+#define TEXT_STATS_H
+
+#include <stddef.h>
+
+// Counts as the server defines them: words are runs of non-whitespace, chars are code
+// points, letters are alphabetic code points (ASCII, umlauts, ß and other scripts).
+typedef struct {
+    int words;
+    int chars;
+    int letters;
+} text_stats_t;
+
+// Receives each token (a run of letters and digits) in order, pointing into the scanned text.
+typedef void (*text_token_fn)(void *userdata, const char *token, size_t len);
+
+// Single pass over UTF-8 text that fills out and, if fn is set, reports every token.
+// Uses AVX2 or SSE4.2 when the CPU has them (checked once at runtime), otherwise plain C.
+void text_stats_scan(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata);
+
+// One code point at a time, no blocks or masks. The reference the fast paths must agree with.
+void text_stats_scan_naive(const char *text, size_t len, text_stats_t *out, text_token_fn fn, void *userdata);
+
+// Name of the implementation text_stats_scan uses ("avx2", "sse4.2" or "scalar").
+const char *text_stats_impl(void);
+// Forces an implementation (for benchmarks). Returns -1 if the CPU or build lacks it.
+int text_stats_set_impl(const char *name);
+
+// Per-text term frequencies: tokens lowercased (ASCII and Latin-1, so "Äpfel" == "äpfel")
+// and counted in a reusable open-addressing table. A used slot has count > 0 and its term at
+// arena + offset.
+typedef struct {
+    size_t offset;
+    size_t len;
+    unsigned int hash;
+    int count;
+} text_term_t;
+
+typedef struct {
+    text_term_t *slots;
+    size_t cap;
+    size_t len;
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    int failed; // an allocation failed; the counts are incomplete
+} text_terms_t;
+
+void text_terms_reset(text_terms_t *t);
+void text_terms_free(text_terms_t *t);
+// text_token_fn that counts into the text_terms_t passed as userdata.
+void text_terms_add(void *userdata, const char *token, size_t len);
+
+#endif // TEXT_STATS_H
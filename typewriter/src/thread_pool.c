@@ -0,0 +1,55 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+
+struct thread_pool_worker {
+    thread_pool_t *pool;
+    void *ctx;
+    pthread_t thread;
+};
+
+static void *worker_main(void *arg) {
+    thread_pool_worker_t *w = arg;
+    void *job;
+    while ((job = queue_pop(&w->pool->jobs)) != NULL) w->pool->fn(w->ctx, job);
+    return NULL;
+}
+
+// worker_ctx may be NULL; otherwise it must hold one entry per thread.
+int thread_pool_init(thread_pool_t *pool, int threads, size_t queue_cap, thread_pool_fn fn, void **worker_ctx) {
+    if (threads < 1 || !fn) return -1;
+    if (queue_init(&pool->jobs, queue_cap) != 0) return -1;
+    pool->fn = fn;
+    pool->threads = 0;
+    pool->workers = calloc((size_t)threads, sizeof(thread_pool_worker_t));
+    if (!pool->workers) {
+        queue_destroy(&pool->jobs);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        thread_pool_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->ctx = worker_ctx ? worker_ctx[i] : NULL;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            thread_pool_destroy(pool);
+            return -1;
+        }
+        pool->threads++;
+    }
+    return 0;
+}
+
+// Blocks while the job queue is full. Returns -1 once the pool is shutting down.
+int thread_pool_submit(thread_pool_t *pool, void *job) {
+    return queue_push(&pool->jobs, job);
+}
+
+// Lets the workers finish every queued job, then joins them.
+void thread_pool_destroy(thread_pool_t *pool) {
+    if (!pool->workers) return;
+    queue_close(&pool->jobs);
+    for (int i = 0; i < pool->threads; i++) pthread_join(pool->workers[i].thread, NULL);
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->threads = 0;
+    queue_destroy(&pool->jobs);
+}
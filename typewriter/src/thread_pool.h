@@ -0,0 +1,26 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "queue.h"
+#include <pthread.h>
+#include <stddef.h>
+
+// Called on a worker thread for every submitted job. worker_ctx is the per-thread state passed
+// to thread_pool_init (e.g. that thread's own database connection).
+typedef void (*thread_pool_fn)(void *worker_ctx, void *job);
+
+typedef struct thread_pool_worker thread_pool_worker_t;
+
+// Fixed set of worker threads fed from a bounded job queue.
+typedef struct {
+    queue_t jobs;
+    thread_pool_fn fn;
+    thread_pool_worker_t *workers;
+    int threads;
+} thread_pool_t;
+
+int thread_pool_init(thread_pool_t *pool, int threads, size_t queue_cap, thread_pool_fn fn, void **worker_ctx);
+int thread_pool_submit(thread_pool_t *pool, void *job);
+void thread_pool_destroy(thread_pool_t *pool);
+
+#endif // THREAD_POOL_H
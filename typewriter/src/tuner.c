@@ -0,0 +1,120 @@
+#include "tuner.h"
+
+// A round only counts as better if it beats the best one by this much; below that it is noise.
+#define TUNER_GAIN 1.05
+// The best rate fades by this factor each round at the best concurrency, so that a server
+// which got faster is probed again.
+#define TUNER_DECAY 0.9
+
+static int clamp(int v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static void new_round(tuner_t *t, double now) {
+    t->round_started = now;
+    t->round_pages = 0;
+    t->round_rows = 0;
+    t->round_slowest = 0;
+}
+
+static void note_peaks(tuner_t *t) {
+    if (t->limit > t->peak_limit) t->peak_limit = t->limit;
+    if (t->concurrency > t->peak_concurrency) t->peak_concurrency = t->concurrency;
+}
+
+void tuner_init(tuner_t *t, const tuner_bounds_t *bounds, int limit, int concurrency, double now) {
+    *t = (tuner_t){.bounds = *bounds, .slow_start = 1};
+    tuner_bounds_t *b = &t->bounds;
+    if (b->min_limit < 1) b->min_limit = 1;
+    if (b->max_limit < b->min_limit) b->max_limit = b->min_limit;
+    if (b->min_concurrency < 1) b->min_concurrency = 1;
+    if (b->max_concurrency < b->min_concurrency) b->max_concurrency = b->min_concurrency;
+    if (b->target_sec <= 0) b->target_sec = 2.0;
+    if (b->max_page_bytes <= 0) b->max_page_bytes = 8L << 20;
+    t->limit = t->start_limit = t->peak_limit = clamp(limit, b->min_limit, b->max_limit);
+    t->concurrency = clamp(concurrency, b->min_concurrency, b->max_concurrency);
+    t->start_concurrency = t->peak_concurrency = t->best_concurrency = t->concurrency;
+    new_round(t, now);
+}
+
+void tuner_requested(tuner_t *t) {
+    t->pages++;
+    t->page_rows += t->limit;
+}
+
+// Larger pages, as long as the slowest page of the round left room and the bytes allow it.
+static void grow_limit(tuner_t *t) {
+    const tuner_bounds_t *b = &t->bounds;
+    if (t->round_slowest >= b->target_sec / 2) return;
+    long long step = b->max_limit / 16 > b->min_limit ? b->max_limit / 16 : b->min_limit;
+    long long limit = t->slow_start ? (long long)t->limit * 2 : t->limit + step;
+    if (t->bytes_per_row > 0 && limit > b->max_page_bytes / t->bytes_per_row) {
+        limit = (long long)(b->max_page_bytes / t->bytes_per_row);
+    }
+    if (limit > b->max_limit) limit = b->max_limit;
+    if (limit > t->limit) t->limit = (int)limit;
+}
+
+static void end_round(tuner_t *t, double now) {
+    double elapsed = now - t->round_started;
+    double rate = elapsed > 0 ? t->round_rows / elapsed : 0;
+    // One change per round, so the next round's rate tells whether it helped. Pages grow first:
+    // they save round trips without loading the server with more requests.
+    int limit = t->limit;
+    grow_limit(t);
+    if (t->limit != limit) {
+        t->best_rate = 0; // rates at the old page size do not compare
+        t->best_concurrency = t->concurrency;
+    } else if (t->best_rate == 0 || rate > t->best_rate * TUNER_GAIN) {
+        t->best_rate = rate;
+        t->best_concurrency = t->concurrency;
+        int next = t->slow_start ? t->concurrency * 2 : t->concurrency + 1;
+        t->concurrency = clamp(next, t->bounds.min_concurrency, t->bounds.max_concurrency);
+    } else if (t->concurrency > t->best_concurrency) {
+        // The extra requests did not get more rows through: the server is the limit.
+        t->concurrency = t->best_concurrency;
+        t->slow_start = 0;
+    } else {
+        t->best_rate *= TUNER_DECAY;
+    }
+    note_peaks(t);
+    new_round(t, now);
+}
+
+void tuner_page_ok(tuner_t *t, int rows, long long bytes, double seconds, double now) {
+    if (rows > 0) {
+        double per_row = (double)bytes / rows;
+        t->bytes_per_row = t->bytes_per_row > 0 ? 0.8 * t->bytes_per_row + 0.2 * per_row : per_row;
+    }
+    if (t->cooldown > 0) {
+        t->cooldown--;
+        return;
+    }
+    if (seconds > t->bounds.target_sec && t->limit > t->bounds.min_limit) {
+        t->limit = clamp(t->limit / 2, t->bounds.min_limit, t->bounds.max_limit);
+        t->slow_start = 0;
+        t->cooldown = t->concurrency;
+        new_round(t, now);
+        return;
+    }
+    t->round_pages++;
+    t->round_rows += rows;
+    if (seconds > t->round_slowest) t->round_slowest = seconds;
+    if (t->round_pages >= (t->concurrency > 2 ? t->concurrency : 2)) end_round(t, now);
+}
+
+void tuner_page_failed(tuner_t *t, int timed_out, double now) {
+    if (t->cooldown > 0) {
+        t->cooldown--;
+        return;
+    }
+    t->backoffs++;
+    t->slow_start = 0;
+    // Everything still in flight was requested with the old settings.
+    t->cooldown = t->concurrency;
+    t->concurrency = clamp(t->concurrency / 2, t->bounds.min_concurrency, t->bounds.max_concurrency);
+    if (timed_out) t->limit = clamp(t->limit / 2, t->bounds.min_limit, t->bounds.max_limit);
+    t->best_rate = 0;
+    t->best_concurrency = t->concurrency;
+    new_round(t, now);
+}
@@ -0,0 +1,54 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stddef.h>
+
+// Picks the page size and the number of requests in flight while a sync runs (AIMD). Settings
+// change at most once per round (as many pages as are in flight). Pages grow as long as one still
+// arrives well within target_sec and max_page_bytes, and are halved as soon as one takes longer
+// or a request times out. Once they stop growing, concurrency is raised by one after every round
+// that got more rows per second than the best round so far, and taken back when the extra request
+// did not pay off; throttling, server errors and timeouts halve it. Both double per round until
+// the first setback (slow start).
+typedef struct {
+    int min_limit;
+    int max_limit;
+    int min_concurrency;
+    int max_concurrency;
+    double target_sec;   // a page should take at most this long
+    long max_page_bytes; // and be at most this large
+} tuner_bounds_t;
+
+typedef struct {
+    tuner_bounds_t bounds;
+    int limit;
+    int concurrency;
+    int slow_start;
+    int cooldown;          // completions to ignore after a decrease: they were requested before it
+    double round_started;
+    int round_pages;
+    long long round_rows;
+    double round_slowest;  // longest page of the round, in seconds
+    double best_rate;      // rows/s of the best round at the current or a lower concurrency
+    int best_concurrency;
+    double bytes_per_row;  // running average
+    // For the summary.
+    int start_limit;
+    int start_concurrency;
+    int peak_limit;
+    int peak_concurrency;
+    long long pages;
+    long long page_rows; // sum of the limits pages were requested with
+    int backoffs;
+} tuner_t;
+
+// Clamps the bounds to sane values and starts at limit/concurrency (clamped into them).
+void tuner_init(tuner_t *t, const tuner_bounds_t *bounds, int limit, int concurrency, double now);
+// A page was requested with the current settings; feeds the average page size of the summary.
+void tuner_requested(tuner_t *t);
+// A page of rows rows and bytes bytes arrived after seconds.
+void tuner_page_ok(tuner_t *t, int rows, long long bytes, double seconds, double now);
+// A request failed in a way that a retry may fix: throttled, a server error or a timeout.
+void tuner_page_failed(tuner_t *t, int timed_out, double now);
+
+#endif // TUNER_H
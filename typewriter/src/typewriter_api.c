@@ -1,4 +1,5 @@
 #include "typewriter_api.h"
+#include "json_stream.h"
 #include <cjson/cJSON.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +23,10 @@ static int parse_session(cJSON *item, session_t *out) {
     out->word_count = wc->valueint;
     out->char_count = cc->valueint;
     out->letter_count = lc->valueint;
+    cJSON *doc = cJSON_GetObjectItem(item, "document_id");
+    cJSON *parent = cJSON_GetObjectItem(item, "parent_id");
+    out->document_id = cJSON_IsNumber(doc) ? doc->valueint : 0;
+    out->parent_id = cJSON_IsNumber(parent) ? parent->valueint : 0;
     return 0;
 }
 
@@ -40,45 +45,293 @@ void sessions_free(session_t *arr, size_t len) {
     free(arr);
 }
 
-static int parse_response_sessions(const char *json, session_t **out_sessions, size_t *out_len, pagination_t *out_pg) {
-    cJSON *root = cJSON_Parse(json);
-    if (!root) return -1;
-    int rc = -1;
-    cJSON *success = cJSON_GetObjectItem(root, "success");
-    if (!cJSON_IsBool(success) || !cJSON_IsTrue(success)) goto end;
-    cJSON *data = cJSON_GetObjectItem(root, "data");
-    cJSON *pagination = cJSON_GetObjectItem(root, "pagination");
-    if (!cJSON_IsArray(data) || !cJSON_IsObject(pagination)) goto end;
-
-    size_t len = cJSON_GetArraySize(data);
-    session_t *arr = calloc(len, sizeof(session_t));
-    if (!arr) goto end;
+void session_batch_init(session_batch_t *b) {
+    memset(b, 0, sizeof(*b));
+}
 
-    for (size_t i = 0; i < len; i++) {
-        cJSON *item = cJSON_GetArrayItem(data, (int)i);
-        if (parse_session(item, &arr[i]) != 0) {
-            sessions_free(arr, len);
-            goto end;
+// Moves the string block and re-points every session into the new copy.
+static int batch_grow_strings(session_batch_t *b, size_t need) {
+    size_t cap = b->strings_cap ? b->strings_cap : 64 * 1024;
+    while (cap < need) cap *= 2;
+    char *n = malloc(cap);
+    if (!n) return -1;
+    if (b->strings) {
+        memcpy(n, b->strings, b->strings_len);
+        for (size_t i = 0; i < b->len; i++) {
+            b->items[i].text = n + (b->items[i].text - b->strings);
+            b->items[i].created_at = n + (b->items[i].created_at - b->strings);
         }
+        free(b->strings);
     }
+    b->strings = n;
+    b->strings_cap = cap;
+    return 0;
+}
 
-    if (out_pg) {
-        cJSON *limit = cJSON_GetObjectItem(pagination, "limit");
-        cJSON *offset = cJSON_GetObjectItem(pagination, "offset");
-        cJSON *total = cJSON_GetObjectItem(pagination, "total");
-        out_pg->limit = cJSON_IsNumber(limit) ? limit->valueint : 0;
-        out_pg->offset = cJSON_IsNumber(offset) ? offset->valueint : 0;
-        out_pg->total = cJSON_IsNumber(total) ? total->valueint : 0;
+// Appends a copy of s; its strings go into the batch's contiguous string block.
+int session_batch_push(session_batch_t *b, const session_t *s) {
+    if (b->len == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 64;
+        session_t *items = realloc(b->items, cap * sizeof(session_t));
+        if (!items) return -1;
+        b->items = items;
+        b->cap = cap;
     }
+    size_t text_len = strlen(s->text) + 1;
+    size_t created_len = strlen(s->created_at) + 1;
+    if (b->strings_len + text_len + created_len > b->strings_cap &&
+        batch_grow_strings(b, b->strings_len + text_len + created_len) != 0)
+        return -1;
+    session_t *out = &b->items[b->len++];
+    *out = *s;
+    out->text = memcpy(b->strings + b->strings_len, s->text, text_len);
+    b->strings_len += text_len;
+    out->created_at = memcpy(b->strings + b->strings_len, s->created_at, created_len);
+    b->strings_len += created_len;
+    return 0;
+}
 
-    *out_sessions = arr;
-    *out_len = len;
-    rc = 0;
-end:
-    cJSON_Delete(root);
+void session_batch_clear(session_batch_t *b) {
+    b->len = 0;
+    b->strings_len = 0;
+}
+
+void session_batch_free(session_batch_t *b) {
+    if (!b) return;
+    free(b->items);
+    free(b->strings);
+    memset(b, 0, sizeof(*b));
+}
+
+enum {
+    F_ID = 1 << 0,
+    F_TEXT = 1 << 1,
+    F_CREATED_AT = 1 << 2,
+    F_WORD_COUNT = 1 << 3,
+    F_CHAR_COUNT = 1 << 4,
+    F_LETTER_COUNT = 1 << 5,
+    F_ALL = (1 << 6) - 1
+};
+
+// Maps lexer events of a /api/v1/sessions response onto session_t values:
+// {"success": true, "data": [{...session...}], "pagination": {...}}
+struct api_sessions_parser {
+    json_stream_t js;
+    session_cb cb;
+    void *userdata;
+    char top_key[16];
+    char key[16];
+    int success;
+    int in_data;
+    int in_session;
+    int in_pagination;
+    int fields;
+    session_t cur;
+    pagination_t pg;
+    size_t bytes;
+    metrics_t *metrics;
+    // Strings of the session being parsed; reused for every session of the response.
+    char *scratch;
+    size_t scratch_len;
+    size_t scratch_cap;
+    size_t text_off;
+    size_t created_at_off;
+};
+
+static int scratch_put(api_sessions_parser_t *p, const char *str, size_t len, size_t *off) {
+    if (p->scratch_len + len + 1 > p->scratch_cap) {
+        size_t cap = p->scratch_cap ? p->scratch_cap : 4096;
+        while (p->scratch_len + len + 1 > cap) cap *= 2;
+        char *n = realloc(p->scratch, cap);
+        if (!n) return -1;
+        p->scratch = n;
+        p->scratch_cap = cap;
+    }
+    *off = p->scratch_len;
+    memcpy(p->scratch + p->scratch_len, str, len + 1);
+    p->scratch_len += len + 1;
+    return 0;
+}
+
+static void copy_key(char *dst, size_t len, const char *src) {
+    snprintf(dst, len, "%s", src);
+}
+
+static int on_json_event(void *userdata, json_event_t ev, const char *str, size_t len, int depth) {
+    api_sessions_parser_t *p = userdata;
+    switch (ev) {
+    case JSON_KEY:
+        if (depth == 1) copy_key(p->top_key, sizeof(p->top_key), str);
+        else if ((depth == 3 && p->in_session) || (depth == 2 && p->in_pagination))
+            copy_key(p->key, sizeof(p->key), str);
+        return 0;
+    case JSON_ARRAY_START:
+        if (depth == 2 && strcmp(p->top_key, "data") == 0) p->in_data = 1;
+        return 0;
+    case JSON_ARRAY_END:
+        if (depth == 2) p->in_data = 0;
+        return 0;
+    case JSON_OBJECT_START:
+        if (depth == 3 && p->in_data) {
+            memset(&p->cur, 0, sizeof(p->cur));
+            p->scratch_len = 0;
+            p->in_session = 1;
+            p->fields = 0;
+        } else if (depth == 2 && strcmp(p->top_key, "pagination") == 0) {
+            p->in_pagination = 1;
+        }
+        p->key[0] = '\0';
+        return 0;
+    case JSON_OBJECT_END:
+        if (depth == 3 && p->in_session) {
+            p->in_session = 0;
+            if (p->fields != F_ALL) return -1;
+            p->cur.text = p->scratch + p->text_off;
+            p->cur.created_at = p->scratch + p->created_at_off;
+            int rc = p->cb(p->userdata, &p->cur);
+            memset(&p->cur, 0, sizeof(p->cur));
+            p->scratch_len = 0;
+            if (rc != 0) return -1;
+        } else if (depth == 2) {
+            p->in_pagination = 0;
+        }
+        return 0;
+    case JSON_TRUE:
+    case JSON_FALSE:
+        if (depth == 1 && strcmp(p->top_key, "success") == 0) p->success = ev == JSON_TRUE;
+        return 0;
+    case JSON_STRING:
+        if (depth != 3 || !p->in_session) return 0;
+        if (strcmp(p->key, "text") == 0 && !(p->fields & F_TEXT)) {
+            if (scratch_put(p, str, len, &p->text_off) != 0) return -1;
+            p->fields |= F_TEXT;
+        } else if (strcmp(p->key, "created_at") == 0 && !(p->fields & F_CREATED_AT)) {
+            if (scratch_put(p, str, len, &p->created_at_off) != 0) return -1;
+            p->fields |= F_CREATED_AT;
+        }
+        return 0;
+    case JSON_NUMBER: {
+        int v = atoi(str);
+        if (depth == 2 && p->in_pagination) {
+            if (strcmp(p->key, "limit") == 0) p->pg.limit = v;
+            else if (strcmp(p->key, "offset") == 0) p->pg.offset = v;
+            else if (strcmp(p->key, "total") == 0) p->pg.total = v;
+        } else if (depth == 3 && p->in_session) {
+            if (strcmp(p->key, "id") == 0) p->cur.id = v, p->fields |= F_ID;
+            else if (strcmp(p->key, "word_count") == 0) p->cur.word_count = v, p->fields |= F_WORD_COUNT;
+            else if (strcmp(p->key, "char_count") == 0) p->cur.char_count = v, p->fields |= F_CHAR_COUNT;
+            else if (strcmp(p->key, "letter_count") == 0) p->cur.letter_count = v, p->fields |= F_LETTER_COUNT;
+            else if (strcmp(p->key, "document_id") == 0) p->cur.document_id = v;
+            else if (strcmp(p->key, "parent_id") == 0) p->cur.parent_id = v;
+        }
+        return 0;
+    }
+    case JSON_NULL:
+        return 0;
+    }
+    return 0;
+}
+
+api_sessions_parser_t *api_sessions_parser_new(session_cb cb, void *userdata) {
+    if (!cb) return NULL;
+    api_sessions_parser_t *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->cb = cb;
+    p->userdata = userdata;
+    json_stream_init(&p->js, on_json_event, p);
+    return p;
+}
+
+void api_sessions_parser_reset(api_sessions_parser_t *p) {
+    if (!p) return;
+    json_stream_reset(&p->js);
+    memset(&p->cur, 0, sizeof(p->cur));
+    p->scratch_len = 0;
+    p->top_key[0] = '\0';
+    p->key[0] = '\0';
+    p->success = p->in_data = p->in_session = p->in_pagination = p->fields = 0;
+    p->bytes = 0;
+    memset(&p->pg, 0, sizeof(p->pg));
+}
+
+// Parse time includes the session callback, e.g. sync handing full batches to its writer.
+int api_sessions_parser_feed(api_sessions_parser_t *p, const char *data, size_t len) {
+    long long started = metrics_now_ns();
+    p->bytes += len;
+    int rc = json_stream_feed(&p->js, data, len);
+    metrics_add(p->metrics, METRIC_PARSE_BYTES, len);
+    metrics_time_since(p->metrics, METRIC_T_PARSE, started);
     return rc;
 }
 
+void api_sessions_parser_set_metrics(api_sessions_parser_t *p, metrics_t *m) {
+    if (p) p->metrics = m;
+}
+
+size_t api_sessions_parser_bytes(const api_sessions_parser_t *p) {
+    return p ? p->bytes : 0;
+}
+
+int api_sessions_parser_finish(api_sessions_parser_t *p, pagination_t *out_pagination) {
+    if (json_stream_finish(&p->js) != 0 || !p->success) return -1;
+    if (out_pagination) *out_pagination = p->pg;
+    return 0;
+}
+
+void api_sessions_parser_free(api_sessions_parser_t *p) {
+    if (!p) return;
+    json_stream_free(&p->js);
+    free(p->scratch);
+    free(p);
+}
+
+static int parser_write(void *userdata, const char *data, size_t len) {
+    return api_sessions_parser_feed(userdata, data, len);
+}
+
+typedef struct {
+    session_t *arr;
+    size_t len;
+    size_t cap;
+} session_vec_t;
+
+static int collect_session(void *userdata, const session_t *s) {
+    session_vec_t *v = userdata;
+    if (v->len == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 64;
+        session_t *arr = realloc(v->arr, cap * sizeof(session_t));
+        if (!arr) return -1;
+        v->arr = arr;
+        v->cap = cap;
+    }
+    session_t *out = &v->arr[v->len];
+    *out = *s;
+    out->text = strdup(s->text);
+    out->created_at = strdup(s->created_at);
+    if (!out->text || !out->created_at) {
+        session_free(out);
+        return -1;
+    }
+    v->len++;
+    return 0;
+}
+
+int api_parse_sessions_page(const char *json, session_t **out_sessions, size_t *out_len, pagination_t *out_pg) {
+    session_vec_t v = {0};
+    api_sessions_parser_t *p = api_sessions_parser_new(collect_session, &v);
+    if (!p) return -1;
+    int rc = -1;
+    if (api_sessions_parser_feed(p, json, strlen(json)) == 0 && api_sessions_parser_finish(p, out_pg) == 0) rc = 0;
+    api_sessions_parser_free(p);
+    if (rc != 0) {
+        sessions_free(v.arr, v.len);
+        return -1;
+    }
+    *out_sessions = v.arr;
+    *out_len = v.len;
+    return 0;
+}
+
 static int parse_response_session(const char *json, session_t *out_session) {
     cJSON *root = cJSON_Parse(json);
     if (!root) return -1;
@@ -92,20 +345,82 @@ end:
     return rc;
 }
 
-int api_list_sessions_page(http_client_t *client, int limit, int offset, session_t **out_sessions, size_t *out_len, pagination_t *out_pagination) {
+static int stream_page_once(http_client_t *client, const char *query, api_sessions_parser_t *p,
+                            pagination_t *out_pagination, long *status) {
+    api_sessions_parser_reset(p);
+    *status = 0;
+    if (http_get_stream(client, "/api/v1/sessions", query, parser_write, p, status) != 0 || *status != 200) return -1;
+    return api_sessions_parser_finish(p, out_pagination);
+}
+
+// After failed attempt number attempt: waits and returns 1 if another one is worthwhile. A 200
+// that did not parse was cut short and is retried like a transport error.
+static int page_retry(http_client_t *client, int attempt, long status) {
+    if (attempt >= client->retries || http_budget_exhausted(client)) return 0;
+    if (status != 200 && !http_should_retry(status == 0 ? -1 : 0, status)) return 0;
+    metrics_add(client->metrics, METRIC_HTTP_RETRIES, 1);
+    http_backoff_sleep(client, attempt, client->last_timing.retry_after_ms);
+    return 1;
+}
+
+// Sessions are handed to cb while the response is still arriving; the body is never buffered.
+// A failed attempt may already have delivered some sessions, so cb must tolerate repeats.
+int api_stream_sessions_page(http_client_t *client, int limit, int offset, session_cb cb, void *userdata,
+                             pagination_t *out_pagination) {
     char query[128];
     snprintf(query, sizeof(query), "limit=%d&offset=%d", limit, offset);
+    api_sessions_parser_t *p = api_sessions_parser_new(cb, userdata);
+    if (!p) return -1;
+    api_sessions_parser_set_metrics(p, client->metrics);
+    int rc;
+    long status;
+    for (int attempt = 1;; attempt++) {
+        rc = stream_page_once(client, query, p, out_pagination, &status);
+        if (rc == 0 || !page_retry(client, attempt, status)) break;
+    }
+    api_sessions_parser_free(p);
+    return rc;
+}
 
-    http_buffer_t buf = {0};
-    long status = 0;
-    int rc = http_get(client, "/api/v1/sessions", query, &buf, &status);
-    if (rc != 0 || status != 200) {
-        http_buffer_free(&buf);
+int api_list_sessions_page(http_client_t *client, int limit, int offset, session_t **out_sessions, size_t *out_len, pagination_t *out_pagination) {
+    char query[128];
+    snprintf(query, sizeof(query), "limit=%d&offset=%d", limit, offset);
+    session_vec_t v = {0};
+    api_sessions_parser_t *p = api_sessions_parser_new(collect_session, &v);
+    if (!p) return -1;
+    api_sessions_parser_set_metrics(p, client->metrics);
+    int rc;
+    long status;
+    for (int attempt = 1;; attempt++) {
+        sessions_free(v.arr, v.len);
+        memset(&v, 0, sizeof(v));
+        rc = stream_page_once(client, query, p, out_pagination, &status);
+        if (rc == 0 || !page_retry(client, attempt, status)) break;
+    }
+    api_sessions_parser_free(p);
+    if (rc != 0) {
+        sessions_free(v.arr, v.len);
         return -1;
     }
-    rc = parse_response_sessions(buf.data, out_sessions, out_len, out_pagination);
-    http_buffer_free(&buf);
-    return rc;
+    *out_sessions = v.arr;
+    *out_len = v.len;
+    return 0;
+}
+
+int api_queue_sessions_page(http_multi_t *multi, int limit, int offset, api_sessions_parser_t *parser,
+                            void *userdata) {
+    char query[128];
+    snprintf(query, sizeof(query), "limit=%d&offset=%d", limit, offset);
+    api_sessions_parser_reset(parser);
+    return http_multi_add_stream(multi, "/api/v1/sessions", query, parser_write, parser, userdata);
+}
+
+int api_queue_versions_page(http_multi_t *multi, int document_id, int limit, int offset, void *userdata) {
+    char path[64];
+    char query[128];
+    snprintf(path, sizeof(path), "/api/v1/documents/%d/versions", document_id);
+    snprintf(query, sizeof(query), "limit=%d&offset=%d", limit, offset);
+    return http_multi_add(multi, path, query, userdata);
 }
 
 int api_get_session(http_client_t *client, int id, session_t *out_session) {
@@ -116,7 +431,7 @@ int api_get_session(http_client_t *client, int id, session_t *out_session) {
     int rc = http_get(client, path, NULL, &buf, &status);
     if (rc != 0 || status != 200) {
         http_buffer_free(&buf);
-        return -1;
+        return rc == 0 && status == 404 ? 1 : -1;
     }
     rc = parse_response_session(buf.data, out_session);
     http_buffer_free(&buf);
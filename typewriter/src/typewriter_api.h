@@ -11,19 +11,61 @@ typedef struct {
     int word_count;
     int char_count;
     int letter_count;
+    int document_id; // the document this session is a version of, 0 for none
+    int parent_id;   // the version it was edited from, 0 for a document's first
 } session_t;
 
+// Sessions whose strings all live in one contiguous block owned by the batch:
+// filling a page costs a handful of allocations, releasing it two frees.
+typedef struct {
+    session_t *items;
+    size_t len;
+    size_t cap;
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+} session_batch_t;
+
 typedef struct {
     int limit;
     int offset;
     int total;
 } pagination_t;
 
+// Receives each parsed session. Its strings are borrowed from the parser and only valid
+// during the call; copy them (e.g. with session_batch_push) to keep them. Returning
+// non-zero aborts parsing.
+typedef int (*session_cb)(void *userdata, const session_t *s);
+
+typedef struct api_sessions_parser api_sessions_parser_t;
+
+api_sessions_parser_t *api_sessions_parser_new(session_cb cb, void *userdata);
+void api_sessions_parser_reset(api_sessions_parser_t *p);
+int api_sessions_parser_feed(api_sessions_parser_t *p, const char *data, size_t len);
+int api_sessions_parser_finish(api_sessions_parser_t *p, pagination_t *out_pagination);
+size_t api_sessions_parser_bytes(const api_sessions_parser_t *p);
+void api_sessions_parser_set_metrics(api_sessions_parser_t *p, metrics_t *m);
+void api_sessions_parser_free(api_sessions_parser_t *p);
+
+int api_stream_sessions_page(http_client_t *client, int limit, int offset, session_cb cb, void *userdata,
+                             pagination_t *out_pagination);
 int api_list_sessions_page(http_client_t *client, int limit, int offset, session_t **out_sessions, size_t *out_len, pagination_t *out_pagination);
+int api_queue_sessions_page(http_multi_t *multi, int limit, int offset, api_sessions_parser_t *parser,
+                            void *userdata);
+int api_parse_sessions_page(const char *json, session_t **out_sessions, size_t *out_len, pagination_t *out_pagination);
+// Returns 1 if the server has no session with that id.
 int api_get_session(http_client_t *client, int id, session_t *out_session);
 int api_get_last_session(http_client_t *client, session_t *out_session);
+// Queues one page of a document's versions (GET /api/v1/documents/<id>/versions, oldest first,
+// the same response shape as a sessions page) on multi; parse the body with api_parse_sessions_page.
+int api_queue_versions_page(http_multi_t *multi, int document_id, int limit, int offset, void *userdata);
 
 void session_free(session_t *s);
 void sessions_free(session_t *arr, size_t len);
 
+void session_batch_init(session_batch_t *b);
+int session_batch_push(session_batch_t *b, const session_t *s);
+void session_batch_clear(session_batch_t *b);
+void session_batch_free(session_batch_t *b);
+
 #endif // TYPEWRITER_API_H
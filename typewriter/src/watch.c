@@ -0,0 +1,266 @@
+#include "watch.h"
+#include "sse.h"
+#include "sync.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Missing ids up to this many are fetched one by one; a larger gap (e.g. after a long
+// downtime) is closed with an incremental sync.
+#define WATCH_MAX_GAP 100
+
+static volatile sig_atomic_t watch_stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+// The reader thread turns every event into a pending catch-up; the main thread runs them.
+typedef struct {
+    http_client_t events; // own client, the reader must not share timing and jitter state
+    const char *path;
+    sse_stream_t sse;
+    long long received;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    int pending;        // catch-ups asked for since the last one ran
+    double first_event; // when the oldest event among them arrived, 0 if none was an event
+} watch_ctx_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(long ms) {
+    while (ms > 0 && !watch_stop) {
+        long slice = ms < 100 ? ms : 100;
+        struct timespec ts = {0, slice * 1000000L};
+        nanosleep(&ts, NULL);
+        ms -= slice;
+    }
+}
+
+static void notify(watch_ctx_t *w, int event) {
+    pthread_mutex_lock(&w->mu);
+    w->pending++;
+    if (event && w->first_event == 0) w->first_event = now_sec();
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mu);
+}
+
+// The server's events carry no session ids (`update` holds the text being typed), so each
+// one only says that something may have changed.
+static int on_event(void *userdata, const char *event, const char *data, size_t len) {
+    (void)event;
+    (void)data;
+    (void)len;
+    watch_ctx_t *w = userdata;
+    w->received++;
+    notify(w, 1);
+    return 0;
+}
+
+static int on_stream_data(void *userdata, const char *data, size_t len) {
+    watch_ctx_t *w = userdata;
+    return sse_stream_feed(&w->sse, data, len);
+}
+
+// Keeps the event stream open. Every (re)connect also asks for a catch-up, for whatever
+// happened while no stream was open.
+static void *reader_main(void *arg) {
+    watch_ctx_t *w = arg;
+    int attempt = 0;
+    while (!watch_stop) {
+        sse_stream_reset(&w->sse);
+        long long received = w->received;
+        double started = now_sec();
+        notify(w, 0);
+        long status = 0;
+        http_get_events(&w->events, w->path, on_stream_data, w, &watch_stop, &status);
+        if (watch_stop) break;
+        // A stream that delivered events or stayed up a while was healthy: start over.
+        if (w->received > received || now_sec() - started > 30) attempt = 0;
+        attempt++;
+        long floor_ms = w->sse.retry_ms > w->events.last_timing.retry_after_ms ? w->sse.retry_ms
+                                                                                : w->events.last_timing.retry_after_ms;
+        long wait_ms = http_backoff_ms(&w->events, attempt, floor_ms);
+        fprintf(stderr, "Event-Stream getrennt (HTTP %ld), neuer Versuch in %ld ms\n", status, wait_ms);
+        sleep_ms(wait_ms);
+    }
+    return NULL;
+}
+
+// Blocks until events arrived, then gives further events commit_ms to join the same catch-up.
+// Without events it returns after interval_sec. *first is when the oldest event arrived, or 0.
+static void wait_events(watch_ctx_t *w, int commit_ms, int interval_sec, double *first) {
+    double deadline = now_sec() + interval_sec;
+    pthread_mutex_lock(&w->mu);
+    while (!w->pending && !watch_stop && now_sec() < deadline) {
+        // Short waits, so a signal is noticed without a wake-up from the reader.
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 200000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&w->cond, &w->mu, &ts);
+    }
+    int got = w->pending > 0;
+    pthread_mutex_unlock(&w->mu);
+    if (got && commit_ms > 0) {
+        struct timespec ts = {commit_ms / 1000, (commit_ms % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+    pthread_mutex_lock(&w->mu);
+    *first = w->first_event;
+    w->pending = 0;
+    w->first_event = 0;
+    pthread_mutex_unlock(&w->mu);
+}
+
+// Collects the sessions between max_id and last (inclusive) into rows. *covered is the
+// highest id up to which nothing is missing any more.
+static int fetch_gap(http_client_t *client, int max_id, const session_t *last, session_batch_t *rows, int *covered) {
+    *covered = max_id;
+    for (int id = max_id + 1; id < last->id; id++) {
+        session_t s = {0};
+        int rc = api_get_session(client, id, &s);
+        if (rc < 0) return -1;
+        if (rc == 0) {
+            rc = session_batch_push(rows, &s);
+            session_free(&s);
+            if (rc != 0) return -1;
+        }
+        *covered = id;
+    }
+    if (session_batch_push(rows, last) != 0) return -1;
+    if (last->id > *covered) *covered = last->id;
+    return 0;
+}
+
+// Group commit: everything one catch-up found goes into a single transaction.
+static int write_rows(session_store_t *store, const session_batch_t *rows, size_t *unchanged) {
+    if (sqlite3_exec(store->db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    if (session_store_bulk_insert(store, rows->items, rows->len, unchanged) != 0) {
+        sqlite3_exec(store->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return sqlite3_exec(store->db, "COMMIT;", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+// Brings the store up to the server's newest session; sets *changed once rows were written.
+static int catch_up(http_client_t *client, session_store_t *store, int *max_id, session_batch_t *rows,
+                    double first, int *changed) {
+    session_t last = {0};
+    if (api_get_last_session(client, &last) != 0) {
+        fprintf(stderr, "Letzte Session nicht abrufbar\n");
+        return -1;
+    }
+    int rc = 0;
+    if (last.id - *max_id - 1 > WATCH_MAX_GAP) {
+        printf("%d Sessions fehlen, hole sie per inkrementellem Sync...\n", last.id - *max_id);
+        sync_config_t cfg = {.page_limit = 200, .concurrency = 4, .incremental = 1};
+        sync_checkpoint_t cp = {0};
+        rc = perform_sync(client, store, &cfg) == 0 && session_store_load_checkpoint(store, &cp) == 0 ? 0 : -1;
+        if (rc == 0) *max_id = cp.max_id;
+        session_free(&last);
+        return rc;
+    }
+    session_batch_clear(rows);
+    int covered = *max_id;
+    if (fetch_gap(client, *max_id, &last, rows, &covered) != 0) {
+        fprintf(stderr, "Session #%d nicht abrufbar\n", covered + 1);
+        rc = -1;
+    }
+    size_t unchanged = 0;
+    long long sealed = store->sealed_skipped;
+    if (rows->len > 0 && write_rows(store, rows, &unchanged) != 0) {
+        fprintf(stderr, "DB Fehler: %s\n", sqlite3_errmsg(store->db));
+        rc = -1;
+    } else {
+        if (covered > *max_id) *max_id = covered;
+        // Rows for a sealed year are neither written nor unchanged.
+        size_t skipped = (size_t)(store->sealed_skipped - sealed);
+        if (skipped > 0) printf("%zu Sessions aus versiegelten Jahren übersprungen\n", skipped);
+        if (rows->len > unchanged + skipped) {
+            printf("%zu Sessions übernommen (neueste #%d)", rows->len - unchanged - skipped, last.id);
+            if (first > 0) printf(", %.0f ms nach dem Event", (now_sec() - first) * 1000);
+            printf("\n");
+            *changed = 1;
+        }
+    }
+    session_free(&last);
+    return rc;
+}
+
+int watch_run(http_client_t *client, session_store_t *store, const watch_config_t *cfg) {
+    sync_checkpoint_t cp = {0};
+    if (session_store_load_checkpoint(store, &cp) != 0) {
+        fprintf(stderr, "Kein Checkpoint gefunden, bitte zuerst sync ausführen.\n");
+        return -1;
+    }
+    int commit_ms = cfg && cfg->commit_ms >= 0 ? cfg->commit_ms : 5;
+    int interval_sec = cfg && cfg->interval_sec > 0 ? cfg->interval_sec : 30;
+
+    watch_ctx_t w = {0};
+    if (http_client_init(&w.events, client->base_url, client->api_key) != 0) return -1;
+    w.path = cfg && cfg->events_path ? cfg->events_path : "/api/sse";
+    sse_stream_init(&w.sse, on_event, &w);
+    pthread_mutex_init(&w.mu, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    watch_stop = 0;
+
+    printf("Beobachte %s%s ab #%d (Abgleich spätestens alle %d s, Ctrl-C beendet)\n", client->base_url, w.path,
+           cp.max_id, interval_sec);
+    fflush(stdout);
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, reader_main, &w) != 0) {
+        fprintf(stderr, "Event-Thread konnte nicht gestartet werden\n");
+        sse_stream_free(&w.sse);
+        pthread_cond_destroy(&w.cond);
+        pthread_mutex_destroy(&w.mu);
+        http_client_cleanup(&w.events);
+        return -1;
+    }
+
+    int max_id = cp.max_id;
+    int changed = 0;
+    session_batch_t rows;
+    session_batch_init(&rows);
+    while (!watch_stop) {
+        double first;
+        wait_events(&w, commit_ms, interval_sec, &first);
+        if (watch_stop) break;
+        catch_up(client, store, &max_id, &rows, first, &changed);
+        fflush(stdout);
+    }
+    watch_stop = 1;
+    pthread_join(reader, NULL);
+    session_batch_free(&rows);
+
+    // Only newer sessions were added to a complete store, so it still is one.
+    int rc = 0;
+    if (changed && session_store_save_checkpoint(store) != 0) {
+        fprintf(stderr, "Checkpoint konnte nicht gespeichert werden: %s\n", sqlite3_errmsg(store->db));
+        rc = -1;
+    }
+    printf("Watch beendet: %lld Events, letzte Session #%d\n", w.received, max_id);
+    sse_stream_free(&w.sse);
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.mu);
+    http_client_cleanup(&w.events);
+    return rc;
+}
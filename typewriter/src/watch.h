@@ -0,0 +1,16 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "session_store.h"
+#include "typewriter_api.h"
+
+typedef struct {
+    const char *events_path; // SSE endpoint, "/api/sse" by default
+    int commit_ms;           // how long events are gathered into one catch-up and transaction
+    int interval_sec;        // catch up at least this often, even without events
+} watch_config_t;
+
+// Keeps store current until SIGINT/SIGTERM. Needs a checkpoint from a previous sync.
+int watch_run(http_client_t *client, session_store_t *store, const watch_config_t *cfg);
+
+#endif // WATCH_H